@@ -0,0 +1,65 @@
+#include "utils/batch_runner.h"
+#include "utils/image_io.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renders every job of a job file (see batch_runner.h) on one pool of
+// workers and writes each frame as a ppm as soon as it is done. --sequential
+// renders the jobs one at a time instead, for comparison.
+//
+// usage: batch_render [--threads n] [--sequential] jobs.txt
+int main(int argc, char **argv)
+{
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool sequential = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else if (arg == "--sequential")
+            sequential = true;
+        else
+            paths.push_back(arg);
+    }
+    if (paths.size() != 1 || threads < 1)
+    {
+        std::cerr << "usage: " << argv[0] << " [--threads n] [--sequential] jobs.txt\n";
+        return 1;
+    }
+
+    std::vector<batch_job> jobs;
+    if (!read_batch_file(paths[0], jobs))
+        return 1;
+
+    int failed = 0;
+    batch_report report = run_batch(
+        jobs, threads, sequential,
+        [&](size_t k, const batch_job &job, const batch_job_report &r, const std::vector<unsigned char> &rgb)
+        {
+            std::cerr << "[" << k + 1 << "/" << jobs.size() << "] " << job.scene << " " << job.image_width << "x"
+                      << job.image_height << " " << job.samples_per_pixel << " spp: ";
+            if (!r.ok)
+                std::cerr << "cannot build scene (line " << job.line << ")\n";
+            else if (!write_ppm(job.output, job.image_width, job.image_height, rgb))
+                std::cerr << "cannot write " << job.output << "\n";
+            else
+            {
+                std::cerr << job.output << ", " << r.tiles << " tiles, built in " << r.build_ms << " ms, rendered in "
+                          << r.render_ms << " ms\n";
+                return;
+            }
+            failed++;
+        });
+
+    std::cerr << jobs.size() << " jobs in " << report.seconds << " seconds on " << threads << " threads, workers "
+              << 100 * report.utilization() << "% busy";
+    if (failed)
+        std::cerr << ", " << failed << " failed";
+    std::cerr << "\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// Job boundaries in batch rendering
+// Builds and renders each built-in scene once on a single thread, timing the
+// scene build (scene, BVH and tile plan) and every tile, then replays the
+// measured times on W simulated workers two ways:
+//   sequential  each job is built, rendered and finished before the next,
+//               so the workers idle during builds and while the slowest
+//               tiles of a job finish
+//   pooled      run_batch: the next job is built during the current one
+//               (on the loader's own core) and free workers take its tiles
+//               as soon as the current job's tiles are all handed out
+// and prints the makespans against the ideal (all tiles spread evenly) and
+// the share of worker time left idle. Then runs the real run_batch both ways
+// on all cores, best of three, and checks the frames are identical.
+//
+// usage: batch_bench [width] [spp] [depth]   (default 256 8 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/batch_runner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const char* scene_names[] = {"floor_sphere_scene", "three_spheres_scene", "three_spheres_scene2",
+                             "three_spheres_scene3", "fov_scene", "random_scene", "GHD_scene"};
+
+struct measured_job {
+    double build_seconds;
+    std::vector<double> tile_seconds; // in the planned order
+};
+
+// Measures one job like run_batch would run it with `threads` workers
+measured_job measure(const batch_job& job, int threads) {
+    measured_job m;
+    auto start = steady_clock::now();
+    hittable_list list;
+    srand(job.scene_seed);
+    build_scene(job.scene, list);
+    bvh world(list);
+    const scene_view& v = job.view;
+    camera cam(v.lookfrom, v.lookat, v.vup, v.vfov, static_cast<double>(job.image_width) / job.image_height,
+               v.aperture, v.dist_to_focus);
+    cost_map estimate = estimate_cost(cam, world, job.image_width, job.image_height, job.max_depth);
+    std::vector<tile> tiles = plan_tiles(estimate, {0, 0, job.image_width, job.image_height}, 16 * threads);
+    m.build_seconds = duration<double>(steady_clock::now() - start).count();
+
+    std::vector<color> sums;
+    for (const tile& t : tiles) {
+        auto tile_start = steady_clock::now();
+        accumulate_tile(cam, world, t, job.image_width, job.image_height, job.samples_per_pixel, job.max_depth,
+                        sums, nullptr, job.seed);
+        m.tile_seconds.push_back(duration<double>(steady_clock::now() - tile_start).count());
+    }
+    return m;
+}
+
+// Runs the tiles on the workers, each taking the next tile when free but not
+// before `ready`, and returns when the last one finishes
+double run_tiles(std::priority_queue<double, std::vector<double>, std::greater<double>>& free_at,
+                 const std::vector<double>& tiles, double ready) {
+    double last = ready;
+    for (double seconds : tiles) {
+        double finish = std::max(free_at.top(), ready) + seconds;
+        free_at.pop();
+        free_at.push(finish);
+        last = std::max(last, finish);
+    }
+    return last;
+}
+
+double simulate(const std::vector<measured_job>& jobs, int workers, bool sequential) {
+    std::priority_queue<double, std::vector<double>, std::greater<double>> free_at;
+    for (int w = 0; w < workers; w++) free_at.push(0);
+    std::vector<double> finished;
+    double loader = 0, end = 0;
+    for (size_t k = 0; k < jobs.size(); k++) {
+        // The loader waits for the job before (sequential) or the one before that
+        double may_build = 0;
+        if (sequential && k >= 1) may_build = finished[k - 1];
+        if (!sequential && k >= 2) may_build = *std::max_element(finished.begin(), finished.end() - 1);
+        loader = std::max(loader, may_build) + jobs[k].build_seconds;
+        finished.push_back(run_tiles(free_at, jobs[k].tile_seconds, loader));
+        end = std::max(end, finished.back());
+    }
+    return end;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? std::stoi(argv[1]) : 256;
+    int spp = argc > 2 ? std::stoi(argv[2]) : 8;
+    int depth = argc > 3 ? std::stoi(argv[3]) : 8;
+    const int plan_threads = 8;
+
+    std::vector<batch_job> jobs;
+    for (const char* name : scene_names) {
+        job_args args = {{"scene", name}, {"out", ""}, {"width", std::to_string(width)},
+                         {"spp", std::to_string(spp)}, {"depth", std::to_string(depth)}};
+        batch_job job;
+        std::string error;
+        parse_batch_job(args, job, error);
+        jobs.push_back(job);
+    }
+
+    printf("%d built-in scenes at %dx%d, %d spp, depth %d, tiles planned for %d workers\n\n", static_cast<int>(jobs.size()),
+           width, jobs[0].image_height, spp, depth, plan_threads);
+    printf("%-22s %10s %10s %8s\n", "scene", "build ms", "render ms", "tiles");
+    std::vector<measured_job> measured;
+    double total_tiles = 0, total_build = 0;
+    for (const batch_job& job : jobs) {
+        measured.push_back(measure(job, plan_threads));
+        const measured_job& m = measured.back();
+        double render = 0;
+        for (double s : m.tile_seconds) render += s;
+        total_tiles += render;
+        total_build += m.build_seconds;
+        printf("%-22s %10.2f %10.2f %8zu\n", job.scene.c_str(), 1e3 * m.build_seconds, 1e3 * render,
+               m.tile_seconds.size());
+        fflush(stdout);
+    }
+
+    printf("\nsimulated batch, makespan over ideal (tiles / workers) and idle worker time\n");
+    printf("%8s %16s %16s %10s\n", "workers", "sequential", "pooled", "speedup");
+    for (int workers : {2, 4, 8, 16, 32}) {
+        double ideal = total_tiles / workers;
+        double seq = simulate(measured, workers, true);
+        double pooled = simulate(measured, workers, false);
+        printf("%8d %7.3f (%4.1f%%) %7.3f (%4.1f%%) %9.2fx\n", workers, seq / ideal,
+               100 * (1 - total_tiles / (seq * workers)), pooled / ideal, 100 * (1 - total_tiles / (pooled * workers)),
+               seq / pooled);
+    }
+
+    // The real thing on this machine
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    printf("\nrun_batch on %d threads, best of 3\n", threads);
+    std::vector<std::vector<unsigned char>> frames[2];
+    for (int mode = 0; mode < 2; mode++) {
+        double best = infinity, utilization = 0;
+        for (int run = 0; run < 3; run++) {
+            frames[mode].assign(jobs.size(), {});
+            batch_report report = run_batch(jobs, threads, mode == 0,
+                                            [&](size_t k, const batch_job&, const batch_job_report&,
+                                                const std::vector<unsigned char>& rgb) { frames[mode][k] = rgb; });
+            if (report.seconds < best) {
+                best = report.seconds;
+                utilization = report.utilization();
+            }
+        }
+        printf("%-12s %8.3f s, workers %5.1f%% busy\n", mode == 0 ? "sequential" : "pooled", best, 100 * utilization);
+        fflush(stdout);
+    }
+    bool same = frames[0] == frames[1];
+    printf("frames %s\n", same ? "identical" : "DIFFER");
+    printf("(builds %.1f ms of %.1f ms single threaded work)\n", 1e3 * total_build, 1e3 * (total_build + total_tiles));
+    return same ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Measurements shared by the benches and the regression check
+
+#include "../utils/rtweekend.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// Best of runs, in seconds
+double best_of(int runs, const std::function<void()>& fn) {
+    double best = infinity;
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = fmin(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Whether two renders accumulated exactly the same n pixel sums
+bool same(const color* a, const color* b, size_t n) {
+    for (size_t p = 0; p < n; p++)
+        for (int c = 0; c < 3; c++)
+            if (a[p][c] != b[p][c]) return false;
+    return true;
+}
+
+bool same(const std::vector<color>& a, const std::vector<color>& b) {
+    return a.size() == b.size() && same(a.data(), b.data(), a.size());
+}
+
+// Root mean square error of two 8 bit images in [0,1] units
+double rmse(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double d = (a[i] - b[i]) / 255.0;
+        sum += d * d;
+    }
+    return sqrt(sum / a.size());
+}
+
+#endif
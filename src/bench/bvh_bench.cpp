@@ -0,0 +1,128 @@
+// Compares the binary BVH against the compressed 4-wide BVH
+// Reports memory per primitive and closest-hit traversal throughput on the
+// same triangles and rays, and checks that both layouts find the same hits.
+//
+// usage: bvh_bench [triangles | mesh.obj | mesh.ply] [rays]
+//   a number generates a random triangle soup of that size (default 1000000)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/triangle_mesh.h"
+#include "../utils/bvh.h"
+#include "../utils/mesh_loader.h"
+#include "../utils/wide_bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Small random triangles filling the unit cube
+void triangle_soup(size_t count, std::vector<float>& positions, std::vector<uint32_t>& indices) {
+    double size = 2.0 / cbrt(static_cast<double>(count));
+    for (size_t f = 0; f < count; f++) {
+        point3 center = vec3::random(-1, 1);
+        for (int k = 0; k < 3; k++) {
+            point3 v = center + size * vec3::random(-1, 1);
+            positions.push_back(static_cast<float>(v.x()));
+            positions.push_back(static_cast<float>(v.y()));
+            positions.push_back(static_cast<float>(v.z()));
+            indices.push_back(static_cast<uint32_t>(3 * f + k));
+        }
+    }
+}
+
+struct trace_result {
+    double seconds;
+    std::vector<int> hits; // closest triangle per ray, -1 on a miss
+};
+
+template <typename tree_type>
+trace_result trace(const triangle_mesh& mesh, const tree_type& tree, const std::vector<ray>& rays) {
+    trace_result result;
+    result.hits.resize(rays.size());
+
+    auto vertex = [&](uint32_t i) {
+        return point3(mesh.positions[3 * i], mesh.positions[3 * i + 1], mesh.positions[3 * i + 2]);
+    };
+
+    auto start = steady_clock::now();
+    for (size_t n = 0; n < rays.size(); n++) {
+        watertight_ray wr(rays[n]);
+        int hit_triangle = -1;
+        tree.traverse(rays[n], 0.0, infinity, [&](int f, double t_lo, double& closest) {
+            double t;
+            if (!wr.intersect(vertex(mesh.indices[3 * f]), vertex(mesh.indices[3 * f + 1]),
+                              vertex(mesh.indices[3 * f + 2]), t_lo, closest, t))
+                return false;
+            closest = t;
+            hit_triangle = f;
+            return true;
+        });
+        result.hits[n] = hit_triangle;
+    }
+    result.seconds = duration<double>(steady_clock::now() - start).count();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::string source = argc > 1 ? argv[1] : "1000000";
+    size_t ray_count = argc > 2 ? std::stoul(argv[2]) : 1000000;
+
+    srand(1);
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    if (source.find_first_not_of("0123456789") == std::string::npos) {
+        triangle_soup(std::stoul(source), positions, indices);
+    }
+    else if (!load_mesh(source, positions, indices)) {
+        return 1;
+    }
+
+    triangle_mesh mesh(std::move(positions), std::move(indices), nullptr);
+    auto boxes = mesh.triangle_boxes();
+
+    auto start = steady_clock::now();
+    bvh_tree tree;
+    tree.build(boxes, 4);
+    double binary_build = duration<double>(steady_clock::now() - start).count();
+
+    start = steady_clock::now();
+    wide_bvh wide(tree);
+    double wide_build = duration<double>(steady_clock::now() - start).count();
+
+    // Rays from a sphere around the mesh aimed at random points inside its box
+    aabb box = tree.bounds();
+    point3 center = box.centroid();
+    vec3 half = 0.5 * (box.max() - box.min());
+    double radius = 2.0 * half.length();
+    std::vector<ray> rays;
+    for (size_t n = 0; n < ray_count; n++) {
+        point3 target = center + half * vec3::random(-1, 1);
+        point3 origin = center + radius * random_unit_vector();
+        rays.push_back(ray(origin, target - origin));
+    }
+
+    auto binary = trace(mesh, tree, rays);
+    auto compressed = trace(mesh, wide, rays);
+
+    size_t mismatches = 0;
+    for (size_t n = 0; n < rays.size(); n++)
+        if (binary.hits[n] != compressed.hits[n]) mismatches++;
+
+    size_t prims = mesh.triangle_count();
+    printf("triangles %zu, rays %zu\n\n", prims, rays.size());
+    printf("%-8s %10s %12s %12s %10s %10s\n", "layout", "nodes", "bytes", "bytes/prim", "build s", "Mrays/s");
+    printf("%-8s %10zu %12zu %12.2f %10.3f %10.3f\n", "binary", tree.nodes.size(), tree.memory_bytes(),
+           static_cast<double>(tree.memory_bytes()) / prims, binary_build, rays.size() / binary.seconds / 1e6);
+    printf("%-8s %10zu %12zu %12.2f %10.3f %10.3f\n", "wide4q8", wide.nodes.size(), wide.memory_bytes(),
+           static_cast<double>(wide.memory_bytes()) / prims, wide_build, rays.size() / compressed.seconds / 1e6);
+    printf("\nnode memory %.2fx smaller, traversal %.2fx faster, %zu of %zu hits differ\n",
+           static_cast<double>(tree.nodes.size() * sizeof(bvh_node)) / (wide.nodes.size() * sizeof(wide_bvh_node)),
+           binary.seconds / compressed.seconds, mismatches, rays.size());
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Startup time with the on-disk BVH cache
+// Builds a 10^6 sphere stress scene and a 10^6 triangle mesh three times,
+// each in a fresh process: with the cache off, cold (empty cache, the tree
+// is built and written) and warm (the tree is read back from the file).
+// Checks that the warm scene gives exactly the same hits as the built one.
+//
+// usage: cache_bench [primitives] [cache dir]   (default 1000000, /tmp/ghd_bvh_cache_bench)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../primitives/triangle_mesh.h"
+#include "../utils/bvh.h"
+#include "../utils/bvh_cache.h"
+#include "../scenes/scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Rolling heightfield with n x n vertices, 2 (n-1)^2 triangles
+hittable_list heightfield_scene(size_t triangles) {
+    int n = static_cast<int>(sqrt(triangles / 2.0)) + 1;
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    positions.reserve(3 * static_cast<size_t>(n) * n);
+    indices.reserve(6 * static_cast<size_t>(n - 1) * (n - 1));
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            float u = 20.0f * x / (n - 1) - 10, v = 20.0f * z / (n - 1) - 10;
+            positions.push_back(u);
+            positions.push_back(0.3f * sinf(1.7f * u) * cosf(1.3f * v) + 0.05f * sinf(23 * u + 17 * v));
+            positions.push_back(v);
+        }
+    }
+    for (int z = 0; z + 1 < n; z++) {
+        for (int x = 0; x + 1 < n; x++) {
+            uint32_t i = z * n + x;
+            indices.insert(indices.end(), {i, i + n, i + 1, i + 1, i + n, i + n + 1});
+        }
+    }
+
+    hittable_list world;
+    world.add(make_shared<triangle_mesh>(std::move(positions), std::move(indices),
+                                         make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+    return world;
+}
+
+// Sum of the hit distances of a fixed set of camera rays
+double hit_checksum(const hittable& world) {
+    scene_view view = default_view("random_scene");
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, 0, view.dist_to_focus);
+    rng generator(7);
+    double sum = 0;
+    for (int n = 0; n < 100000; n++) {
+        hit_record rec;
+        double u = generator.next() / 4294967296.0, v = generator.next() / 4294967296.0;
+        if (world.hit(cam.get_ray(u, v), 0.001, infinity, rec)) sum += rec.t;
+    }
+    return sum;
+}
+
+size_t cache_bytes(const std::string& dir) {
+    size_t total = 0;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* e = readdir(d)) {
+            struct stat st;
+            if (stat((dir + "/" + e->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) total += st.st_size;
+        }
+        closedir(d);
+    }
+    return total;
+}
+
+void clear_cache(const std::string& dir) {
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* e = readdir(d))
+            if (e->d_name[0] != '.') remove((dir + "/" + e->d_name).c_str());
+        closedir(d);
+    }
+}
+
+void run(const char* scene, const char* mode, size_t count, const std::string& cache_dir) {
+    setenv("GHD_BVH_CACHE", mode[0] == 'o' ? "off" : cache_dir.c_str(), 1);
+
+    auto start = steady_clock::now();
+    hittable_list list;
+    if (scene[0] == 's') {
+        stress_params params;
+        params.count = count;
+        list = stress_scene(params);
+    }
+    else {
+        list = heightfield_scene(count);
+    }
+    bvh world(list);
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    printf("%-8s %-6s %10.3f %10.1f %16.6f\n", scene, mode, seconds,
+           cache_bytes(cache_dir) / (1024.0 * 1024.0), hit_checksum(world));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? static_cast<size_t>(std::stod(argv[1])) : 1000000;
+    std::string cache_dir = argc > 2 ? argv[2] : "/tmp/ghd_bvh_cache_bench";
+    if (!make_dirs(cache_dir)) {
+        std::cerr << "cannot create " << cache_dir << "\n";
+        return 1;
+    }
+
+    printf("%zu primitives, cache in %s\n\n", count, cache_dir.c_str());
+    printf("%-8s %-6s %10s %10s %16s\n", "scene", "cache", "startup s", "file MB", "hit checksum");
+    fflush(stdout);
+
+    int failures = 0;
+    for (const char* scene : {"spheres", "mesh"}) {
+        clear_cache(cache_dir);
+        for (const char* mode : {"off", "cold", "warm"}) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(scene, mode, count, cache_dir);
+                _exit(0);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf("%-8s %-6s failed\n", scene, mode);
+                failures++;
+            }
+        }
+    }
+    clear_cache(cache_dir);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// Throughput of converting a directory of renders to PNG and JPEG
+// Renders a small frame, scales it up to the frame size with per pixel
+// noise (so no two frames compress alike) and writes the frames as P3, as
+// main.cpp does, as P6 and as PFM into a temporary directory. First times
+// decoding a P3 frame with read_ppm's iostreams against the mapped scanner.
+// Then converts every directory to PNG and JPEG with convert_all on one
+// thread and on all cores, and, if ImageMagick's convert is installed,
+// with one convert process per frame as tools/convert_ppm_to_*.sh do.
+//
+// usage: convert_bench [frames] [width] [height]   (default 4 3840 2160)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/image_convert.h"
+#include "../utils/image_io.h"
+#include "../utils/render.h"
+#include "../utils/simd_dispatch.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// The sums of a small render of GHD_scene, divided by the samples
+std::vector<color> render_frame(int width, int height, int threads) {
+    hittable_list list;
+    srand(69);
+    build_scene("GHD_scene", list);
+    bvh world(list);
+    scene_view view = default_view("GHD_scene");
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    const int spp = 16;
+    std::vector<color> frame(static_cast<size_t>(width) * height);
+    accumulate_tiles(cam, world, split_tiles({0, 0, width, height}, 16), width, height, spp, 8, threads, 7,
+                     [&](const tile& t, const std::vector<color>& sums, double) {
+                         size_t k = 0;
+                         for (int y = t.y0; y < t.y1; y++)
+                             for (int x = t.x0; x < t.x1; x++)
+                                 frame[static_cast<size_t>(y) * width + x] = sums[k++] / spp;
+                         return true;
+                     });
+    return frame;
+}
+
+// frame scaled bilinearly to width x height, every channel times 1 +- 10% noise
+std::vector<color> upscale(const std::vector<color>& frame, int fw, int fh, int width, int height, uint64_t seed) {
+    std::vector<color> out(static_cast<size_t>(width) * height);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int y = 0; y < height; y++) {
+        double sy = (y + 0.5) * fh / height - 0.5;
+        int y0 = std::clamp(static_cast<int>(floor(sy)), 0, fh - 1), y1 = std::min(y0 + 1, fh - 1);
+        double ty = std::clamp(sy - y0, 0.0, 1.0);
+        for (int x = 0; x < width; x++) {
+            double sx = (x + 0.5) * fw / width - 0.5;
+            int x0 = std::clamp(static_cast<int>(floor(sx)), 0, fw - 1), x1 = std::min(x0 + 1, fw - 1);
+            double tx = std::clamp(sx - x0, 0.0, 1.0);
+            color c = (1 - ty) * ((1 - tx) * frame[y0 * fw + x0] + tx * frame[y0 * fw + x1]) +
+                      ty * ((1 - tx) * frame[y1 * fw + x0] + tx * frame[y1 * fw + x1]);
+            for (int k = 0; k < 3; k++) {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                c[k] *= 0.9 + 0.2 * (state >> 40) / 16777216.0;
+            }
+            out[static_cast<size_t>(y) * width + x] = c;
+        }
+    }
+    return out;
+}
+
+// Writes rgb as the ascii ppm main.cpp prints
+bool write_p3(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) {
+    std::ofstream out(path);
+    out << "P3\n" << width << ' ' << height << "\n255\n";
+    for (size_t p = 0; p < rgb.size(); p += 3)
+        out << int(rgb[p]) << ' ' << int(rgb[p + 1]) << ' ' << int(rgb[p + 2]) << '\n';
+    return static_cast<bool>(out);
+}
+
+// The files of a directory, for the convert processes
+std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> names;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(d))
+            if (convertible_name(entry->d_name)) names.push_back(dir + "/" + entry->d_name);
+        closedir(d);
+    }
+    return names;
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? std::stoi(argv[1]) : 4;
+    int width = argc > 2 ? std::stoi(argv[2]) : 3840;
+    int height = argc > 3 ? std::stoi(argv[3]) : 2160;
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    char root_template[] = "/tmp/convert_bench_XXXXXX";
+    if (!mkdtemp(root_template)) {
+        fprintf(stderr, "cannot make a temporary directory\n");
+        return 1;
+    }
+    const std::string root = root_template;
+    const char* formats[3] = {"p3", "p6", "pfm"};
+    for (const char* format : formats) mkdir((root + "/" + format).c_str(), 0755);
+
+    const int fw = 384, fh = 256;
+    std::vector<color> small = render_frame(fw, fh, cores);
+    printf("%d frames of %dx%d, %d cores, in %s\n", frames, width, height, cores, root.c_str());
+    std::vector<unsigned char> rgb(3 * static_cast<size_t>(width) * height);
+    std::vector<float> linear(rgb.size());
+    for (int f = 0; f < frames; f++) {
+        std::vector<color> frame = upscale(small, fw, fh, width, height, f + 1);
+        simd().tonemap(frame.data(), frame.size(), 1.0, rgb.data());
+        for (size_t p = 0; p < frame.size(); p++)
+            for (int k = 0; k < 3; k++) linear[3 * p + k] = static_cast<float>(frame[p][k]);
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%04d", f);
+        if (!write_p3(root + "/p3" + name + ".ppm", width, height, rgb) ||
+            !write_ppm(root + "/p6" + name + ".ppm", width, height, rgb) ||
+            !write_pfm(root + "/pfm" + name + ".pfm", width, height, 3, linear)) {
+            fprintf(stderr, "cannot write the frames\n");
+            return 1;
+        }
+    }
+
+    // Decoding alone
+    {
+        const std::string path = root + "/p3/frame_0000.ppm";
+        int w, h;
+        std::vector<unsigned char> streamed, mapped;
+        auto start = steady_clock::now();
+        read_ppm(path, w, h, streamed);
+        double stream_seconds = duration<double>(steady_clock::now() - start).count();
+        start = steady_clock::now();
+        std::string error;
+        mapped_file file(path);
+        decode_image(file, convert_options(), w, h, mapped, error);
+        double map_seconds = duration<double>(steady_clock::now() - start).count();
+        printf("\ndecoding a %.1f MB P3 frame: read_ppm %.0f ms, mapped scanner %.0f ms (%.1fx)%s\n",
+               file.size / 1048576.0, 1e3 * stream_seconds, 1e3 * map_seconds, stream_seconds / map_seconds,
+               streamed == mapped ? "" : ", pixels DIFFER");
+    }
+
+    printf("\n%6s %6s %8s %10s %10s %10s %12s\n", "input", "output", "threads", "seconds", "images/s", "MB/s in",
+           "MB out each");
+    for (const char* format : formats)
+        for (bool jpeg : {false, true})
+            for (int threads : {1, cores}) {
+                convert_options options;
+                options.jpeg = jpeg;
+                convert_inputs next({root + "/" + format}, root + "/out", jpeg);
+                convert_report report = convert_all(std::ref(next), threads, 4 * threads, options);
+                printf("%6s %6s %8d %10.2f %10.2f %10.1f %12.2f\n", format, jpeg ? "jpg" : "png", threads,
+                       report.seconds, report.images / report.seconds, report.bytes_in / 1048576.0 / report.seconds,
+                       report.bytes_out / 1048576.0 / std::max<size_t>(1, report.images));
+                for (const auto& failure : report.failures) printf("  %s\n", failure.c_str());
+                fflush(stdout);
+                if (cores == 1) break;
+            }
+
+    // One ImageMagick process per frame, as the shell scripts do
+    if (system("command -v convert > /dev/null 2>&1") == 0) {
+        for (const char* format : {"p3", "p6"})
+            for (const char* extension : {"png", "jpg"}) {
+                auto start = steady_clock::now();
+                int images = 0;
+                for (const std::string& path : list_dir(root + "/" + format)) {
+                    std::string out = root + "/out/magick." + extension;
+                    if (system(("convert '" + path + "' '" + out + "'").c_str()) == 0) images++;
+                }
+                double seconds = duration<double>(steady_clock::now() - start).count();
+                printf("%6s %6s %8s %10.2f %10.2f   (convert per frame)\n", format, extension, "1", seconds,
+                       images / seconds);
+            }
+    } else {
+        printf("\nImageMagick convert is not installed, skipped the per frame convert loop\n");
+    }
+
+    system(("rm -rf '" + root + "'").c_str());
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Pixel- against sample-parallel rendering of small crops
+// Renders square crops of 1 to 32 pixels a side from the middle of a frame
+// at a high sample count. Every block of sample_block samples of every
+// pixel is timed on one thread, then replayed on W simulated workers:
+//   pixels   tiles planned for W workers (as main.cpp plans them), each
+//            worker taking the next tile, so a crop with fewer tiles than
+//            workers leaves the rest idle
+//   samples  each tile in turn, the W workers taking the next block of
+//            samples of its pixels (accumulate_tile_samples)
+// and prints both makespans and the mode use_sample_parallel picks. Then
+// renders every crop for real in both modes with 1, 2 and all threads and
+// checks the sums are the same bits every time.
+//
+// usage: crop_bench [scene] [spp] [depth]   (default GHD_scene 1024 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int width = 384, height = 256;
+
+// Finish time of the last of `workers` workers taking jobs in list order
+double makespan(const std::vector<double>& jobs, int workers) {
+    std::priority_queue<double, std::vector<double>, std::greater<double>> free_at;
+    for (int w = 0; w < workers; w++) free_at.push(0);
+    double last = 0;
+    for (double seconds : jobs) {
+        double finish = free_at.top() + seconds;
+        free_at.pop();
+        free_at.push(finish);
+        last = std::max(last, finish);
+    }
+    return last;
+}
+
+// The sums of a crop, rows top to bottom
+std::vector<color> render_crop(const camera& cam, const hittable& world, const std::vector<tile>& tiles,
+                               const tile& crop, int spp, int depth, int threads, parallel_mode mode) {
+    std::vector<color> frame(static_cast<size_t>(crop.width()) * crop.height());
+    accumulate_tiles(cam, world, tiles, width, height, spp, depth, threads, 7,
+                     [&](const tile& t, const std::vector<color>& sums, double) {
+                         size_t k = 0;
+                         for (int y = t.y0; y < t.y1; y++)
+                             for (int x = t.x0; x < t.x1; x++)
+                                 frame[static_cast<size_t>(y - crop.y0) * crop.width() + x - crop.x0] = sums[k++];
+                         return true;
+                     },
+                     nullptr, nullptr, mode);
+    return frame;
+}
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "GHD_scene";
+    int spp = argc > 2 ? std::stoi(argv[2]) : 1024;
+    int depth = argc > 3 ? std::stoi(argv[3]) : 8;
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int blocks = (spp + sample_block - 1) / sample_block;
+
+    hittable_list list;
+    srand(69);
+    if (!build_scene(name, list)) {
+        fprintf(stderr, "unknown scene %s\n", name.c_str());
+        return 1;
+    }
+    bvh world(list);
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    cost_map estimate = estimate_cost(cam, world, width, height, depth);
+
+    printf("%s, crops of a %dx%d frame at %d spp (%d blocks of %d), depth %d\n\n", name.c_str(), width, height, spp,
+           blocks, sample_block, depth);
+    printf("%7s %8s %6s %12s %12s %9s %8s\n", "crop", "workers", "tiles", "pixels ms", "samples ms", "speedup",
+           "picks");
+    bool ok = true;
+    for (int side : {1, 4, 16, 32}) {
+        tile crop = {width / 2 - side / 2, height / 2 - side / 2, width / 2 - side / 2 + side,
+                     height / 2 - side / 2 + side};
+
+        // Every block of every pixel on one thread
+        std::vector<double> block_seconds;
+        for (int y = crop.y0; y < crop.y1; y++)
+            for (int x = crop.x0; x < crop.x1; x++)
+                for (int b = 0; b < blocks; b++) {
+                    rng pixel_rng(7, static_cast<uint64_t>(y) * width + x);
+                    pixel_rng.advance(2 * static_cast<uint64_t>(b) * sample_block);
+                    thread_rng = &pixel_rng;
+                    auto start = steady_clock::now();
+                    render_samples(cam, world, x, height - 1 - y, width, height,
+                                   std::min(sample_block, spp - b * sample_block), depth);
+                    block_seconds.push_back(duration<double>(steady_clock::now() - start).count());
+                }
+        thread_rng = nullptr;
+        auto pixel_blocks = [&](int x, int y) {
+            size_t first = (static_cast<size_t>(y - crop.y0) * crop.width() + x - crop.x0) * blocks;
+            return std::vector<double>(block_seconds.begin() + first, block_seconds.begin() + first + blocks);
+        };
+
+        for (int workers : {4, 16, 64}) {
+            std::vector<tile> tiles = plan_tiles(estimate, crop, 16 * workers);
+            std::vector<double> tile_seconds;
+            double samples = 0;
+            for (const tile& t : tiles) {
+                std::vector<double> tile_blocks;
+                for (int y = t.y0; y < t.y1; y++)
+                    for (int x = t.x0; x < t.x1; x++) {
+                        std::vector<double> b = pixel_blocks(x, y);
+                        tile_blocks.insert(tile_blocks.end(), b.begin(), b.end());
+                    }
+                double sum = 0;
+                for (double s : tile_blocks) sum += s;
+                tile_seconds.push_back(sum);
+                samples += makespan(tile_blocks, workers);
+            }
+            double pixels = makespan(tile_seconds, workers);
+            bool picked = use_sample_parallel(parallel_mode::automatic, tiles.size(), spp, workers);
+            printf("%3dx%-3d %8d %6zu %12.1f %12.1f %8.2fx %8s\n", side, side, workers, tiles.size(), 1e3 * pixels,
+                   1e3 * samples, pixels / samples, picked ? "samples" : "pixels");
+        }
+
+        // The real thing, same bits for every mode and thread count
+        std::vector<tile> tiles = plan_tiles(estimate, crop, 16 * threads);
+        std::vector<color> reference = render_crop(cam, world, tiles, crop, spp, depth, 1, parallel_mode::pixels);
+        for (int t : {1, 2, threads})
+            for (parallel_mode mode : {parallel_mode::pixels, parallel_mode::samples})
+                ok = ok && same(reference, render_crop(cam, world, tiles, crop, spp, depth, t, mode));
+        fflush(stdout);
+    }
+    printf("\nsums %s across modes and 1, 2 and %d threads\n", ok ? "identical" : "DIFFER", threads);
+    return ok ? 0 : 1;
+}
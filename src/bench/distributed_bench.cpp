@@ -0,0 +1,98 @@
+// Sort-last rendering of a scene split between 1 to 8 processes
+// Renders a stress scene through distributed_scene with 1, 2, 4 and 8
+// partitions and prints the memory of the largest partition's slab and of
+// all of them, the render time, the rays forwarded per second and the
+// traffic. Then builds the whole scene in this process, renders it with
+// accumulate_tiles and checks every distributed frame is the same bits.
+// The partitions are forked before the whole scene is built, so they do not
+// inherit it.
+//
+// usage: distributed_bench [scene] [width] [spp] [depth]   (default stress:count=1e6 192 4 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/distributed.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "stress:count=1e6";
+    int width = argc > 2 ? std::stoi(argv[2]) : 192;
+    int spp = argc > 3 ? std::stoi(argv[3]) : 4;
+    int depth = argc > 4 ? std::stoi(argv[4]) : 8;
+    int height = static_cast<int>(width / 1.5);
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    const int64_t seed = 7;
+
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    printf("%s at %dx%d, %d spp, depth %d, %d cores\n\n", name.c_str(), width, height, spp, depth, cores);
+    printf("%6s %13s %12s %10s %10s %12s %10s %9s\n", "parts", "largest MB", "all MB", "build ms", "render ms",
+           "rays/s", "MB moved", "waiting");
+
+    std::vector<std::vector<color>> frames;
+    for (int parts : {1, 2, 4, 8}) {
+        distributed_scene scene;
+        std::string error;
+        std::vector<color> sums;
+        if (!scene.start(name, parts, std::max(1, cores / parts), error) ||
+            !scene.render(cam, width, height, spp, depth, seed, sums, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        scene.stop();
+        double largest = 0, all = 0, build = 0;
+        for (const auto& p : scene.partitions) {
+            largest = std::max(largest, p.stats.scene_mb);
+            all += p.stats.scene_mb;
+            build = std::max(build, p.stats.build_seconds);
+        }
+        printf("%6d %13.1f %12.1f %10.0f %10.0f %12.3g %10.1f %8.0f%%\n", parts, largest, all, 1e3 * build,
+               1e3 * scene.render_seconds, scene.rays_forwarded / scene.render_seconds,
+               (scene.bytes_sent + scene.bytes_received) / 1048576.0,
+               100 * scene.exchange_seconds / scene.render_seconds);
+        fflush(stdout);
+        frames.push_back(sums);
+    }
+
+    // The whole scene in one process
+    double rss_before = resident_mb("VmRSS");
+    hittable_list list;
+    srand(69);
+    build_scene(name, list);
+    bvh world(list);
+    double whole_mb = resident_mb("VmRSS") - rss_before;
+    std::vector<color> reference(static_cast<size_t>(width) * height);
+    auto start = steady_clock::now();
+    accumulate_tiles(cam, world, split_tiles({0, 0, width, height}, 16), width, height, spp, depth, cores, seed,
+                     [&](const tile& t, const std::vector<color>& sums, double) {
+                         size_t k = 0;
+                         for (int y = t.y0; y < t.y1; y++)
+                             for (int x = t.x0; x < t.x1; x++)
+                                 reference[static_cast<size_t>(y) * width + x] = sums[k++];
+                         return true;
+                     });
+    double single = duration<double>(steady_clock::now() - start).count();
+    printf("%6s %13.1f %12s %10s %10.0f   (accumulate_tiles, whole scene in one process)\n", "-", whole_mb, "", "",
+           1e3 * single);
+
+    bool ok = true;
+    for (const auto& frame : frames)
+        ok = ok && same(frame, reference);
+    printf("\ndistributed frames %s\n", ok ? "identical to accumulate_tiles" : "DIFFER");
+    return ok ? 0 : 1;
+}
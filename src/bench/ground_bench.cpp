@@ -0,0 +1,129 @@
+// Traversal speed with a ground plane against the old ground sphere
+// Builds the built-in scenes and uniform stress scenes twice: as they are,
+// standing on a ground plane that the bvh tests on every ray, and with the
+// ground sphere they used before (radius 1000, or the scene's side if that
+// is larger, inside the sphere_set; radius 100 for floor_sphere_scene).
+// Reports camera ray throughput, the best of three small renders, and how
+// far ground hits land from the surface that was hit (the large sphere's
+// quadratic loses precision, the source of acne when t_min is small).
+//
+// usage: ground_bench [camera rays]   (default 1000000)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../primitives/plane.h"
+#include "../primitives/sphere.h"
+#include "../primitives/sphere_set.h"
+#include "../utils/bvh.h"
+#include "../utils/render.h"
+#include "../scenes/scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Swaps the ground plane of a scene for the sphere it replaced, returns its center and radius
+void sphere_ground(hittable_list& list, point3& center, double& radius) {
+    auto ground = std::static_pointer_cast<plane>(list.objects.back());
+    list.objects.pop_back();
+
+    auto set = std::dynamic_pointer_cast<sphere_set>(list.objects[0]);
+    if (!set) {
+        // floor_sphere_scene, plain sphere objects
+        radius = 100;
+        center = ground->origin - vec3(0, radius, 0);
+        list.add(make_shared<sphere>(center, radius, ground->mat_ptr));
+        return;
+    }
+
+    // The sphere goes back into the set, where its box contains every other one
+    aabb box;
+    set->bounding_box(box);
+    vec3 size = box.max() - box.min();
+    radius = fmax(1000.0, fmax(size.x(), size.z()));
+    center = ground->origin - vec3(0, radius, 0);
+
+    auto with_ground = make_shared<sphere_set>(set->arena);
+    with_ground->reserve(set->size() + 1);
+    with_ground->add(center, radius,
+                     set->arena->add_material<lambertian>(color(0.5, 0.5, 0.5)));
+    for (size_t i = 0; i < set->size(); i++)
+        with_ground->add(set->center(i), set->radius(i), set->material_ids[i]);
+    with_ground->build();
+    list.objects[0] = with_ground;
+}
+
+struct ground_result {
+    double mrays;
+    double render_seconds;
+    double surface_error; // mean distance of ground hits from the ground surface
+};
+
+ground_result measure(const char* name, bool use_sphere, size_t ray_count) {
+    hittable_list list;
+    srand(69);
+    build_scene(name, list);
+    point3 center;
+    double radius = 0;
+    if (use_sphere) sphere_ground(list, center, radius);
+    bvh world(list);
+
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+
+    rng generator(7);
+    auto random = [&]() { return generator.next() / 4294967296.0; };
+    auto start = steady_clock::now();
+    for (size_t n = 0; n < ray_count; n++) {
+        hit_record rec;
+        world.hit(cam.get_ray(random(), random()), 0.001, infinity, rec);
+    }
+    ground_result result;
+    result.mrays = ray_count / duration<double>(steady_clock::now() - start).count() / 1e6;
+
+    // Ground hits are the ones with an upward normal below the spheres' lowest point
+    double ground_height = std::string(name) == "floor_sphere_scene" ? -0.5 : 0.0;
+    size_t ground_hits = 0;
+    double error_sum = 0;
+    for (size_t n = 0; n < ray_count / 10; n++) {
+        hit_record rec;
+        if (!world.hit(cam.get_ray(random(), random()), 0.001, infinity, rec) ||
+            rec.normal.y() < 0.9 || rec.p.y() > ground_height + 1e-3)
+            continue;
+        ground_hits++;
+        error_sum += use_sphere ? fabs((rec.p - center).length() - radius) : fabs(rec.p.y() - ground_height);
+    }
+    result.surface_error = ground_hits ? error_sum / ground_hits : 0;
+
+    std::vector<unsigned char> rgb;
+    result.render_seconds = infinity;
+    for (int run = 0; run < 3; run++) {
+        start = steady_clock::now();
+        render_tile(cam, world, {0, 0, 192, 128}, 192, 128, 8, 8, rgb, nullptr, 1);
+        result.render_seconds = fmin(result.render_seconds, duration<double>(steady_clock::now() - start).count());
+    }
+    return result;
+}
+int main(int argc, char** argv) {
+    size_t ray_count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    printf("%zu camera rays, best of three 192x128 renders at 8 spp, depth 8\n\n", ray_count);
+    printf("%-26s %9s %9s %9s %9s %9s %9s %10s %10s\n", "scene", "sph Mr/s", "pln Mr/s", "speedup",
+           "sph s", "pln s", "speedup", "sph error", "pln error");
+    for (const char* name : {"GHD_scene", "random_scene", "floor_sphere_scene", "stress:count=1e5",
+                             "stress:count=1e6"}) {
+        ground_result old_ground = measure(name, true, ray_count);
+        ground_result new_ground = measure(name, false, ray_count);
+        printf("%-26s %9.2f %9.2f %8.2fx %9.3f %9.3f %8.2fx %10.2e %10.2e\n", name, old_ground.mrays,
+               new_ground.mrays, new_ground.mrays / old_ground.mrays, old_ground.render_seconds,
+               new_ground.render_seconds, old_ground.render_seconds / new_ground.render_seconds,
+               old_ground.surface_error, new_ground.surface_error);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Edit-to-preview latency of incremental re-rendering
+// Renders a scene once with incremental_frame (keeping every sample's first
+// hit) and once the normal way, then edits a diffuse, a metal and a glass
+// material the camera sees and the sky one after the other. After each edit
+// the frame is reshaded from the cached first hits and compared with a full
+// re-render of the edited scene at the same seed, which it has to match
+// exactly. Prints the share of pixels reshaded and both times.
+//
+// usage: incremental_bench [scene] [width] [spp] [depth]   (default GHD_scene 384 8 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/incremental.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// The whole frame the normal way, sums rows top to bottom
+std::vector<color> full_render(const camera& cam, const hittable& world, int width, int height, int spp, int depth,
+                               int threads, int64_t seed) {
+    std::vector<color> frame(static_cast<size_t>(width) * height);
+    accumulate_tiles(cam, world, split_tiles({0, 0, width, height}, 32), width, height, spp, depth, threads, seed,
+                     [&](const tile& t, const std::vector<color>& sums, double) {
+                         size_t k = 0;
+                         for (int y = t.y0; y < t.y1; y++)
+                             for (int x = t.x0; x < t.x1; x++) frame[static_cast<size_t>(y) * width + x] = sums[k++];
+                         return true;
+                     });
+    return frame;
+}
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "GHD_scene";
+    int width = argc > 2 ? std::stoi(argv[2]) : 384;
+    int spp = argc > 3 ? std::stoi(argv[3]) : 8;
+    int depth = argc > 4 ? std::stoi(argv[4]) : 8;
+    int height = static_cast<int>(width / 1.5);
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int64_t seed = 7;
+
+    hittable_list list;
+    srand(69);
+    if (!build_scene(name, list)) {
+        fprintf(stderr, "unknown scene %s\n", name.c_str());
+        return 1;
+    }
+    bvh world(list);
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+
+    printf("%s at %dx%d, %d spp, depth %d, %d threads\n\n", name.c_str(), width, height, spp, depth, threads);
+    std::vector<color> reference;
+    double full = best_of(2, [&]() { reference = full_render(cam, world, width, height, spp, depth, threads, seed); });
+    incremental_frame frame(width, height, spp, depth, seed);
+    double cached = best_of(2, [&]() { frame.render(cam, world, threads); });
+    printf("full render          %8.1f ms\n", 1e3 * full);
+    printf("caching first hits   %8.1f ms, %.1f MB, %s\n\n", 1e3 * cached, frame.memory_bytes() / 1048576.0,
+           same(frame.sums, reference) ? "same frame" : "FRAME DIFFERS");
+
+    // The first visible material of each kind
+    lambertian* diffuse = nullptr;
+    metal* shiny = nullptr;
+    dielectric* glass = nullptr;
+    for (const primary_sample& s : frame.samples) {
+        if (!s.hit) continue;
+        material* m = const_cast<material*>(s.rec.mat_ptr);
+        if (!diffuse) diffuse = dynamic_cast<lambertian*>(m);
+        if (!shiny) shiny = dynamic_cast<metal*>(m);
+        if (!glass) glass = dynamic_cast<dielectric*>(m);
+    }
+
+    struct edit {
+        const char* name;
+        material* changed; // null for the sky
+        std::function<void()> apply;
+    };
+    std::vector<edit> edits;
+    if (diffuse) edits.push_back({"lambertian albedo", diffuse, [&]() { diffuse->albedo = color(0.9, 0.2, 0.1); }});
+    if (shiny) edits.push_back({"metal fuzz", shiny, [&]() { shiny->fuzz = shiny->fuzz > 0.5 ? 0.1 : 0.6; }});
+    if (glass) edits.push_back({"dielectric ir", glass, [&]() { glass->ir = 2.4; }});
+    edits.push_back({"sky colors", nullptr, [&]() { scene_sky.top = color(1.0, 0.6, 0.3); }});
+
+    printf("%-20s %9s %12s %12s %9s\n", "edit", "pixels", "reshade ms", "full ms", "speedup");
+    bool ok = true;
+    for (const edit& e : edits) {
+        e.apply();
+        std::vector<const material*> changed;
+        if (e.changed) changed.push_back(e.changed);
+        size_t pixels = 0;
+        double reshade =
+            best_of(3, [&]() { pixels = frame.reshade(cam, world, changed, !e.changed, threads); });
+        double rerender =
+            best_of(1, [&]() { reference = full_render(cam, world, width, height, spp, depth, threads, seed); });
+        bool match = same(frame.sums, reference);
+        ok = ok && match;
+        printf("%-20s %8.1f%% %12.1f %12.1f %8.1fx%s\n", e.name, 100.0 * pixels / frame.sums.size(), 1e3 * reshade,
+               1e3 * rerender, rerender / reshade, match ? "" : "   FRAME DIFFERS");
+        fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// NUMA placement of workers, framebuffer and scene
+// Renders one frame three ways on every CPU the process may use:
+//   unpinned    accumulate_tiles, threads wherever the kernel puts them and
+//               the frame and scene wherever they were first touched
+//   pinned      accumulate_tiles_numa, a worker pinned to every core, each
+//               node rendering its own band into memory first touched there
+//   replicated  pinned, and the scene and BVH built once per node by a
+//               thread pinned to it
+// best of three each, and checks the three give the same sums. Then repeats
+// the pinned modes on the first 1, 2, 4, ... CPUs of every node.
+//
+// Without a multi-socket machine simulate a topology with a cpuset, e.g.
+//   GHD_NUMA="0-3;4-7" ./numa_bench
+// (the placement then costs nothing to measure against, the remote memory
+// penalty needs real nodes). For huge pages in the scene memory run with
+// GLIBC_TUNABLES=glibc.malloc.hugetlb=1.
+//
+// usage: numa_bench [scene] [width] [spp] [depth]   (default stress:count=2e5 384 4 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/numa.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// A scene and its BVH
+struct scene_copy {
+    hittable_list list;
+    std::unique_ptr<bvh> tree;
+};
+
+std::shared_ptr<scene_copy> build_copy(const std::string& name) {
+    auto copy = std::make_shared<scene_copy>();
+    srand(69);
+    if (!build_scene(name, copy->list)) return nullptr;
+    copy->tree.reset(new bvh(copy->list));
+    return copy;
+}
+
+bool same(const std::vector<color>& a, const numa_frame& b) {
+    for (int y = 0; y < b.height; y++)
+        if (!same(a.data() + static_cast<size_t>(y) * b.width, b.row(y), b.width)) return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "stress:count=2e5";
+    int width = argc > 2 ? std::stoi(argv[2]) : 384;
+    int spp = argc > 3 ? std::stoi(argv[3]) : 4;
+    int depth = argc > 4 ? std::stoi(argv[4]) : 8;
+    int height = static_cast<int>(width / 1.5);
+    const int64_t seed = 7;
+
+    std::vector<numa_node> nodes = numa_topology();
+    int cpus = 0;
+    for (const numa_node& node : nodes) cpus += static_cast<int>(node.cpus.size());
+    std::string thp = transparent_huge_pages();
+    printf("%s\n", describe_topology(nodes).c_str());
+    printf("transparent huge pages: %s\n", thp.empty() ? "unknown" : thp.c_str());
+
+    std::shared_ptr<scene_copy> shared = build_copy(name);
+    if (!shared) {
+        fprintf(stderr, "unknown scene %s\n", name.c_str());
+        return 1;
+    }
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    cost_map estimate = estimate_cost(cam, *shared->tree, width, height, depth);
+    printf("%s at %dx%d, %d spp, depth %d\n\n", name.c_str(), width, height, spp, depth);
+
+    auto ignore = [](const tile&, const std::vector<color>&, double) { return true; };
+
+    // Unpinned
+    std::vector<color> reference(static_cast<size_t>(width) * height);
+    std::vector<tile> tiles = plan_tiles(estimate, {0, 0, width, height}, 16 * cpus);
+    double unpinned = best_of(3, [&]() {
+        accumulate_tiles(cam, *shared->tree, tiles, width, height, spp, depth, cpus, seed,
+                         [&](const tile& t, const std::vector<color>& sums, double) {
+                             size_t k = 0;
+                             for (int y = t.y0; y < t.y1; y++)
+                                 for (int x = t.x0; x < t.x1; x++)
+                                     reference[static_cast<size_t>(y) * width + x] = sums[k++];
+                             return true;
+                         });
+    });
+
+    // Pinned, one scene for all nodes
+    numa_frame frame(width, height, nodes, numa_bands(estimate, nodes));
+    double pinned = best_of(3, [&]() {
+        accumulate_tiles_numa(cam, {shared->tree.get()}, frame, estimate, spp, depth, seed, ignore);
+    });
+    bool pinned_same = same(reference, frame);
+
+    // Pinned, a scene per node
+    std::vector<std::shared_ptr<scene_copy>> copies;
+    double build = best_of(1, [&]() { copies = replicate_per_node(nodes, [&]() { return build_copy(name); }); });
+    std::vector<const hittable*> worlds;
+    for (auto& copy : copies) worlds.push_back(copy->tree.get());
+    double replicated =
+        best_of(3, [&]() { accumulate_tiles_numa(cam, worlds, frame, estimate, spp, depth, seed, ignore); });
+    bool replicated_same = same(reference, frame);
+
+    printf("%-12s %10s %10s\n", "mode", "ms", "speedup");
+    printf("%-12s %10.1f %10s\n", "unpinned", 1e3 * unpinned, "1.00x");
+    printf("%-12s %10.1f %9.2fx%s\n", "pinned", 1e3 * pinned, unpinned / pinned, pinned_same ? "" : "   SUMS DIFFER");
+    printf("%-12s %10.1f %9.2fx%s\n", "replicated", 1e3 * replicated, unpinned / replicated,
+           replicated_same ? "" : "   SUMS DIFFER");
+    printf("(framebuffer %s huge pages, %zu scene copies built in %.1f ms)\n\n", frame.huge_pages ? "advised" : "without",
+           copies.size(), 1e3 * build);
+
+    // The same on the first cores of every node
+    printf("%12s %10s %10s %10s\n", "cpus/node", "unpinned", "pinned", "replicated");
+    size_t most = 0;
+    for (const numa_node& node : nodes) most = std::max(most, node.cpus.size());
+    for (size_t per_node = 1; per_node <= most; per_node *= 2) {
+        std::vector<numa_node> subset;
+        int count = 0;
+        for (const numa_node& node : nodes) {
+            numa_node part{node.id, {}};
+            for (size_t k = 0; k < node.cpus.size() && k < per_node; k++) part.cpus.push_back(node.cpus[k]);
+            count += static_cast<int>(part.cpus.size());
+            subset.push_back(part);
+        }
+        numa_frame part_frame(width, height, subset, numa_bands(estimate, subset));
+        std::vector<tile> part_tiles = plan_tiles(estimate, {0, 0, width, height}, 16 * count);
+        double a = best_of(3, [&]() {
+            accumulate_tiles(cam, *shared->tree, part_tiles, width, height, spp, depth, count, seed, ignore);
+        });
+        double b = best_of(3, [&]() {
+            accumulate_tiles_numa(cam, {shared->tree.get()}, part_frame, estimate, spp, depth, seed, ignore);
+        });
+        double c = best_of(3, [&]() {
+            accumulate_tiles_numa(cam, worlds, part_frame, estimate, spp, depth, seed, ignore);
+        });
+        printf("%12zu %10.1f %10.1f %10.1f\n", per_node, 1e3 * a, 1e3 * b, 1e3 * c);
+        fflush(stdout);
+    }
+    return pinned_same && replicated_same ? 0 : 1;
+}
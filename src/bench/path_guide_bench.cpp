@@ -0,0 +1,110 @@
+// Equal-time RMSE of path guiding
+// Renders scenes in passes of one sample per pixel for the same wall clock
+// budget, once with plain cosine sampling and once with a path guide whose
+// training counts against the budget, and compares both to a converged
+// reference. The built-in scenes use the regression references in
+// renders/reference; the stress scene, whose sky is mostly seen through
+// gaps between clustered spheres, gets a reference rendered here first.
+//
+// usage: path_guide_bench [seconds per scene] [--dir renders/reference]
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/bvh.h"
+#include "../utils/image_io.h"
+#include "../utils/path_guide.h"
+#include "../utils/render.h"
+#include "../utils/simd_dispatch.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int image_width = 96;
+const int image_height = 64;
+const int max_depth = 8;
+const int reference_spp = 1024;
+
+struct timed_render {
+    std::vector<unsigned char> rgb;
+    int spp;
+    double train_seconds;
+};
+
+// One sample per pixel passes until the budget (including training) is spent
+timed_render render_for(const camera& cam, const hittable& world, double budget, bool guided) {
+    const tile frame{0, 0, image_width, image_height};
+    auto start = steady_clock::now();
+    auto elapsed = [&]() { return duration<double>(steady_clock::now() - start).count(); };
+
+    timed_render result{{}, 0, 0};
+    path_guide guide(world);
+    render_caches caches;
+    if (guided) {
+        train_path_guide(guide, cam, world, image_width, image_height, max_depth, 1, 77);
+        caches.guide = &guide;
+        result.train_seconds = elapsed();
+    }
+
+    std::vector<color> sums(image_width * image_height, color(0, 0, 0)), pass;
+    while (elapsed() < budget || result.spp == 0) {
+        accumulate_tile(cam, world, frame, image_width, image_height, 1, max_depth, pass, nullptr,
+                        1000 + result.spp, &caches);
+        for (size_t i = 0; i < sums.size(); i++) sums[i] += pass[i];
+        result.spp++;
+    }
+
+    result.rgb.resize(3 * sums.size());
+    simd().tonemap(sums.data(), sums.size(), 1.0 / result.spp, result.rgb.data());
+    return result;
+}
+
+int main(int argc, char** argv) {
+    double budget = 1.0;
+    std::string dir = "renders/reference";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc)
+            dir = argv[++i];
+        else
+            budget = std::stod(arg);
+    }
+
+    printf("%dx%d, depth %d, %.1f s per render\n\n", image_width, image_height, max_depth, budget);
+    printf("%-42s %8s %8s %8s %8s %8s %9s\n", "scene", "spp", "rmse", "guided", "rmse", "train s", "rmse gain");
+
+    for (const char* name : {"GHD_scene", "random_scene", "floor_sphere_scene",
+                             "stress:count=3e4,dist=clustered,mix=1/0/0"}) {
+        hittable_list list;
+        srand(69);
+        build_scene(name, list);
+        bvh world(list);
+        scene_view view = default_view(name);
+        camera cam(view.lookfrom, view.lookat, view.vup, view.vfov,
+                   static_cast<double>(image_width) / image_height, view.aperture, view.dist_to_focus);
+
+        int width, height;
+        std::vector<unsigned char> reference;
+        if (!read_ppm(dir + "/" + name + ".ppm", width, height, reference) ||
+            width != image_width || height != image_height) {
+            render_tile(cam, world, {0, 0, image_width, image_height}, image_width, image_height,
+                        reference_spp, max_depth, reference, nullptr, 1);
+        }
+
+        timed_render plain = render_for(cam, world, budget, false);
+        timed_render guided = render_for(cam, world, budget, true);
+        double plain_error = rmse(plain.rgb, reference);
+        double guided_error = rmse(guided.rgb, reference);
+        printf("%-42s %8d %8.4f %8d %8.4f %8.2f %8.2fx\n", name, plain.spp, plain_error, guided.spp,
+               guided_error, guided.train_seconds, plain_error / guided_error);
+        fflush(stdout);
+    }
+    return 0;
+}
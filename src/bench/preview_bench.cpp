@@ -0,0 +1,87 @@
+// Latency and throughput of the coarse-to-fine preview
+// Renders a scene at 16 and 256 spp with the tile scheduler (as main.cpp
+// does) and with preview_frame, best of three each, and prints when each
+// preview level was ready, its RMSE against the final image and the total
+// time of both. The final frame of the preview has to be the same bits as
+// the tile scheduler's.
+//
+// usage: preview_bench [scene] [width] [depth]   (default GHD_scene 384 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/preview.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "GHD_scene";
+    int width = argc > 2 ? std::stoi(argv[2]) : 384;
+    int depth = argc > 3 ? std::stoi(argv[3]) : 8;
+    int height = static_cast<int>(width / 1.5);
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int64_t seed = 7;
+
+    hittable_list list;
+    srand(69);
+    if (!build_scene(name, list)) {
+        fprintf(stderr, "unknown scene %s\n", name.c_str());
+        return 1;
+    }
+    bvh world(list);
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    printf("%s at %dx%d, depth %d, %d threads\n", name.c_str(), width, height, depth, threads);
+
+    bool ok = true;
+    for (int spp : {16, 256}) {
+        std::vector<color> tiled(static_cast<size_t>(width) * height);
+        double tiles_seconds = best_of(3, [&]() {
+            cost_map estimate = estimate_cost(cam, world, width, height, depth);
+            std::vector<tile> tiles = plan_tiles(estimate, {0, 0, width, height}, 16 * threads);
+            accumulate_tiles(cam, world, tiles, width, height, spp, depth, threads, seed,
+                             [&](const tile& t, const std::vector<color>& sums, double) {
+                                 size_t k = 0;
+                                 for (int y = t.y0; y < t.y1; y++)
+                                     for (int x = t.x0; x < t.x1; x++)
+                                         tiled[static_cast<size_t>(y) * width + x] = sums[k++];
+                                 return true;
+                             });
+        });
+
+        std::vector<double> ready(4, infinity);
+        std::vector<std::vector<unsigned char>> previews(4);
+        double preview_seconds = best_of(3, [&]() {
+            preview_frame frame(width, height, spp, depth);
+            int level = 0;
+            frame.render(cam, world, threads, seed, [&](int scale, double seconds) {
+                ready[level] = fmin(ready[level], seconds);
+                frame.resolve(scale, previews[level++]);
+                return true;
+            });
+            ok = ok && same(frame.sums, tiled);
+        });
+
+        printf("\n%d spp: tile scheduler %.1f ms, coarse-to-fine %.1f ms (%+.1f%%)\n", spp, 1e3 * tiles_seconds,
+               1e3 * preview_seconds, 100 * (preview_seconds / tiles_seconds - 1));
+        printf("%8s %10s %8s %8s\n", "level", "ready ms", "share", "RMSE");
+        for (int level = 0; level < 4; level++)
+            printf("%8s %10.1f %7.1f%% %8.4f\n", ("1/" + std::to_string(preview_scales[level])).c_str(),
+                   1e3 * ready[level], 100 * ready[level] / preview_seconds, rmse(previews[level], previews[3]));
+        fflush(stdout);
+    }
+    printf("\nfinal frames %s\n", ok ? "identical to the tile scheduler's" : "DIFFER");
+    return ok ? 0 : 1;
+}
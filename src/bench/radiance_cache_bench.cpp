@@ -0,0 +1,93 @@
+// Equal-quality speedup of the radiance cache
+// Renders the diffuse-heavy built-in scenes at the size of the regression
+// references (renders/reference, 1024 spp) with and without the cache, for
+// a few cell sizes and sample counts, and reports time, RMSE to the
+// reference, cache cells and memory. Without the cache RMSE^2 * time is
+// about constant, so the time the plain renderer needs for the cache's
+// RMSE follows from its 64 spp render; speedup is that time over the
+// cached render's time including training. A cached RMSE that stops
+// falling with more samples is the cache's bias.
+//
+// usage: radiance_cache_bench [--dir renders/reference]
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/bvh.h"
+#include "../utils/image_io.h"
+#include "../utils/radiance_cache.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int image_width = 96;
+const int image_height = 64;
+const int max_depth = 8;
+const int64_t render_seed = 4321;
+
+int main(int argc, char** argv) {
+    std::string dir = argc > 2 && std::string(argv[1]) == "--dir" ? argv[2] : "renders/reference";
+    const int spp_counts[] = {4, 16, 64};
+    const double cell_sizes[] = {0.05, 0.1, 0.2};
+
+    for (const char* name : {"GHD_scene", "random_scene", "floor_sphere_scene"}) {
+        int width, height;
+        std::vector<unsigned char> reference;
+        if (!read_ppm(dir + "/" + name + ".ppm", width, height, reference) ||
+            width != image_width || height != image_height) {
+            std::cerr << "missing reference " << dir << "/" << name << ".ppm, run regression --update\n";
+            return 1;
+        }
+
+        hittable_list list;
+        srand(69);
+        build_scene(name, list);
+        bvh world(list);
+        scene_view view = default_view(name);
+        camera cam(view.lookfrom, view.lookat, view.vup, view.vfov,
+                   static_cast<double>(image_width) / image_height, view.aperture, view.dist_to_focus);
+        const tile frame{0, 0, image_width, image_height};
+
+        printf("%s %dx%d, depth %d\n", name, image_width, image_height, max_depth);
+        printf("%8s %5s %10s %8s %10s %10s %9s\n", "cell", "spp", "seconds", "rmse", "cells", "cache MB", "speedup");
+
+        // rmse^2 * seconds of the plain renderer, from its last (64 spp) render
+        double noise_time = 0;
+        std::vector<unsigned char> rgb;
+        for (int spp : spp_counts) {
+            auto start = steady_clock::now();
+            render_tile(cam, world, frame, image_width, image_height, spp, max_depth, rgb, nullptr, render_seed);
+            double seconds = duration<double>(steady_clock::now() - start).count();
+            double error = rmse(rgb, reference);
+            noise_time = error * error * seconds;
+            printf("%8s %5d %10.3f %8.4f\n", "off", spp, seconds, error);
+        }
+
+        for (double cell : cell_sizes) {
+            for (int spp : spp_counts) {
+                radiance_cache cache(cell);
+                render_caches caches;
+                caches.radiance = &cache;
+                auto start = steady_clock::now();
+                train_radiance_cache(cache, cam, world, image_width, image_height, max_depth, 1, render_seed);
+                render_tile(cam, world, frame, image_width, image_height, spp, max_depth, rgb, nullptr,
+                            render_seed, &caches);
+                double seconds = duration<double>(steady_clock::now() - start).count();
+                double error = rmse(rgb, reference);
+                printf("%8.2f %5d %10.3f %8.4f %10zu %10.1f %8.2fx\n", cell, spp, seconds, error, cache.cells(),
+                       cache.memory_bytes() / (1024.0 * 1024.0), noise_time / (error * error) / seconds);
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Golden-image and performance regression check
+// Renders every built-in scene at a fixed seed and low spp and compares it
+// against a converged reference image in renders/reference. A render is
+// accepted when its RMSE to the reference stays within the noise level
+// recorded when the references were made and its mean color has not drifted,
+// so changes to sampling order pass while changes to the image do not.
+// Render speed is compared against the recorded samples per second.
+//
+// usage: regression [--update] [--no-perf] [--perf-tolerance 0.2] [--dir renders/reference]
+//   --update re-renders the references and records this machine's baseline
+//   exit status is 0 when every scene passes
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/bvh.h"
+#include "../utils/image_io.h"
+#include "../utils/render.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int image_width = 96;
+const int image_height = 64;
+const int max_depth = 8;
+const int test_spp = 16;
+const int reference_spp = 1024;
+const int perf_spp = 64;
+const int perf_runs = 3;
+const unsigned int render_seed = 1234;
+
+// Allowed growth of the RMSE over the recorded noise level, and of the mean
+// color shift over the recorded one (gamma makes low spp renders biased)
+const double rmse_slack = 1.25;
+const double rmse_floor = 0.002;
+const double shift_tolerance = 0.005;
+
+struct baseline_entry
+{
+    double rmse;
+    double shift;
+    double samples_per_sec;
+};
+
+struct render_result
+{
+    std::vector<unsigned char> rgb;
+    double samples_per_sec;
+};
+
+render_result render_scene(const std::string &name, int samples_per_pixel)
+{
+    hittable_list list;
+    srand(69);
+    build_scene(name, list);
+    bvh world(list);
+
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov,
+               static_cast<double>(image_width) / image_height, view.aperture, view.dist_to_focus);
+
+    render_result result;
+    srand(render_seed);
+    auto start = steady_clock::now();
+    render_tile(cam, world, {0, 0, image_width, image_height}, image_width, image_height,
+                samples_per_pixel, max_depth, result.rgb);
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    result.samples_per_sec = static_cast<double>(image_width) * image_height * samples_per_pixel / seconds;
+    return result;
+}
+
+// Best of a few timed renders, long enough to keep timer noise out
+double measure_throughput(const std::string &name)
+{
+    double best = 0;
+    for (int run = 0; run < perf_runs; run++)
+        best = fmax(best, render_scene(name, perf_spp).samples_per_sec);
+    return best;
+}
+
+// Largest per-channel difference of the image means in [0,1] units
+double mean_shift(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b)
+{
+    double sum[3] = {0, 0, 0};
+    for (size_t i = 0; i < a.size(); i++)
+        sum[i % 3] += a[i] - b[i];
+    double worst = 0;
+    for (double s : sum)
+        worst = fmax(worst, fabs(s) / (a.size() / 3) / 255.0);
+    return worst;
+}
+
+std::map<std::string, baseline_entry> read_baseline(const std::string &path)
+{
+    std::map<std::string, baseline_entry> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string name;
+        baseline_entry entry;
+        if (fields >> name >> entry.rmse >> entry.shift >> entry.samples_per_sec)
+            baseline[name] = entry;
+    }
+    return baseline;
+}
+
+int main(int argc, char **argv)
+{
+    bool update = false;
+    bool check_perf = true;
+    double perf_tolerance = 0.2;
+    std::string dir = "renders/reference";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--update")
+            update = true;
+        else if (arg == "--no-perf")
+            check_perf = false;
+        else if (arg == "--perf-tolerance" && i + 1 < argc)
+            perf_tolerance = std::stod(argv[++i]);
+        else if (arg == "--dir" && i + 1 < argc)
+            dir = argv[++i];
+        else
+        {
+            std::cerr << "usage: regression [--update] [--no-perf] [--perf-tolerance 0.2] [--dir renders/reference]\n";
+            return 2;
+        }
+    }
+
+    const std::vector<std::string> scenes = {
+        "floor_sphere_scene", "three_spheres_scene", "three_spheres_scene2", "three_spheres_scene3",
+        "fov_scene", "random_scene", "GHD_scene"};
+    const std::string baseline_path = dir + "/baseline.txt";
+
+    if (update)
+    {
+        std::ofstream baseline(baseline_path);
+        baseline << "# scene, rmse and mean shift of the " << test_spp << " spp render, samples per second\n";
+        for (const auto &name : scenes)
+        {
+            std::cerr << "Rendering reference " << name << std::endl;
+            auto reference = render_scene(name, reference_spp);
+            auto test = render_scene(name, test_spp);
+            if (!write_ppm(dir + "/" + name + ".ppm", image_width, image_height, reference.rgb))
+            {
+                std::cerr << "cannot write " << dir << "/" << name << ".ppm\n";
+                return 2;
+            }
+            baseline << name << ' ' << rmse(test.rgb, reference.rgb) << ' ' << mean_shift(test.rgb, reference.rgb)
+                     << ' ' << measure_throughput(name) << '\n';
+        }
+        return 0;
+    }
+
+    auto baseline = read_baseline(baseline_path);
+    int failures = 0;
+    printf("%-22s %8s %8s %8s %12s %12s  %s\n", "scene", "rmse", "limit", "shift", "samples/s", "baseline", "result");
+    for (const auto &name : scenes)
+    {
+        int width, height;
+        std::vector<unsigned char> reference;
+        if (!baseline.count(name) ||
+            !read_ppm(dir + "/" + name + ".ppm", width, height, reference) ||
+            width != image_width || height != image_height)
+        {
+            printf("%-22s missing reference, run with --update\n", name.c_str());
+            failures++;
+            continue;
+        }
+
+        auto test = render_scene(name, test_spp);
+        const baseline_entry &base = baseline[name];
+        double error = rmse(test.rgb, reference);
+        double limit = base.rmse * rmse_slack + rmse_floor;
+        double shift = mean_shift(test.rgb, reference);
+        double samples_per_sec = check_perf ? measure_throughput(name) : 0;
+
+        std::string result = "ok";
+        if (error > limit || shift > base.shift + shift_tolerance)
+            result = "IMAGE CHANGED";
+        else if (check_perf && samples_per_sec < base.samples_per_sec * (1 - perf_tolerance))
+            result = "SLOWER";
+        if (result != "ok")
+            failures++;
+
+        printf("%-22s %8.4f %8.4f %8.4f %12.0f %12.0f  %s\n", name.c_str(), error, limit, shift,
+               samples_per_sec, base.samples_per_sec, result.c_str());
+    }
+
+    printf("\n%d of %zu scenes failed\n", failures, scenes.size());
+    return failures == 0 ? 0 : 1;
+}
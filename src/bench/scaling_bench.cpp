@@ -0,0 +1,155 @@
+// Scaling curves of the stress scenes
+// Sweeps the sphere count of a stress_scene over several orders of magnitude
+// and, for every size, traces the same camera rays with 1..N threads.
+// Reports build time, resident memory and Mrays/s per thread count, so the
+// point where the BVH, the memory or the threads stop scaling shows up.
+// Every size is built in its own process so memory numbers don't mix.
+//
+// usage: scaling_bench [--dist uniform|clustered|overlapping] [--mix 0.8/0.15/0.05]
+//                      [--min 1000] [--max 10000000] [--threads N] [--rays 500000] [--csv]
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/resident_memory.h"
+#include "../scenes/scenes.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Closest-hit throughput of a set of rays split evenly over threads
+double trace_mrays(const hittable& world, const std::vector<ray>& rays, int threads) {
+    std::atomic<size_t> hits(0);
+    auto start = steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            size_t begin = rays.size() * t / threads;
+            size_t end = rays.size() * (t + 1) / threads;
+            size_t local_hits = 0;
+            hit_record rec;
+            for (size_t n = begin; n < end; n++)
+                if (world.hit(rays[n], 0.001, infinity, rec)) local_hits++;
+            hits += local_hits;
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    return rays.size() / seconds / 1e6;
+}
+
+void run_size(stress_params params, const std::vector<int>& thread_counts, size_t ray_count, bool csv) {
+    double rss_before = resident_mb("VmRSS");
+
+    auto start = steady_clock::now();
+    hittable_list list = stress_scene(params);
+    bvh world(list);
+    double build_seconds = duration<double>(steady_clock::now() - start).count();
+    double rss = resident_mb("VmRSS") - rss_before;
+    double peak = resident_mb("VmHWM") - rss_before;
+
+    // Camera rays of the default view, the same for every size
+    srand(1);
+    scene_view view = default_view("random_scene");
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    std::vector<ray> rays;
+    rays.reserve(ray_count);
+    for (size_t n = 0; n < ray_count; n++)
+        rays.push_back(cam.get_ray(random_double(), random_double()));
+
+    std::vector<double> mrays;
+    for (int threads : thread_counts)
+        mrays.push_back(trace_mrays(world, rays, threads));
+
+    if (csv) {
+        printf("%s,%zu,%.3f,%.1f,%.1f", distribution_name(params.distribution), params.count, build_seconds, rss, peak);
+        for (double m : mrays) printf(",%.3f", m);
+    }
+    else {
+        printf("%10zu %10.2f %10.0f %10.0f", params.count, build_seconds, rss, peak);
+        for (double m : mrays) printf(" %10.3f", m);
+        printf(" %9.0f%%", 100 * mrays.back() / (mrays.front() * thread_counts.back()));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    stress_params params;
+    size_t min_count = 1000, max_count = 10000000, ray_count = 500000;
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool csv = false;
+    std::string spec;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--csv")
+            csv = true;
+        else if (i + 1 < argc && (arg == "--dist" || arg == "--mix" || arg == "--seed"))
+            spec += (spec.empty() ? "" : ",") + arg.substr(2) + "=" + argv[++i];
+        else if (arg == "--min" && i + 1 < argc)
+            min_count = static_cast<size_t>(std::stod(argv[++i]));
+        else if (arg == "--max" && i + 1 < argc)
+            max_count = static_cast<size_t>(std::stod(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            max_threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--rays" && i + 1 < argc)
+            ray_count = std::max<size_t>(1, std::stoul(argv[++i]));
+        else {
+            std::cerr << "usage: scaling_bench [--dist uniform|clustered|overlapping] [--mix 0.8/0.15/0.05]\n"
+                         "                     [--seed 69] [--min 1000] [--max 10000000] [--threads N]\n"
+                         "                     [--rays 500000] [--csv]\n";
+            return 2;
+        }
+    }
+    if (!parse_stress_params(spec, params)) {
+        std::cerr << "bad --dist, --mix or --seed\n";
+        return 2;
+    }
+
+    // 1, 2, 4, ... and the maximum
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    if (csv) {
+        printf("distribution,spheres,build_s,rss_mb,peak_mb");
+        for (int t : thread_counts) printf(",mrays_%dt", t);
+    }
+    else {
+        printf("%s spheres, %zu camera rays, Mrays/s per thread count\n\n",
+               distribution_name(params.distribution), ray_count);
+        printf("%10s %10s %10s %10s", "spheres", "build s", "rss MB", "peak MB");
+        for (int t : thread_counts) printf(" %9dt", t);
+        printf(" %10s", "efficiency");
+    }
+    printf("\n");
+    fflush(stdout);
+
+    int failures = 0;
+    for (size_t count = min_count; count <= max_count; count *= 10) {
+        params.count = count;
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_size(params, thread_counts, ray_count, csv);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("%10zu failed (out of memory?)\n", count);
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Scene build time and memory of arena storage against shared_ptr objects
+// Builds random_scene scaled up to the requested number of spheres twice,
+// once the old way with a make_shared sphere and material per object in a
+// hittable_list plus a bvh over it, and once with random_scene's sphere_set
+// and scene_arena. Each variant runs in its own process so the resident
+// memory numbers don't mix.
+//
+// usage: scene_bench [spheres] [rays]   (default 10000000 spheres, 200000 rays)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../primitives/sphere.h"
+#include "../utils/bvh.h"
+#include "../utils/hittable_list.h"
+#include "../utils/material.h"
+#include "../utils/resident_memory.h"
+#include "../scenes/scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// random_scene as it was built before the arena, one heap object per sphere and material
+hittable_list random_scene_shared(int grid) {
+    hittable_list world;
+    world.objects.reserve(4 * static_cast<size_t>(grid) * grid + 4);
+    world.add(ground_plane(0, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+
+    for (int a = -grid; a < grid; a++) {
+        for (int b = -grid; b < grid; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if ((center - point3(4, 0.2, 0)).length() <= 0.9) continue;
+
+            shared_ptr<material> sphere_material;
+            if (choose_mat < 0.8) {
+                sphere_material = make_shared<lambertian>(color::random() * color::random());
+            }
+            else if (choose_mat < 0.95) {
+                auto albedo = color::random(0.5, 1);
+                auto fuzz = random_double(0, 0.5);
+                sphere_material = make_shared<metal>(albedo, fuzz);
+            }
+            else {
+                sphere_material = make_shared<dielectric>(1.5);
+            }
+            world.add(make_shared<sphere>(center, 0.2, sphere_material));
+        }
+    }
+
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.0)));
+    return world;
+}
+
+void run_variant(bool use_arena, int grid, size_t ray_count) {
+    double rss_before = resident_mb("VmRSS");
+    srand(69);
+
+    // The sphere_set builds its BVH inside random_scene, so time both together
+    auto start = steady_clock::now();
+    hittable_list list = use_arena ? random_scene(grid) : random_scene_shared(grid);
+    bvh world(list);
+    double build_seconds = duration<double>(steady_clock::now() - start).count();
+    double rss = resident_mb("VmRSS") - rss_before;
+    double peak = resident_mb("VmHWM") - rss_before;
+
+    size_t sphere_count = use_arena ? std::static_pointer_cast<sphere_set>(list.objects[0])->size()
+                                    : list.objects.size() - 1;
+
+    // Camera rays of random_scene's default view
+    scene_view view = default_view("random_scene");
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    size_t hits = 0;
+    start = steady_clock::now();
+    for (size_t n = 0; n < ray_count; n++) {
+        hit_record rec;
+        if (world.hit(cam.get_ray(random_double(), random_double()), 0.001, infinity, rec)) hits++;
+    }
+    double trace_seconds = duration<double>(steady_clock::now() - start).count();
+
+    printf("%-8s %10zu %10.2f %10.0f %10.0f %10.1f %10.3f\n", use_arena ? "arena" : "shared",
+           sphere_count, build_seconds, rss, peak, rss * 1024 * 1024 / sphere_count,
+           ray_count / trace_seconds / 1e6);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    size_t ray_count = argc > 2 ? std::stoul(argv[2]) : 200000;
+
+    // (2*grid)^2 cells with one sphere each
+    int grid = std::max(1, static_cast<int>(ceil(sqrt(static_cast<double>(count)) / 2)));
+
+    printf("random_scene grid %d\n\n", grid);
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "storage", "spheres", "build s",
+           "rss MB", "peak MB", "bytes/obj", "Mrays/s");
+    fflush(stdout);
+
+    int failures = 0;
+    for (bool use_arena : {false, true}) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_variant(use_arena, grid, ray_count);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("%-8s failed (out of memory?)\n", use_arena ? "arena" : "shared");
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// Tail latency of tile schedules
+// Renders a scene with skewed cost once per schedule, timing every tile on a
+// single thread, then replays the measured tile times on T simulated workers
+// that each take the next tile in list order. The makespan against the
+// ideal total / T is the tail the last busy workers add. Schedules:
+//   rows      one horizontal band per worker (static split)
+//   scanline  32x32 tiles top to bottom (render_daemon's old order)
+//   lpt       tiles sized and ordered by the pre-pass estimate
+// The same measured tiles are also dealt to render nodes, as contiguous
+// bands against assign_shards. Reports how well the pre-pass predicted the
+// measured tile times, and on a multi-core machine a real threaded render.
+//
+// usage: schedule_bench [scene] [width] [spp] [depth]
+//        (default stress:count=2e4,dist=clustered 384 8 8)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/render.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct timed_tile {
+    tile t;
+    double seconds;
+};
+
+// Renders every tile in list order on one thread and times it
+std::vector<timed_tile> measure(const camera& cam, const hittable& world, const std::vector<tile>& tiles,
+                                int width, int height, int spp, int depth) {
+    std::vector<timed_tile> timed;
+    render_tiles(cam, world, tiles, width, height, spp, depth, 1, 1,
+                 [&](const tile& t, const std::vector<unsigned char>&, double seconds) {
+                     timed.push_back({t, seconds});
+                     return true;
+                 });
+    return timed;
+}
+
+// Finish time of the last of `workers` workers taking tiles in list order
+double makespan(const std::vector<timed_tile>& timed, int workers) {
+    std::priority_queue<double, std::vector<double>, std::greater<double>> free_at;
+    for (int w = 0; w < workers; w++) free_at.push(0);
+    double last = 0;
+    for (const auto& t : timed) {
+        double finish = free_at.top() + t.seconds;
+        free_at.pop();
+        free_at.push(finish);
+        last = std::max(last, finish);
+    }
+    return last;
+}
+
+// One horizontal band of rows per worker, fixed before the render
+std::vector<tile> row_bands(int width, int height, int bands) {
+    std::vector<tile> tiles;
+    for (int b = 0; b < bands; b++) {
+        int y0 = height * b / bands, y1 = height * (b + 1) / bands;
+        if (y1 > y0) tiles.push_back({0, y0, width, y1});
+    }
+    return tiles;
+}
+
+double total_seconds(const std::vector<timed_tile>& timed) {
+    double sum = 0;
+    for (const auto& t : timed) sum += t.seconds;
+    return sum;
+}
+
+// Pearson correlation of estimated and measured tile cost
+double correlation(const cost_map& estimate, const std::vector<timed_tile>& timed) {
+    double n = timed.size(), sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (const auto& t : timed) {
+        double x = estimate.cost(t.t), y = t.seconds;
+        sx += x; sy += y; sxx += x * x; syy += y * y; sxy += x * y;
+    }
+    double den = sqrt((n * sxx - sx * sx) * (n * syy - sy * sy));
+    return den > 0 ? (n * sxy - sx * sy) / den : 0;
+}
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "stress:count=2e4,dist=clustered";
+    int width = argc > 2 ? std::stoi(argv[2]) : 384;
+    int spp = argc > 3 ? std::stoi(argv[3]) : 8;
+    int depth = argc > 4 ? std::stoi(argv[4]) : 8;
+    int height = static_cast<int>(width / 1.5);
+
+    hittable_list list;
+    srand(69);
+    if (!build_scene(name, list)) {
+        std::cerr << "cannot build scene " << name << "\n";
+        return 1;
+    }
+    bvh world(list);
+
+    scene_view view = default_view(name);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+
+    auto start = steady_clock::now();
+    cost_map estimate = estimate_cost(cam, world, width, height, depth);
+    double estimate_seconds = duration<double>(steady_clock::now() - start).count();
+
+    tile frame{0, 0, width, height};
+    const int worker_counts[] = {2, 4, 8, 16, 32};
+
+    printf("%s %dx%d, %d spp, depth %d\n", name.c_str(), width, height, spp, depth);
+
+    // Measured once per schedule, rows per worker count since the split depends on it
+    std::vector<timed_tile> scanline = measure(cam, world, split_tiles(frame, 32), width, height, spp, depth);
+    std::vector<tile> lpt_tiles = plan_tiles(estimate, frame, static_cast<int>(scanline.size()));
+    std::vector<timed_tile> lpt = measure(cam, world, lpt_tiles, width, height, spp, depth);
+    double total = total_seconds(lpt);
+
+    printf("pre-pass %.3f s (%.1f%% of the render), estimate/measured tile correlation %.3f\n\n",
+           estimate_seconds, 100 * estimate_seconds / total, correlation(estimate, lpt));
+
+    printf("simulated makespan over ideal (total / workers), %zu scanline and %zu lpt tiles\n",
+           scanline.size(), lpt.size());
+    printf("%8s %10s %10s %10s %10s\n", "workers", "ideal s", "rows", "scanline", "lpt");
+    for (int workers : worker_counts) {
+        std::vector<timed_tile> rows = measure(cam, world, row_bands(width, height, workers),
+                                               width, height, spp, depth);
+        double ideal = total_seconds(rows) / workers;
+        printf("%8d %10.3f %9.2fx %9.2fx %9.2fx\n", workers, ideal, makespan(rows, workers) / ideal,
+               makespan(scanline, workers) / (total_seconds(scanline) / workers),
+               makespan(lpt, workers) / (total / workers));
+    }
+
+    // Render nodes get their tiles up front, so a slow shard can't be helped out
+    printf("\nslowest shard over ideal, the lpt tiles split between nodes\n");
+    printf("%8s %10s %10s\n", "nodes", "bands", "balanced");
+    for (int nodes : {2, 4, 8}) {
+        double ideal = total / nodes;
+        std::vector<double> bands(nodes, 0), balanced(nodes, 0);
+        for (const auto& t : lpt) {
+            int band = std::min(nodes - 1, (t.t.y0 + t.t.y1) / 2 * nodes / height);
+            bands[band] += t.seconds;
+        }
+        auto shards = assign_shards(estimate, lpt_tiles, nodes);
+        for (int k = 0; k < nodes; k++)
+            for (const auto& t : shards[k])
+                for (const auto& m : lpt)
+                    if (m.t.x0 == t.x0 && m.t.y0 == t.y0 && m.t.x1 == t.x1 && m.t.y1 == t.y1)
+                        balanced[k] += m.seconds;
+        printf("%8d %9.2fx %9.2fx\n", nodes, *std::max_element(bands.begin(), bands.end()) / ideal,
+               *std::max_element(balanced.begin(), balanced.end()) / ideal);
+    }
+
+    // Wall clock with real threads, only meaningful with several cores
+    int threads = std::thread::hardware_concurrency();
+    if (threads > 1) {
+        printf("\nthreaded render, %d threads\n", threads);
+        for (const char* schedule : {"scanline", "lpt"}) {
+            std::vector<tile> tiles = schedule[0] == 'l' ? lpt_tiles : split_tiles(frame, 32);
+            double last_tile = 0;
+            start = steady_clock::now();
+            render_tiles(cam, world, tiles, width, height, spp, depth, threads, 1,
+                         [&](const tile&, const std::vector<unsigned char>&, double) {
+                             last_tile = duration<double>(steady_clock::now() - start).count();
+                             return true;
+                         });
+            printf("%8s %8.3f s wall, ideal %.3f s\n", schedule, last_tile, total / threads);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Runs every SIMD kernel variant the current CPU supports
+// Times sphere intersection, the wide BVH node test, tonemapping and vec3
+// batch ops per instruction set and checks every variant returns exactly
+// what the scalar kernels return.
+//
+// usage: simd_bench [--isa scalar|sse4.2|avx2|avx512] [--scale 1]
+//   --isa benchmarks only that variant (plus scalar for checking)
+//   --scale multiplies the amount of work per kernel
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/triangle_mesh.h"
+#include "../utils/bvh.h"
+#include "../utils/simd_dispatch.h"
+#include "../utils/wide_bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Keeps results alive so the timed loops are not optimized away
+volatile double sink;
+
+struct kernel_inputs {
+    // Spheres
+    std::vector<double> cx, cy, cz, radius;
+    std::vector<ray> rays;
+
+    // Wide BVH nodes and rays tested against them
+    std::vector<wide_bvh_node> nodes;
+    std::vector<wide_ray> node_rays;
+    // Axis-parallel rays starting exactly on a plane of a node's child,
+    // whose slab distances on that axis are 0 * inf = NaN
+    std::vector<std::pair<size_t, wide_ray>> plane_rays;
+
+    // Pixels and vectors
+    std::vector<color> pixels;
+    std::vector<vec3> x;
+};
+
+kernel_inputs make_inputs(int scale) {
+    kernel_inputs in;
+
+    // A small set of spheres tested by every ray
+    for (int i = 0; i < 64; i++) {
+        point3 c = vec3::random(-4, 4);
+        in.cx.push_back(c.x());
+        in.cy.push_back(c.y());
+        in.cz.push_back(c.z());
+        in.radius.push_back(random_double(0.1, 1.0));
+    }
+    for (int i = 0; i < 20000 * scale; i++) {
+        point3 origin = 10 * random_unit_vector();
+        in.rays.push_back(ray(origin, vec3::random(-3, 3) - origin));
+    }
+
+    // Nodes of a real tree over a random triangle soup
+    std::vector<aabb> boxes;
+    for (int i = 0; i < 100000; i++) {
+        point3 c = vec3::random(-1, 1);
+        boxes.push_back(aabb(c - vec3(0.01, 0.01, 0.01), c + vec3(0.01, 0.01, 0.01)));
+    }
+    bvh_tree tree;
+    tree.build(boxes, 4);
+    wide_bvh wide(tree);
+    in.nodes = wide.nodes;
+    for (int i = 0; i < 64; i++) {
+        point3 origin = 4 * random_unit_vector();
+        in.node_rays.push_back(wide_ray(ray(origin, vec3::random(-1, 1) - origin)));
+    }
+    for (size_t n = 0; n < in.nodes.size(); n += 97) {
+        const wide_bvh_node& node = in.nodes[n];
+        for (int c = 0; c < node.child_count; c++)
+            for (int a = 0; a < 3; a++) {
+                wide_ray r(ray(point3(0, 0, 0), vec3::random(-1, 1)));
+                for (int b = 0; b < 3; b++) {
+                    float scale = ldexpf(1.0f, node.exponent[b]);
+                    float lo = node.origin[b] + node.bounds[b][c] * scale;
+                    float hi = node.origin[b] + node.bounds[b][4 + c] * scale;
+                    r.origin[b] = b == a ? lo : 0.5f * (lo + hi);
+                }
+                r.inv_dir[a] = 1.0f / 0.0f;
+                in.plane_rays.push_back({n, r});
+            }
+    }
+
+    for (int i = 0; i < 1000000 * scale; i++) {
+        in.pixels.push_back(16 * color::random());
+        in.x.push_back(vec3::random(-1, 1));
+    }
+    return in;
+}
+
+struct kernel_result {
+    double seconds[4];
+    bool matches[4];
+};
+
+kernel_result run(const simd_kernels& k, const simd_kernels& reference, const kernel_inputs& in) {
+    kernel_result result;
+
+    // Sphere intersection
+    sphere_soa spheres = {in.cx.data(), in.cy.data(), in.cz.data(), in.radius.data(), in.cx.size()};
+    auto start = steady_clock::now();
+    double sum = 0;
+    for (const ray& r : in.rays) {
+        double t;
+        if (k.hit_spheres(spheres, r, 0.001, infinity, t) >= 0) sum += t;
+    }
+    result.seconds[0] = duration<double>(steady_clock::now() - start).count();
+    bool same = true;
+    for (const ray& r : in.rays) {
+        double t, t_ref;
+        int hit = k.hit_spheres(spheres, r, 0.001, infinity, t);
+        int hit_ref = reference.hit_spheres(spheres, r, 0.001, infinity, t_ref);
+        same = same && hit == hit_ref && (hit < 0 || t == t_ref);
+    }
+    result.matches[0] = same;
+
+    // Node tests
+    start = steady_clock::now();
+    int masks = 0;
+    for (const wide_ray& r : in.node_rays) {
+        for (const wide_bvh_node& node : in.nodes) {
+            float t_near[4];
+            masks += k.wide_node_test(node, r, 0.0f, 1e30f, t_near);
+        }
+    }
+    result.seconds[1] = duration<double>(steady_clock::now() - start).count();
+    same = true;
+    for (size_t n = 0; n < in.nodes.size() && same; n++) {
+        for (const wide_ray& r : in.node_rays) {
+            float t_near[4], t_near_ref[4];
+            int mask = k.wide_node_test(in.nodes[n], r, 0.0f, 1e30f, t_near);
+            int mask_ref = reference.wide_node_test(in.nodes[n], r, 0.0f, 1e30f, t_near_ref);
+            same = same && mask == mask_ref;
+            for (int c = 0; c < 4; c++)
+                if (mask & (1 << c)) same = same && t_near[c] == t_near_ref[c];
+        }
+    }
+    for (const auto& plane_ray : in.plane_rays) {
+        const wide_bvh_node& node = in.nodes[plane_ray.first];
+        float t_near[4], t_near_ref[4];
+        int mask = k.wide_node_test(node, plane_ray.second, 0.0f, 1e30f, t_near);
+        int mask_ref = reference.wide_node_test(node, plane_ray.second, 0.0f, 1e30f, t_near_ref);
+        same = same && mask == mask_ref;
+    }
+    result.matches[1] = same;
+    sum += masks;
+
+    // Tonemapping
+    std::vector<unsigned char> rgb(3 * in.pixels.size()), rgb_ref(3 * in.pixels.size());
+    start = steady_clock::now();
+    k.tonemap(in.pixels.data(), in.pixels.size(), 1.0 / 16, rgb.data());
+    result.seconds[2] = duration<double>(steady_clock::now() - start).count();
+    reference.tonemap(in.pixels.data(), in.pixels.size(), 1.0 / 16, rgb_ref.data());
+    result.matches[2] = rgb == rgb_ref;
+
+    // vec3 batch axpy
+    std::vector<vec3> y(in.x.size()), y_ref(in.x.size());
+    start = steady_clock::now();
+    for (int pass = 0; pass < 8; pass++) k.vec3_axpy(0.5, in.x.data(), y.data(), y.size());
+    result.seconds[3] = duration<double>(steady_clock::now() - start).count();
+    for (int pass = 0; pass < 8; pass++) reference.vec3_axpy(0.5, in.x.data(), y_ref.data(), y_ref.size());
+    result.matches[3] = memcmp(y.data(), y_ref.data(), y.size() * sizeof(vec3)) == 0;
+
+    sink = sum;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int only = -1;
+    int scale = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        simd_isa isa;
+        if (arg == "--isa" && i + 1 < argc && parse_isa(argv[i + 1], isa)) {
+            only = isa;
+            i++;
+        }
+        else if (arg == "--scale" && i + 1 < argc) {
+            scale = std::max(1, std::stoi(argv[++i]));
+        }
+        else {
+            std::cerr << "usage: simd_bench [--isa scalar|sse4.2|avx2|avx512] [--scale 1]\n";
+            return 2;
+        }
+    }
+
+    srand(1);
+    kernel_inputs in = make_inputs(scale);
+    const simd_kernels& reference = kernels_for(isa_scalar);
+
+    printf("cpu best %s, renderer uses %s\n\n", isa_name(best_isa()), isa_name(simd().isa));
+    printf("%-8s %14s %14s %14s %14s\n", "isa", "spheres ms", "node test ms", "tonemap ms", "vec3 axpy ms");
+
+    const char* kernel_names[4] = {"spheres", "node test", "tonemap", "vec3 axpy"};
+    double scalar_seconds[4] = {0, 0, 0, 0};
+    int failures = 0;
+    for (int i = 0; i < isa_count; i++) {
+        simd_isa isa = static_cast<simd_isa>(i);
+        if (only >= 0 && i != only && i != isa_scalar) continue;
+        if (!isa_supported(isa)) {
+            printf("%-8s %14s\n", isa_name(isa), "not supported");
+            continue;
+        }
+
+        kernel_result result = run(kernels_for(isa), reference, in);
+        if (isa == isa_scalar)
+            for (int k = 0; k < 4; k++) scalar_seconds[k] = result.seconds[k];
+
+        printf("%-8s", isa_name(isa));
+        for (int k = 0; k < 4; k++) {
+            char cell[32];
+            snprintf(cell, sizeof(cell), "%.2f (%.2fx)", 1000 * result.seconds[k],
+                     scalar_seconds[k] / result.seconds[k]);
+            printf(" %14s", cell);
+        }
+        printf("\n");
+
+        for (int k = 0; k < 4; k++) {
+            if (!result.matches[k]) {
+                printf("  %s %s differs from scalar\n", isa_name(isa), kernel_names[k]);
+                failures++;
+            }
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
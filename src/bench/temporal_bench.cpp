@@ -0,0 +1,150 @@
+// Temporal sample reuse on a turntable
+// Orbits the camera around a scene by a few degrees per frame and renders
+// every frame of the sequence independently at 1 to 32 spp and with
+// temporal_frame (history reprojected from the frame before) at 1 to 4 new
+// spp. Reports the mean time per frame and the RMSE against a high spp
+// reference of each frame over the second half of the sequence (after the
+// history has filled up), the share of pixels that reused history, and the
+// independent spp and time of equal RMSE (interpolated on the log-log
+// curve of the independent frames). The reference has noise of its own,
+// about a third of the 32 spp error at the default 256 spp.
+//
+// usage: temporal_bench [scene] [width] [frames] [degrees per frame] [reference spp]
+//        (default GHD_scene 192 16 2 256)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../utils/bvh.h"
+#include "../utils/render.h"
+#include "../utils/temporal.h"
+#include "../utils/tile_scheduler.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int max_depth = 8;
+
+// The whole frame the normal way, tonemapped
+std::vector<unsigned char> full_render(const camera& cam, const hittable& world, int width, int height, int spp,
+                                       int threads, int64_t seed) {
+    std::vector<unsigned char> rgb(3 * static_cast<size_t>(width) * height);
+    render_tiles(cam, world, split_tiles({0, 0, width, height}, 32), width, height, spp, max_depth, threads, seed,
+                 [&](const tile& t, const std::vector<unsigned char>& tile_rgb, double) {
+                     size_t k = 0;
+                     for (int y = t.y0; y < t.y1; y++)
+                         for (int x = t.x0; x < t.x1; x++, k += 3)
+                             std::copy(tile_rgb.begin() + k, tile_rgb.begin() + k + 3,
+                                       rgb.begin() + 3 * (static_cast<size_t>(y) * width + x));
+                     return true;
+                 });
+    return rgb;
+}
+
+struct result {
+    int spp;
+    double ms;    // mean per frame
+    double error; // mean RMSE over the measured frames
+    double reused;
+};
+
+int main(int argc, char** argv) {
+    std::string name = argc > 1 ? argv[1] : "GHD_scene";
+    int width = argc > 2 ? std::stoi(argv[2]) : 192;
+    int frames = argc > 3 ? std::stoi(argv[3]) : 16;
+    double step = argc > 4 ? std::stod(argv[4]) : 2;
+    int reference_spp = argc > 5 ? std::stoi(argv[5]) : 256;
+    int height = static_cast<int>(width / 1.5);
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int first_measured = frames / 2;
+
+    hittable_list list;
+    srand(69);
+    if (!build_scene(name, list)) {
+        fprintf(stderr, "unknown scene %s\n", name.c_str());
+        return 1;
+    }
+    bvh world(list);
+
+    // The camera orbits the point it looks at around the vertical axis
+    scene_view view = default_view(name);
+    std::vector<camera> cams;
+    for (int f = 0; f < frames; f++) {
+        double a = degrees_to_radians(step * f);
+        vec3 offset = view.lookfrom - view.lookat;
+        vec3 turned(cos(a) * offset.x() + sin(a) * offset.z(), offset.y(), -sin(a) * offset.x() + cos(a) * offset.z());
+        cams.emplace_back(view.lookat + turned, view.lookat, view.vup, view.vfov, 1.5, view.aperture,
+                          view.dist_to_focus);
+    }
+
+    printf("%s at %dx%d, %d frames turning %.1f degrees each, %d threads\n", name.c_str(), width, height, frames, step,
+           threads);
+    printf("references at %d spp, RMSE and time over frames %d to %d\n\n", reference_spp, first_measured, frames - 1);
+    fflush(stdout);
+    std::vector<std::vector<unsigned char>> references;
+    for (int f = 0; f < frames; f++)
+        references.push_back(full_render(cams[f], world, width, height, reference_spp, threads, 1000 + f));
+
+    std::vector<result> independent;
+    for (int spp : {1, 2, 4, 8, 16, 32}) {
+        result r = {spp, 0, 0, 0};
+        for (int f = first_measured; f < frames; f++) {
+            auto start = steady_clock::now();
+            std::vector<unsigned char> rgb = full_render(cams[f], world, width, height, spp, threads, f);
+            r.ms += 1e3 * duration<double>(steady_clock::now() - start).count();
+            r.error += rmse(rgb, references[f]);
+        }
+        r.ms /= frames - first_measured;
+        r.error /= frames - first_measured;
+        independent.push_back(r);
+    }
+
+    std::vector<result> temporal;
+    for (int spp : {1, 2, 4}) {
+        result r = {spp, 0, 0, 0};
+        temporal_frame frame(width, height, spp, max_depth);
+        std::vector<unsigned char> rgb;
+        for (int f = 0; f < frames; f++) {
+            auto start = steady_clock::now();
+            size_t reused = frame.render(cams[f], world, f, threads);
+            frame.resolve(rgb);
+            if (f < first_measured) continue;
+            r.ms += 1e3 * duration<double>(steady_clock::now() - start).count();
+            r.error += rmse(rgb, references[f]);
+            r.reused += static_cast<double>(reused) / frame.radiance.size();
+        }
+        r.ms /= frames - first_measured;
+        r.error /= frames - first_measured;
+        r.reused /= frames - first_measured;
+        temporal.push_back(r);
+    }
+
+    printf("%-12s %5s %10s %8s %8s\n", "mode", "spp", "ms/frame", "RMSE", "reused");
+    for (const result& r : independent)
+        printf("%-12s %5d %10.1f %8.4f %8s\n", "independent", r.spp, r.ms, r.error, "");
+    for (const result& r : temporal)
+        printf("%-12s %5d %10.1f %8.4f %7.1f%%\n", "temporal", r.spp, r.ms, r.error, 100 * r.reused);
+
+    // Independent frames of the same RMSE, log-log between the two nearest
+    printf("\n%-12s %14s %12s %10s\n", "temporal spp", "equal RMSE spp", "ms/frame", "speedup");
+    for (const result& t : temporal) {
+        size_t k = 1;
+        while (k + 1 < independent.size() && independent[k].error > t.error) k++;
+        const result &a = independent[k - 1], &b = independent[k];
+        double f = log(t.error / a.error) / log(b.error / a.error);
+        double spp = exp(log(a.spp) + f * (log(b.spp) - log(a.spp)));
+        double ms = exp(log(a.ms) + f * (log(b.ms) - log(a.ms)));
+        bool extrapolated = f < 0 || f > 1;
+        printf("%-12d %14.1f %12.1f %9.2fx%s\n", t.spp, spp, ms, ms / t.ms, extrapolated ? "   (extrapolated)" : "");
+    }
+    printf("(history buffers %.1f MB)\n", temporal_frame(width, height, 1, max_depth).memory_bytes() / 1048576.0);
+    return 0;
+}
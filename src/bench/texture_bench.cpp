@@ -0,0 +1,184 @@
+// Texture cache hit rate and footprint filtering
+// Writes a set of procedural textures (color albedo maps and one roughness
+// map) into a directory, larger together than the smaller caches, then
+// renders a grid of textured spheres on a textured ground plane through
+// caches of several sizes. Every render is done twice: with mip levels
+// picked by the ray footprint, and with every lookup forced to level 0 (no
+// filtering, what a renderer without ray cones would do). Reports render
+// time, cache hit rate, bytes read from disk, resident tile memory and the
+// RMS difference between the two images (aliasing of the unfiltered one).
+//
+// usage: texture_bench [directory] [texture size] [threads]
+//        (default /tmp/ghd_textures, 2048, hardware threads)
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../primitives/plane.h"
+#include "../primitives/sphere.h"
+#include "../utils/bvh.h"
+#include "../utils/hittable_list.h"
+#include "../utils/material.h"
+#include "../utils/render.h"
+#include "../utils/texture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const int albedo_count = 6;
+
+// A tinted checkerboard with fine stripes, detail at every scale
+std::vector<unsigned char> pattern(int size, int seed, int channels) {
+    std::vector<unsigned char> texels(static_cast<size_t>(size) * size * channels);
+    rng generator(seed);
+    double tint[3] = {0.3 + 0.7 * (generator.next() / 4294967296.0), 0.3 + 0.7 * (generator.next() / 4294967296.0),
+                      0.3 + 0.7 * (generator.next() / 4294967296.0)};
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            bool check = ((x / (size / 16)) + (y / (size / 16))) % 2;
+            bool stripe = (x + y) % 6 < 3;
+            double value = (check ? 0.8 : 0.3) * (stripe ? 1.0 : 0.6);
+            for (int c = 0; c < channels; c++)
+                texels[(static_cast<size_t>(y) * size + x) * channels + c] =
+                    static_cast<unsigned char>(255 * value * (channels == 3 ? tint[c] : 1.0));
+        }
+    }
+    return texels;
+}
+
+// Writes the textures if they aren't there yet, returns false if one can't be written
+bool write_textures(const std::string& dir, int size) {
+    mkdir(dir.c_str(), 0755);
+    for (int k = 0; k <= albedo_count; k++) {
+        bool roughness = k == albedo_count;
+        std::string path = dir + (roughness ? "/roughness.tex" : "/albedo" + std::to_string(k) + ".tex");
+        struct stat existing;
+        texture_file_header header;
+        FILE* f = fopen(path.c_str(), "rb");
+        bool current = f && fread(&header, sizeof(header), 1, f) == 1 && header.width == static_cast<uint32_t>(size);
+        if (f) fclose(f);
+        if (current && stat(path.c_str(), &existing) == 0) continue;
+        if (!write_texture(path, size, size, roughness ? 1 : 3, pattern(size, k + 1, roughness ? 1 : 3), !roughness))
+            return false;
+    }
+    return true;
+}
+
+hittable_list textured_grid(const std::string& dir, shared_ptr<texture_cache> cache) {
+    std::vector<shared_ptr<texture>> albedo;
+    for (int k = 0; k < albedo_count; k++)
+        albedo.push_back(load_texture(dir + "/albedo" + std::to_string(k) + ".tex", cache));
+    shared_ptr<texture> roughness = load_texture(dir + "/roughness.tex", cache);
+
+    hittable_list world;
+    auto ground = make_shared<plane>(point3(0, 0, 0), vec3(0, 1, 0), make_shared<lambertian>(albedo[0]));
+    ground->texture_scale = 4;
+    world.add(ground);
+    int k = 1;
+    for (int a = -3; a <= 3; a++) {
+        for (int b = -3; b <= 3; b++, k++) {
+            point3 center(a * 1.4, 0.5, b * 1.4);
+            shared_ptr<material> m;
+            if (k % 4 == 0)
+                m = make_shared<metal>(color(0.8, 0.8, 0.8), 0.6, albedo[k % albedo_count], roughness);
+            else
+                m = make_shared<lambertian>(albedo[k % albedo_count]);
+            world.add(make_shared<sphere>(center, 0.5, m));
+        }
+    }
+    return world;
+}
+
+// Renders width x height at spp samples into linear colors, rows split
+// over the threads. Without filtering every ray has a zero footprint.
+std::vector<color> render(const camera& cam, const hittable& world, int width, int height, int spp, int depth,
+                          int threads, bool filtered) {
+    std::vector<color> image(static_cast<size_t>(width) * height);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (int y = t; y < height; y += threads) {
+                for (int x = 0; x < width; x++) {
+                    rng generator(1, static_cast<uint64_t>(y) * width + x);
+                    thread_rng = &generator;
+                    int j = height - 1 - y;
+                    ray_cone cone = {0, filtered ? cam.pixel_spread(height) : 0.0};
+                    color sum(0, 0, 0);
+                    for (int s = 0; s < spp; s++) {
+                        ray r = cam.get_ray((x + random_double()) / (width - 1), (j + random_double()) / (height - 1));
+                        sum += ray_color(r, world, depth, nullptr, nullptr, 0, cone);
+                    }
+                    image[static_cast<size_t>(y) * width + x] = sum / spp;
+                }
+            }
+            thread_rng = nullptr;
+        });
+    }
+    for (auto& w : workers) w.join();
+    return image;
+}
+
+int main(int argc, char** argv) {
+    std::string dir = argc > 1 ? argv[1] : "/tmp/ghd_textures";
+    int size = argc > 2 ? std::stoi(argv[2]) : 2048;
+    int threads = argc > 3 ? std::stoi(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+    const int width = 720, height = 480, spp = 4, depth = 4;
+
+    auto start = steady_clock::now();
+    if (!write_textures(dir, size)) {
+        fprintf(stderr, "cannot write textures to %s\n", dir.c_str());
+        return 1;
+    }
+    double texture_mb = 0;
+    for (int k = 0; k <= albedo_count; k++) {
+        struct stat file;
+        std::string path = dir + (k == albedo_count ? "/roughness.tex" : "/albedo" + std::to_string(k) + ".tex");
+        if (stat(path.c_str(), &file) == 0) texture_mb += file.st_size / (1024.0 * 1024.0);
+    }
+    printf("%d textures of %dx%d, %.0f MB on disk (ready in %.1f s)\n", albedo_count + 1, size, size, texture_mb,
+           duration<double>(steady_clock::now() - start).count());
+    printf("%dx%d at %d spp, depth %d, %d threads\n\n", width, height, spp, depth, threads);
+
+    camera cam(point3(9, 4, 9), point3(0, 0, 0), vec3(0, 1, 0), 35, 1.5, 0.0, 12.0);
+    printf("%8s %-9s %9s %9s %10s %10s %10s %9s\n", "cache MB", "lookup", "seconds", "hit rate", "MB read",
+           "resident", "evictions", "rms diff");
+    for (int cache_mb : {4, 16, 64, 256}) {
+        std::vector<color> images[2];
+        for (int filtered = 1; filtered >= 0; filtered--) {
+            auto cache = make_shared<texture_cache>(static_cast<size_t>(cache_mb) << 20);
+            hittable_list list = textured_grid(dir, cache);
+            bvh world(list);
+            start = steady_clock::now();
+            images[filtered] = render(cam, world, width, height, spp, depth, threads, filtered);
+            double seconds = duration<double>(steady_clock::now() - start).count();
+            texture_cache_stats stats = cache->stats();
+
+            double diff = 0;
+            if (!filtered) {
+                for (size_t p = 0; p < images[0].size(); p++) {
+                    // In display units, through the gamma 2 tonemap
+                    for (int c = 0; c < 3; c++) {
+                        double d = sqrt(fmax(images[0][p][c], 0.0)) - sqrt(fmax(images[1][p][c], 0.0));
+                        diff += d * d;
+                    }
+                }
+                diff = sqrt(diff / (3.0 * images[0].size()));
+            }
+            printf("%8d %-9s %9.2f %8.1f%% %10.1f %9.1fM %10llu ", cache_mb, filtered ? "footprint" : "level 0",
+                   seconds, 100 * stats.hit_rate(), stats.bytes_read / (1024.0 * 1024.0),
+                   stats.memory_bytes / (1024.0 * 1024.0), static_cast<unsigned long long>(stats.evictions));
+            if (filtered) printf("%9s\n", "-");
+            else printf("%9.4f\n", diff);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
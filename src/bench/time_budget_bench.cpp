@@ -0,0 +1,73 @@
+// Deadlines and noise estimates of time-budgeted rendering
+// Renders the built-in scenes at the size of the regression references
+// (renders/reference, 1024 spp) for several wall clock budgets, with uniform
+// and adaptive sample counts, and reports the time actually taken, the
+// samples reached, the renderer's own noise estimate and the real RMSE
+// against the reference. The reference has noise of its own, about a
+// fifth of the 32 spp error, so estimates below that read a bit low.
+//
+// usage: time_budget_bench [--dir renders/reference]
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/bvh.h"
+#include "../utils/image_io.h"
+#include "../utils/progressive.h"
+#include "../scenes/scenes.h"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+const int image_width = 96;
+const int image_height = 64;
+const int max_depth = 8;
+
+int main(int argc, char** argv) {
+    std::string dir = argc > 2 && std::string(argv[1]) == "--dir" ? argv[2] : "renders/reference";
+    const double budgets[] = {0.25, 0.5, 1, 2};
+    int overruns = 0;
+
+    for (const char* name : {"GHD_scene", "random_scene", "floor_sphere_scene"}) {
+        int width, height;
+        std::vector<unsigned char> reference;
+        if (!read_ppm(dir + "/" + name + ".ppm", width, height, reference) ||
+            width != image_width || height != image_height) {
+            std::cerr << "missing reference " << dir << "/" << name << ".ppm, run regression --update\n";
+            return 1;
+        }
+
+        hittable_list list;
+        srand(69);
+        build_scene(name, list);
+        bvh world(list);
+        scene_view view = default_view(name);
+        camera cam(view.lookfrom, view.lookat, view.vup, view.vfov,
+                   static_cast<double>(image_width) / image_height, view.aperture, view.dist_to_focus);
+
+        printf("%s %dx%d, depth %d\n", name, image_width, image_height, max_depth);
+        printf("%8s %9s %8s %7s %13s %10s %8s\n", "budget", "mode", "seconds", "passes", "spp", "est noise", "rmse");
+        for (double budget : budgets) {
+            for (bool adaptive : {false, true}) {
+                progressive_frame frame(image_width, image_height);
+                progressive_report report = render_progressive(cam, world, frame, max_depth, 1, 4321, budget,
+                                                               adaptive, [](const progressive_report&) {});
+                std::vector<unsigned char> rgb;
+                frame.resolve(rgb);
+
+                char spp[32];
+                snprintf(spp, sizeof spp, report.min_spp == report.max_spp ? "%d" : "%d-%d",
+                         report.min_spp, report.max_spp);
+                printf("%8.2f %9s %8.3f %7d %13s %10.4f %8.4f%s\n", budget, adaptive ? "adaptive" : "uniform",
+                       report.seconds, report.passes, spp, report.noise, rmse(rgb, reference),
+                       report.seconds > budget ? "  over" : "");
+                overruns += report.seconds > budget;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    printf("%d renders over budget\n", overruns);
+    return overruns == 0 ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// Per-function timings of vec3
+// vec3 is picked when compiling (see vec3.h), so build this once per
+// layout and compare the tables:
+//   g++ -O2 src/bench/vec3_bench.cpp                          three doubles, scalar code
+//   g++ -O2 -DGHD_SSE_VEC3 src/bench/vec3_bench.cpp           four lanes, SSE2
+//   g++ -O2 -mavx2 -DGHD_SCALAR_VEC3 src/bench/vec3_bench.cpp three doubles, AVX2 code
+//   g++ -O2 -mavx2 src/bench/vec3_bench.cpp                   four lanes, AVX2
+// Every operation runs over arrays that fit in L2, storing its results,
+// and the checksum printed with each line has to be the same for every
+// build. The last lines time the code the operators are used in: sphere
+// hits, camera rays, material scattering and a small render. Every time
+// is the best of five runs.
+//
+// usage: vec3_bench [--scale 1]
+
+#include "../utils/rtweekend.h"
+
+#include "../primitives/camera.h"
+#include "../primitives/sphere.h"
+#include "../utils/bvh.h"
+#include "../utils/material.h"
+#include "../utils/render.h"
+#include "../scenes/scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+const size_t count = 4096;
+
+struct inputs {
+    std::vector<vec3> a, b, n;
+    std::vector<double> t;
+};
+
+// Sum of the bits of every result, the same for every vec3 layout when
+// their results are identical
+struct checksum {
+    uint64_t sum = 0;
+    void add(double x) {
+        uint64_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        sum = sum * 31 + bits;
+    }
+    void add(const vec3& v) {
+        add(v.x());
+        add(v.y());
+        add(v.z());
+    }
+};
+
+// Runs op(i) for every element passes times, and prints the best of five
+// such runs in nanoseconds per call and the checksum of the results
+template <typename op_fn, typename result_t>
+void time_op(const char* name, int passes, std::vector<result_t>& out, op_fn&& op) {
+    double seconds = infinity;
+    for (int run = 0; run < 5; run++) {
+        auto start = steady_clock::now();
+        for (int pass = 0; pass < passes; pass++)
+            for (size_t i = 0; i < count; i++) out[i] = op(i);
+        seconds = fmin(seconds, duration<double>(steady_clock::now() - start).count());
+    }
+    checksum c;
+    for (const result_t& r : out) c.add(r);
+    printf("%-22s %8.2f ns   %016llx\n", name, 1e9 * seconds / (static_cast<double>(passes) * count),
+           static_cast<unsigned long long>(c.sum));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int scale = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i + 1 < argc) {
+            scale = std::max(1, std::stoi(argv[++i]));
+        }
+        else {
+            fprintf(stderr, "usage: vec3_bench [--scale 1]\n");
+            return 2;
+        }
+    }
+
+    rng generator(1);
+    thread_rng = &generator;
+    inputs in;
+    for (size_t i = 0; i < count; i++) {
+        in.a.push_back(vec3::random(-1, 1));
+        in.b.push_back(vec3::random(-1, 1));
+        in.n.push_back(random_unit_vector());
+        in.t.push_back(random_double(0.5, 2));
+    }
+
+    printf("vec3 %s, %d lanes, %zu bytes\n\n", vec3_backend(), vec3_lanes, sizeof(vec3));
+    printf("%-22s %11s   %s\n", "operation", "per call", "checksum");
+
+    const int passes = 4000 * scale;
+    std::vector<vec3> v(count);
+    std::vector<double> d(count);
+    time_op("a + b", passes, v, [&](size_t i) { return in.a[i] + in.b[i]; });
+    time_op("a - b", passes, v, [&](size_t i) { return in.a[i] - in.b[i]; });
+    time_op("a * b", passes, v, [&](size_t i) { return in.a[i] * in.b[i]; });
+    time_op("t * a", passes, v, [&](size_t i) { return in.t[i] * in.a[i]; });
+    time_op("a / t", passes, v, [&](size_t i) { return in.a[i] / in.t[i]; });
+    time_op("-a", passes, v, [&](size_t i) { return -in.a[i]; });
+    time_op("a += b", passes, v, [&](size_t i) { vec3 r = in.a[i]; r += in.b[i]; return r; });
+    time_op("dot", passes, d, [&](size_t i) { return dot(in.a[i], in.b[i]); });
+    time_op("cross", passes, v, [&](size_t i) { return cross(in.a[i], in.b[i]); });
+    time_op("length", passes, d, [&](size_t i) { return in.a[i].length(); });
+    time_op("unit_vector", passes, v, [&](size_t i) { return unit_vector(in.a[i]); });
+    time_op("reflect", passes, v, [&](size_t i) { return reflect(in.a[i], in.n[i]); });
+    time_op("refract", passes, v, [&](size_t i) { return refract(unit_vector(in.a[i]), in.n[i], 1 / 1.5); });
+
+    // Where the operators are used
+    printf("\n");
+    std::vector<ray> rays;
+    for (size_t i = 0; i < count; i++) rays.push_back(ray(10 * in.n[i], in.a[i] - 10 * in.n[i]));
+    sphere ball(point3(0, 0, 0), 1.5, nullptr);
+    time_op("sphere::hit", passes / 4, d, [&](size_t i) {
+        hit_record rec;
+        return ball.hit(rays[i], 0.001, infinity, rec) ? rec.t + rec.normal.x() : -1.0;
+    });
+
+    camera cam(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 19, 1.5, 0.1, 10.0);
+    time_op("camera::get_ray", passes / 4, v, [&](size_t i) {
+        generator = rng(1, i);
+        ray r = cam.get_ray(in.t[i] - 0.5, in.t[(i + 1) % count] - 0.5);
+        return r.origin() + r.direction();
+    });
+
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal shiny(color(0.8, 0.8, 0.8), 0.3);
+    dielectric glass(1.5);
+    hit_record rec;
+    rec.p = point3(0, 0, 0);
+    rec.front_face = true;
+    rec.footprint = 0;
+    const material* materials[3] = {&diffuse, &shiny, &glass};
+    const char* material_names[3] = {"lambertian::scatter", "metal::scatter", "dielectric::scatter"};
+    for (int m = 0; m < 3; m++) {
+        time_op(material_names[m], passes / 8, v, [&](size_t i) {
+            generator = rng(2, i);
+            rec.normal = in.n[i];
+            ray scattered;
+            color attenuation;
+            materials[m]->scatter(rays[i], rec, attenuation, scattered);
+            return scattered.direction() + attenuation;
+        });
+    }
+
+    // A small render of the cover scene, one thread, best of five
+    hittable_list list;
+    srand(69);
+    build_scene("GHD_scene", list);
+    bvh world(list);
+    scene_view view = default_view("GHD_scene");
+    camera scene_cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    const int width = 96 * scale, height = 64 * scale, spp = 8;
+    std::vector<color> image(static_cast<size_t>(width) * height);
+    double best = infinity;
+    int ray_count = 0;
+    for (int run = 0; run < 5; run++) {
+        ray_count = 0;
+        auto start = steady_clock::now();
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                generator = rng(3, static_cast<uint64_t>(j) * width + i);
+                image[static_cast<size_t>(j) * width + i] =
+                    render_pixel(scene_cam, world, i, j, width, height, spp, 8, &ray_count);
+            }
+        }
+        best = fmin(best, duration<double>(steady_clock::now() - start).count());
+    }
+    checksum c;
+    for (const color& pixel : image) c.add(pixel);
+    printf("%-22s %8.2f ns   %016llx   (%dx%d at %d spp, %.2f Mrays/s)\n", "render, per ray", 1e9 * best / ray_count,
+           static_cast<unsigned long long>(c.sum), width, height, spp, ray_count / best / 1e6);
+    thread_rng = nullptr;
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "utils/image_convert.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Converts ppm (P3 or P6) and pfm renders to PNG or JPEG on every core.
+// Inputs are files or directories, whose .ppm and .pfm files are all
+// converted; outputs go to --out, or to a converted directory next to the
+// input. Float images are tonemapped (see image_convert.h).
+//
+// usage: convert_images [--format png|jpg] [--quality q] [--png-level l] [--exposure e] [--threads n]
+//                       [--queue n] [--out dir] inputs...
+int main(int argc, char **argv)
+{
+    convert_options options;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int capacity = 0;
+    std::string format = "png", output_dir;
+    std::vector<std::string> inputs;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--format" && i + 1 < argc)
+                format = argv[++i];
+            else if (arg == "--quality" && i + 1 < argc)
+                options.quality = std::stoi(argv[++i]);
+            else if (arg == "--png-level" && i + 1 < argc)
+                options.png_level = std::stoi(argv[++i]);
+            else if (arg == "--exposure" && i + 1 < argc)
+                options.exposure = std::stod(argv[++i]);
+            else if (arg == "--threads" && i + 1 < argc)
+                threads = std::stoi(argv[++i]);
+            else if (arg == "--queue" && i + 1 < argc)
+                capacity = std::stoi(argv[++i]);
+            else if (arg == "--out" && i + 1 < argc)
+                output_dir = argv[++i];
+            else
+                inputs.push_back(arg);
+        }
+    }
+    catch (const std::exception &)
+    {
+        inputs.clear();
+    }
+    options.jpeg = format == "jpg" || format == "jpeg";
+    if (inputs.empty() || (format != "png" && !options.jpeg) || options.quality < 1 || options.quality > 100 ||
+        options.png_level < 0 || options.png_level > 9 || !(options.exposure > 0) || threads < 1 || capacity < 0)
+    {
+        std::cerr << "usage: " << argv[0] << " [--format png|jpg] [--quality q] [--png-level l] [--exposure e]"
+                  << " [--threads n] [--queue n] [--out dir] inputs...\n";
+        return 1;
+    }
+    // Enough names queued that no worker waits on the directory listing
+    if (capacity == 0)
+        capacity = 4 * threads;
+
+    if (!output_dir.empty())
+        mkdir(output_dir.c_str(), 0755);
+    convert_inputs next(inputs, output_dir, options.jpeg);
+    convert_report report = convert_all(std::ref(next), threads, capacity, options);
+
+    for (const auto &failure : report.failures)
+        std::cerr << failure << "\n";
+    fprintf(stderr, "converted %zu images (%.1f MB to %.1f MB) in %.2f sec on %d threads: %.1f images/s, %.1f MB/s in\n",
+            report.images, report.bytes_in / 1048576.0, report.bytes_out / 1048576.0, report.seconds, threads,
+            report.images / report.seconds, report.bytes_in / 1048576.0 / report.seconds);
+    return report.failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include "utils/rtweekend.h"
+
+#include "primitives/camera.h"
+#include "utils/distributed.h"
+#include "utils/image_io.h"
+#include "utils/simd_dispatch.h"
+#include "scenes/scenes.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renders a scene split between partition processes (see distributed.h)
+// and prints what every process holds and how many rays went through it.
+// --threads is per partition, by default the cores shared out between them.
+// Only stress: scenes are never held whole by one process; the others are
+// built whole to plan the slabs and by every partition before it keeps its
+// slab, so they must fit in one process's memory.
+//
+// usage: distributed_render [--parts n] [--threads n] [--width n] [--spp n] [--depth n] [--seed n]
+//                           scene out.ppm
+int main(int argc, char **argv)
+{
+    int parts = 4, threads = 0;
+    int image_width = 384, samples_per_pixel = 16, max_depth = 8;
+    int64_t seed = 1;
+    std::vector<std::string> paths;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--parts" && i + 1 < argc)
+                parts = std::stoi(argv[++i]);
+            else if (arg == "--threads" && i + 1 < argc)
+                threads = std::stoi(argv[++i]);
+            else if (arg == "--width" && i + 1 < argc)
+                image_width = std::stoi(argv[++i]);
+            else if (arg == "--spp" && i + 1 < argc)
+                samples_per_pixel = std::stoi(argv[++i]);
+            else if (arg == "--depth" && i + 1 < argc)
+                max_depth = std::stoi(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc)
+                seed = std::stoll(argv[++i]);
+            else
+                paths.push_back(arg);
+        }
+    }
+    catch (const std::exception &)
+    {
+        paths.clear();
+    }
+    if (paths.size() != 2 || parts < 1 || threads < 0 || image_width < 2 || samples_per_pixel < 1 || max_depth < 1 ||
+        seed < 0)
+    {
+        std::cerr << "usage: " << argv[0] << " [--parts n] [--threads n] [--width n] [--spp n] [--depth n]"
+                  << " [--seed n] scene out.ppm\n"
+                  << "only stress: scenes are split without building them whole in one process\n";
+        return 1;
+    }
+    if (threads == 0)
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / parts);
+    const int image_height = static_cast<int>(image_width / 1.5);
+
+    // The partitions are forked before the coordinator allocates anything
+    distributed_scene scene;
+    std::string error;
+    if (!scene.start(paths[0], parts, threads, error))
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    scene_view view = default_view(paths[0]);
+    camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 1.5, view.aperture, view.dist_to_focus);
+    std::vector<color> sums;
+    if (!scene.render(cam, image_width, image_height, samples_per_pixel, max_depth, seed, sums, error))
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    double coordinator_mb = resident_mb("VmHWM");
+    if (!scene.stop())
+        std::cerr << "a partition did not report its stats\n";
+
+    std::vector<unsigned char> image(3 * sums.size());
+    simd().tonemap(sums.data(), sums.size(), 1.0 / samples_per_pixel, image.data());
+    if (!write_ppm(paths[1], image_width, image_height, image))
+    {
+        std::cerr << "cannot write " << paths[1] << "\n";
+        return 1;
+    }
+
+    std::cerr << paths[0] << " " << image_width << "x" << image_height << " " << samples_per_pixel << " spp in "
+              << scene.render_seconds << " sec, " << parts << " partitions of " << threads << " threads\n";
+    fprintf(stderr, "%9s %16s %11s %9s %9s %10s %10s %8s %12s\n", "process", "slab", "primitives", "scene MB",
+            "peak MB", "rays in", "hits out", "busy", "rays/s");
+    for (size_t p = 0; p < scene.partitions.size(); p++)
+    {
+        const distributed_scene::partition &part = scene.partitions[p];
+        const partition_stats &s = part.stats;
+        char slab[40];
+        snprintf(slab, sizeof(slab), "%c %.3g..%.3g", "xyz"[part.slab.axis], part.slab.min, part.slab.max);
+        fprintf(stderr, "%9zu %16s %11llu %9.1f %9.1f %10llu %10llu %7.1f%% %12.3g\n", p, slab,
+                static_cast<unsigned long long>(s.primitives), s.scene_mb, s.peak_mb,
+                static_cast<unsigned long long>(s.rays), static_cast<unsigned long long>(s.hits),
+                100 * s.busy_seconds / scene.render_seconds, s.busy_seconds > 0 ? s.rays / s.busy_seconds : 0.0);
+    }
+    fprintf(stderr, "%9s %16s %11s %9s %9.1f\n", "coord", "", "", "", coordinator_mb);
+    fprintf(stderr, "forwarded %.3g rays (%.3g per second) and %.3g hits in %llu round trips, %.1f MB out and %.1f MB"
+                    " back, %.0f%% of the time waiting on partitions\n",
+            static_cast<double>(scene.rays_forwarded), scene.rays_forwarded / scene.render_seconds,
+            static_cast<double>(scene.hits_returned), static_cast<unsigned long long>(scene.bounces),
+            scene.bytes_sent / 1048576.0, scene.bytes_received / 1048576.0,
+            100 * scene.exchange_seconds / scene.render_seconds);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "utils/image_io.h"
+#include "utils/live_framebuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads the live framebuffer of a render in progress (main --live or the
+// daemon's live=) without stopping it: prints its progress and writes the
+// mean so far of every pixel as a ppm, once or every --watch seconds until
+// the render ends. --whole-frame waits for a copy no tile was added during,
+// otherwise every row is consistent on its own.
+//
+// usage: live_view [--out snapshot.ppm] [--watch seconds] [--whole-frame] /dev/shm/ghd-live
+int main(int argc, char **argv)
+{
+    std::string out_path;
+    double watch = 0;
+    bool whole_frame = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "--watch" && i + 1 < argc)
+            watch = std::stod(argv[++i]);
+        else if (arg == "--whole-frame")
+            whole_frame = true;
+        else
+            paths.push_back(arg);
+    }
+    if (paths.size() != 1)
+    {
+        std::cerr << "usage: " << argv[0] << " [--out snapshot.ppm] [--watch seconds] [--whole-frame] path\n";
+        return 1;
+    }
+
+    live_snapshot snapshot;
+    std::vector<unsigned char> rgb;
+    while (true)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!read_live_snapshot(paths[0], snapshot, whole_frame))
+        {
+            std::cerr << "cannot read live framebuffer " << paths[0] << "\n";
+            return 1;
+        }
+        double copy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // A renderer that died can't have marked its file
+        live_state state = snapshot.state;
+        if (state == live_rendering && live_writer_gone(snapshot.pid))
+            state = live_abandoned;
+
+        uint32_t fewest = UINT32_MAX, most = 0;
+        double total = 0;
+        size_t covered = 0;
+        for (const live_pixel &p : snapshot.pixels)
+        {
+            fewest = std::min(fewest, p.samples);
+            most = std::max(most, p.samples);
+            total += p.samples;
+            covered += p.samples > 0;
+        }
+        const char *state_names[] = {"?", "rendering", "finished", "abandoned"};
+        std::cout << snapshot.width << "x" << snapshot.height << " " << state_names[state <= 3 ? state : 0]
+                  << " | generation " << snapshot.generation << (snapshot.whole_frame ? "" : snapshot.whole_rows ? " (rows)" : " (torn rows)")
+                  << " | spp " << fewest << " to " << most << ", mean " << total / snapshot.pixels.size();
+        if (snapshot.target_spp > 0)
+            std::cout << " of " << snapshot.target_spp << " (" << 100 * total / snapshot.target_spp / snapshot.pixels.size()
+                      << "%)";
+        else
+            std::cout << " (" << 100.0 * covered / snapshot.pixels.size() << "% of pixels)";
+        std::cout << " | copied in " << copy_ms << " ms" << std::endl;
+
+        if (!out_path.empty())
+        {
+            snapshot.resolve(rgb);
+            if (!write_ppm(out_path, snapshot.width, snapshot.height, rgb))
+            {
+                std::cerr << "cannot write " << out_path << "\n";
+                return 1;
+            }
+        }
+
+        if (watch <= 0 || state != live_rendering)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::duration<double>(watch));
+    }
+}
@@ -5,13 +5,25 @@
 #include "primitives/sphere.h"
 #include "primitives/camera.h"
 #include "utils/material.h"
+#include "utils/bvh.h"
+#include "utils/image_io.h"
+#include "utils/numa.h"
+#include "utils/preview.h"
+#include "utils/progressive.h"
+#include "utils/render.h"
+#include "utils/tile_scheduler.h"
+#include "scenes/scenes.h"
 
 // time
 #include <chrono>
 #include <sys/time.h>
 #include <ctime>
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 // time
@@ -22,638 +34,151 @@ using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::chrono::system_clock;
 
-std::vector<std::vector<double>> generate_spheres(double scale)
+// usage: main [--time-budget seconds [--adaptive]] [--live /dev/shm/ghd-live] [--numa [--numa-replicate]]
+//             [--crop x0,y0,x1,y1] [--parallel auto|pixels|samples] [--preview renders/preview] > image.ppm
+int main(int argc, char **argv)
 {
-    // Z, Y, X, R
-    std::vector<std::vector<double>> spheres{
-        {-0.4518, -0.0159, 0.1662, 0.1575},
-        {-0.422, -0.0159, 0.6069, 0.1465},
-        {-0.4518, -0.0159, 1.4322, 0.1575},
-        {0.129, -0.0159, 0.8182, 0.1255},
-        {0.5103, -0.0159, 1.0015, 0.1189},
-        {0.5874, -0.0159, 0.1161, 0.1157},
-        {0.5214, -0.0159, 0.3798, 0.1569},
-        {0.5188, -0.0159, 0.7095, 0.1718},
-        {0.4157, -0.0159, 0.1224, 0.0573},
-        {0.6425, -0.0159, 0.5376, 0.0403},
-        {-0.3577, -0.0159, 0.3895, 0.0854},
-        {-0.5256, -0.0159, 0.4022, 0.0854},
-        {-0.5243, -0.0159, 0.8144, 0.0854},
-        {-0.5676, -0.0159, 0.7075, 0.0294},
-        {-0.5714, -0.0159, 0.5129, 0.0294},
-        {0.4168, -0.0159, 0.8844, 0.0294},
-        {0.6411, -0.0159, 0.8915, 0.0523},
-        {-0.2017, -0.0159, 0.8436, 0.1255},
-        {-0.0084, -0.0159, 0.9233, 0.0473},
-        {-0.0208, -0.0159, 0.8474, 0.0271},
-        {-0.0244, -0.0159, 0.7419, 0.0457},
-        {-0.5243, -0.0159, 1.1994, 0.0854},
-        {-0.3669, -0.0159, 1.2191, 0.0704},
-        {-0.4124, -0.0159, 1.0474, 0.1043},
-        {-0.5617, -0.0159, 1.0704, 0.0453},
-        {-0.5513, -0.0159, 0.9646, 0.06},
-        {-0.3878, -0.0159, 0.8762, 0.0621},
-        {-0.413, -0.0159, 0.7863, 0.0294},
-        {-0.4711, -0.0159, 0.9254, 0.0294},
-        {-0.0333, -0.0159, 0.8058, 0.0168},
-        {0.3123, -0.0159, 0.8947, 0.0735},
-        {0.3013, -0.0159, 0.7622, 0.0563},
-        {0.2384, -0.0159, 0.7138, 0.024},
-        {0.0545, -0.0159, 0.942, 0.0181},
-        {0.2214, -0.0159, 0.9427, 0.0278},
-        {0.086, -0.0159, 0.9527, 0.0146},
-        {-1.954, -0.0159, 1.0511, 0.044},
-        {0.1431, -0.0159, 0.9569, 0.0134},
-        {0.1799, -0.0159, 0.9475, 0.0136},
-        {-0.5885, -0.0159, 0.6085, 0.0192},
-        {-0.5805, -0.0159, 1.5672, 0.0294},
-        {-0.3148, -0.0159, 1.5647, 0.0294},
-        {-0.3111, -0.0159, 1.1379, 0.0294},
-        {-0.316, -0.0159, 0.9524, 0.032},
-        {-0.3016, -0.0159, 0.4866, 0.0249},
-        {-0.3082, -0.0159, 0.2863, 0.0294},
-        {-0.3075, -0.0159, 0.0393, 0.0332},
-        {-0.5804, -0.0159, 0.3011, 0.0294},
-        {0.4191, -0.0159, 0.5355, 0.0294},
-        {0.6525, -0.0159, 0.2467, 0.0294},
-        {0.4671, -0.0159, 0.1981, 0.0294},
-        {-0.3516, -0.0159, 0.7733, 0.0294},
-        {0.5812, -0.0159, 1.3058, 0.1136},
-        {0.4603, -0.0159, 1.4835, 0.1006},
-        {0.4149, -0.0159, 1.3288, 0.0569},
-        {0.6127, -0.0159, 1.479, 0.0569},
-        {0.4524, -0.0159, 1.2494, 0.0294},
-        {0.5682, -0.0159, 1.5547, 0.0294},
-        {0.6241, -0.0159, 1.5636, 0.0294},
-        {0.3813, -0.0159, 1.5758, 0.0198},
-        {0.6707, -0.0159, 1.5723, 0.017},
-        {0.6633, -0.0159, 1.5386, 0.017},
-        {0.6518, -0.0159, 1.4139, 0.017},
-        {0.4599, -0.0159, 1.2011, 0.0203},
-        {0.6759, -0.0159, 0.8249, 0.0223},
-        {0.6431, -0.0159, 1.1446, 0.0566},
-        {-0.293, -0.0159, 1.0826, 0.0197},
-        {1.2626, -0.0159, 0.1662, 0.1575},
-        {1.2924, -0.0159, 0.6069, 0.1465},
-        {1.2626, -0.0159, 1.4322, 0.1575},
-        {1.3567, -0.0159, 0.3895, 0.0854},
-        {1.1888, -0.0159, 0.4022, 0.0854},
-        {1.1901, -0.0159, 0.8144, 0.0854},
-        {1.1468, -0.0159, 0.7075, 0.0294},
-        {1.143, -0.0159, 0.5129, 0.0294},
-        {1.1901, -0.0159, 1.1994, 0.0854},
-        {1.3474, -0.0159, 1.2191, 0.0704},
-        {1.302, -0.0159, 1.0474, 0.1043},
-        {1.1527, -0.0159, 1.0704, 0.0453},
-        {1.1584, -0.0159, 0.959, 0.0626},
-        {1.3266, -0.0159, 0.8762, 0.0621},
-        {1.3014, -0.0159, 0.7863, 0.0294},
-        {1.2453, -0.0159, 0.9244, 0.03},
-        {1.1356, -0.0159, 0.6598, 0.0192},
-        {1.1305, -0.0159, 1.5628, 0.0294},
-        {1.3897, -0.0159, 1.5682, 0.0294},
-        {1.4017, -0.0159, 1.1349, 0.0294},
-        {1.3904, -0.0159, 0.9438, 0.0294},
-        {1.4087, -0.0159, 0.4858, 0.0216},
-        {1.4069, -0.0159, 0.2881, 0.0294},
-        {1.4073, -0.0159, 0.0485, 0.0294},
-        {1.134, -0.0159, 0.3011, 0.0294},
-        {1.3628, -0.0159, 0.7733, 0.0294},
-        {1.4042, -0.0159, 0.82, 0.0326},
-        {1.1322, -0.0159, 1.2987, 0.0294},
-        {1.4267, -0.0159, 1.5228, 0.0294},
-        {-1.1398, -0.0159, 0.3569, 0.1465},
-        {-1.0823, -0.0159, 0.134, 0.0854},
-        {-1.2508, -0.0159, 0.1533, 0.0854},
-        {-1.2209, -0.0159, 0.5728, 0.0854},
-        {-1.2735, -0.0159, 0.4707, 0.0294},
-        {-1.286, -0.0159, 0.2618, 0.0294},
-        {-1.1069, -0.0159, 0.7994, 0.0995},
-        {-1.2579, -0.0159, 0.8321, 0.0534},
-        {-1.2526, -0.0159, 0.7175, 0.0626},
-        {-1.0844, -0.0159, 0.6346, 0.0621},
-        {-1.1096, -0.0159, 0.5447, 0.0294},
-        {-1.166, -0.0159, 0.6806, 0.0328},
-        {-1.2948, -0.0159, 0.4196, 0.0192},
-        {-1.0208, -0.0159, 0.7023, 0.0305},
-        {-1.0196, -0.0159, 0.2289, 0.0294},
-        {-1.0578, -0.0159, 0.5095, 0.0294},
-        {-1.0238, -0.0159, 0.5636, 0.0326},
-        {-1.4519, -0.0159, 0.8781, 0.0193},
-        {-1.5318, -0.0159, 0.8078, 0.0854},
-        {-1.4157, -0.0159, 0.6975, 0.0729},
-        {-1.503, -0.0159, 0.6476, 0.0294},
-        {-1.3341, -0.0159, 0.7536, 0.0266},
-        {-1.4389, -0.0159, 0.7788, 0.0135},
-        {-1.321, -0.0159, 0.6502, 0.0334},
-        {-1.3001, -0.0159, 0.311, 0.0192},
-        {-2.0018, -0.0159, 0.7721, 0.0505},
-        {-1.5699, -0.0159, 0.6808, 0.0467},
-        {-1.3811, -0.0159, 0.8317, 0.0661},
-        {-1.5174, -0.0159, 0.7103, 0.0135},
-        {-1.5009, -0.0159, 0.6899, 0.0135},
-        {-1.5407, -0.0159, 0.6279, 0.0135},
-        {-1.6066, -0.0159, 0.6312, 0.0148},
-        {-1.6048, -0.0159, 0.7351, 0.0166},
-        {-1.605, -0.0159, 0.8793, 0.0171},
-        {-1.3296, -0.0159, 0.7127, 0.0155},
-        {0.4149, -0.0159, 1.1448, 0.0536},
-        {0.5097, -0.0159, 1.1641, 0.0446},
-        {0.3943, -0.0159, 1.2295, 0.0325},
-        {0.4173, -0.0159, 1.2633, 0.009},
-        {0.4336, -0.0159, 1.2156, 0.0095},
-        {0.3868, -0.0159, 1.0699, 0.0246},
-        {0.5749, -0.0159, 1.1741, 0.0202},
-        {0.5661, -0.0159, 1.1299, 0.0227},
-        {0.3839, -0.0159, 0.9516, 0.0189},
-        {0.3767, -0.0159, 0.9909, 0.0159},
-        {0.377, -0.0159, 1.0261, 0.0169},
-        {0.6351, -0.0159, 1.0681, 0.0227},
-        {0.661, -0.0159, 0.9747, 0.0341},
-        {0.6547, -0.0159, 1.0281, 0.0236},
-        {0.6779, -0.0159, 1.0672, 0.0202},
-        {0.6857, -0.0159, 1.0129, 0.0113},
-        {0.6871, -0.0159, 1.0364, 0.0113},
-        {-0.0994, -0.0159, 0.7223, 0.0286},
-        {-0.3038, -0.0159, 0.7319, 0.0278},
-        {-0.1481, -0.0159, 0.7091, 0.0209},
-        {-1.5994, -0.0159, 0.0324, 0.0538},
-        {-0.2154, -0.0159, 0.7046, 0.0143},
-        {-0.2519, -0.0159, 0.7094, 0.017},
-        {-0.0603, -0.0159, 0.831, 0.0179},
-        {-0.0809, -0.0159, 0.9413, 0.0288},
-        {-0.0581, -0.0159, 0.8769, 0.0219},
-        {-1.8718, -0.0159, 0.0766, 0.0397},
-        {-1.3197, -0.0159, 0.041, 0.0465},
-        {-0.1192, -0.0159, 0.9559, 0.0124},
-        {-0.0823, -0.0159, 0.7653, 0.019},
-        {0.0323, -0.0159, 0.7126, 0.0179},
-        {0.0609, -0.0159, 0.7011, 0.0124},
-        {-0.0652, -0.0159, 0.702, 0.0117},
-        {-1.4594, -0.0159, 0.1362, 0.1219},
-        {-2.1034, -0.0159, 0.5721, 0.1726},
-        {-2.1084, -0.0159, 0.9384, 0.1465},
-        {-2.0393, -0.0159, 1.2222, 0.1465},
-        {-1.185, -0.0159, 1.4393, 0.1439},
-        {-1.4144, -0.0159, 1.5191, 0.0998},
-        {-1.6138, -0.0159, 1.5105, 0.0998},
-        {-1.7831, -0.0159, 1.3731, 0.1184},
-        {-1.9249, 0.0, 0.2577, 0.1507},
-        {-1.7385, -0.0159, 0.0938, 0.0971},
-        {-1.6285, -0.0159, 0.2043, 0.0596},
-        {-1.7276, -0.0159, 0.2477, 0.0468},
-        {-2.1266, -0.0159, 0.3361, 0.0655},
-        {-1.9271, -0.0159, 0.45, 0.0425},
-        {-2.2376, -0.0159, 0.7735, 0.0655},
-        {-2.202, -0.0159, 1.1097, 0.048},
-        {-1.8481, -0.0159, 1.2274, 0.0446},
-        {-1.9468, -0.0159, 1.3912, 0.0446},
-        {-2.0254, -0.0159, 1.4041, 0.0362},
-        {-1.9843, -0.0159, 1.4507, 0.0257},
-        {-1.9162, -0.0159, 1.4722, 0.0429},
-        {-1.761, -0.0159, 1.5347, 0.0447},
-        {-1.5089, -0.0159, 1.3949, 0.0551},
-        {-1.6199, -0.0159, 1.3661, 0.0461},
-        {-1.3647, -0.0159, 1.3808, 0.0461},
-        {-1.5162, -0.0159, 1.5918, 0.0252},
-        {-1.3234, -0.0159, 1.5924, 0.0178},
-        {-1.3027, -0.0159, 1.5462, 0.015},
-        {-1.2844, -0.0159, 1.5814, 0.0232},
-        {-1.247, -0.0159, 1.5826, 0.0134},
-        {-1.0539, -0.0159, 1.5288, 0.0152},
-        {-1.0322, -0.0159, 1.4725, 0.0138},
-        {-1.0216, -0.0159, 1.5074, 0.0231},
-        {-1.1171, -0.0159, 1.2848, 0.0254},
-        {-1.092, -0.0159, 1.3137, 0.0131},
-        {-1.1541, -0.0159, 1.2862, 0.0115},
-        {2.2397, -0.0159, 0.9034, 0.1726},
-        {2.181, -0.0159, 0.5418, 0.1465},
-        {2.0586, -0.0159, 0.281, 0.1442},
-        {1.7162, -0.0159, 0.1482, 0.1402},
-        {2.1286, -0.0, 1.2512, 0.1465},
-        {1.9688, -0.0159, 1.4343, 0.0971},
-        {1.9314, -0.0159, 1.2893, 0.0536},
-        {2.3035, -0.0159, 1.1317, 0.0655},
-        {2.0906, -0.0159, 1.0584, 0.0456},
-        {2.3369, -0.0159, 0.6818, 0.0655},
-        {2.2404, -0.0159, 0.3538, 0.0537},
-        {1.86, -0.0159, 0.2803, 0.0558},
-        {1.8976, -0.0159, 0.1818, 0.0446},
-        {1.5742, -0.0, 1.4589, 0.1337},
-        {1.7954, -0.0, 1.5005, 0.0808},
-        {1.7455, -0.0, 1.3692, 0.058},
-        {1.8404, -0.0159, 1.3885, 0.0404},
-        {1.846, -0.0159, 1.3139, 0.0348},
-        {1.8921, -0.0159, 0.0921, 0.0446},
-        {1.9491, -0.0159, 0.1384, 0.0226},
-        {1.9667, -0.0159, 0.0939, 0.0243},
-        {1.9916, -0.0159, 0.1311, 0.0199},
-        {2.2995, -0.0159, 0.4249, 0.0202},
-        {2.3065, -0.0159, 0.3852, 0.0206},
-        {2.3327, -0.0159, 0.4161, 0.0135},
-        {1.501, -0.0159, 0.1923, 0.0854},
-        {1.4772, -0.0159, 0.0652, 0.0436},
-        {1.5638, -0.0159, 0.0446, 0.0441},
-        {1.3505, -0.0159, 0.0169, 0.0165},
-        {-1.3436, -0.0159, 0.241, 0.0355},
-        {-1.6142, -0.0159, 0.1164, 0.0296},
-        {-1.5252, -0.0159, 0.004, 0.0253},
-        {-1.3826, -0.0159, 0.0122, 0.0242},
-        {-2.1074, -0.0159, 0.2412, 0.0309},
-        {-2.2015, -0.0159, 0.3966, 0.0283},
-        {-1.1774, -0.0159, 0.0556, 0.0366},
-        {-1.2417, -0.0159, 0.0381, 0.0307},
-        {-2.2686, -0.0159, 0.8639, 0.03},
-        {-2.2727, -0.0159, 0.9144, 0.02},
-        {-2.2711, -0.0159, 0.9532, 0.0182},
-        {-2.2446, -0.0159, 1.0469, 0.0279},
-        {-2.2682, -0.0159, 1.0163, 0.0104},
-        {1.5911, -0.0159, 0.2545, 0.0243},
-        {1.9054, -0.0159, 0.344, 0.0223},
-        {-1.312, -0.0159, 0.7917, 0.0135},
-        {-1.3019, -0.0159, 0.7709, 0.01},
-        {-2.2777, -0.0159, 0.9793, 0.008},
-        {-1.8484, -0.0159, 1.5122, 0.0357},
-        {-1.4316, -0.0159, 1.3977, 0.0233},
-        {-1.8772, -0.0159, 1.1635, 0.0257},
-        {-1.9016, -0.0159, 1.1179, 0.0257},
-        {-2.1444, -0.0159, 0.766, 0.0285},
-        {-2.0987, -0.0159, 0.7696, -0.0174},
-        {-2.2676, -0.0159, 0.6854, 0.0261},
-        {-2.0492, -0.0159, 0.3829, 0.0245},
-        {-1.9832, -0.0159, 0.4195, 0.0233},
-        {-2.0168, -0.0159, 0.4063, 0.0152},
-        {-2.0659, -0.0159, 0.7709, -0.0145},
-        {-2.2013, -0.0159, 1.1829, 0.0226},
-        {-1.9142, -0.0159, 1.3331, 0.0217},
-        {-1.9058, -0.0159, 1.0808, 0.0125},
-        {-1.8861, -0.0159, 1.2803, 0.0202},
-        {-1.465, -0.0159, 0.6283, 0.0128},
-        {-2.1968, -0.0159, 1.2201, 0.0129},
-        {-2.0745, -0.0159, 1.3828, 0.0181},
-        {-2.0971, -0.0159, 1.3675, 0.0112},
-        {-2.112, -0.0159, 1.3569, 0.0067},
-        {-2.1205, -0.0159, 1.35, 0.0046},
-        {-1.9723, -0.0159, 0.8368, 0.021},
-        {-1.9487, -0.0159, 0.9865, 0.0201},
-        {2.0289, -0.0159, 0.4533, 0.0299},
-        {-1.9514, -0.0159, 0.9269, 0.0108},
-        {-0.1387, -0.0159, 0.9623, 0.008},
-        {-1.9614, -0.0159, 0.8748, 0.0142},
-        {-1.3122, -0.0159, 0.8784, 0.0177},
-        {-1.1991, -0.0159, 0.8759, 0.0199},
-        {-1.0122, -0.0159, 0.8748, 0.0212},
-        {-1.0077, -0.0159, 0.7449, 0.0145},
-        {-1.0067, -0.0159, 0.6558, 0.0178},
-        {-1.0076, -0.0159, 0.6108, 0.0178},
-        {-1.0142, -0.0159, 0.4739, 0.0228},
-        {-1.0096, -0.0159, 0.5147, 0.0178},
-        {-2.0841, -0.0159, 0.1933, 0.021},
-        {-1.9343, -0.0159, 0.0843, 0.0228},
-        {-2.0339, -0.0159, 0.1368, 0.0135},
-        {-2.0542, -0.0159, 0.1571, 0.0149},
-        {-1.9265, -0.0159, 0.5094, 0.0152},
-        {-1.8792, -0.0159, 0.4157, 0.0152},
-        {-1.763, -0.0159, 0.2994, 0.0162},
-        {-1.9679, -0.0159, 0.71, 0.0208},
-        {-1.7124, -0.0159, 1.5757, 0.0181},
-        {-1.6887, -0.0159, 1.5894, 0.0085},
-        {-1.6759, -0.0159, 1.5954, 0.0055},
-        {-1.5124, -0.0159, 1.4631, 0.0128},
-        {-1.5748, -0.0159, 1.4054, 0.0128},
-        {-1.4439, -0.0159, 1.3568, 0.019},
-        {-1.7897, -0.0159, 1.241, 0.0139},
-        {-0.292, -0.0159, 1.0182, 0.0197},
-        {-0.2936, -0.0159, 1.5167, 0.0228},
-        {-0.2847, -0.0159, 1.4642, 0.0135},
-        {-0.5953, -0.0159, 1.5266, 0.0135},
-        {-0.5381, -0.0159, 1.5813, 0.0147},
-        {-0.6019, -0.0159, 1.5023, 0.0101},
-        {-0.3086, -0.0159, 1.3061, 0.0326},
-        {-0.5815, -0.0159, 1.2999, 0.0276},
-        {-1.3133, -0.0159, 1.3541, 0.0128},
-        {-1.3407, -0.0159, 1.4345, 0.0128},
-        {-0.5947, -0.0159, 1.3395, 0.0128},
-        {-0.2894, -0.0159, 1.3639, 0.0182},
-        {-0.59, -0.0159, 0.0551, 0.0209},
-        {-0.5607, -0.0159, 0.0259, 0.0209},
-        {-0.5947, -0.0159, 0.0196, 0.0153},
-        {-0.529, -0.0159, 0.0146, 0.0127},
-        {-0.5071, -0.0159, 0.0099, 0.0091},
-        {-0.4912, -0.0159, 0.0069, 0.0069},
-        {-0.3548, -0.0159, 0.02, 0.018},
-        {-0.3099, -0.0159, 0.0811, 0.0084},
-        {-0.2867, -0.0159, 0.0831, 0.0145},
-        {-0.2887, -0.0159, 0.1129, 0.0145},
-        {-0.3826, -0.0159, 0.0125, 0.0107},
-        {-0.4012, -0.0159, 0.0084, 0.0078},
-        {-0.2852, -0.0159, 0.1405, 0.0117},
-        {-0.2917, -0.0159, 0.2415, 0.0191},
-        {-0.2848, -0.0159, 0.2025, 0.0126},
-        {-0.4458, -0.0159, 0.3385, 0.0144},
-        {-0.4376, -0.0159, 0.4479, 0.0126},
-        {2.2263, -0.0159, 0.2762, 0.0262},
-        {2.336, -0.0159, 0.4579, 0.0285},
-        {2.3649, -0.0159, 0.5373, 0.0249},
-        {2.3711, -0.0159, 0.5917, 0.0322},
-        {2.3615, -0.0159, 0.4962, 0.0166},
-        {2.2446, -0.0159, 0.7029, 0.0289},
-        {2.1211, -0.0159, 0.7234, 0.0425},
-        {2.18, -0.0159, 0.7234, 0.0182},
-        {2.2094, -0.0159, 0.7217, 0.0115},
-        {2.1992, -0.0159, 0.7015, 0.0112},
-        {2.3903, -0.0159, 0.7653, 0.0332},
-        {2.3642, -0.0159, 1.0613, 0.0274},
-        {2.1542, -0.0159, 1.0827, 0.0235},
-        {2.2211, -0.0159, 1.1078, 0.0235},
-        {2.1846, -0.0159, 1.1034, 0.012},
-        {2.2991, -0.0159, 1.2263, 0.0258},
-        {1.4373, -0.0159, 1.3609, 0.0323},
-        {1.4083, -0.0159, 0.8957, 0.0223},
-        {1.4124, -0.0159, 0.9898, 0.022},
-        {1.4429, -0.0159, 1.5734, 0.0222},
-        {1.7015, -0.0159, 1.5638, 0.0265},
-        {1.8934, -0.0159, 1.5352, 0.0232},
-        {2.1022, -0.0159, 1.4303, 0.0345},
-        {1.9654, -0.0159, 1.2225, 0.0215},
-        {1.9883, -0.0159, 0.4271, 0.0189},
-        {1.9301, -0.0159, 0.3724, 0.0144},
-        {2.0282, -0.0159, 0.4997, 0.0144},
-        {1.7861, -0.0159, 0.2901, 0.018},
-        {1.1272, -0.0159, 0.0498, 0.0222},
-        {1.1574, -0.0159, 0.0303, 0.0141},
-        {1.1343, -0.0159, 0.015, 0.0137},
-        {0.4013, -0.0159, 0.2241, 0.0398},
-        {0.4614, -0.0159, 0.0468, 0.0315},
-        {0.4069, -0.0159, 0.0413, 0.0232},
-        {0.3891, -0.0159, 0.4963, 0.0194},
-        {0.386, -0.0159, 0.5717, 0.0194},
-        {0.3762, -0.0159, 0.5355, 0.0148},
-        {0.3774, -0.0159, 0.4668, 0.0123},
-        {0.3574, -0.0159, 0.8132, 0.0204},
-        {0.6794, -0.0159, 1.2144, 0.0196},
-        {0.6794, -0.0159, 1.4421, 0.0196},
-        {0.6804, -0.0159, 0.0192, 0.0176},
-        {0.6773, -0.0159, 0.2921, 0.0211},
-        {0.6727, -0.0159, 0.4838, 0.0211},
-        {0.681, -0.0159, 0.4472, 0.0154},
-        {1.3864, -0.0159, 1.3029, 0.0222},
-        {1.4808, -0.0159, 1.5802, 0.0153},
-        {1.5059, -0.0159, 1.584, 0.0088},
-        {1.3488, -0.0159, 1.581, 0.0145},
-        {1.3267, -0.0159, 1.5855, 0.0084},
-        {1.3118, -0.0159, 1.5886, 0.0068},
-        {1.4078, -0.0159, 0.7386, 0.0278},
-        {1.1347, -0.0159, 0.628, 0.0124},
-        {1.1303, -0.0159, 0.5627, 0.0209},
-        {2.0432, -0.0159, 1.1074, 0.0209},
-        {2.0192, -0.0159, 1.1325, 0.0138},
-        {-0.5853, -0.0159, 0.6547, 0.0246},
-        {-0.5897, -0.0159, 0.8961, 0.0184},
-        {-0.5919, -0.0159, 1.1236, 0.0156},
-        {-0.5978, -0.0159, 1.2634, 0.0119},
-        {-0.5934, -0.0159, 1.0242, 0.0128},
-        {-0.5948, -0.0159, 0.7432, 0.0141},
-        {-0.5999, -0.0159, 0.6853, 0.0094},
-        {-0.5841, -0.0159, 0.568, 0.0215},
-        {0.4113, -0.0159, 1.5842, 0.0112},
-        {0.3712, -0.0159, 1.5472, 0.0098},
-        {0.4312, -0.0159, 1.5884, 0.008},
-        {0.6895, -0.0159, 1.5886, 0.008},
-        {1.1715, -0.0159, 1.5769, -0.0136},
-        {1.1885, -0.0159, 1.5894, -0.0066},
-        {1.1165, -0.0159, 1.5226, -0.0136},
-        {1.1079, -0.0159, 1.5901, -0.0053},
-        {1.1087, -0.0159, 1.5017, -0.0082},
-        {-1.002, -0.0159, 0.0812, 0.0131},
-        {-1.5586, -0.0159, 1.3487, 0.0171},
-        {-1.5505, -0.0159, 1.6041, -0.0118},
-        {-1.4813, -0.0159, 1.607, -0.0118}};
-
-    return spheres;
-}
-
-// Returns a color for a given ray r
-color ray_color(const ray &r, const hittable &world, int depth)
-{
-    hit_record rec;
-
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0, 0, 0);
-
-    if (world.hit(r, 0.001, infinity, rec))
-    {
-        ray scattered;
-        color attenuation;
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
-        return color(0, 0, 0);
-    }
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
-}
-
-// Scenes
-hittable_list GHD_scene()
-{
-    hittable_list world;
-    // Ground
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-
-    // list of x,y,z,R s
-    std::vector<std::vector<double>> spheres = generate_spheres(1.0);
-
-    // for each sphere on that list
-    for (int i = 0; i < spheres.size(); i++)
+    // --time-budget renders progressively until the wall clock budget is
+    // spent instead of a fixed samples_per_pixel, --adaptive spends later
+    // passes on the noisiest tiles. --live publishes the samples as they come
+    // in a shared memory file that live_view reads. --numa pins a worker to
+    // every core and renders each NUMA node's band of the frame on that node
+    // (see numa.h), --numa-replicate also builds the scene once per node so
+    // every node's rays read a local copy. --crop renders and writes only
+    // that rectangle of the frame. --parallel picks between threads rendering
+    // tiles (pixels) and threads sharing out the samples of each tile's
+    // pixels (samples), by default samples when there are too few tiles for
+    // the threads. --preview renders coarse-to-fine (see preview.h) and
+    // writes the 1/16, 1/8 and 1/4 previews as <prefix>_16.ppm, _8 and _4 as
+    // they finish; with --live the full resolution samples are published once
+    // they are done.
+    double time_budget = 0;
+    bool adaptive = false;
+    std::string live_path;
+    bool numa = false, numa_replicate = false;
+    bool cropped = false;
+    tile crop{0, 0, 0, 0};
+    parallel_mode parallel = parallel_mode::automatic;
+    std::string preview_prefix;
+    for (int i = 1; i < argc; i++)
     {
-        auto choose_mat = random_double();
-        // axis mismatch fix
-        point3 center(spheres[i][1],
-                      spheres[i][2],
-                      -1 * spheres[i][0]);
-
-        // select a random material
-        shared_ptr<material> sphere_material;
-        if (choose_mat < 0.8)
+        std::string arg = argv[i];
+        if (arg == "--time-budget" && i + 1 < argc)
+            time_budget = std::stod(argv[++i]);
+        else if (arg == "--adaptive")
+            adaptive = true;
+        else if (arg == "--live" && i + 1 < argc)
+            live_path = argv[++i];
+        else if (arg == "--numa")
+            numa = true;
+        else if (arg == "--numa-replicate")
+            numa = numa_replicate = true;
+        else if (arg == "--crop" && i + 1 < argc)
         {
-            // diffuse
-            auto albedo = color::random() * color::random();
-            sphere_material = make_shared<lambertian>(albedo);
-        }
-        else if (choose_mat < 0.99)
-        {
-            // metal
-            auto albedo = color::random(0.5, 1);
-            auto fuzz = random_double(0, 0.5);
-            sphere_material = make_shared<metal>(albedo, fuzz);
+            char comma;
+            std::istringstream in(argv[++i]);
+            in >> crop.x0 >> comma >> crop.y0 >> comma >> crop.x1 >> comma >> crop.y1;
+            cropped = true;
         }
+        else if (arg == "--parallel" && i + 1 < argc && parse_parallel_mode(argv[i + 1], parallel))
+            i++;
+        else if (arg == "--preview" && i + 1 < argc)
+            preview_prefix = argv[++i];
         else
         {
-            // glass
-            sphere_material = make_shared<dielectric>(1.5);
+            std::cerr << "usage: " << argv[0] << " [--time-budget seconds [--adaptive]] [--live path] [--numa [--numa-replicate]]"
+                      << " [--crop x0,y0,x1,y1] [--parallel auto|pixels|samples] [--preview prefix]\n";
+            return 1;
         }
-
-        // create ith sphere and give it a random material
-        world.add(make_shared<sphere>(center, spheres[i][3], sphere_material));
     }
-    return world;
-}
 
-hittable_list random_scene()
-{
-    hittable_list world;
+    // set random seed
+    srand(69);
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+    // Image
+    const auto aspect_ratio = 3.0 / 2.0;
+    const int image_width = 512;
+    const int image_height = static_cast<int>(image_width / aspect_ratio);
+    const int samples_per_pixel = 16;
+    const int max_depth = 2;
 
-    for (int a = -11; a < 11; a++)
+    // Render cost AOV (nanoseconds, rays and path depth per pixel), written as
+    // cost_aov_path.pfm and a cost_aov_path_heatmap.ppm next to the beauty pass.
+    // Only the tiled render records it, not --time-budget, --numa or --preview
+    const bool write_cost_aov = false;
+    const std::string cost_aov_path = "renders/cost";
+    cost_aov aov(image_width, image_height);
+
+    if (!cropped)
+        crop = {0, 0, image_width, image_height};
+    else if (crop.x0 < 0 || crop.y0 < 0 || crop.x1 > image_width || crop.y1 > image_height ||
+             crop.x0 >= crop.x1 || crop.y0 >= crop.y1 || time_budget > 0 || numa)
     {
-        for (int b = -11; b < 11; b++)
-        {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9)
-            {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8)
-                {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                else if (choose_mat < 0.95)
-                {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                else
-                {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
+        std::cerr << "--crop needs a rectangle inside the " << image_width << "x" << image_height
+                  << " frame and no --time-budget or --numa\n";
+        return 1;
+    }
+    if (!preview_prefix.empty() && (time_budget > 0 || numa || cropped))
+    {
+        std::cerr << "--preview renders the whole frame, without --time-budget, --numa or --crop\n";
+        return 1;
+    }
+    if (write_cost_aov && (time_budget > 0 || numa || !preview_prefix.empty()))
+    {
+        std::cerr << "the cost AOV is only recorded without --time-budget, --numa or --preview\n";
+        return 1;
     }
 
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    // Radiance cache: diffuse bounces after the first end in a cache of
+    // incoming light filled by a few cheap passes before the render.
+    // Smaller cells (world units) are less biased but need more samples.
+    const bool use_radiance_cache = false;
+    const double radiance_cache_cell = 0.1;
+    radiance_cache cache(radiance_cache_cell);
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    // Path guiding: diffuse bounces learn where light comes from in a few
+    // passes before the render and sample towards it
+    const bool use_path_guide = false;
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    // World, built by a function so --numa-replicate can build it again on
+    // every node
+    auto build_world = []()
+    {
+        // W1) a plane and a sphere on top
+        auto world = floor_sphere_scene();
 
-    return world;
-}
+        // W2) three spheres - one lambertian center and two metals on each side
+        // auto world = three_spheres_scene();
 
-hittable_list floor_sphere_scene()
-{
-    hittable_list world;
-    auto material_ground = make_shared<metal>(color(0.8, 0.8, 0.8), 0.35);
-    auto material_ball = make_shared<lambertian>(color(0.8, 0.15, 0.05));
-    world.add(make_shared<sphere>(point3(0, 0, -1), 0.5, material_ball));
-    world.add(make_shared<sphere>(point3(0, -100.5, -1), 100, material_ground));
-    return world;
-}
-
-hittable_list three_spheres_scene()
-{
-    hittable_list world;
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.7, 0.3, 0.3));
-    auto material_left = make_shared<metal>(color(0.8, 0.8, 0.8), 0.3);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
-    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-    return world;
-}
-
-hittable_list three_spheres_scene2()
-{
-    hittable_list world;
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<dielectric>(1.5);
-    auto material_left = make_shared<dielectric>(1.5);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
-    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-    return world;
-}
-
-hittable_list three_spheres_scene3()
-{
-    hittable_list world;
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left = make_shared<dielectric>(1.5);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
-    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-    return world;
-}
-
-hittable_list fov_scene()
-{
-    auto R = cos(pi / 4);
-    hittable_list world;
-    auto material_left = make_shared<lambertian>(color(0, 0, 1));
-    auto material_right = make_shared<lambertian>(color(1, 0, 0));
-    world.add(make_shared<sphere>(point3(-R, 0, -1), R, material_left));
-    world.add(make_shared<sphere>(point3(R, 0, -1), R, material_right));
-    return world;
-}
-
-int main()
-{
+        // W3) three spheres - one metal to the right and two dielectrics on its left
+        // auto world = three_spheres_scene2();
 
-    // set random seed
-    srand(69);
-
-    // Image
-    const auto aspect_ratio = 3.0 / 2.0;
-    const int image_width = 512;
-    const int image_height = static_cast<int>(image_width / aspect_ratio);
-    const int samples_per_pixel = 16;
-    const int max_depth = 2;
+        // W3) three spheres - one metal to the right lambertian in the middle and a hollow glass on the left
+        // auto world = three_spheres_scene3();
 
-    // World
-    // W1) a plane and a sphere on top
-    auto world = floor_sphere_scene();
+        // W4) FOV Test Scene
+        // auto world = fov_scene();
 
-    // W2) three spheres - one lambertian center and two metals on each side
-    // auto world = three_spheres_scene();
+        // W5) Cover Scene - Random Spheres with random materials
+        //  auto world = random_scene();
 
-    // W3) three spheres - one metal to the right and two dielectrics on its left
-    // auto world = three_spheres_scene2();
+        // W6) GHD Scene
+        // auto world = GHD_scene();
 
-    // W3) three spheres - one metal to the right lambertian in the middle and a hollow glass on the left
-    // auto world = three_spheres_scene3();
+        // W7) A mesh exported from blender (OBJ or PLY)
+        // hittable_list world;
+        // mesh_scene("../blender/mesh.obj", world);
 
-    // W4) FOV Test Scene
-    // auto world = fov_scene();
+        // W8) Textured ground and spheres (texture files from make_texture)
+        // hittable_list world;
+        // textured_scene("textures/albedo.tex", "textures/roughness.tex", world);
 
-    // W5) Cover Scene - Random Spheres with random materials
-    //  auto world = random_scene();
+        return world;
+    };
+    hittable_list world = build_world();
 
-    // W6) GHD Scene
-    // auto world = GHD_scene();
+    // Acceleration structure
+    bvh world_bvh(world);
 
     srand(time(NULL));
 
@@ -667,51 +192,199 @@ int main()
     camera cam(lookfrom, lookat, vup, 19, aspect_ratio, aperture, dist_to_focus);
 
     // Render
-
-    // Write PPM Header
-    std::cout << "P3\n"
-              << image_width << ' ' << image_height << "\n255\n";
+    // A quick low resolution pre-pass estimates where the image is expensive,
+    // then all cores render tiles sized and ordered by that estimate
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const int64_t seed = time(NULL);
 
     // time before rendering
+    auto start = std::chrono::steady_clock::now();
     auto start_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
     auto end_time = start_time;
-    float eta = 0.0;
-    // Loop over pixels
-    for (int j = image_height - 1; j >= 0; --j)
+
+    render_caches caches;
+    path_guide guide(world_bvh);
+    if (use_radiance_cache)
     {
-        // std::cerr << "\rScanlines Remaining: " << j << ' ' <<std::endl;
-        end_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        train_radiance_cache(cache, cam, world_bvh, image_width, image_height, max_depth, threads, seed);
+        caches.radiance = &cache;
+    }
+    if (use_path_guide)
+    {
+        train_path_guide(guide, cam, world_bvh, image_width, image_height, max_depth, threads, seed);
+        caches.guide = &guide;
+    }
 
-        // time_remaining = time_elapsed *
-        //                  row_remaining /
-        //                  rows_elapsed
-        eta = static_cast<float>((end_time - start_time)) *
-              static_cast<float>(j) /
-              static_cast<float>(image_height - j) /
-              1000.0;
+    live_framebuffer live;
+    if (!live_path.empty() && !live.create(live_path, image_width, image_height, time_budget > 0 ? 0 : samples_per_pixel))
+        return 1;
 
-        std::cerr << "\rETA: " << eta << " sec "
-                  << " | " << (image_height - j) << "/" << image_height << std::flush;
+    std::vector<unsigned char> image(3 * image_width * image_height);
+    if (!preview_prefix.empty())
+    {
+        preview_frame frame(image_width, image_height, samples_per_pixel, max_depth);
+        frame.render(cam, world_bvh, threads, seed,
+                     [&](int scale, double seconds)
+                     {
+                         std::cerr << "1/" << scale << " resolution after " << seconds << " sec";
+                         if (scale > 1)
+                         {
+                             std::string path = preview_prefix + "_" + std::to_string(scale) + ".ppm";
+                             frame.resolve(scale, image);
+                             if (!write_ppm(path, image_width, image_height, image))
+                                 std::cerr << ", cannot write " << path;
+                             else
+                                 std::cerr << ", " << path;
+                         }
+                         std::cerr << "\n";
+                         return true;
+                     },
+                     &caches);
+        frame.resolve(1, image);
+        // The levels give pixels different sample counts, which the live
+        // file can't hold, so viewers get the finished sums in one go
+        live.add({0, 0, image_width, image_height}, frame.sums, samples_per_pixel);
+    }
+    else if (time_budget > 0)
+    {
+        // Passes of growing sample counts until the budget (training
+        // included) runs out, the last one sized to fit
+        progressive_frame frame(image_width, image_height);
+        if (live.is_open())
+            frame.live = &live;
+        progressive_report report = render_progressive(
+            cam, world_bvh, frame, max_depth, threads, seed, time_budget, adaptive,
+            [&](const progressive_report &r)
+            {
+                std::cerr << "\rpass " << r.passes << " | " << r.mean_spp << " spp | noise " << r.noise
+                          << " | " << r.seconds << " / " << time_budget << " sec   " << std::flush;
+            },
+            &caches, start);
+        frame.resolve(image);
+
+        std::cerr << "\n"
+                  << report.passes << " passes in " << report.seconds << " of " << time_budget << " seconds, ";
+        if (report.min_spp == report.max_spp)
+            std::cerr << report.min_spp << " spp";
+        else
+            std::cerr << report.min_spp << " to " << report.max_spp << " spp (mean " << report.mean_spp << ")";
+        std::cerr << ", estimated noise " << report.noise << " (" << 255 * report.noise << " / 255 RMS)\n";
+        if (report.dropped_tiles)
+            std::cerr << "last pass overran the budget, " << report.dropped_tiles << " tiles dropped\n";
+    }
+    else
+    {
+        cost_map estimate = estimate_cost(cam, world_bvh, image_width, image_height, max_depth);
+        tile frame = crop;
+        std::vector<tile> tiles;
+        std::vector<numa_node> nodes;
+        std::vector<tile> bands;
+        size_t tiles_total = 0;
+        if (numa)
+        {
+            // Every node renders its own band into memory on that node
+            nodes = numa_topology();
+            bands = numa_bands(estimate, nodes);
+            std::cerr << describe_topology(nodes) << "\n";
+        }
+        else
+        {
+            tiles = plan_tiles(estimate, frame, 16 * threads);
+            tiles_total = tiles.size();
+        }
 
-        for (int i = 0; i < image_width; ++i)
+        double total_cost = estimate.cost(frame);
+        double done_cost = 0;
+        size_t tiles_done = 0;
+        std::vector<unsigned char> rgb;
+        auto on_tile = [&](const tile &t, const std::vector<color> &sums, double)
+                         {
+                             live.add(t, sums, samples_per_pixel);
+                             // --numa resolves the image from its node-local sums at the end
+                             if (!numa)
+                             {
+                                 rgb.resize(3 * sums.size());
+                                 simd().tonemap(sums.data(), sums.size(), 1.0 / samples_per_pixel, rgb.data());
+                                 for (int y = t.y0; y < t.y1; ++y)
+                                     std::copy(rgb.begin() + 3 * (y - t.y0) * t.width(),
+                                               rgb.begin() + 3 * (y - t.y0 + 1) * t.width(),
+                                               image.begin() + 3 * (y * image_width + t.x0));
+                             }
+
+                             // time_remaining = time_elapsed *
+                             //                  estimated_cost_remaining /
+                             //                  estimated_cost_done
+                             done_cost += estimate.cost(t);
+                             end_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+                             float eta = static_cast<float>(end_time - start_time) *
+                                         static_cast<float>((total_cost - done_cost) / done_cost) /
+                                         1000.0;
+
+                             std::cerr << "\rETA: " << eta << " sec "
+                                       << " | " << ++tiles_done << "/" << tiles_total << " tiles" << std::flush;
+                             return true;
+                         };
+
+        if (numa)
         {
-            color pixel_color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; ++s)
+            // Copies of the scene built by a thread on each node, seeded like the
+            // first so they are the same scene
+            std::vector<std::shared_ptr<bvh>> replicas;
+            std::vector<const hittable *> worlds = {&world_bvh};
+            if (numa_replicate)
             {
-                // Screen UV coordinates
-                auto u = (i + random_double()) / (image_width - 1);
-                auto v = (j + random_double()) / (image_height - 1);
-                ray r = cam.get_ray(u, v);
-
-                // Add the color of every sample to current pixels color
-                pixel_color += ray_color(r, world, max_depth);
+                replicas = replicate_per_node(nodes, [&]()
+                                              {
+                                                  srand(69);
+                                                  return std::make_shared<bvh>(build_world());
+                                              });
+                worlds.clear();
+                for (const auto &replica : replicas)
+                    worlds.push_back(replica.get());
             }
-            // this function averages the pixel_color based on the number of samples per pixel
-            write_color(std::cout, pixel_color, samples_per_pixel);
+
+            numa_frame sums(image_width, image_height, nodes, bands);
+            for (const std::vector<tile> &queue : numa_tiles(estimate, sums))
+                tiles_total += queue.size();
+            accumulate_tiles_numa(cam, worlds, sums, estimate, samples_per_pixel, max_depth, seed, on_tile,
+                                  true, &caches);
+            for (int y = 0; y < image_height; y++)
+                simd().tonemap(sums.row(y), image_width, 1.0 / samples_per_pixel,
+                               image.data() + 3 * static_cast<size_t>(y) * image_width);
         }
+        else
+            accumulate_tiles(cam, world_bvh, tiles, image_width, image_height, samples_per_pixel, max_depth, threads,
+                             seed, on_tile, write_cost_aov ? &aov : nullptr, &caches, parallel);
     }
+    live.close();
 
     end_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 
     std::cerr << "\nDone. in " << (end_time - start_time) / 1000 << " seconds\n";
+    if (use_radiance_cache)
+        std::cerr << "radiance cache: " << cache.cells() << " cells, "
+                  << cache.memory_bytes() / (1024 * 1024) << " MB\n";
+    if (use_path_guide)
+        std::cerr << "path guide: " << guide.leaf_count() << " regions, "
+                  << guide.memory_bytes() / 1024 << " KB\n";
+    texture_cache_stats textures = default_texture_cache()->stats();
+    if (textures.hits + textures.misses > 0)
+        std::cerr << "texture cache: " << 100 * textures.hit_rate() << "% hits, "
+                  << textures.bytes_read / (1024 * 1024) << " MB read, " << textures.resident_tiles << " of "
+                  << textures.capacity_tiles << " tiles resident (" << textures.memory_bytes / (1024 * 1024)
+                  << " MB)\n";
+
+    // Write PPM
+    std::cout << "P3\n"
+              << crop.width() << ' ' << crop.height() << "\n255\n";
+    for (int y = crop.y0; y < crop.y1; y++)
+        for (int p = 3 * (y * image_width + crop.x0); p < 3 * (y * image_width + crop.x1); p += 3)
+            std::cout << int(image[p]) << ' ' << int(image[p + 1]) << ' ' << int(image[p + 2]) << '\n';
+
+    if (write_cost_aov)
+    {
+        if (!aov.write_pfm(cost_aov_path + ".pfm") || !aov.write_heatmap(cost_aov_path + "_heatmap.ppm"))
+            std::cerr << "cannot write " << cost_aov_path << ".pfm\n";
+        aov.print_histogram(std::cerr);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "utils/image_io.h"
+#include "utils/texture_cache.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Converts a ppm image into a tiled, mipmapped texture file for
+// load_texture. Color images are taken to be stored with gamma 2 like the
+// renderer's output; --data keeps the values linear and the first channel
+// only, for roughness and other non-color maps. The tile size has to match
+// the texture_cache that reads the file (64 by default).
+//
+// usage: make_texture [--data] [--tile-size n] input.ppm output.tex
+int main(int argc, char **argv)
+{
+    bool data = false;
+    int tile_size = 64;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--data")
+            data = true;
+        else if (arg == "--tile-size" && i + 1 < argc)
+            tile_size = std::stoi(argv[++i]);
+        else
+            paths.push_back(arg);
+    }
+    if (paths.size() != 2 || tile_size < 1)
+    {
+        std::cerr << "usage: " << argv[0] << " [--data] [--tile-size n] input.ppm output.tex\n";
+        return 1;
+    }
+
+    int width, height;
+    std::vector<unsigned char> rgb;
+    if (!read_ppm(paths[0], width, height, rgb))
+    {
+        std::cerr << "cannot read " << paths[0] << "\n";
+        return 1;
+    }
+
+    std::vector<unsigned char> texels;
+    if (data)
+    {
+        texels.resize(static_cast<size_t>(width) * height);
+        for (size_t p = 0; p < texels.size(); p++)
+            texels[p] = rgb[3 * p];
+    }
+    else
+    {
+        texels = std::move(rgb);
+    }
+
+    if (!write_texture(paths[1], width, height, data ? 1 : 3, texels, !data, tile_size))
+    {
+        std::cerr << "cannot write " << paths[1] << "\n";
+        return 1;
+    }
+    return 0;
+}
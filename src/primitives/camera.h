@@ -16,7 +16,7 @@ class camera {
         ) {
             auto theta = degrees_to_radians(vfov);
             auto h = tan(theta/2);
-            auto viewport_height = 2.0 * h;
+            viewport_height = 2.0 * h;
             auto viewport_width = aspect_ratio * viewport_height;
 
             w = unit_vector(lookfrom - lookat);
@@ -42,6 +42,25 @@ class camera {
             );
         }
 
+        // Angle in radians one pixel of an image_height tall image spans,
+        // how fast the ray cone of a primary ray grows
+        double pixel_spread(int image_height) const {
+            return viewport_height / image_height;
+        }
+
+        // Screen coordinates (s, t) of the pinhole ray through p, the inverse
+        // of get_ray without the lens. False if p is behind the camera.
+        bool project(const point3& p, double& s, double& t) const {
+            vec3 d = p - origin;
+            double along = -dot(d, w);
+            if (along <= 0) return false;
+            double focus_dist = -dot(lower_left_corner + horizontal/2 + vertical/2 - origin, w);
+            vec3 q = origin + d * (focus_dist / along) - lower_left_corner;
+            s = dot(q, horizontal) / horizontal.length_squared();
+            t = dot(q, vertical) / vertical.length_squared();
+            return true;
+        }
+
     private:
         point3 origin;
         point3 lower_left_corner;
@@ -49,5 +68,6 @@ class camera {
         vec3 vertical;
         vec3 u, v, w;
         double lens_radius;
+        double viewport_height;
 };
 #endif
\ No newline at end of file
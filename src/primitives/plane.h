@@ -0,0 +1,193 @@
+#ifndef PLANE_H
+#define PLANE_H
+
+// Flat primitives: an infinite plane, a disk and a rectangle
+// A ray meets their plane at t = dot(n, q - o) / dot(n, d), exact at any
+// size, where a huge sphere faking a floor loses precision in its quadratic
+// (shadow acne far from the camera) and gives the BVH a box that overlaps
+// everything. All three are always tested by a bvh instead of sitting in
+// its tree; disks and rectangles that are small parts of the scene can be
+// made with always_tested = false to go in the tree like any other object.
+//
+// Textures repeat every texture_scale world units across planes and disks
+// and stretch once over a rectangle.
+
+#include "../utils/hittable.h"
+#include "../utils/vec3.h"
+
+// Two unit vectors spanning the plane with normal n
+inline void plane_axes(const vec3& n, vec3& axis_u, vec3& axis_v) {
+    vec3 a = fabs(n.x()) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    axis_u = unit_vector(cross(a, n));
+    axis_v = cross(n, axis_u);
+}
+
+// Plane through point with the given normal, one sided only for shading
+// (rays from below see the back face with the flipped normal)
+class plane : public hittable {
+    public:
+        plane(point3 point, vec3 normal, shared_ptr<material> m)
+            : origin(point), normal(unit_vector(normal)), mat_ptr(m) {
+            plane_axes(this->normal, axis_u, axis_v);
+        }
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb&) const override { return false; }
+
+        virtual bool always_test() const override { return true; }
+
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override {
+            u = dot(rec.p - origin, axis_u) / texture_scale;
+            v = dot(rec.p - origin, axis_v) / texture_scale;
+            uv_size = texture_scale;
+            return true;
+        }
+
+    public:
+        point3 origin;
+        vec3 normal;
+        vec3 axis_u, axis_v;
+        shared_ptr<material> mat_ptr;
+        double texture_scale = 1;
+};
+
+// Distance along r to the plane through q with normal n, false if it is
+// parallel or the distance is outside [t_min, t_max]
+inline bool plane_distance(const ray& r, const point3& q, const vec3& n, double t_min, double t_max, double& t) {
+    auto denominator = dot(n, r.direction());
+    if (fabs(denominator) < 1e-12) return false;
+    t = dot(n, q - r.origin()) / denominator;
+    return t >= t_min && t <= t_max;
+}
+
+bool plane::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    double t;
+    if (!plane_distance(r, origin, normal, t_min, t_max, t)) return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, normal);
+    rec.mat_ptr = mat_ptr.get();
+    rec.object = this;
+    return true;
+}
+
+class disk : public hittable {
+    public:
+        disk(point3 cen, vec3 normal, double r, shared_ptr<material> m, bool always_tested = true)
+            : center(cen), normal(unit_vector(normal)), radius(r), mat_ptr(m), always_tested(always_tested) {
+            plane_axes(this->normal, axis_u, axis_v);
+        }
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual bool always_test() const override { return always_tested; }
+
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override {
+            u = dot(rec.p - center, axis_u) / texture_scale;
+            v = dot(rec.p - center, axis_v) / texture_scale;
+            uv_size = texture_scale;
+            return true;
+        }
+
+    public:
+        point3 center;
+        vec3 normal;
+        vec3 axis_u, axis_v;
+        double radius;
+        shared_ptr<material> mat_ptr;
+        bool always_tested;
+        double texture_scale = 1;
+};
+
+bool disk::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    double t;
+    if (!plane_distance(r, center, normal, t_min, t_max, t)) return false;
+    point3 p = r.at(t);
+    if ((p - center).length_squared() > radius * radius) return false;
+
+    rec.t = t;
+    rec.p = p;
+    rec.set_face_normal(r, normal);
+    rec.mat_ptr = mat_ptr.get();
+    rec.object = this;
+    return true;
+}
+
+bool disk::bounding_box(aabb& output_box) const {
+    // Extent along each axis is radius * sin of the angle to the normal,
+    // padded so a disk facing an axis still has a box with some thickness
+    vec3 extent;
+    for (int a = 0; a < 3; a++)
+        extent[a] = radius * sqrt(fmax(0.0, 1 - normal[a] * normal[a])) + 1e-4;
+    output_box = aabb(center - extent, center + extent);
+    return true;
+}
+
+// Parallelogram corner + a * u + b * v for a, b in [0, 1], a rectangle when
+// u and v are perpendicular
+class rect : public hittable {
+    public:
+        rect(point3 corner, vec3 u, vec3 v, shared_ptr<material> m, bool always_tested = true)
+            : corner(corner), u(u), v(v), mat_ptr(m), always_tested(always_tested) {
+            vec3 n = cross(u, v);
+            normal = unit_vector(n);
+            w = n / dot(n, n);
+        }
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual bool always_test() const override { return always_tested; }
+
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override {
+            vec3 offset = rec.p - corner;
+            u = dot(w, cross(offset, this->v));
+            v = dot(w, cross(this->u, offset));
+            uv_size = this->u.length();
+            return true;
+        }
+
+    public:
+        point3 corner;
+        vec3 u, v;
+        vec3 normal;
+        vec3 w; // cross(u, v) / |cross(u, v)|^2, turns a point into (a, b)
+        shared_ptr<material> mat_ptr;
+        bool always_tested;
+};
+
+bool rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    double t;
+    if (!plane_distance(r, corner, normal, t_min, t_max, t)) return false;
+    point3 p = r.at(t);
+    vec3 offset = p - corner;
+    auto a = dot(w, cross(offset, v));
+    auto b = dot(w, cross(u, offset));
+    if (a < 0 || a > 1 || b < 0 || b > 1) return false;
+
+    rec.t = t;
+    rec.p = p;
+    rec.set_face_normal(r, normal);
+    rec.mat_ptr = mat_ptr.get();
+    rec.object = this;
+    return true;
+}
+
+bool rect::bounding_box(aabb& output_box) const {
+    aabb box = aabb::empty();
+    for (const point3& p : {corner, corner + u, corner + v, corner + u + v})
+        box.grow(p);
+    vec3 pad(1e-4, 1e-4, 1e-4);
+    output_box = aabb(box.min() - pad, box.max() + pad);
+    return true;
+}
+
+#endif
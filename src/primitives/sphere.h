@@ -13,6 +13,10 @@ class sphere : public hittable {
         virtual bool hit(
             const ray& r, double t_min, double t_max, hit_record& rec) const override;
 
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override;
+
     public:
         point3 center;
         double radius;
@@ -43,8 +47,32 @@ bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) cons
     rec.normal = (rec.p - center) / radius;
     vec3 outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
+    rec.object = this;
+
+    return true;
+}
+
+// Longitude and latitude of the point p on a sphere around center, both in
+// [0, 1], with u running once around the y axis; returns the length of u's circle
+inline double sphere_uv(const point3& p, const point3& center, double radius, double& u, double& v) {
+    vec3 n = (p - center) / fabs(radius);
+    u = (atan2(-n.z(), n.x()) + pi) / (2 * pi);
+    v = acos(clamp(-n.y(), -1.0, 1.0)) / pi;
+    return 2 * pi * fabs(radius);
+}
+
+bool sphere::surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const {
+    uv_size = sphere_uv(rec.p, center, radius, u, v);
+    return true;
+}
 
+bool sphere::bounding_box(aabb& output_box) const {
+    // fabs keeps the box valid for the negative radius hollow spheres
+    auto r = fabs(radius);
+    output_box = aabb(
+        center - vec3(r, r, r),
+        center + vec3(r, r, r));
     return true;
 }
 
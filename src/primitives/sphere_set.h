@@ -0,0 +1,155 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+// Many spheres stored as one hittable
+// Spheres are plain records in one array and refer to their material by its
+// index in a scene_arena, so a scene with millions of spheres costs a few
+// large allocations instead of two shared_ptr objects per sphere. The set
+// has its own BVH and gives the same hits as sphere objects. Once built,
+// the spheres are kept as separate center and radius arrays in tree order,
+// so each leaf is tested by the SIMD hit_spheres kernel.
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/bvh.h"
+#include "../utils/bvh_cache.h"
+#include "../utils/hittable.h"
+#include "../utils/scene_arena.h"
+#include "../utils/simd_dispatch.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <vector>
+
+class sphere_set : public hittable {
+    public:
+        sphere_set(shared_ptr<scene_arena> scene_materials) : arena(scene_materials) {}
+
+        void reserve(size_t count) {
+            spheres.reserve(count);
+            material_ids.reserve(count);
+        }
+
+        void add(point3 center, double radius, uint32_t material_id) {
+            spheres.push_back({{center.x(), center.y(), center.z(), radius}});
+            material_ids.push_back(material_id);
+        }
+
+        // Builds the BVH, or loads it from the bvh cache if the same
+        // spheres were built before. Call once after the last add().
+        void build(int max_leaf_size = 2);
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override {
+            uv_size = sphere_uv(rec.p, center(rec.primitive), radius(rec.primitive), u, v);
+            return true;
+        }
+
+        size_t size() const { return material_ids.size(); }
+
+        // Sphere i of the built set
+        point3 center(size_t i) const { return point3(cx[i], cy[i], cz[i]); }
+        double radius(size_t i) const { return radii[i]; }
+
+        size_t memory_bytes() const {
+            return spheres.capacity() * sizeof(sphere_record) +
+                   (cx.capacity() + cy.capacity() + cz.capacity() + radii.capacity()) * sizeof(double) +
+                   material_ids.capacity() * sizeof(uint32_t) + tree.memory_bytes() + arena->memory_bytes();
+        }
+
+    public:
+        // Hashed as raw bytes for the bvh cache, so no padding: four
+        // doubles rather than a vec3 and a radius, which a four lane vec3
+        // would pad to 48 bytes
+        struct sphere_record {
+            double data[4]; // center x, y, z and radius
+
+            point3 center() const { return point3(data[0], data[1], data[2]); }
+            double radius() const { return data[3]; }
+        };
+
+        std::vector<sphere_record> spheres; // as added, released by build()
+        std::vector<double> cx, cy, cz, radii;
+        std::vector<uint32_t> material_ids;
+        shared_ptr<scene_arena> arena;
+        bvh_tree tree;
+};
+
+void sphere_set::build(int max_leaf_size) {
+    std::vector<aabb> boxes(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        // fabs keeps the box valid for the negative radius hollow spheres
+        auto r = fabs(spheres[i].radius());
+        boxes[i] = aabb(spheres[i].center() - vec3(r, r, r), spheres[i].center() + vec3(r, r, r));
+    }
+
+    build_cached(tree, boxes, max_leaf_size, spheres.data(), spheres.size() * sizeof(sphere_record));
+    boxes.clear();
+    boxes.shrink_to_fit();
+
+    // Store the spheres in tree order so every leaf reads one contiguous run
+    // of each array
+    const size_t n = spheres.size();
+    cx.resize(n);
+    cy.resize(n);
+    cz.resize(n);
+    radii.resize(n);
+    std::vector<uint32_t> sorted_ids(n);
+    for (size_t i = 0; i < n; i++) {
+        const sphere_record& s = spheres[tree.prim_indices[i]];
+        cx[i] = s.data[0];
+        cy[i] = s.data[1];
+        cz[i] = s.data[2];
+        radii[i] = s.data[3];
+        sorted_ids[i] = material_ids[tree.prim_indices[i]];
+        tree.prim_indices[i] = static_cast<int>(i);
+    }
+    material_ids.swap(sorted_ids);
+    spheres.clear();
+    spheres.shrink_to_fit();
+}
+
+bool sphere_set::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    const simd_kernels& kernels = simd();
+    int hit_sphere = -1;
+    double hit_t = t_max;
+
+    // prim_indices is the identity after build(), so a leaf is the run of
+    // spheres from its first entry
+    tree.traverse_leaves(r, t_min, t_max, [&](int first, int count, double t_lo, double& closest) {
+        const sphere_soa leaf = {cx.data() + first, cy.data() + first, cz.data() + first, radii.data() + first,
+                                 static_cast<size_t>(count)};
+        double t;
+        int i = kernels.hit_spheres(leaf, r, t_lo, closest, t);
+        if (i < 0)
+            return false;
+        closest = hit_t = t;
+        hit_sphere = first + i;
+        return true;
+    });
+
+    if (hit_sphere < 0)
+        return false;
+
+    rec.t = hit_t;
+    rec.p = r.at(rec.t);
+    vec3 outward_normal = (rec.p - center(hit_sphere)) / radius(hit_sphere);
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = arena->get_material(material_ids[hit_sphere]);
+    rec.object = this;
+    rec.primitive = static_cast<uint32_t>(hit_sphere);
+
+    return true;
+}
+
+bool sphere_set::bounding_box(aabb& output_box) const {
+    if (tree.nodes.empty()) return false;
+    output_box = tree.bounds();
+    return true;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "../utils/hittable.h"
+#include "../utils/vec3.h"
+#include "../utils/bvh.h"
+#include "../utils/bvh_cache.h"
+#include "../utils/wide_bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle mesh with its own BVH over the triangles
+// Vertices are stored as packed floats and faces as three 32 bit indices,
+// so a triangle costs 12 bytes of indices plus a 12 byte precomputed normal
+// on top of the shared vertex array. The BVH is built binary and kept in the
+// compressed 4-wide layout, which is about a third of the size and faster to traverse.
+class triangle_mesh : public hittable {
+    public:
+        triangle_mesh() {}
+        triangle_mesh(std::vector<float> vertex_positions, std::vector<uint32_t> triangle_indices,
+                      shared_ptr<material> m);
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        // Meshes are loaded without texture coordinates, so textures are
+        // projected along the axis the triangle faces most, one repeat per unit
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const override;
+
+        size_t vertex_count() const { return positions.size() / 3; }
+        size_t triangle_count() const { return indices.size() / 3; }
+
+        std::vector<aabb> triangle_boxes() const;
+
+    public:
+        std::vector<float> positions;  // x y z per vertex
+        std::vector<uint32_t> indices; // three vertex indices per triangle
+        std::vector<float> normals;    // unit geometric normal per triangle
+        shared_ptr<material> mat_ptr;
+        wide_bvh tree;
+
+    private:
+        point3 vertex(uint32_t i) const {
+            return point3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+        }
+};
+
+triangle_mesh::triangle_mesh(std::vector<float> vertex_positions, std::vector<uint32_t> triangle_indices,
+                             shared_ptr<material> m)
+    : positions(std::move(vertex_positions)), indices(std::move(triangle_indices)), mat_ptr(m) {
+    // Precompute the edge cross products once so a hit only has to look its normal up
+    size_t count = triangle_count();
+    normals.resize(3 * count);
+    for (size_t f = 0; f < count; f++) {
+        point3 v0 = vertex(indices[3 * f]);
+        point3 v1 = vertex(indices[3 * f + 1]);
+        point3 v2 = vertex(indices[3 * f + 2]);
+
+        vec3 n = cross(v1 - v0, v2 - v0);
+        auto len = n.length();
+        if (len > 0) n /= len;
+        normals[3 * f] = static_cast<float>(n.x());
+        normals[3 * f + 1] = static_cast<float>(n.y());
+        normals[3 * f + 2] = static_cast<float>(n.z());
+    }
+
+    // Large meshes reuse the tree of an earlier run from the bvh cache
+    std::vector<uint64_t> content = {hash_bytes(positions.data(), positions.size() * sizeof(float)),
+                                     hash_bytes(indices.data(), indices.size() * sizeof(uint32_t))};
+    build_cached(tree, triangle_boxes(), 4, content.data(), content.size() * sizeof(uint64_t));
+}
+
+std::vector<aabb> triangle_mesh::triangle_boxes() const {
+    std::vector<aabb> boxes(triangle_count());
+    for (size_t f = 0; f < boxes.size(); f++) {
+        boxes[f] = aabb::empty();
+        for (int k = 0; k < 3; k++)
+            boxes[f].grow(vertex(indices[3 * f + k]));
+    }
+    return boxes;
+}
+
+// Watertight ray/triangle intersection (Woop, Benthin and Wald, JCGT 2013)
+// The ray is sheared so it points along +z, which makes the edge tests
+// exact on shared edges: a ray through an edge hits one of its two triangles.
+struct watertight_ray {
+    int kx, ky, kz;
+    double sx, sy, sz;
+    point3 origin;
+
+    watertight_ray(const ray& r) : origin(r.origin()) {
+        vec3 d = r.direction();
+        kz = fabs(d.x()) > fabs(d.y()) ? (fabs(d.x()) > fabs(d.z()) ? 0 : 2)
+                                       : (fabs(d.y()) > fabs(d.z()) ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        // Keep the winding of the sheared triangle consistent
+        if (d[kz] < 0) std::swap(kx, ky);
+
+        sx = d[kx] / d[kz];
+        sy = d[ky] / d[kz];
+        sz = 1.0 / d[kz];
+    }
+
+    // Returns the hit distance through t on a hit within (t_min, t_max)
+    bool intersect(const point3& v0, const point3& v1, const point3& v2,
+                   double t_min, double t_max, double& t) const {
+        vec3 a = v0 - origin;
+        vec3 b = v1 - origin;
+        vec3 c = v2 - origin;
+
+        double ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+        double bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+        double cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+        double u = cx * by - cy * bx;
+        double v = ax * cy - ay * cx;
+        double w = bx * ay - by * ax;
+
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+            return false;
+
+        double det = u + v + w;
+        if (det == 0)
+            return false;
+
+        double scaled_t = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+        t = scaled_t / det;
+        return t > t_min && t < t_max;
+    }
+};
+
+bool triangle_mesh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    watertight_ray wr(r);
+    int hit_triangle = -1;
+    double hit_t = t_max;
+
+    tree.traverse(r, t_min, t_max, [&](int f, double t_lo, double& closest) {
+        double t;
+        if (!wr.intersect(vertex(indices[3 * f]), vertex(indices[3 * f + 1]), vertex(indices[3 * f + 2]),
+                          t_lo, closest, t))
+            return false;
+        closest = hit_t = t;
+        hit_triangle = f;
+        return true;
+    });
+
+    if (hit_triangle < 0)
+        return false;
+
+    rec.t = hit_t;
+    rec.p = r.at(rec.t);
+    vec3 outward_normal(normals[3 * hit_triangle], normals[3 * hit_triangle + 1], normals[3 * hit_triangle + 2]);
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = mat_ptr.get();
+    rec.object = this;
+    rec.primitive = static_cast<uint32_t>(hit_triangle);
+
+    return true;
+}
+
+bool triangle_mesh::surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const {
+    const float* n = &normals[3 * rec.primitive];
+    int axis = fabs(n[0]) > fabs(n[1]) ? (fabs(n[0]) > fabs(n[2]) ? 0 : 2) : (fabs(n[1]) > fabs(n[2]) ? 1 : 2);
+    u = rec.p[(axis + 1) % 3];
+    v = rec.p[(axis + 2) % 3];
+    uv_size = 1;
+    return true;
+}
+
+bool triangle_mesh::bounding_box(aabb& output_box) const {
+    if (tree.nodes.empty()) return false;
+    output_box = tree.bounds();
+    return true;
+}
+
+#endif
@@ -0,0 +1,693 @@
+// Resident render daemon
+// Listens on a UNIX domain socket and renders jobs against scenes that stay
+// built in memory between jobs, so repeat renders of a scene skip the
+// scene build entirely. Finished tiles are streamed back as they complete.
+//
+// Protocol (one line per request, key=value arguments in any order):
+//   render scene=GHD_scene width=512 height=341 spp=16 depth=8 ...
+//   plan scene=GHD_scene width=512 shards=4 ...
+//   reshade scene=GHD_scene [pick=x,y albedo=r,g,b fuzz=f ir=n] [sky_top=r,g,b] ...
+//   stats
+//   evict [scene=<name>] [scene_seed=<n>]   (no arguments evicts everything)
+//   shutdown
+//
+// render replies with
+//   ok <width> <height> <tiles> <hit|miss> <scene build ms>
+//   tile <x0> <y0> <x1> <y1>        followed by (x1-x0)*(y1-y0)*3 RGB bytes
+//   ...
+//   done <render ms>
+// and any failure is reported as a single "error <message>" line.
+// plan splits the frame (or region) into shards of equal estimated cost for
+// several daemons and replies with
+//   shard <k> tile <x0> <y0> <x1> <y1>
+//   ...
+//   done <tiles>
+// and each shard's tile list is rendered with render ... tiles=x0,y0,x1,y1;...
+//
+// render takes threads=<n> (default all cores), schedule=lpt|scanline and
+// parallel=auto|pixels|samples (see accumulate_tiles).
+// lpt (the default) sizes and orders tiles from a low resolution pre-pass,
+// most expensive first; scanline renders tile x tile squares top to bottom.
+// Tiles arrive in completion order. radiance_cache=<cell size> ends diffuse
+// paths in a radiance cache trained for this job (see radiance_cache.h) and
+// guide=1 samples diffuse bounces from a path guide trained for it
+// (see path_guide.h). live=<path> also publishes the samples in a shared
+// memory file live_view can watch while the job runs (see live_framebuffer.h).
+// temporal=1 renders one frame of a flythrough: the history of the last
+// temporal=1 frame of the same scene, size, spp and depth is reprojected
+// and blended with spp new samples per pixel (see temporal.h), and the
+// seed is advanced by one every frame. The whole frame is rendered, region=
+// only picks the tiles sent back; schedule=, parallel=, radiance_cache= and
+// guide= are ignored, and tiles= and live= are rejected.
+// incremental=1 renders the whole frame keeping every sample's first hit
+// (see incremental.h) as the scene's look-dev frame, replacing the last one;
+// tiles=, live=, the caches and temporal=1 are rejected.
+// reshade edits that frame's scene and reshades only the pixels the edit
+// can change, replying like render with "done <ms> <pixels reshaded>".
+// pick=x,y picks the material seen first by pixel (x, y), which takes
+// albedo= (lambertian and metal), fuzz= (metal) or ir= (dielectric);
+// sky_top= and sky_bottom= set the sky of every later render. Edits stay in
+// the cached scene until it is evicted.
+
+#include "utils/rtweekend.h"
+
+#include "utils/color.h"
+#include "utils/hittable_list.h"
+#include "utils/bvh.h"
+#include "primitives/camera.h"
+#include "utils/incremental.h"
+#include "utils/job_args.h"
+#include "utils/live_framebuffer.h"
+#include "utils/render.h"
+#include "utils/temporal.h"
+#include "utils/tile_scheduler.h"
+#include "scenes/scenes.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+const char *default_socket_path = "/tmp/ghd_render.sock";
+
+// A built scene and its acceleration structure kept alive between jobs
+struct cached_scene
+{
+    shared_ptr<hittable> world;
+    double build_ms;
+    int uses;
+};
+
+// Scenes are keyed by name and the seed their random materials were drawn
+// with, mesh: scenes also by the modification time and size of their file
+// so a file exported again is loaded again
+std::map<std::string, cached_scene> scene_cache;
+
+std::string scene_key(const std::string &name, unsigned int seed)
+{
+    std::string key = name + "@" + std::to_string(seed);
+    struct stat st;
+    if (name.rfind("mesh:", 0) == 0 && stat(name.c_str() + 5, &st) == 0)
+        key += " " + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + " " +
+               std::to_string(st.st_size);
+    return key;
+}
+
+// Drops every cached version of a scene
+void erase_scene(const std::string &name, unsigned int seed)
+{
+    std::string base = name + "@" + std::to_string(seed);
+    for (auto it = scene_cache.begin(); it != scene_cache.end();)
+        if (it->first == base || it->first.rfind(base + " ", 0) == 0)
+            it = scene_cache.erase(it);
+        else
+            ++it;
+}
+
+// History of temporal=1 renders, by scene key, size, spp and depth
+std::map<std::string, std::unique_ptr<temporal_frame>> temporal_histories;
+
+// The last incremental=1 render of a scene, by scene key
+struct incremental_render
+{
+    shared_ptr<hittable> world; // holds the materials of the cached first hits
+    camera cam;
+    sky_gradient sky; // the sky the frame was last shaded with
+    std::vector<tile> tiles;
+    std::unique_ptr<incremental_frame> frame;
+};
+std::map<std::string, std::unique_ptr<incremental_render>> incremental_renders;
+
+// Returns the cached scene, building it first if needed
+// Returns null if the scene name is unknown or its mesh file fails to load
+const cached_scene *get_scene(const std::string &name, unsigned int seed, bool &hit)
+{
+    auto key = scene_key(name, seed);
+    auto it = scene_cache.find(key);
+    hit = it != scene_cache.end();
+    if (hit)
+    {
+        it->second.uses++;
+        return &it->second;
+    }
+
+    // An older version of the mesh file is not used again
+    erase_scene(name, seed);
+
+    auto start = steady_clock::now();
+    hittable_list list;
+    srand(seed);
+    if (!build_scene(name, list))
+        return nullptr;
+    auto world = make_shared<bvh>(list);
+    auto build_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+
+    cached_scene &entry = scene_cache[key];
+    entry.world = world;
+    entry.build_ms = build_ms;
+    entry.uses = 1;
+    return &entry;
+}
+
+// Writes the whole buffer, returns false once the client has gone away
+bool send_all(int fd, const void *data, size_t size)
+{
+    auto p = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        auto n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool send_line(int fd, const std::string &line)
+{
+    return send_all(fd, line.data(), line.size()) && send_all(fd, "\n", 1);
+}
+
+// Image, camera and scene of a render or plan job
+struct job
+{
+    int image_width, image_height;
+    int samples_per_pixel, max_depth, tile_size;
+    tile region;
+    std::string scene_name;
+    const cached_scene *scene;
+    bool hit;
+};
+
+// Parses the job and builds or looks up its scene
+// Returns false after sending an error line (or failing to)
+bool setup_job(int fd, const job_args &args, job &j, bool &alive)
+{
+    auto name = args.count("scene") ? args.at("scene") : std::string("random_scene");
+    unsigned int scene_seed = arg_int(args, "scene_seed", 69);
+    j.scene_name = name;
+
+    // Image
+    j.image_width = arg_int(args, "width", 512);
+    j.image_height = arg_int(args, "height", static_cast<int>(j.image_width / (3.0 / 2.0)));
+    j.samples_per_pixel = arg_int(args, "spp", 16);
+    j.max_depth = arg_int(args, "depth", 8);
+    j.tile_size = arg_int(args, "tile", 32);
+
+    // Region defaults to the full frame, a given one must be all four numbers
+    tile &region = j.region;
+    region = {0, 0, j.image_width, j.image_height};
+    bool region_ok = true;
+    if (args.count("region"))
+    {
+        char comma;
+        std::istringstream in(args.at("region"));
+        region_ok = (in >> region.x0 >> comma >> region.y0 >> comma >> region.x1 >> comma >> region.y1) &&
+                    (in >> std::ws).eof();
+    }
+
+    if (j.image_width < 2 || j.image_height < 2 || j.samples_per_pixel < 1 || j.max_depth < 1 ||
+        j.tile_size < 1 || !region_ok || region.x0 < 0 || region.y0 < 0 || region.x1 > j.image_width ||
+        region.y1 > j.image_height || region.x0 >= region.x1 || region.y0 >= region.y1)
+    {
+        alive = send_line(fd, "error bad image size, spp, depth, tile or region");
+        return false;
+    }
+
+    j.scene = get_scene(name, scene_seed, j.hit);
+    if (!j.scene)
+    {
+        alive = send_line(fd, "error cannot build scene " + name);
+        return false;
+    }
+
+    return true;
+}
+
+// Camera, anything not given falls back to the scene's own view
+camera job_camera(const job_args &args, const job &j)
+{
+    scene_view view = default_view(j.scene_name);
+    point3 lookfrom = arg_vec3(args, "lookfrom", view.lookfrom);
+    point3 lookat = arg_vec3(args, "lookat", view.lookat);
+    vec3 vup = arg_vec3(args, "vup", view.vup);
+    auto vfov = arg_double(args, "vfov", view.vfov);
+    auto dist_to_focus = arg_double(args, "focus", view.dist_to_focus);
+    auto aperture = arg_double(args, "aperture", view.aperture);
+    const double aspect_ratio = static_cast<double>(j.image_width) / j.image_height;
+
+    return camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus);
+}
+
+// Parses "x0,y0,x1,y1;x0,y0,x1,y1;..."
+// Returns false if a tile is malformed or outside the image
+bool parse_tiles(const std::string &text, const job &j, std::vector<tile> &tiles)
+{
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ';'))
+    {
+        tile t;
+        char comma;
+        std::istringstream tile_in(item);
+        if (!(tile_in >> t.x0 >> comma >> t.y0 >> comma >> t.x1 >> comma >> t.y1) ||
+            t.x0 < 0 || t.y0 < 0 || t.x1 > j.image_width || t.y1 > j.image_height ||
+            t.x0 >= t.x1 || t.y0 >= t.y1)
+            return false;
+        tiles.push_back(t);
+    }
+    return !tiles.empty();
+}
+
+// Streams the tiles of a tonemapped frame (3 bytes per pixel) to fd
+bool send_image_tiles(int fd, const std::vector<unsigned char> &image, int width, const std::vector<tile> &tiles)
+{
+    std::vector<unsigned char> rgb;
+    for (const tile &t : tiles)
+    {
+        rgb.clear();
+        for (int y = t.y0; y < t.y1; y++)
+            rgb.insert(rgb.end(), image.begin() + 3 * (y * width + t.x0), image.begin() + 3 * (y * width + t.x1));
+        std::ostringstream tile_header;
+        tile_header << "tile " << t.x0 << ' ' << t.y0 << ' ' << t.x1 << ' ' << t.y1;
+        if (!send_line(fd, tile_header.str()) || !send_all(fd, rgb.data(), rgb.size()))
+            return false;
+    }
+    return true;
+}
+
+// Renders one frame of a flythrough with temporal reuse and streams the
+// region to fd in tile x tile squares
+bool run_temporal(int fd, const job_args &args, const job &j, const camera &cam, int threads, int64_t seed)
+{
+    std::ostringstream key;
+    key << scene_key(j.scene_name, arg_int(args, "scene_seed", 69)) << ' ' << j.image_width << 'x'
+        << j.image_height << ' ' << j.samples_per_pixel << ' ' << j.max_depth;
+    std::unique_ptr<temporal_frame> &frame = temporal_histories[key.str()];
+    if (!frame)
+        frame.reset(new temporal_frame(j.image_width, j.image_height, j.samples_per_pixel, j.max_depth));
+
+    std::vector<tile> tiles = split_tiles(j.region, j.tile_size);
+    std::ostringstream header;
+    header << "ok " << j.image_width << ' ' << j.image_height << ' ' << tiles.size() << ' '
+           << (j.hit ? "hit" : "miss") << ' ' << j.scene->build_ms;
+    if (!send_line(fd, header.str()))
+        return false;
+
+    auto start = steady_clock::now();
+    frame->render(cam, *j.scene->world, seed + frame->frames, threads);
+    std::vector<unsigned char> image;
+    frame->resolve(image);
+    if (!send_image_tiles(fd, image, j.image_width, tiles))
+        return false;
+    auto render_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    return send_line(fd, "done " + std::to_string(render_ms));
+}
+
+// Renders the whole frame keeping its first hits for reshade, replacing
+// the scene's last incremental render, and streams the region to fd
+bool run_incremental(int fd, const job_args &args, const job &j, const camera &cam, int threads, int64_t seed)
+{
+    std::unique_ptr<incremental_render> &entry =
+        incremental_renders[scene_key(j.scene_name, arg_int(args, "scene_seed", 69))];
+    entry.reset(new incremental_render{j.scene->world, cam, scene_sky, split_tiles(j.region, j.tile_size),
+                                       std::unique_ptr<incremental_frame>(new incremental_frame(
+                                           j.image_width, j.image_height, j.samples_per_pixel, j.max_depth, seed))});
+
+    std::ostringstream header;
+    header << "ok " << j.image_width << ' ' << j.image_height << ' ' << entry->tiles.size() << ' '
+           << (j.hit ? "hit" : "miss") << ' ' << j.scene->build_ms;
+    if (!send_line(fd, header.str()))
+        return false;
+
+    auto start = steady_clock::now();
+    entry->frame->render(cam, *entry->world, threads);
+    std::vector<unsigned char> image;
+    entry->frame->resolve(image);
+    if (!send_image_tiles(fd, image, j.image_width, entry->tiles))
+        return false;
+    auto render_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    return send_line(fd, "done " + std::to_string(render_ms));
+}
+
+// Renders one job and streams its tiles to fd
+// Returns false if the connection broke while sending
+bool run_render(int fd, const job_args &args)
+{
+    job j;
+    bool alive = true;
+    if (!setup_job(fd, args, j, alive))
+        return alive;
+    camera cam = job_camera(args, j);
+
+    const int threads = arg_int(args, "threads", std::max(1u, std::thread::hardware_concurrency()));
+    const std::string schedule = args.count("schedule") ? args.at("schedule") : std::string("lpt");
+    const int64_t seed = args.count("seed") ? arg_int(args, "seed", 0) : time(NULL);
+    parallel_mode parallel = parallel_mode::automatic;
+    if (threads < 1 || (schedule != "lpt" && schedule != "scanline") ||
+        arg_double(args, "radiance_cache", 1) <= 0 ||
+        (args.count("parallel") && !parse_parallel_mode(args.at("parallel"), parallel)))
+        return send_line(fd, "error bad threads, schedule, parallel or radiance_cache");
+    if (arg_int(args, "incremental", 0))
+    {
+        if (args.count("tiles") || args.count("live") || args.count("radiance_cache") || args.count("guide") ||
+            arg_int(args, "temporal", 0))
+            return send_line(fd, "error incremental=1 takes no tiles, live, caches or temporal");
+        return run_incremental(fd, args, j, cam, threads, seed);
+    }
+    if (arg_int(args, "temporal", 0))
+    {
+        if (args.count("tiles") || args.count("live"))
+            return send_line(fd, "error temporal=1 takes no tiles or live");
+        return run_temporal(fd, args, j, cam, threads, seed);
+    }
+
+    // An explicit tile list (one shard of a plan) is rendered as given,
+    // otherwise the region is split by the schedule
+    std::vector<tile> tiles;
+    if (args.count("tiles"))
+    {
+        if (!parse_tiles(args.at("tiles"), j, tiles))
+            return send_line(fd, "error bad tiles");
+    }
+    else if (schedule == "scanline")
+        tiles = split_tiles(j.region, j.tile_size);
+    else
+    {
+        // As many tiles as the scanline split would give, sized by cost
+        cost_map estimate = estimate_cost(cam, *j.scene->world, j.image_width, j.image_height, j.max_depth);
+        int tile_count = static_cast<int>(split_tiles(j.region, j.tile_size).size());
+        tiles = plan_tiles(estimate, j.region, std::max(tile_count, 4 * threads));
+    }
+
+    live_framebuffer live;
+    if (args.count("live") && !live.create(args.at("live"), j.image_width, j.image_height, j.samples_per_pixel))
+        return send_line(fd, "error cannot create live framebuffer " + args.at("live"));
+
+    std::ostringstream header;
+    header << "ok " << j.image_width << ' ' << j.image_height << ' ' << tiles.size() << ' '
+           << (j.hit ? "hit" : "miss") << ' ' << j.scene->build_ms;
+    if (!send_line(fd, header.str()))
+        return false;
+
+    auto start = steady_clock::now();
+    render_caches caches;
+    std::unique_ptr<radiance_cache> cache;
+    std::unique_ptr<path_guide> guide;
+    if (args.count("radiance_cache"))
+    {
+        cache.reset(new radiance_cache(arg_double(args, "radiance_cache", 0.1)));
+        train_radiance_cache(*cache, cam, *j.scene->world, j.image_width, j.image_height, j.max_depth,
+                             threads, seed);
+        caches.radiance = cache.get();
+    }
+    if (arg_int(args, "guide", 0))
+    {
+        guide.reset(new path_guide(*j.scene->world));
+        train_path_guide(*guide, cam, *j.scene->world, j.image_width, j.image_height, j.max_depth,
+                         threads, seed);
+        caches.guide = guide.get();
+    }
+
+    bool sent = true;
+    std::vector<unsigned char> rgb;
+    accumulate_tiles(cam, *j.scene->world, tiles, j.image_width, j.image_height,
+                     j.samples_per_pixel, j.max_depth, threads, seed,
+                     [&](const tile &t, const std::vector<color> &sums, double)
+                     {
+                         live.add(t, sums, j.samples_per_pixel);
+                         rgb.resize(3 * sums.size());
+                         simd().tonemap(sums.data(), sums.size(), 1.0 / j.samples_per_pixel, rgb.data());
+                         std::ostringstream tile_header;
+                         tile_header << "tile " << t.x0 << ' ' << t.y0 << ' ' << t.x1 << ' ' << t.y1;
+                         sent = send_line(fd, tile_header.str()) && send_all(fd, rgb.data(), rgb.size());
+                         return sent;
+                     },
+                     nullptr, &caches, parallel);
+    live.close(sent ? live_finished : live_abandoned);
+    if (!sent)
+        return false;
+    auto render_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    return send_line(fd, "done " + std::to_string(render_ms));
+}
+
+// Splits a job into shards of equal estimated cost
+bool run_plan(int fd, const job_args &args)
+{
+    job j;
+    bool alive = true;
+    if (!setup_job(fd, args, j, alive))
+        return alive;
+    camera cam = job_camera(args, j);
+
+    const int shards = arg_int(args, "shards", 2);
+    if (shards < 1)
+        return send_line(fd, "error bad shards");
+
+    // Several tiles per shard so the greedy split can even out the cost
+    cost_map estimate = estimate_cost(cam, *j.scene->world, j.image_width, j.image_height, j.max_depth);
+    int tile_count = std::max(static_cast<int>(split_tiles(j.region, j.tile_size).size()), 8 * shards);
+    auto tiles = plan_tiles(estimate, j.region, tile_count);
+    auto assignment = assign_shards(estimate, tiles, shards);
+
+    for (int k = 0; k < shards; k++)
+    {
+        for (const auto &t : assignment[k])
+        {
+            std::ostringstream line;
+            line << "shard " << k << " tile " << t.x0 << ' ' << t.y0 << ' ' << t.x1 << ' ' << t.y1;
+            if (!send_line(fd, line.str()))
+                return false;
+        }
+    }
+    return send_line(fd, "done " + std::to_string(tiles.size()));
+}
+
+// Edits the sky or the material picked by a pixel of the scene's last
+// incremental render and reshades that frame
+bool run_reshade(int fd, const job_args &args)
+{
+    auto name = args.count("scene") ? args.at("scene") : std::string("random_scene");
+    auto it = incremental_renders.find(scene_key(name, arg_int(args, "scene_seed", 69)));
+    if (it == incremental_renders.end())
+        return send_line(fd, "error no incremental render of " + name);
+    incremental_render &entry = *it->second;
+    incremental_frame &frame = *entry.frame;
+    const int threads = arg_int(args, "threads", std::max(1u, std::thread::hardware_concurrency()));
+    if (threads < 1)
+        return send_line(fd, "error bad threads");
+
+    // The material the first sample of the picked pixel hit first
+    material *picked = nullptr;
+    if (args.count("pick"))
+    {
+        int x = -1, y = -1;
+        char comma;
+        std::istringstream in(args.at("pick"));
+        if (!(in >> x >> comma >> y) || !(in >> std::ws).eof() || x < 0 || y < 0 || x >= frame.width ||
+            y >= frame.height)
+            return send_line(fd, "error bad pick");
+        const primary_sample &sample = frame.samples[(static_cast<size_t>(y) * frame.width + x) * frame.samples_per_pixel];
+        if (!sample.hit)
+            return send_line(fd, "error pick sees the sky");
+        picked = const_cast<material *>(sample.rec.mat_ptr);
+    }
+    auto diffuse = dynamic_cast<lambertian *>(picked);
+    auto shiny = dynamic_cast<metal *>(picked);
+    auto glass = dynamic_cast<dielectric *>(picked);
+
+    // Every value is checked before anything is edited
+    const bool edit_albedo = args.count("albedo"), edit_fuzz = args.count("fuzz"), edit_ir = args.count("ir");
+    color albedo = arg_vec3(args, "albedo", color(0, 0, 0));
+    double fuzz = arg_double(args, "fuzz", 0);
+    double ir = arg_double(args, "ir", 1.5);
+    sky_gradient sky = scene_sky;
+    sky.top = arg_vec3(args, "sky_top", sky.top);
+    sky.bottom = arg_vec3(args, "sky_bottom", sky.bottom);
+    if ((edit_albedo && !diffuse && !shiny) || (edit_fuzz && !shiny) || (edit_ir && !glass))
+        return send_line(fd, "error the picked material has no such parameter");
+    if (albedo.x() < 0 || albedo.y() < 0 || albedo.z() < 0 || !(fuzz >= 0) || !(ir > 0))
+        return send_line(fd, "error bad albedo, fuzz or ir");
+
+    if (edit_albedo)
+        (diffuse ? diffuse->albedo : shiny->albedo) = albedo;
+    if (edit_fuzz)
+        shiny->fuzz = fuzz < 1 ? fuzz : 1;
+    if (edit_ir)
+        glass->ir = ir;
+    std::vector<const material *> changed;
+    if (edit_albedo || edit_fuzz || edit_ir)
+        changed.push_back(picked);
+
+    // The sky is shared by every scene, so it is compared with the one this
+    // frame was last shaded with rather than the one before the edit
+    scene_sky = sky;
+    bool sky_changed = false;
+    for (int c = 0; c < 3; c++)
+        sky_changed = sky_changed || entry.sky.top[c] != sky.top[c] || entry.sky.bottom[c] != sky.bottom[c];
+    entry.sky = sky;
+    if (!changed.empty() || sky_changed)
+        temporal_histories.clear();
+
+    std::ostringstream header;
+    header << "ok " << frame.width << ' ' << frame.height << ' ' << entry.tiles.size() << " hit 0";
+    if (!send_line(fd, header.str()))
+        return false;
+
+    auto start = steady_clock::now();
+    size_t pixels = frame.reshade(entry.cam, *entry.world, changed, sky_changed, threads);
+    std::vector<unsigned char> image;
+    frame.resolve(image);
+    if (!send_image_tiles(fd, image, frame.width, entry.tiles))
+        return false;
+    auto render_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    return send_line(fd, "done " + std::to_string(render_ms) + " " + std::to_string(pixels));
+}
+
+bool run_stats(int fd)
+{
+    for (const auto &entry : scene_cache)
+    {
+        std::ostringstream line;
+        line << "scene " << entry.first << " build_ms=" << entry.second.build_ms
+             << " uses=" << entry.second.uses;
+        if (!send_line(fd, line.str()))
+            return false;
+    }
+    return send_line(fd, "done " + std::to_string(scene_cache.size()));
+}
+
+bool run_evict(int fd, const job_args &args)
+{
+    temporal_histories.clear();
+    incremental_renders.clear();
+    if (!args.count("scene"))
+        scene_cache.clear();
+    else
+        erase_scene(args.at("scene"), arg_int(args, "scene_seed", 69));
+    return send_line(fd, "done " + std::to_string(scene_cache.size()));
+}
+
+// Serves requests from one client until it disconnects
+// Returns false if the client asked the daemon to shut down
+bool serve_client(int fd)
+{
+    std::string pending;
+    char buffer[4096];
+    while (true)
+    {
+        auto newline = pending.find('\n');
+        if (newline == std::string::npos)
+        {
+            auto n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+                return true;
+            pending.append(buffer, n);
+            continue;
+        }
+
+        std::istringstream line(pending.substr(0, newline));
+        pending.erase(0, newline + 1);
+
+        std::string command;
+        line >> command;
+        auto args = parse_args(line);
+
+        bool alive;
+        try
+        {
+            if (command == "render")
+                alive = run_render(fd, args);
+            else if (command == "reshade")
+                alive = run_reshade(fd, args);
+            else if (command == "plan")
+                alive = run_plan(fd, args);
+            else if (command == "stats")
+                alive = run_stats(fd);
+            else if (command == "evict")
+                alive = run_evict(fd, args);
+            else if (command == "shutdown")
+            {
+                send_line(fd, "done 0");
+                return false;
+            }
+            else if (command.empty())
+                alive = true;
+            else
+                alive = send_line(fd, "error unknown command " + command);
+        }
+        catch (const std::exception &e)
+        {
+            // std::stoi and friends on malformed arguments
+            alive = send_line(fd, std::string("error ") + e.what());
+        }
+
+        if (!alive)
+            return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = argc > 1 ? argv[1] : default_socket_path;
+
+    // A client closing early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        std::cerr << "socket path too long: " << socket_path << '\n';
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+
+    if (bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(server, 8) < 0)
+    {
+        perror(socket_path);
+        return 1;
+    }
+    std::cerr << "Listening on " << socket_path << std::endl;
+
+    bool running = true;
+    while (running)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        running = serve_client(client);
+        close(client);
+    }
+
+    close(server);
+    unlink(socket_path);
+    std::cerr << "Shut down" << std::endl;
+}
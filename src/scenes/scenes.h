@@ -0,0 +1,961 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+// Built-in scenes
+// Every scene builder returns a hittable_list and draws its random
+// materials from rand(), so call srand() before building one if
+// the result has to be reproducible.
+
+#include "../utils/rtweekend.h"
+
+#include "../utils/hittable_list.h"
+#include "../primitives/plane.h"
+#include "../primitives/sphere.h"
+#include "../primitives/sphere_set.h"
+#include "../primitives/triangle_mesh.h"
+#include "../utils/material.h"
+#include "../utils/mesh_loader.h"
+#include "../utils/scene_arena.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::vector<std::vector<double>> generate_spheres(double scale)
+{
+    // Z, Y, X, R
+    std::vector<std::vector<double>> spheres{
+        {-0.4518, -0.0159, 0.1662, 0.1575},
+        {-0.422, -0.0159, 0.6069, 0.1465},
+        {-0.4518, -0.0159, 1.4322, 0.1575},
+        {0.129, -0.0159, 0.8182, 0.1255},
+        {0.5103, -0.0159, 1.0015, 0.1189},
+        {0.5874, -0.0159, 0.1161, 0.1157},
+        {0.5214, -0.0159, 0.3798, 0.1569},
+        {0.5188, -0.0159, 0.7095, 0.1718},
+        {0.4157, -0.0159, 0.1224, 0.0573},
+        {0.6425, -0.0159, 0.5376, 0.0403},
+        {-0.3577, -0.0159, 0.3895, 0.0854},
+        {-0.5256, -0.0159, 0.4022, 0.0854},
+        {-0.5243, -0.0159, 0.8144, 0.0854},
+        {-0.5676, -0.0159, 0.7075, 0.0294},
+        {-0.5714, -0.0159, 0.5129, 0.0294},
+        {0.4168, -0.0159, 0.8844, 0.0294},
+        {0.6411, -0.0159, 0.8915, 0.0523},
+        {-0.2017, -0.0159, 0.8436, 0.1255},
+        {-0.0084, -0.0159, 0.9233, 0.0473},
+        {-0.0208, -0.0159, 0.8474, 0.0271},
+        {-0.0244, -0.0159, 0.7419, 0.0457},
+        {-0.5243, -0.0159, 1.1994, 0.0854},
+        {-0.3669, -0.0159, 1.2191, 0.0704},
+        {-0.4124, -0.0159, 1.0474, 0.1043},
+        {-0.5617, -0.0159, 1.0704, 0.0453},
+        {-0.5513, -0.0159, 0.9646, 0.06},
+        {-0.3878, -0.0159, 0.8762, 0.0621},
+        {-0.413, -0.0159, 0.7863, 0.0294},
+        {-0.4711, -0.0159, 0.9254, 0.0294},
+        {-0.0333, -0.0159, 0.8058, 0.0168},
+        {0.3123, -0.0159, 0.8947, 0.0735},
+        {0.3013, -0.0159, 0.7622, 0.0563},
+        {0.2384, -0.0159, 0.7138, 0.024},
+        {0.0545, -0.0159, 0.942, 0.0181},
+        {0.2214, -0.0159, 0.9427, 0.0278},
+        {0.086, -0.0159, 0.9527, 0.0146},
+        {-1.954, -0.0159, 1.0511, 0.044},
+        {0.1431, -0.0159, 0.9569, 0.0134},
+        {0.1799, -0.0159, 0.9475, 0.0136},
+        {-0.5885, -0.0159, 0.6085, 0.0192},
+        {-0.5805, -0.0159, 1.5672, 0.0294},
+        {-0.3148, -0.0159, 1.5647, 0.0294},
+        {-0.3111, -0.0159, 1.1379, 0.0294},
+        {-0.316, -0.0159, 0.9524, 0.032},
+        {-0.3016, -0.0159, 0.4866, 0.0249},
+        {-0.3082, -0.0159, 0.2863, 0.0294},
+        {-0.3075, -0.0159, 0.0393, 0.0332},
+        {-0.5804, -0.0159, 0.3011, 0.0294},
+        {0.4191, -0.0159, 0.5355, 0.0294},
+        {0.6525, -0.0159, 0.2467, 0.0294},
+        {0.4671, -0.0159, 0.1981, 0.0294},
+        {-0.3516, -0.0159, 0.7733, 0.0294},
+        {0.5812, -0.0159, 1.3058, 0.1136},
+        {0.4603, -0.0159, 1.4835, 0.1006},
+        {0.4149, -0.0159, 1.3288, 0.0569},
+        {0.6127, -0.0159, 1.479, 0.0569},
+        {0.4524, -0.0159, 1.2494, 0.0294},
+        {0.5682, -0.0159, 1.5547, 0.0294},
+        {0.6241, -0.0159, 1.5636, 0.0294},
+        {0.3813, -0.0159, 1.5758, 0.0198},
+        {0.6707, -0.0159, 1.5723, 0.017},
+        {0.6633, -0.0159, 1.5386, 0.017},
+        {0.6518, -0.0159, 1.4139, 0.017},
+        {0.4599, -0.0159, 1.2011, 0.0203},
+        {0.6759, -0.0159, 0.8249, 0.0223},
+        {0.6431, -0.0159, 1.1446, 0.0566},
+        {-0.293, -0.0159, 1.0826, 0.0197},
+        {1.2626, -0.0159, 0.1662, 0.1575},
+        {1.2924, -0.0159, 0.6069, 0.1465},
+        {1.2626, -0.0159, 1.4322, 0.1575},
+        {1.3567, -0.0159, 0.3895, 0.0854},
+        {1.1888, -0.0159, 0.4022, 0.0854},
+        {1.1901, -0.0159, 0.8144, 0.0854},
+        {1.1468, -0.0159, 0.7075, 0.0294},
+        {1.143, -0.0159, 0.5129, 0.0294},
+        {1.1901, -0.0159, 1.1994, 0.0854},
+        {1.3474, -0.0159, 1.2191, 0.0704},
+        {1.302, -0.0159, 1.0474, 0.1043},
+        {1.1527, -0.0159, 1.0704, 0.0453},
+        {1.1584, -0.0159, 0.959, 0.0626},
+        {1.3266, -0.0159, 0.8762, 0.0621},
+        {1.3014, -0.0159, 0.7863, 0.0294},
+        {1.2453, -0.0159, 0.9244, 0.03},
+        {1.1356, -0.0159, 0.6598, 0.0192},
+        {1.1305, -0.0159, 1.5628, 0.0294},
+        {1.3897, -0.0159, 1.5682, 0.0294},
+        {1.4017, -0.0159, 1.1349, 0.0294},
+        {1.3904, -0.0159, 0.9438, 0.0294},
+        {1.4087, -0.0159, 0.4858, 0.0216},
+        {1.4069, -0.0159, 0.2881, 0.0294},
+        {1.4073, -0.0159, 0.0485, 0.0294},
+        {1.134, -0.0159, 0.3011, 0.0294},
+        {1.3628, -0.0159, 0.7733, 0.0294},
+        {1.4042, -0.0159, 0.82, 0.0326},
+        {1.1322, -0.0159, 1.2987, 0.0294},
+        {1.4267, -0.0159, 1.5228, 0.0294},
+        {-1.1398, -0.0159, 0.3569, 0.1465},
+        {-1.0823, -0.0159, 0.134, 0.0854},
+        {-1.2508, -0.0159, 0.1533, 0.0854},
+        {-1.2209, -0.0159, 0.5728, 0.0854},
+        {-1.2735, -0.0159, 0.4707, 0.0294},
+        {-1.286, -0.0159, 0.2618, 0.0294},
+        {-1.1069, -0.0159, 0.7994, 0.0995},
+        {-1.2579, -0.0159, 0.8321, 0.0534},
+        {-1.2526, -0.0159, 0.7175, 0.0626},
+        {-1.0844, -0.0159, 0.6346, 0.0621},
+        {-1.1096, -0.0159, 0.5447, 0.0294},
+        {-1.166, -0.0159, 0.6806, 0.0328},
+        {-1.2948, -0.0159, 0.4196, 0.0192},
+        {-1.0208, -0.0159, 0.7023, 0.0305},
+        {-1.0196, -0.0159, 0.2289, 0.0294},
+        {-1.0578, -0.0159, 0.5095, 0.0294},
+        {-1.0238, -0.0159, 0.5636, 0.0326},
+        {-1.4519, -0.0159, 0.8781, 0.0193},
+        {-1.5318, -0.0159, 0.8078, 0.0854},
+        {-1.4157, -0.0159, 0.6975, 0.0729},
+        {-1.503, -0.0159, 0.6476, 0.0294},
+        {-1.3341, -0.0159, 0.7536, 0.0266},
+        {-1.4389, -0.0159, 0.7788, 0.0135},
+        {-1.321, -0.0159, 0.6502, 0.0334},
+        {-1.3001, -0.0159, 0.311, 0.0192},
+        {-2.0018, -0.0159, 0.7721, 0.0505},
+        {-1.5699, -0.0159, 0.6808, 0.0467},
+        {-1.3811, -0.0159, 0.8317, 0.0661},
+        {-1.5174, -0.0159, 0.7103, 0.0135},
+        {-1.5009, -0.0159, 0.6899, 0.0135},
+        {-1.5407, -0.0159, 0.6279, 0.0135},
+        {-1.6066, -0.0159, 0.6312, 0.0148},
+        {-1.6048, -0.0159, 0.7351, 0.0166},
+        {-1.605, -0.0159, 0.8793, 0.0171},
+        {-1.3296, -0.0159, 0.7127, 0.0155},
+        {0.4149, -0.0159, 1.1448, 0.0536},
+        {0.5097, -0.0159, 1.1641, 0.0446},
+        {0.3943, -0.0159, 1.2295, 0.0325},
+        {0.4173, -0.0159, 1.2633, 0.009},
+        {0.4336, -0.0159, 1.2156, 0.0095},
+        {0.3868, -0.0159, 1.0699, 0.0246},
+        {0.5749, -0.0159, 1.1741, 0.0202},
+        {0.5661, -0.0159, 1.1299, 0.0227},
+        {0.3839, -0.0159, 0.9516, 0.0189},
+        {0.3767, -0.0159, 0.9909, 0.0159},
+        {0.377, -0.0159, 1.0261, 0.0169},
+        {0.6351, -0.0159, 1.0681, 0.0227},
+        {0.661, -0.0159, 0.9747, 0.0341},
+        {0.6547, -0.0159, 1.0281, 0.0236},
+        {0.6779, -0.0159, 1.0672, 0.0202},
+        {0.6857, -0.0159, 1.0129, 0.0113},
+        {0.6871, -0.0159, 1.0364, 0.0113},
+        {-0.0994, -0.0159, 0.7223, 0.0286},
+        {-0.3038, -0.0159, 0.7319, 0.0278},
+        {-0.1481, -0.0159, 0.7091, 0.0209},
+        {-1.5994, -0.0159, 0.0324, 0.0538},
+        {-0.2154, -0.0159, 0.7046, 0.0143},
+        {-0.2519, -0.0159, 0.7094, 0.017},
+        {-0.0603, -0.0159, 0.831, 0.0179},
+        {-0.0809, -0.0159, 0.9413, 0.0288},
+        {-0.0581, -0.0159, 0.8769, 0.0219},
+        {-1.8718, -0.0159, 0.0766, 0.0397},
+        {-1.3197, -0.0159, 0.041, 0.0465},
+        {-0.1192, -0.0159, 0.9559, 0.0124},
+        {-0.0823, -0.0159, 0.7653, 0.019},
+        {0.0323, -0.0159, 0.7126, 0.0179},
+        {0.0609, -0.0159, 0.7011, 0.0124},
+        {-0.0652, -0.0159, 0.702, 0.0117},
+        {-1.4594, -0.0159, 0.1362, 0.1219},
+        {-2.1034, -0.0159, 0.5721, 0.1726},
+        {-2.1084, -0.0159, 0.9384, 0.1465},
+        {-2.0393, -0.0159, 1.2222, 0.1465},
+        {-1.185, -0.0159, 1.4393, 0.1439},
+        {-1.4144, -0.0159, 1.5191, 0.0998},
+        {-1.6138, -0.0159, 1.5105, 0.0998},
+        {-1.7831, -0.0159, 1.3731, 0.1184},
+        {-1.9249, 0.0, 0.2577, 0.1507},
+        {-1.7385, -0.0159, 0.0938, 0.0971},
+        {-1.6285, -0.0159, 0.2043, 0.0596},
+        {-1.7276, -0.0159, 0.2477, 0.0468},
+        {-2.1266, -0.0159, 0.3361, 0.0655},
+        {-1.9271, -0.0159, 0.45, 0.0425},
+        {-2.2376, -0.0159, 0.7735, 0.0655},
+        {-2.202, -0.0159, 1.1097, 0.048},
+        {-1.8481, -0.0159, 1.2274, 0.0446},
+        {-1.9468, -0.0159, 1.3912, 0.0446},
+        {-2.0254, -0.0159, 1.4041, 0.0362},
+        {-1.9843, -0.0159, 1.4507, 0.0257},
+        {-1.9162, -0.0159, 1.4722, 0.0429},
+        {-1.761, -0.0159, 1.5347, 0.0447},
+        {-1.5089, -0.0159, 1.3949, 0.0551},
+        {-1.6199, -0.0159, 1.3661, 0.0461},
+        {-1.3647, -0.0159, 1.3808, 0.0461},
+        {-1.5162, -0.0159, 1.5918, 0.0252},
+        {-1.3234, -0.0159, 1.5924, 0.0178},
+        {-1.3027, -0.0159, 1.5462, 0.015},
+        {-1.2844, -0.0159, 1.5814, 0.0232},
+        {-1.247, -0.0159, 1.5826, 0.0134},
+        {-1.0539, -0.0159, 1.5288, 0.0152},
+        {-1.0322, -0.0159, 1.4725, 0.0138},
+        {-1.0216, -0.0159, 1.5074, 0.0231},
+        {-1.1171, -0.0159, 1.2848, 0.0254},
+        {-1.092, -0.0159, 1.3137, 0.0131},
+        {-1.1541, -0.0159, 1.2862, 0.0115},
+        {2.2397, -0.0159, 0.9034, 0.1726},
+        {2.181, -0.0159, 0.5418, 0.1465},
+        {2.0586, -0.0159, 0.281, 0.1442},
+        {1.7162, -0.0159, 0.1482, 0.1402},
+        {2.1286, -0.0, 1.2512, 0.1465},
+        {1.9688, -0.0159, 1.4343, 0.0971},
+        {1.9314, -0.0159, 1.2893, 0.0536},
+        {2.3035, -0.0159, 1.1317, 0.0655},
+        {2.0906, -0.0159, 1.0584, 0.0456},
+        {2.3369, -0.0159, 0.6818, 0.0655},
+        {2.2404, -0.0159, 0.3538, 0.0537},
+        {1.86, -0.0159, 0.2803, 0.0558},
+        {1.8976, -0.0159, 0.1818, 0.0446},
+        {1.5742, -0.0, 1.4589, 0.1337},
+        {1.7954, -0.0, 1.5005, 0.0808},
+        {1.7455, -0.0, 1.3692, 0.058},
+        {1.8404, -0.0159, 1.3885, 0.0404},
+        {1.846, -0.0159, 1.3139, 0.0348},
+        {1.8921, -0.0159, 0.0921, 0.0446},
+        {1.9491, -0.0159, 0.1384, 0.0226},
+        {1.9667, -0.0159, 0.0939, 0.0243},
+        {1.9916, -0.0159, 0.1311, 0.0199},
+        {2.2995, -0.0159, 0.4249, 0.0202},
+        {2.3065, -0.0159, 0.3852, 0.0206},
+        {2.3327, -0.0159, 0.4161, 0.0135},
+        {1.501, -0.0159, 0.1923, 0.0854},
+        {1.4772, -0.0159, 0.0652, 0.0436},
+        {1.5638, -0.0159, 0.0446, 0.0441},
+        {1.3505, -0.0159, 0.0169, 0.0165},
+        {-1.3436, -0.0159, 0.241, 0.0355},
+        {-1.6142, -0.0159, 0.1164, 0.0296},
+        {-1.5252, -0.0159, 0.004, 0.0253},
+        {-1.3826, -0.0159, 0.0122, 0.0242},
+        {-2.1074, -0.0159, 0.2412, 0.0309},
+        {-2.2015, -0.0159, 0.3966, 0.0283},
+        {-1.1774, -0.0159, 0.0556, 0.0366},
+        {-1.2417, -0.0159, 0.0381, 0.0307},
+        {-2.2686, -0.0159, 0.8639, 0.03},
+        {-2.2727, -0.0159, 0.9144, 0.02},
+        {-2.2711, -0.0159, 0.9532, 0.0182},
+        {-2.2446, -0.0159, 1.0469, 0.0279},
+        {-2.2682, -0.0159, 1.0163, 0.0104},
+        {1.5911, -0.0159, 0.2545, 0.0243},
+        {1.9054, -0.0159, 0.344, 0.0223},
+        {-1.312, -0.0159, 0.7917, 0.0135},
+        {-1.3019, -0.0159, 0.7709, 0.01},
+        {-2.2777, -0.0159, 0.9793, 0.008},
+        {-1.8484, -0.0159, 1.5122, 0.0357},
+        {-1.4316, -0.0159, 1.3977, 0.0233},
+        {-1.8772, -0.0159, 1.1635, 0.0257},
+        {-1.9016, -0.0159, 1.1179, 0.0257},
+        {-2.1444, -0.0159, 0.766, 0.0285},
+        {-2.0987, -0.0159, 0.7696, -0.0174},
+        {-2.2676, -0.0159, 0.6854, 0.0261},
+        {-2.0492, -0.0159, 0.3829, 0.0245},
+        {-1.9832, -0.0159, 0.4195, 0.0233},
+        {-2.0168, -0.0159, 0.4063, 0.0152},
+        {-2.0659, -0.0159, 0.7709, -0.0145},
+        {-2.2013, -0.0159, 1.1829, 0.0226},
+        {-1.9142, -0.0159, 1.3331, 0.0217},
+        {-1.9058, -0.0159, 1.0808, 0.0125},
+        {-1.8861, -0.0159, 1.2803, 0.0202},
+        {-1.465, -0.0159, 0.6283, 0.0128},
+        {-2.1968, -0.0159, 1.2201, 0.0129},
+        {-2.0745, -0.0159, 1.3828, 0.0181},
+        {-2.0971, -0.0159, 1.3675, 0.0112},
+        {-2.112, -0.0159, 1.3569, 0.0067},
+        {-2.1205, -0.0159, 1.35, 0.0046},
+        {-1.9723, -0.0159, 0.8368, 0.021},
+        {-1.9487, -0.0159, 0.9865, 0.0201},
+        {2.0289, -0.0159, 0.4533, 0.0299},
+        {-1.9514, -0.0159, 0.9269, 0.0108},
+        {-0.1387, -0.0159, 0.9623, 0.008},
+        {-1.9614, -0.0159, 0.8748, 0.0142},
+        {-1.3122, -0.0159, 0.8784, 0.0177},
+        {-1.1991, -0.0159, 0.8759, 0.0199},
+        {-1.0122, -0.0159, 0.8748, 0.0212},
+        {-1.0077, -0.0159, 0.7449, 0.0145},
+        {-1.0067, -0.0159, 0.6558, 0.0178},
+        {-1.0076, -0.0159, 0.6108, 0.0178},
+        {-1.0142, -0.0159, 0.4739, 0.0228},
+        {-1.0096, -0.0159, 0.5147, 0.0178},
+        {-2.0841, -0.0159, 0.1933, 0.021},
+        {-1.9343, -0.0159, 0.0843, 0.0228},
+        {-2.0339, -0.0159, 0.1368, 0.0135},
+        {-2.0542, -0.0159, 0.1571, 0.0149},
+        {-1.9265, -0.0159, 0.5094, 0.0152},
+        {-1.8792, -0.0159, 0.4157, 0.0152},
+        {-1.763, -0.0159, 0.2994, 0.0162},
+        {-1.9679, -0.0159, 0.71, 0.0208},
+        {-1.7124, -0.0159, 1.5757, 0.0181},
+        {-1.6887, -0.0159, 1.5894, 0.0085},
+        {-1.6759, -0.0159, 1.5954, 0.0055},
+        {-1.5124, -0.0159, 1.4631, 0.0128},
+        {-1.5748, -0.0159, 1.4054, 0.0128},
+        {-1.4439, -0.0159, 1.3568, 0.019},
+        {-1.7897, -0.0159, 1.241, 0.0139},
+        {-0.292, -0.0159, 1.0182, 0.0197},
+        {-0.2936, -0.0159, 1.5167, 0.0228},
+        {-0.2847, -0.0159, 1.4642, 0.0135},
+        {-0.5953, -0.0159, 1.5266, 0.0135},
+        {-0.5381, -0.0159, 1.5813, 0.0147},
+        {-0.6019, -0.0159, 1.5023, 0.0101},
+        {-0.3086, -0.0159, 1.3061, 0.0326},
+        {-0.5815, -0.0159, 1.2999, 0.0276},
+        {-1.3133, -0.0159, 1.3541, 0.0128},
+        {-1.3407, -0.0159, 1.4345, 0.0128},
+        {-0.5947, -0.0159, 1.3395, 0.0128},
+        {-0.2894, -0.0159, 1.3639, 0.0182},
+        {-0.59, -0.0159, 0.0551, 0.0209},
+        {-0.5607, -0.0159, 0.0259, 0.0209},
+        {-0.5947, -0.0159, 0.0196, 0.0153},
+        {-0.529, -0.0159, 0.0146, 0.0127},
+        {-0.5071, -0.0159, 0.0099, 0.0091},
+        {-0.4912, -0.0159, 0.0069, 0.0069},
+        {-0.3548, -0.0159, 0.02, 0.018},
+        {-0.3099, -0.0159, 0.0811, 0.0084},
+        {-0.2867, -0.0159, 0.0831, 0.0145},
+        {-0.2887, -0.0159, 0.1129, 0.0145},
+        {-0.3826, -0.0159, 0.0125, 0.0107},
+        {-0.4012, -0.0159, 0.0084, 0.0078},
+        {-0.2852, -0.0159, 0.1405, 0.0117},
+        {-0.2917, -0.0159, 0.2415, 0.0191},
+        {-0.2848, -0.0159, 0.2025, 0.0126},
+        {-0.4458, -0.0159, 0.3385, 0.0144},
+        {-0.4376, -0.0159, 0.4479, 0.0126},
+        {2.2263, -0.0159, 0.2762, 0.0262},
+        {2.336, -0.0159, 0.4579, 0.0285},
+        {2.3649, -0.0159, 0.5373, 0.0249},
+        {2.3711, -0.0159, 0.5917, 0.0322},
+        {2.3615, -0.0159, 0.4962, 0.0166},
+        {2.2446, -0.0159, 0.7029, 0.0289},
+        {2.1211, -0.0159, 0.7234, 0.0425},
+        {2.18, -0.0159, 0.7234, 0.0182},
+        {2.2094, -0.0159, 0.7217, 0.0115},
+        {2.1992, -0.0159, 0.7015, 0.0112},
+        {2.3903, -0.0159, 0.7653, 0.0332},
+        {2.3642, -0.0159, 1.0613, 0.0274},
+        {2.1542, -0.0159, 1.0827, 0.0235},
+        {2.2211, -0.0159, 1.1078, 0.0235},
+        {2.1846, -0.0159, 1.1034, 0.012},
+        {2.2991, -0.0159, 1.2263, 0.0258},
+        {1.4373, -0.0159, 1.3609, 0.0323},
+        {1.4083, -0.0159, 0.8957, 0.0223},
+        {1.4124, -0.0159, 0.9898, 0.022},
+        {1.4429, -0.0159, 1.5734, 0.0222},
+        {1.7015, -0.0159, 1.5638, 0.0265},
+        {1.8934, -0.0159, 1.5352, 0.0232},
+        {2.1022, -0.0159, 1.4303, 0.0345},
+        {1.9654, -0.0159, 1.2225, 0.0215},
+        {1.9883, -0.0159, 0.4271, 0.0189},
+        {1.9301, -0.0159, 0.3724, 0.0144},
+        {2.0282, -0.0159, 0.4997, 0.0144},
+        {1.7861, -0.0159, 0.2901, 0.018},
+        {1.1272, -0.0159, 0.0498, 0.0222},
+        {1.1574, -0.0159, 0.0303, 0.0141},
+        {1.1343, -0.0159, 0.015, 0.0137},
+        {0.4013, -0.0159, 0.2241, 0.0398},
+        {0.4614, -0.0159, 0.0468, 0.0315},
+        {0.4069, -0.0159, 0.0413, 0.0232},
+        {0.3891, -0.0159, 0.4963, 0.0194},
+        {0.386, -0.0159, 0.5717, 0.0194},
+        {0.3762, -0.0159, 0.5355, 0.0148},
+        {0.3774, -0.0159, 0.4668, 0.0123},
+        {0.3574, -0.0159, 0.8132, 0.0204},
+        {0.6794, -0.0159, 1.2144, 0.0196},
+        {0.6794, -0.0159, 1.4421, 0.0196},
+        {0.6804, -0.0159, 0.0192, 0.0176},
+        {0.6773, -0.0159, 0.2921, 0.0211},
+        {0.6727, -0.0159, 0.4838, 0.0211},
+        {0.681, -0.0159, 0.4472, 0.0154},
+        {1.3864, -0.0159, 1.3029, 0.0222},
+        {1.4808, -0.0159, 1.5802, 0.0153},
+        {1.5059, -0.0159, 1.584, 0.0088},
+        {1.3488, -0.0159, 1.581, 0.0145},
+        {1.3267, -0.0159, 1.5855, 0.0084},
+        {1.3118, -0.0159, 1.5886, 0.0068},
+        {1.4078, -0.0159, 0.7386, 0.0278},
+        {1.1347, -0.0159, 0.628, 0.0124},
+        {1.1303, -0.0159, 0.5627, 0.0209},
+        {2.0432, -0.0159, 1.1074, 0.0209},
+        {2.0192, -0.0159, 1.1325, 0.0138},
+        {-0.5853, -0.0159, 0.6547, 0.0246},
+        {-0.5897, -0.0159, 0.8961, 0.0184},
+        {-0.5919, -0.0159, 1.1236, 0.0156},
+        {-0.5978, -0.0159, 1.2634, 0.0119},
+        {-0.5934, -0.0159, 1.0242, 0.0128},
+        {-0.5948, -0.0159, 0.7432, 0.0141},
+        {-0.5999, -0.0159, 0.6853, 0.0094},
+        {-0.5841, -0.0159, 0.568, 0.0215},
+        {0.4113, -0.0159, 1.5842, 0.0112},
+        {0.3712, -0.0159, 1.5472, 0.0098},
+        {0.4312, -0.0159, 1.5884, 0.008},
+        {0.6895, -0.0159, 1.5886, 0.008},
+        {1.1715, -0.0159, 1.5769, -0.0136},
+        {1.1885, -0.0159, 1.5894, -0.0066},
+        {1.1165, -0.0159, 1.5226, -0.0136},
+        {1.1079, -0.0159, 1.5901, -0.0053},
+        {1.1087, -0.0159, 1.5017, -0.0082},
+        {-1.002, -0.0159, 0.0812, 0.0131},
+        {-1.5586, -0.0159, 1.3487, 0.0171},
+        {-1.5505, -0.0159, 1.6041, -0.0118},
+        {-1.4813, -0.0159, 1.607, -0.0118}};
+
+    return spheres;
+}
+
+// Scenes
+// GHD_scene and random_scene keep their spheres in one sphere_set and their
+// materials in a scene_arena. Floors are planes, which a bvh tests on every
+// ray instead of stretching its boxes over them.
+
+// The part of space min <= p[axis] < max, for building only the share of
+// a scene one process of a distributed render holds (see distributed.h).
+// An object belongs to the slab its center is in, the ground plane to the
+// slab of the origin. GHD_scene, random_scene and stress_scene still draw
+// the numbers of the spheres they leave out, so the ones they keep are the
+// same as in the whole scene.
+struct scene_slab
+{
+    int axis = 0;
+    double min = -infinity;
+    double max = infinity;
+
+    bool whole() const { return min == -infinity && max == infinity; }
+    bool contains(const point3 &p) const { return p[axis] >= min && p[axis] < max; }
+};
+
+// The y = height ground plane the scenes stand on
+shared_ptr<plane> ground_plane(double height, shared_ptr<material> m)
+{
+    return make_shared<plane>(point3(0, height, 0), vec3(0, 1, 0), m);
+}
+
+hittable_list GHD_scene(const scene_slab &slab = scene_slab())
+{
+    auto arena = make_shared<scene_arena>();
+    auto spheres = make_shared<sphere_set>(arena);
+
+    // list of x,y,z,R s
+    std::vector<std::vector<double>> sphere_list = generate_spheres(1.0);
+
+    // for each sphere on that list
+    for (size_t i = 0; i < sphere_list.size(); i++)
+    {
+        auto choose_mat = random_double();
+        // axis mismatch fix
+        point3 center(sphere_list[i][1],
+                      sphere_list[i][2],
+                      -1 * sphere_list[i][0]);
+        bool keep = slab.contains(center);
+
+        // select a random material
+        uint32_t sphere_material = 0;
+        if (choose_mat < 0.8)
+        {
+            // diffuse
+            auto albedo = color::random() * color::random();
+            if (keep)
+                sphere_material = arena->add_material<lambertian>(albedo);
+        }
+        else if (choose_mat < 0.99)
+        {
+            // metal
+            auto albedo = color::random(0.5, 1);
+            auto fuzz = random_double(0, 0.5);
+            if (keep)
+                sphere_material = arena->add_material<metal>(albedo, fuzz);
+        }
+        else if (keep)
+        {
+            // glass
+            sphere_material = arena->add_material<dielectric>(1.5);
+        }
+
+        // create ith sphere and give it a random material
+        if (keep)
+            spheres->add(center, sphere_list[i][3], sphere_material);
+    }
+
+    spheres->build();
+    hittable_list world(spheres);
+    if (slab.contains(point3(0, 0, 0)))
+        world.add(ground_plane(0, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+    return world;
+}
+
+// The small spheres fill a (2*grid)^2 grid of unit cells, the default gives
+// the book's scene and larger grids scale it up (grid 1581 is 10^7 spheres)
+hittable_list random_scene(int grid = 11, const scene_slab &slab = scene_slab())
+{
+    auto arena = make_shared<scene_arena>();
+    auto spheres = make_shared<sphere_set>(arena);
+    if (slab.whole())
+        spheres->reserve(4 * static_cast<size_t>(grid) * grid + 3);
+
+    for (int a = -grid; a < grid; a++)
+    {
+        for (int b = -grid; b < grid; b++)
+        {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9)
+            {
+                bool keep = slab.contains(center);
+                uint32_t sphere_material = 0;
+
+                if (choose_mat < 0.8)
+                {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    if (keep)
+                        sphere_material = arena->add_material<lambertian>(albedo);
+                }
+                else if (choose_mat < 0.95)
+                {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    if (keep)
+                        sphere_material = arena->add_material<metal>(albedo, fuzz);
+                }
+                else if (keep)
+                {
+                    // glass
+                    sphere_material = arena->add_material<dielectric>(1.5);
+                }
+                if (keep)
+                    spheres->add(center, 0.2, sphere_material);
+            }
+        }
+    }
+
+    if (slab.contains(point3(0, 1, 0)))
+    {
+        auto material1 = arena->add_material<dielectric>(1.5);
+        spheres->add(point3(0, 1, 0), 1.0, material1);
+    }
+
+    if (slab.contains(point3(-4, 1, 0)))
+    {
+        auto material2 = arena->add_material<lambertian>(color(0.4, 0.2, 0.1));
+        spheres->add(point3(-4, 1, 0), 1.0, material2);
+    }
+
+    if (slab.contains(point3(4, 1, 0)))
+    {
+        auto material3 = arena->add_material<metal>(color(0.7, 0.6, 0.5), 0.0);
+        spheres->add(point3(4, 1, 0), 1.0, material3);
+    }
+
+    spheres->build();
+    hittable_list world(spheres);
+    if (slab.contains(point3(0, 0, 0)))
+        world.add(ground_plane(0, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+    return world;
+}
+
+// Parametric stress scene
+// random_scene and GHD_scene grown to any number of spheres, one sphere per
+// unit of ground area so the camera sees the same density at any size.
+//   uniform     random_scene's 0.2 radius spheres spread evenly
+//   clustered   GHD_scene like groups of small spheres of mixed sizes
+//   overlapping large spheres floating through each other, the worst case
+//               for a BVH since every box overlaps many others
+enum class stress_distribution
+{
+    uniform,
+    clustered,
+    overlapping
+};
+
+struct stress_params
+{
+    size_t count = 100000;
+    stress_distribution distribution = stress_distribution::uniform;
+    double diffuse = 0.8; // material mix, glass gets what is left
+    double metal = 0.15;
+    unsigned int seed = 69;
+};
+
+const char *distribution_name(stress_distribution d)
+{
+    switch (d)
+    {
+    case stress_distribution::clustered:
+        return "clustered";
+    case stress_distribution::overlapping:
+        return "overlapping";
+    default:
+        return "uniform";
+    }
+}
+
+// Largest sphere count a stress scene takes
+const double max_stress_count = 1e10;
+
+// Parses "count=1e6,dist=clustered,mix=0.7/0.2/0.1,seed=3", every key is
+// optional. The count must be in [1, max_stress_count] and no mix weight
+// negative.
+bool parse_stress_params(const std::string &spec, stress_params &params)
+{
+    size_t begin = 0;
+    while (begin < spec.size())
+    {
+        size_t end = spec.find(',', begin);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string field = spec.substr(begin, end - begin);
+        begin = end + 1;
+
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            return false;
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+        try
+        {
+            if (key == "count")
+            {
+                // Checked as a double, casting a negative or NaN one to size_t is undefined
+                size_t used = 0;
+                double count = std::stod(value, &used);
+                if (used != value.size() || !(count >= 1 && count <= max_stress_count))
+                    return false;
+                params.count = static_cast<size_t>(count);
+            }
+            else if (key == "seed")
+                params.seed = static_cast<unsigned int>(std::stoul(value));
+            else if (key == "dist" && value == "uniform")
+                params.distribution = stress_distribution::uniform;
+            else if (key == "dist" && value == "clustered")
+                params.distribution = stress_distribution::clustered;
+            else if (key == "dist" && value == "overlapping")
+                params.distribution = stress_distribution::overlapping;
+            else if (key == "mix")
+            {
+                double diffuse = 0, metal = 0, glass = 0;
+                char slash;
+                std::istringstream in(value);
+                if (!(in >> diffuse >> slash >> metal >> slash >> glass) || diffuse < 0 || metal < 0 || glass < 0 ||
+                    diffuse + metal + glass <= 0)
+                    return false;
+                params.diffuse = diffuse / (diffuse + metal + glass);
+                params.metal = metal / (diffuse + metal + glass);
+            }
+            else
+                return false;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return params.count > 0;
+}
+
+hittable_list stress_scene(const stress_params &params, const scene_slab &slab = scene_slab())
+{
+    srand(params.seed);
+    auto arena = make_shared<scene_arena>();
+    auto spheres = make_shared<sphere_set>(arena);
+    if (slab.whole())
+        spheres->reserve(params.count);
+
+    // Square of one unit of area per sphere on the y = 0 ground plane
+    const double side = sqrt(static_cast<double>(params.count));
+
+    // Draws a material, and adds it to the arena if keep
+    auto random_material = [&](bool keep) -> uint32_t
+    {
+        auto choose_mat = random_double();
+        if (choose_mat < params.diffuse)
+        {
+            auto albedo = color::random() * color::random();
+            return keep ? arena->add_material<lambertian>(albedo) : 0;
+        }
+        if (choose_mat < params.diffuse + params.metal)
+        {
+            auto albedo = color::random(0.5, 1);
+            auto fuzz = random_double(0, 0.5);
+            return keep ? arena->add_material<metal>(albedo, fuzz) : 0;
+        }
+        return keep ? arena->add_material<dielectric>(1.5) : 0;
+    };
+
+    // Groups of a few hundred spheres a couple of units across, like GHD_scene's
+    const size_t cluster_size = 256;
+    const double cluster_spread = 0.06 * sqrt(static_cast<double>(cluster_size));
+    point3 cluster_center;
+
+    for (size_t i = 0; i < params.count; i++)
+    {
+        double x, z, radius, lift = 0;
+        if (params.distribution == stress_distribution::clustered)
+        {
+            if (i % cluster_size == 0)
+                cluster_center = point3(random_double(-side / 2, side / 2), 0, random_double(-side / 2, side / 2));
+            // Sum of two uniforms, denser towards the middle of the group
+            x = cluster_center.x() + cluster_spread * (random_double(-1, 1) + random_double(-1, 1));
+            z = cluster_center.z() + cluster_spread * (random_double(-1, 1) + random_double(-1, 1));
+            radius = random_double(0.015, 0.16);
+        }
+        else if (params.distribution == stress_distribution::overlapping)
+        {
+            x = random_double(-side / 2, side / 2);
+            z = random_double(-side / 2, side / 2);
+            radius = random_double(0.5, 1.5);
+            lift = random_double(0, 2);
+        }
+        else
+        {
+            x = random_double(-side / 2, side / 2);
+            z = random_double(-side / 2, side / 2);
+            radius = 0.2;
+        }
+        point3 center(x, radius + lift, z);
+        bool keep = slab.contains(center);
+        uint32_t sphere_material = random_material(keep);
+        if (keep)
+            spheres->add(center, radius, sphere_material);
+    }
+
+    spheres->build();
+    hittable_list world(spheres);
+    if (slab.contains(point3(0, 0, 0)))
+        world.add(ground_plane(0, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+    return world;
+}
+
+hittable_list floor_sphere_scene()
+{
+    hittable_list world;
+    auto material_ground = make_shared<metal>(color(0.8, 0.8, 0.8), 0.35);
+    auto material_ball = make_shared<lambertian>(color(0.8, 0.15, 0.05));
+    world.add(make_shared<sphere>(point3(0, 0, -1), 0.5, material_ball));
+    world.add(ground_plane(-0.5, material_ground));
+    return world;
+}
+
+hittable_list three_spheres_scene()
+{
+    hittable_list world;
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<lambertian>(color(0.7, 0.3, 0.3));
+    auto material_left = make_shared<metal>(color(0.8, 0.8, 0.8), 0.3);
+    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
+    world.add(ground_plane(-0.5, material_ground));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    return world;
+}
+
+hittable_list three_spheres_scene2()
+{
+    hittable_list world;
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<dielectric>(1.5);
+    auto material_left = make_shared<dielectric>(1.5);
+    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+    world.add(ground_plane(-0.5, material_ground));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    return world;
+}
+
+hittable_list three_spheres_scene3()
+{
+    hittable_list world;
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left = make_shared<dielectric>(1.5);
+    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
+    world.add(ground_plane(-0.5, material_ground));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    return world;
+}
+
+hittable_list fov_scene()
+{
+    auto R = cos(pi / 4);
+    hittable_list world;
+    auto material_left = make_shared<lambertian>(color(0, 0, 1));
+    auto material_right = make_shared<lambertian>(color(1, 0, 0));
+    world.add(make_shared<sphere>(point3(-R, 0, -1), R, material_left));
+    world.add(make_shared<sphere>(point3(R, 0, -1), R, material_right));
+    return world;
+}
+
+// A mesh file (OBJ or PLY) standing on the ground of random_scene
+// The mesh is scaled to fit a 4 unit box and moved to the origin so the
+// default camera frames it, returns false if the file can't be loaded
+bool mesh_scene(const std::string &path, hittable_list &world)
+{
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    if (!load_mesh(path, positions, indices))
+        return false;
+
+    aabb box = aabb::empty();
+    for (size_t i = 0; i < positions.size(); i += 3)
+        box.grow(point3(positions[i], positions[i + 1], positions[i + 2]));
+    auto size = box.max() - box.min();
+    auto scale = 4.0 / fmax(size.x(), fmax(size.y(), size.z()));
+    point3 base(box.centroid().x(), box.min().y(), box.centroid().z());
+    for (size_t i = 0; i < positions.size(); i += 3)
+        for (int axis = 0; axis < 3; axis++)
+            positions[i + axis] = static_cast<float>((positions[i + axis] - base[axis]) * scale);
+
+    world.add(ground_plane(0, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+
+    auto mesh_material = make_shared<lambertian>(color(0.7, 0.3, 0.3));
+    world.add(make_shared<triangle_mesh>(std::move(positions), std::move(indices), mesh_material));
+    return true;
+}
+
+// The three spheres on a textured ground: albedo_path colors the ground
+// and the center sphere, roughness_path (may be empty) scales the fuzz of
+// the metal sphere on the right. Textures are texture files written by
+// make_texture and are read through default_texture_cache(). Returns false
+// if a texture can't be opened.
+bool textured_scene(const std::string &albedo_path, const std::string &roughness_path, hittable_list &world)
+{
+    auto albedo = load_texture(albedo_path);
+    if (!albedo)
+        return false;
+    shared_ptr<texture> roughness;
+    if (!roughness_path.empty() && !(roughness = load_texture(roughness_path)))
+        return false;
+
+    auto ground = make_shared<plane>(point3(0, -0.5, 0), vec3(0, 1, 0), make_shared<lambertian>(albedo));
+    ground->texture_scale = 2;
+    world.add(ground);
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, make_shared<lambertian>(albedo, color(0.9, 0.9, 0.9))));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5,
+                                  make_shared<metal>(color(0.8, 0.6, 0.2), 1.0, nullptr, roughness)));
+    return true;
+}
+
+// Camera placement that frames a scene
+struct scene_view
+{
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+    double vfov; // vertical field-of-view in degrees
+    double aperture;
+    double dist_to_focus;
+};
+
+// The view each built-in scene was made for
+scene_view default_view(const std::string &name)
+{
+    if (name == "floor_sphere_scene" || name.rfind("three_spheres_scene", 0) == 0 || name.rfind("textured:", 0) == 0)
+        return {point3(-2, 2, 1), point3(0, 0, -1), vec3(0, 1, 0), 40, 0.0, sqrt(12.0)};
+    if (name == "fov_scene")
+        return {point3(0, 0, 0), point3(0, 0, -1), vec3(0, 1, 0), 90, 0.0, 1.0};
+    // random_scene, GHD_scene, stress scenes and meshes
+    return {point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 19, 0.1, 12.0};
+}
+
+// Returns true and fills world if name refers to one of the scenes above
+// "mesh:<path>" loads a mesh file into mesh_scene and "stress:<params>"
+// builds a stress_scene, e.g. "stress:count=1e6,dist=clustered".
+// "textured:<albedo.tex>[,<roughness.tex>]" builds a textured_scene.
+// With a slab only the objects in it are kept (see scene_slab).
+bool build_scene(const std::string &name, hittable_list &world, const scene_slab &slab = scene_slab())
+{
+    if (name.rfind("stress:", 0) == 0)
+    {
+        stress_params params;
+        if (!parse_stress_params(name.substr(7), params))
+            return false;
+        world = stress_scene(params, slab);
+        return true;
+    }
+    if (name == "random_scene")
+    {
+        world = random_scene(11, slab);
+        return true;
+    }
+    if (name == "GHD_scene")
+    {
+        world = GHD_scene(slab);
+        return true;
+    }
+
+    // The other scenes are built whole and cut down to the slab
+    if (name.rfind("mesh:", 0) == 0)
+    {
+        if (!mesh_scene(name.substr(5), world))
+            return false;
+    }
+    else if (name.rfind("textured:", 0) == 0)
+    {
+        std::string paths = name.substr(9);
+        size_t comma = paths.find(',');
+        if (!textured_scene(paths.substr(0, comma), comma == std::string::npos ? "" : paths.substr(comma + 1), world))
+            return false;
+    }
+    else if (name == "floor_sphere_scene")
+        world = floor_sphere_scene();
+    else if (name == "three_spheres_scene")
+        world = three_spheres_scene();
+    else if (name == "three_spheres_scene2")
+        world = three_spheres_scene2();
+    else if (name == "three_spheres_scene3")
+        world = three_spheres_scene3();
+    else if (name == "fov_scene")
+        world = fov_scene();
+    else
+        return false;
+
+    if (!slab.whole())
+    {
+        std::vector<shared_ptr<hittable>> kept;
+        for (const auto &object : world.objects)
+        {
+            aabb box;
+            if (slab.contains(object->bounding_box(box) ? box.centroid() : point3(0, 0, 0)))
+                kept.push_back(object);
+        }
+        world.objects.swap(kept);
+    }
+    return true;
+}
+
+#endif
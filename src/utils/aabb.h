@@ -0,0 +1,88 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+// Axis-aligned bounding box
+class aabb {
+    public:
+        aabb() {}
+        aabb(const point3& a, const point3& b) { minimum = a; maximum = b; }
+
+        point3 min() const { return minimum; }
+        point3 max() const { return maximum; }
+
+        bool hit(const ray& r, double t_min, double t_max) const {
+            for (int a = 0; a < 3; a++) {
+                auto invD = 1.0f / r.direction()[a];
+                auto t0 = (min()[a] - r.origin()[a]) * invD;
+                auto t1 = (max()[a] - r.origin()[a]) * invD;
+                if (invD < 0.0f)
+                    std::swap(t0, t1);
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max <= t_min)
+                    return false;
+            }
+            return true;
+        }
+
+        // Slab test with the reciprocal direction precomputed by the caller,
+        // t_near receives the entry distance on a hit
+        bool hit(const point3& origin, const vec3& inv_dir, double t_min, double t_max, double& t_near) const {
+            for (int a = 0; a < 3; a++) {
+                auto t0 = (minimum.e[a] - origin.e[a]) * inv_dir.e[a];
+                auto t1 = (maximum.e[a] - origin.e[a]) * inv_dir.e[a];
+                if (inv_dir.e[a] < 0.0)
+                    std::swap(t0, t1);
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max < t_min)
+                    return false;
+            }
+            t_near = t_min;
+            return true;
+        }
+
+        point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+        double surface_area() const {
+            auto d = maximum - minimum;
+            return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+        }
+
+        // Index of the longest axis
+        int longest_axis() const {
+            auto d = maximum - minimum;
+            if (d.x() > d.y() && d.x() > d.z()) return 0;
+            return d.y() > d.z() ? 1 : 2;
+        }
+
+        // An inverted box that any surrounding_box/grow call replaces
+        static aabb empty() {
+            return aabb(point3(infinity, infinity, infinity), point3(-infinity, -infinity, -infinity));
+        }
+
+        void grow(const point3& p) {
+            minimum = point3(fmin(minimum.x(), p.x()), fmin(minimum.y(), p.y()), fmin(minimum.z(), p.z()));
+            maximum = point3(fmax(maximum.x(), p.x()), fmax(maximum.y(), p.y()), fmax(maximum.z(), p.z()));
+        }
+
+    public:
+        point3 minimum;
+        point3 maximum;
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1) {
+    point3 small(fmin(box0.min().x(), box1.min().x()),
+                 fmin(box0.min().y(), box1.min().y()),
+                 fmin(box0.min().z(), box1.min().z()));
+
+    point3 big(fmax(box0.max().x(), box1.max().x()),
+               fmax(box0.max().y(), box1.max().y()),
+               fmax(box0.max().z(), box1.max().z()));
+
+    return aabb(small, big);
+}
+
+#endif
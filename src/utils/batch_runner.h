@@ -0,0 +1,318 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+// Batch rendering on one worker pool
+// A batch is a list of jobs (scene, camera, resolution, samples, output
+// file), one per line of a job file in the render daemon's key=value form:
+//   scene=GHD_scene width=512 spp=64 out=renders/ghd.ppm
+//   scene=fov_scene width=256 height=256 vfov=60 out=renders/fov.ppm
+// All jobs share one pool of workers that take the next tile of the oldest
+// job that still has tiles to hand out. A loader thread builds the next
+// job's scene, BVH and tile plan while the current one renders, so when the
+// last tiles of a job are handed out the free workers go straight on to the
+// next job instead of waiting for the job's slowest tiles. The job a worker
+// finishes last is written by that worker while the others keep rendering.
+// At most two jobs are unfinished at a time, which bounds the memory to two
+// scenes and frames. sequential mode starts every job only once the one
+// before it is written, as rendering them one by one does.
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "job_args.h"
+#include "render.h"
+#include "simd_dispatch.h"
+#include "tile_scheduler.h"
+#include "../primitives/camera.h"
+#include "../scenes/scenes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One render of a batch
+struct batch_job
+{
+    std::string scene;
+    unsigned int scene_seed = 69;
+    int image_width = 512, image_height = 341;
+    int samples_per_pixel = 16, max_depth = 8;
+    scene_view view;
+    int64_t seed = 1;
+    std::string output;
+    int line = 0; // in the job file
+};
+
+// Fills job from the arguments of one job file line. scene and out are
+// required, everything else falls back to the render daemon's defaults and
+// the scene's own view (see default_view).
+// Returns false with a message in error if an argument is unknown or bad.
+bool parse_batch_job(const job_args &args, batch_job &job, std::string &error)
+{
+    static const std::set<std::string> known = {"scene", "scene_seed", "width", "height", "spp", "depth",
+                                                "lookfrom", "lookat", "vup", "vfov", "aperture", "focus",
+                                                "seed", "out"};
+    for (const auto &arg : args)
+    {
+        if (!known.count(arg.first))
+        {
+            error = "unknown argument " + arg.first;
+            return false;
+        }
+    }
+    if (!args.count("scene") || !args.count("out"))
+    {
+        error = "scene and out are required";
+        return false;
+    }
+
+    job.scene = args.at("scene");
+    job.output = args.at("out");
+    job.scene_seed = arg_int(args, "scene_seed", 69);
+    job.image_width = arg_int(args, "width", 512);
+    job.image_height = arg_int(args, "height", static_cast<int>(job.image_width / (3.0 / 2.0)));
+    job.samples_per_pixel = arg_int(args, "spp", 16);
+    job.max_depth = arg_int(args, "depth", 8);
+    job.seed = arg_int(args, "seed", 1);
+
+    scene_view view = default_view(job.scene);
+    job.view.lookfrom = arg_vec3(args, "lookfrom", view.lookfrom);
+    job.view.lookat = arg_vec3(args, "lookat", view.lookat);
+    job.view.vup = arg_vec3(args, "vup", view.vup);
+    job.view.vfov = arg_double(args, "vfov", view.vfov);
+    job.view.aperture = arg_double(args, "aperture", view.aperture);
+    job.view.dist_to_focus = arg_double(args, "focus", view.dist_to_focus);
+
+    if (job.image_width < 2 || job.image_height < 2 || job.samples_per_pixel < 1 || job.max_depth < 1)
+    {
+        error = "bad image size, spp or depth";
+        return false;
+    }
+    return true;
+}
+
+// Reads a job file, one job per line, # starts a comment
+// Returns false after printing every bad line
+bool read_batch_file(const std::string &path, std::vector<batch_job> &jobs)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "cannot read " << path << "\n";
+        return false;
+    }
+
+    bool ok = true;
+    std::string text;
+    for (int line = 1; std::getline(in, text); line++)
+    {
+        std::istringstream fields(text.substr(0, text.find('#')));
+        job_args args = parse_args(fields);
+        if (args.empty())
+            continue;
+
+        batch_job job;
+        job.line = line;
+        std::string error;
+        try
+        {
+            if (parse_batch_job(args, job, error))
+            {
+                jobs.push_back(job);
+                continue;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            // std::stoi and friends on malformed numbers
+            error = std::string("bad number, ") + e.what();
+        }
+        std::cerr << path << ":" << line << ": " << error << "\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// What happened to one job of a batch
+struct batch_job_report
+{
+    bool ok = false;      // the scene was built and every tile rendered
+    double build_ms = 0;  // scene, BVH and tile plan
+    double render_ms = 0; // first tile started to last tile finished
+    size_t tiles = 0;
+};
+
+struct batch_report
+{
+    std::vector<batch_job_report> jobs;
+    double seconds = 0;
+    double busy_seconds = 0; // rendering tiles, summed over the workers
+    int threads = 0;
+
+    // Share of the workers' time spent rendering tiles
+    double utilization() const { return seconds > 0 ? busy_seconds / (seconds * threads) : 0; }
+};
+
+// Renders every job on threads workers (plus the loader thread) and calls
+// on_job(index, job, job_report, rgb) with the tonemapped frame (3 bytes per
+// pixel, rows top to bottom, empty if the scene failed to build) as each job
+// finishes, one call at a time, jobs finishing in about their list order.
+// sequential finishes each job before building the next.
+template <typename job_fn>
+batch_report run_batch(const std::vector<batch_job> &jobs, int threads, bool sequential, job_fn &&on_job)
+{
+    using clock = std::chrono::steady_clock;
+
+    struct job_state
+    {
+        shared_ptr<hittable> world;
+        std::unique_ptr<camera> cam;
+        std::vector<tile> tiles;
+        std::vector<unsigned char> rgb;
+        size_t next = 0; // tile to hand out
+        size_t left = 0; // tiles not finished
+        bool ready = false;
+        clock::time_point started;
+    };
+    std::vector<job_state> state(jobs.size());
+
+    batch_report report;
+    report.jobs.resize(jobs.size());
+    report.threads = threads;
+
+    std::mutex lock, output_lock;
+    std::condition_variable changed;
+    size_t current = 0;  // oldest job that may have tiles to hand out
+    size_t finished = 0; // jobs written
+    auto start = clock::now();
+
+    auto finish = [&](size_t k)
+    {
+        {
+            std::lock_guard<std::mutex> guard(output_lock);
+            on_job(k, jobs[k], report.jobs[k], state[k].rgb);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        state[k].world.reset();
+        std::vector<unsigned char>().swap(state[k].rgb);
+        finished++;
+        changed.notify_all();
+    };
+
+    auto load = [&]()
+    {
+        for (size_t k = 0; k < jobs.size(); k++)
+        {
+            {
+                // The next job is built while the one before it renders
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return finished + (sequential ? 0 : 1) >= k; });
+            }
+
+            const batch_job &job = jobs[k];
+            job_state &s = state[k];
+            auto build_start = clock::now();
+            hittable_list list;
+            srand(job.scene_seed);
+            bool built = build_scene(job.scene, list);
+            if (built)
+            {
+                s.world = make_shared<bvh>(list);
+                const scene_view &v = job.view;
+                s.cam.reset(new camera(v.lookfrom, v.lookat, v.vup, v.vfov,
+                                       static_cast<double>(job.image_width) / job.image_height, v.aperture,
+                                       v.dist_to_focus));
+                cost_map estimate = estimate_cost(*s.cam, *s.world, job.image_width, job.image_height, job.max_depth);
+                s.tiles = plan_tiles(estimate, {0, 0, job.image_width, job.image_height}, 16 * threads);
+                s.rgb.resize(3 * static_cast<size_t>(job.image_width) * job.image_height);
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                report.jobs[k].build_ms = std::chrono::duration<double, std::milli>(clock::now() - build_start).count();
+                report.jobs[k].tiles = s.tiles.size();
+                s.left = s.tiles.size();
+                s.ready = true;
+                changed.notify_all();
+            }
+            if (!built)
+                finish(k);
+        }
+    };
+
+    auto worker = [&]()
+    {
+        std::vector<color> sums;
+        std::vector<unsigned char> tile_rgb;
+        while (true)
+        {
+            size_t k;
+            tile t;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while (current < jobs.size() && state[current].ready && state[current].next == state[current].tiles.size())
+                    current++;
+                if (current == jobs.size())
+                    return;
+                if (!state[current].ready)
+                {
+                    changed.wait(guard);
+                    continue;
+                }
+                k = current;
+                if (state[k].next == 0)
+                    state[k].started = clock::now();
+                t = state[k].tiles[state[k].next++];
+            }
+
+            const batch_job &job = jobs[k];
+            job_state &s = state[k];
+            auto tile_start = clock::now();
+            accumulate_tile(*s.cam, *s.world, t, job.image_width, job.image_height, job.samples_per_pixel,
+                            job.max_depth, sums, nullptr, job.seed);
+            tile_rgb.resize(3 * sums.size());
+            simd().tonemap(sums.data(), sums.size(), 1.0 / job.samples_per_pixel, tile_rgb.data());
+            for (int y = t.y0; y < t.y1; ++y)
+                std::copy(tile_rgb.begin() + 3 * (y - t.y0) * t.width(), tile_rgb.begin() + 3 * (y - t.y0 + 1) * t.width(),
+                          s.rgb.begin() + 3 * (static_cast<size_t>(y) * job.image_width + t.x0));
+            auto tile_end = clock::now();
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                report.busy_seconds += std::chrono::duration<double>(tile_end - tile_start).count();
+                last = --s.left == 0;
+                if (last)
+                {
+                    report.jobs[k].ok = true;
+                    report.jobs[k].render_ms = std::chrono::duration<double, std::milli>(tile_end - s.started).count();
+                }
+            }
+            if (last)
+                finish(k);
+        }
+    };
+
+    std::thread loader(load);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+    loader.join();
+
+    report.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    return report;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef BVH_H
+#define BVH_H
+
+// Bounding volume hierarchy
+// bvh_tree is a flat binary BVH over an arbitrary set of primitive boxes,
+// bvh wraps it into a hittable that accelerates a hittable_list.
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <vector>
+
+// Node of a flattened binary BVH
+// The left child of an inner node always directly follows it in the node array
+struct bvh_node {
+    aabb box;
+    int offset; // inner node: index of the right child, leaf: first entry in prim_indices
+    int count;  // number of primitives in a leaf, 0 for inner nodes
+    int axis;   // split axis of an inner node, decides which child is visited first
+};
+
+class bvh_tree {
+    public:
+        // Builds the tree over the primitive boxes with a binned SAH
+        void build(const std::vector<aabb>& prim_boxes, int max_leaf_size = 4);
+
+        aabb bounds() const { return nodes.empty() ? aabb::empty() : nodes[0].box; }
+
+        size_t memory_bytes() const {
+            return nodes.size() * sizeof(bvh_node) + prim_indices.size() * sizeof(int);
+        }
+
+        // Visits every leaf the ray can reach, nearer children first
+        // hit_primitive(prim, t_min, closest) returns true on a hit and shrinks closest
+        template <typename hit_fn>
+        bool traverse(const ray& r, double t_min, double t_max, hit_fn&& hit_primitive) const;
+
+        // Same as traverse, one call per leaf: hit_leaf(first, count, t_min,
+        // closest) tests prim_indices[first] to prim_indices[first + count - 1]
+        template <typename leaf_fn>
+        bool traverse_leaves(const ray& r, double t_min, double t_max, leaf_fn&& hit_leaf) const;
+
+    public:
+        std::vector<bvh_node> nodes;
+        std::vector<int> prim_indices;
+
+    private:
+        static const int bin_count = 16;
+        static const int max_sah_depth = 48;
+
+        void build_node(int node_index, int begin, int end, int depth);
+
+        const std::vector<aabb>* boxes = nullptr;
+        std::vector<point3> centroids;
+        int leaf_size = 4;
+};
+
+void bvh_tree::build(const std::vector<aabb>& prim_boxes, int max_leaf_size) {
+    nodes.clear();
+    prim_indices.resize(prim_boxes.size());
+    if (prim_boxes.empty()) return;
+
+    boxes = &prim_boxes;
+    leaf_size = max_leaf_size;
+    centroids.resize(prim_boxes.size());
+    for (size_t i = 0; i < prim_boxes.size(); i++) {
+        prim_indices[i] = static_cast<int>(i);
+        centroids[i] = prim_boxes[i].centroid();
+    }
+
+    // A binary tree with n leaves has 2n-1 nodes
+    nodes.reserve(2 * prim_boxes.size() / std::max(1, max_leaf_size) + 1);
+    nodes.push_back(bvh_node());
+    build_node(0, 0, static_cast<int>(prim_boxes.size()), 0);
+
+    nodes.shrink_to_fit();
+    boxes = nullptr;
+    centroids.clear();
+    centroids.shrink_to_fit();
+}
+
+void bvh_tree::build_node(int node_index, int begin, int end, int depth) {
+    aabb box = aabb::empty();
+    aabb centroid_box = aabb::empty();
+    for (int i = begin; i < end; i++) {
+        const aabb& b = (*boxes)[prim_indices[i]];
+        box = surrounding_box(box, b);
+        centroid_box.grow(centroids[prim_indices[i]]);
+    }
+
+    nodes[node_index].box = box;
+    nodes[node_index].offset = begin;
+    nodes[node_index].count = end - begin;
+    nodes[node_index].axis = 0;
+
+    int count = end - begin;
+    if (count <= leaf_size) return;
+
+    int axis = centroid_box.longest_axis();
+    double lo = centroid_box.min()[axis];
+    double extent = centroid_box.max()[axis] - lo;
+
+    int mid = -1;
+    if (extent > 0 && depth < max_sah_depth) {
+        // Bin the centroids and sweep for the cheapest split
+        int bin_counts[bin_count] = {};
+        aabb bin_boxes[bin_count];
+        for (auto& b : bin_boxes) b = aabb::empty();
+
+        auto bin_of = [&](int prim) {
+            int b = static_cast<int>(bin_count * (centroids[prim][axis] - lo) / extent);
+            return std::min(b, bin_count - 1);
+        };
+
+        for (int i = begin; i < end; i++) {
+            int b = bin_of(prim_indices[i]);
+            bin_counts[b]++;
+            bin_boxes[b] = surrounding_box(bin_boxes[b], (*boxes)[prim_indices[i]]);
+        }
+
+        double right_area[bin_count];
+        int right_count[bin_count];
+        aabb acc = aabb::empty();
+        int acc_count = 0;
+        for (int b = bin_count - 1; b > 0; b--) {
+            acc = surrounding_box(acc, bin_boxes[b]);
+            acc_count += bin_counts[b];
+            right_area[b] = acc_count ? acc.surface_area() : 0.0;
+            right_count[b] = acc_count;
+        }
+
+        double best_cost = infinity;
+        int best_split = -1;
+        acc = aabb::empty();
+        acc_count = 0;
+        for (int b = 1; b < bin_count; b++) {
+            acc = surrounding_box(acc, bin_boxes[b - 1]);
+            acc_count += bin_counts[b - 1];
+            if (acc_count == 0 || right_count[b] == 0) continue;
+            double cost = acc_count * acc.surface_area() + right_count[b] * right_area[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        // Keep small nodes as leaves when splitting would not pay off
+        if (best_cost >= count * box.surface_area() && count <= 4 * leaf_size)
+            return;
+
+        auto first = prim_indices.begin() + begin;
+        auto last = prim_indices.begin() + end;
+        mid = static_cast<int>(std::partition(first, last, [&](int prim) {
+            return bin_of(prim) < best_split;
+        }) - prim_indices.begin());
+    }
+
+    if (mid <= begin || mid >= end) {
+        // Degenerate centroids or a very deep tree, fall back to a median split
+        mid = begin + count / 2;
+        std::nth_element(prim_indices.begin() + begin, prim_indices.begin() + mid, prim_indices.begin() + end,
+            [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = axis;
+
+    int left = static_cast<int>(nodes.size());
+    nodes.push_back(bvh_node());
+    build_node(left, begin, mid, depth + 1);
+
+    int right = static_cast<int>(nodes.size());
+    nodes.push_back(bvh_node());
+    build_node(right, mid, end, depth + 1);
+
+    nodes[node_index].offset = right;
+}
+
+template <typename hit_fn>
+bool bvh_tree::traverse(const ray& r, double t_min, double t_max, hit_fn&& hit_primitive) const {
+    return traverse_leaves(r, t_min, t_max, [&](int first, int count, double t_lo, double& closest) {
+        bool hit = false;
+        for (int i = first; i < first + count; i++)
+            if (hit_primitive(prim_indices[i], t_lo, closest))
+                hit = true;
+        return hit;
+    });
+}
+
+template <typename leaf_fn>
+bool bvh_tree::traverse_leaves(const ray& r, double t_min, double t_max, leaf_fn&& hit_leaf) const {
+    if (nodes.empty()) return false;
+
+    const point3 origin = r.origin();
+    const vec3 dir = r.direction();
+    const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+    const bool dir_negative[3] = {dir.x() < 0, dir.y() < 0, dir.z() < 0};
+
+    // Depth is bounded by max_sah_depth plus the median splits below it
+    int stack[128];
+    int top = 0;
+    stack[top++] = 0;
+
+    bool hit_anything = false;
+    double closest = t_max;
+    double t_near;
+
+    while (top > 0) {
+        int index = stack[--top];
+        const bvh_node& node = nodes[index];
+        if (!node.box.hit(origin, inv_dir, t_min, closest, t_near))
+            continue;
+
+        if (node.count > 0) {
+            if (hit_leaf(node.offset, node.count, t_min, closest))
+                hit_anything = true;
+        }
+        else {
+            // Push the far child first so the near one is popped next
+            if (dir_negative[node.axis]) {
+                stack[top++] = index + 1;
+                stack[top++] = node.offset;
+            }
+            else {
+                stack[top++] = node.offset;
+                stack[top++] = index + 1;
+            }
+        }
+    }
+
+    return hit_anything;
+}
+
+// Accelerates the objects of a hittable_list with a bvh_tree
+// Objects without a bounding box or that ask to be always tested (planes,
+// large disks and rectangles) are kept outside the tree and tested on every ray
+class bvh : public hittable {
+    public:
+        bvh() {}
+        bvh(const hittable_list& list, int max_leaf_size = 2);
+
+        virtual bool hit(
+            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+    public:
+        std::vector<shared_ptr<hittable>> objects;   // indexed by the tree
+        std::vector<shared_ptr<hittable>> unbounded; // tested on every ray, bounded or not
+        bvh_tree tree;
+};
+
+bvh::bvh(const hittable_list& list, int max_leaf_size) {
+    std::vector<aabb> boxes;
+    aabb box;
+    for (const auto& object : list.objects) {
+        if (!object->always_test() && object->bounding_box(box)) {
+            objects.push_back(object);
+            boxes.push_back(box);
+        }
+        else {
+            unbounded.push_back(object);
+        }
+    }
+    tree.build(boxes, max_leaf_size);
+}
+
+bool bvh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    hit_record temp_rec;
+    bool hit_anything = tree.traverse(r, t_min, t_max, [&](int prim, double t_lo, double& closest) {
+        if (!objects[prim]->hit(r, t_lo, closest, temp_rec))
+            return false;
+        closest = temp_rec.t;
+        rec = temp_rec;
+        return true;
+    });
+
+    auto closest_so_far = hit_anything ? rec.t : t_max;
+    for (const auto& object : unbounded) {
+        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+    return hit_anything;
+}
+
+bool bvh::bounding_box(aabb& output_box) const {
+    if (objects.empty() && unbounded.empty()) return false;
+    output_box = objects.empty() ? aabb::empty() : tree.bounds();
+    aabb box;
+    for (const auto& object : unbounded) {
+        if (!object->bounding_box(box)) return false;
+        output_box = surrounding_box(output_box, box);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+// On-disk cache of built acceleration structures
+// A BVH over many primitives is written to a binary file named after a hash
+// of the primitives and the build parameters. The next run over the same
+// primitives maps the file and copies the finished arrays out instead of
+// building the tree again, and any change to the scene gives a new hash and
+// so a rebuild. Nodes refer to each other by index, so the arrays are stored
+// as is. Only trees over at least bvh_cache_min_primitives primitives are
+// cached.
+//
+// Files go to $GHD_BVH_CACHE, else $XDG_CACHE_HOME/ghd-path-tracer, else
+// ~/.cache/ghd-path-tracer. GHD_BVH_CACHE=off disables the cache.
+//
+// File layout (native endianness, checked through the magic number):
+//   bvh_cache_header
+//   nodes          node_count * node_size bytes, at a 64 byte aligned offset
+//   prim_indices   index_count * 4 bytes
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "mapped_file.h"
+#include "wide_bvh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+const size_t bvh_cache_min_primitives = 100000;
+
+// Bump whenever the builders or the node layouts change
+const uint32_t bvh_cache_version = 1;
+
+enum bvh_cache_kind : uint32_t {
+    bvh_cache_binary = 1,
+    bvh_cache_wide = 2
+};
+
+struct bvh_cache_header {
+    char magic[8];        // "GHDBVH" and two zero bytes
+    uint32_t byte_order;  // 0x01020304 as written
+    uint32_t version;
+    uint32_t kind;
+    uint32_t node_size;
+    uint64_t key;
+    uint64_t node_count;
+    uint64_t index_count;
+    uint64_t nodes_offset;
+    uint64_t indices_offset;
+    double bounds[6];     // min xyz, max xyz
+};
+
+// 64 bit hash of a block of memory (MurmurHash64A), the cache key of a scene
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (size * m);
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size / 8 * 8;
+    for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, size & 7);
+    if (size & 7) {
+        h ^= tail;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Key of a tree built over the given primitive data with the given parameters
+uint64_t bvh_cache_key(bvh_cache_kind kind, int max_leaf_size, const void* data, size_t size) {
+    uint64_t params[3] = {bvh_cache_version, kind, static_cast<uint64_t>(max_leaf_size)};
+    return hash_bytes(data, size, hash_bytes(params, sizeof(params)));
+}
+
+// Cache directory, empty if caching is off
+std::string bvh_cache_dir() {
+    const char* dir = getenv("GHD_BVH_CACHE");
+    if (dir)
+        return strcmp(dir, "off") == 0 ? std::string() : std::string(dir);
+    if ((dir = getenv("XDG_CACHE_HOME")) && *dir)
+        return std::string(dir) + "/ghd-path-tracer";
+    if ((dir = getenv("HOME")) && *dir)
+        return std::string(dir) + "/.cache/ghd-path-tracer";
+    return std::string();
+}
+
+std::string bvh_cache_path(bvh_cache_kind kind, uint64_t key) {
+    std::string dir = bvh_cache_dir();
+    if (dir.empty()) return dir;
+    char name[64];
+    snprintf(name, sizeof(name), "/%s_%016llx.bvh", kind == bvh_cache_binary ? "bvh" : "wbvh",
+             static_cast<unsigned long long>(key));
+    return dir + name;
+}
+
+// Creates dir and its parents, returns false if it still isn't there
+bool make_dirs(const std::string& dir) {
+    for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1)) {
+        mkdir(dir.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Reads a cached tree into nodes and prim_indices
+// Returns false if there is no usable file for this key
+template <typename node_t>
+bool load_cached_tree(bvh_cache_kind kind, uint64_t key, std::vector<node_t>& nodes,
+                      std::vector<int>& prim_indices, aabb& bounds) {
+    std::string path = bvh_cache_path(kind, key);
+    if (path.empty()) return false;
+
+    mapped_file file(path);
+    if (!file.is_open() || file.size < sizeof(bvh_cache_header)) return false;
+
+    bvh_cache_header header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, "GHDBVH\0\0", 8) != 0 || header.byte_order != 0x01020304 ||
+        header.version != bvh_cache_version || header.kind != kind ||
+        header.node_size != sizeof(node_t) || header.key != key ||
+        header.nodes_offset + header.node_count * sizeof(node_t) > file.size ||
+        header.indices_offset + header.index_count * sizeof(int) > file.size) {
+        std::cerr << "ignoring stale bvh cache " << path << '\n';
+        return false;
+    }
+
+    nodes.resize(header.node_count);
+    memcpy(nodes.data(), file.data + header.nodes_offset, header.node_count * sizeof(node_t));
+    prim_indices.resize(header.index_count);
+    memcpy(prim_indices.data(), file.data + header.indices_offset, header.index_count * sizeof(int));
+    bounds = aabb(point3(header.bounds[0], header.bounds[1], header.bounds[2]),
+                  point3(header.bounds[3], header.bounds[4], header.bounds[5]));
+    return true;
+}
+
+// Writes a tree to the cache, through a temporary file so a reader never
+// sees a partial one. Failures only cost the next run a rebuild.
+template <typename node_t>
+bool store_cached_tree(bvh_cache_kind kind, uint64_t key, const std::vector<node_t>& nodes,
+                       const std::vector<int>& prim_indices, const aabb& bounds) {
+    std::string path = bvh_cache_path(kind, key);
+    if (path.empty() || !make_dirs(bvh_cache_dir())) return false;
+
+    bvh_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GHDBVH\0\0", 8);
+    header.byte_order = 0x01020304;
+    header.version = bvh_cache_version;
+    header.kind = kind;
+    header.node_size = sizeof(node_t);
+    header.key = key;
+    header.node_count = nodes.size();
+    header.index_count = prim_indices.size();
+    header.nodes_offset = (sizeof(header) + 63) / 64 * 64;
+    header.indices_offset = header.nodes_offset + nodes.size() * sizeof(node_t);
+    for (int a = 0; a < 3; a++) {
+        header.bounds[a] = bounds.min()[a];
+        header.bounds[3 + a] = bounds.max()[a];
+    }
+
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(temp_path.c_str(), "wb");
+    if (!f) return false;
+    std::vector<char> padding(header.nodes_offset - sizeof(header), 0);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(padding.data(), 1, padding.size(), f) == padding.size() &&
+              fwrite(nodes.data(), sizeof(node_t), nodes.size(), f) == nodes.size() &&
+              fwrite(prim_indices.data(), sizeof(int), prim_indices.size(), f) == prim_indices.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Builds tree over boxes, or loads it if the same primitives were built before
+// data and size are the primitive content the key is hashed from
+void build_cached(bvh_tree& tree, const std::vector<aabb>& boxes, int max_leaf_size,
+                  const void* data, size_t size) {
+    if (boxes.size() < bvh_cache_min_primitives) {
+        tree.build(boxes, max_leaf_size);
+        return;
+    }
+
+    uint64_t key = bvh_cache_key(bvh_cache_binary, max_leaf_size, data, size);
+    aabb bounds;
+    if (load_cached_tree(bvh_cache_binary, key, tree.nodes, tree.prim_indices, bounds) &&
+        tree.prim_indices.size() == boxes.size())
+        return;
+
+    tree.build(boxes, max_leaf_size);
+    store_cached_tree(bvh_cache_binary, key, tree.nodes, tree.prim_indices, tree.bounds());
+}
+
+// Same for a 4-wide tree collapsed from a binary one; a hit skips both builds
+void build_cached(wide_bvh& tree, const std::vector<aabb>& boxes, int max_leaf_size,
+                  const void* data, size_t size) {
+    bool cached = boxes.size() >= bvh_cache_min_primitives;
+    uint64_t key = cached ? bvh_cache_key(bvh_cache_wide, max_leaf_size, data, size) : 0;
+    if (cached &&
+        load_cached_tree(bvh_cache_wide, key, tree.nodes, tree.prim_indices, tree.box) &&
+        tree.prim_indices.size() == boxes.size())
+        return;
+
+    bvh_tree binary;
+    binary.build(boxes, max_leaf_size);
+    tree.build_from(binary);
+    if (cached)
+        store_cached_tree(bvh_cache_wide, key, tree.nodes, tree.prim_indices, tree.box);
+}
+
+#endif
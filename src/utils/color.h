@@ -5,7 +5,8 @@
 
 #include <iostream>
 
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
+// Averages the samples, gamma-corrects for gamma=2.0 and quantizes to [0,255]
+inline void color_to_bytes(color pixel_color, int samples_per_pixel, int rgb[3]) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
     auto b = pixel_color.z();
@@ -16,10 +17,29 @@ void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
     g = sqrt(scale * g);
     b = sqrt(scale * b);
 
+    // Translate to a [0,255] value for each color component.
+    rgb[0] = static_cast<int>(256 * clamp(r, 0.0, 0.999));
+    rgb[1] = static_cast<int>(256 * clamp(g, 0.0, 0.999));
+    rgb[2] = static_cast<int>(256 * clamp(b, 0.0, 0.999));
+}
+
+void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
+    int rgb[3];
+    color_to_bytes(pixel_color, samples_per_pixel, rgb);
+
     // Write the translated [0,255] value of each color component.
-    out << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(g, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
+    out << rgb[0] << ' ' << rgb[1] << ' ' << rgb[2] << '\n';
+}
+
+// Binary counterpart of write_color, returns the position after the written pixel
+unsigned char* write_color_rgb8(unsigned char* out, color pixel_color, int samples_per_pixel) {
+    int rgb[3];
+    color_to_bytes(pixel_color, samples_per_pixel, rgb);
+
+    *out++ = static_cast<unsigned char>(rgb[0]);
+    *out++ = static_cast<unsigned char>(rgb[1]);
+    *out++ = static_cast<unsigned char>(rgb[2]);
+    return out;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,136 @@
+#ifndef COST_AOV_H
+#define COST_AOV_H
+
+// Render cost AOV
+// Records what every pixel cost to render: wall time in nanoseconds, the
+// number of rays traced and the average path depth (rays per sample).
+// Written as a three channel pfm (cost, rays, depth) next to the beauty
+// pass, as a false color heatmap, and summarized as a histogram of where
+// the render time went.
+
+#include "image_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class cost_aov
+{
+public:
+    cost_aov(int image_width, int image_height)
+        : width(image_width), height(image_height),
+          ns(static_cast<size_t>(image_width) * image_height, 0.0f),
+          rays(ns.size(), 0.0f), depth(ns.size(), 0.0f) {}
+
+    // x, y in image space, y = 0 is the top row
+    void record(int x, int y, std::chrono::nanoseconds cost, int ray_count, int samples_per_pixel)
+    {
+        size_t i = static_cast<size_t>(y) * width + x;
+        ns[i] = static_cast<float>(cost.count());
+        rays[i] = static_cast<float>(ray_count);
+        depth[i] = static_cast<float>(ray_count) / samples_per_pixel;
+    }
+
+    // Channels are nanoseconds, rays and average path depth
+    bool write_pfm(const std::string &path) const
+    {
+        std::vector<float> data(3 * ns.size());
+        for (size_t i = 0; i < ns.size(); i++)
+        {
+            data[3 * i] = ns[i];
+            data[3 * i + 1] = rays[i];
+            data[3 * i + 2] = depth[i];
+        }
+        return ::write_pfm(path, width, height, 3, data);
+    }
+
+    // Cost on a log scale from the cheapest pixel to the 99.9th percentile,
+    // black through blue, red and yellow to white. A few pixels always get
+    // preempted, the percentile keeps them from flattening the rest.
+    bool write_heatmap(const std::string &path) const
+    {
+        std::vector<float> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        float lo = sorted.front();
+        float hi = sorted[std::min(sorted.size() - 1, static_cast<size_t>(0.999 * sorted.size()))];
+        double range = std::log(std::max(hi, 1.0f) / std::max(lo, 1.0f));
+
+        const double stops[5][3] = {{0, 0, 0}, {0.1, 0.1, 0.8}, {0.9, 0.1, 0.1}, {1, 0.9, 0.1}, {1, 1, 1}};
+        std::vector<unsigned char> rgb(3 * ns.size());
+        for (size_t i = 0; i < ns.size(); i++)
+        {
+            double v = range > 0 ? std::log(std::max(ns[i], 1.0f) / std::max(lo, 1.0f)) / range : 0;
+            double pos = std::min(std::max(v, 0.0), 1.0) * 4;
+            int k = std::min(static_cast<int>(pos), 3);
+            double f = pos - k;
+            for (int c = 0; c < 3; c++)
+                rgb[3 * i + c] = static_cast<unsigned char>(255.999 * (stops[k][c] * (1 - f) + stops[k + 1][c] * f));
+        }
+        return write_ppm(path, width, height, rgb);
+    }
+
+    // Pixels and share of the render time per power of two of pixel cost
+    void print_histogram(std::ostream &out) const
+    {
+        std::vector<float> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0, total_rays = 0;
+        for (size_t i = 0; i < ns.size(); i++)
+        {
+            total += ns[i];
+            total_rays += rays[i];
+        }
+        if (sorted.empty() || total <= 0)
+            return;
+
+        auto percentile = [&](double p)
+        { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))]; };
+
+        char line[160];
+        snprintf(line, sizeof(line), "pixel cost: mean %.0f ns, median %.0f, p99 %.0f, max %.0f (%.1fx median)\n",
+                 total / ns.size(), percentile(0.5), percentile(0.99), sorted.back(),
+                 sorted.back() / std::max(percentile(0.5), 1.0f));
+        out << line;
+        snprintf(line, sizeof(line), "rays: %.0f total, %.2f per pixel, %.1f ns per ray\n",
+                 total_rays, total_rays / ns.size(), total / std::max(total_rays, 1.0));
+        out << line;
+
+        // Buckets [2^b, 2^(b+1)) ns
+        int first = static_cast<int>(std::floor(std::log2(std::max(sorted.front(), 1.0f))));
+        int last = static_cast<int>(std::floor(std::log2(std::max(sorted.back(), 1.0f))));
+        std::vector<size_t> pixels(last - first + 1, 0);
+        std::vector<double> time(last - first + 1, 0);
+        for (float cost : ns)
+        {
+            int b = static_cast<int>(std::floor(std::log2(std::max(cost, 1.0f)))) - first;
+            pixels[b]++;
+            time[b] += cost;
+        }
+
+        snprintf(line, sizeof(line), "%24s %8s %8s %8s\n", "cost ns", "pixels", "% pixels", "% time");
+        out << line;
+        for (size_t b = 0; b < pixels.size(); b++)
+        {
+            if (!pixels[b])
+                continue;
+            double share = 100 * time[b] / total;
+            snprintf(line, sizeof(line), "%11.0f - %-10.0f %8zu %8.1f %8.1f  %s\n",
+                     std::ldexp(1.0, first + static_cast<int>(b)), std::ldexp(1.0, first + static_cast<int>(b) + 1),
+                     pixels[b], 100.0 * pixels[b] / ns.size(), share,
+                     std::string(static_cast<size_t>(share / 2), '#').c_str());
+            out << line;
+        }
+    }
+
+public:
+    int width, height;
+    std::vector<float> ns;    // nanoseconds per pixel
+    std::vector<float> rays;  // rays traced per pixel
+    std::vector<float> depth; // rays per sample
+};
+
+#endif
@@ -0,0 +1,622 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+// Sort-last rendering of a scene split between processes
+// For scenes too large for one machine's memory the scene is cut into slabs
+// along an axis (see scene_slab) of about the same number of objects, and every
+// slab is built and held by its own partition process, which never holds
+// the rest. The coordinator keeps only the camera and the framebuffer and
+// traces the paths of a wave of pixels one bounce at a time: every bounce's
+// rays are sent in one batch to each partition whose bounds they cross,
+// each partition answers with its closest hit of every ray, already shaded
+// (the ray scattered from it and its attenuation), and the coordinator
+// keeps the hit of smallest t. Shading at every partition costs a scatter
+// per extra hit but saves a second round trip to the owner of the hit.
+//
+// The generator of a path travels with its rays and the attenuations are
+// multiplied in the order ray_color multiplies them, so the frame is the
+// same bits as accumulate_tiles gives with the same seed (radiance caches
+// and path guides are not supported here).
+//
+// Partitions are forked from the coordinator and talk to it over a unix
+// socketpair each, so all of it runs on one machine; across machines the
+// sockets would be TCP connections carrying the same messages.
+//
+// Only stress: scenes are planned and built a slab at a time. Every other
+// scene is built whole once by plan_slabs in the coordinator and again by
+// every partition before it is cut down, so those scenes must still fit in
+// one process's memory.
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "render.h"
+#include "resident_memory.h"
+#include "../primitives/camera.h"
+#include "../primitives/sphere_set.h"
+#include "../scenes/scenes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static_assert(std::is_trivially_copyable<rng>::value && sizeof(rng) == 2 * sizeof(uint64_t),
+              "path generators are sent between processes as two words");
+
+// A ray sent to a partition with the generator and ray cone of its path
+struct forwarded_ray
+{
+    double origin[3], direction[3];
+    double cone_width, cone_spread;
+    uint64_t generator[2];
+    uint32_t path; // index in the coordinator's wave
+    uint32_t padding;
+};
+
+// A partition's closest hit of a forwarded ray, shaded: the ray scattered
+// from it, its attenuation, the cone of the scattered ray and the
+// generator after scattering
+struct forwarded_hit
+{
+    double t;
+    double origin[3], direction[3];
+    double attenuation[3];
+    double cone_width, cone_spread;
+    uint64_t generator[2];
+    uint32_t path;
+    uint32_t scatters;
+};
+
+enum partition_message : uint32_t
+{
+    partition_trace = 1,  // count forwarded_rays follow, answered with forwarded_hits
+    partition_finish = 2  // answered with the partition_stats, then the partition exits
+};
+
+struct message_header
+{
+    uint32_t kind;
+    uint32_t count;
+};
+
+// What a partition holds and did, sent once it has built its slab and
+// again when it finishes
+struct partition_stats
+{
+    uint32_t ok;        // 0 if the scene could not be built
+    uint32_t unbounded; // holds an object without bounds (the ground), gets every ray
+    double box_min[3], box_max[3];
+    uint64_t primitives; // spheres of sphere sets and other objects
+    double build_seconds;
+    double scene_mb; // resident memory the slab added
+    double peak_mb;  // peak resident memory of the process
+    uint64_t rays, hits;
+    double busy_seconds; // tracing and shading
+};
+
+// Whole buffers over a socket, false if the other end went away
+bool send_all(int fd, const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receive_all(int fd, void *data, size_t size)
+{
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t got = recv(fd, bytes, size, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        bytes += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Splits the scene into parts slabs of about the same number of objects.
+// Stress scenes are spread evenly over a known square and are cut into
+// equal widths along x without building them; the others are built once
+// here and cut at the quantiles of their objects' centers along the axis
+// the centers spread furthest on, so they must fit in the coordinator's
+// memory (they are small, or built whole by every partition anyway).
+std::vector<scene_slab> plan_slabs(const std::string &scene, int parts)
+{
+    std::vector<scene_slab> slabs(parts);
+    std::vector<double> cuts; // parts - 1 inner boundaries
+    stress_params params;
+    if (scene.rfind("stress:", 0) == 0 && parse_stress_params(scene.substr(7), params))
+    {
+        const double side = sqrt(static_cast<double>(params.count));
+        for (int k = 1; k < parts; k++)
+            cuts.push_back(-side / 2 + side * k / parts);
+    }
+    else
+    {
+        hittable_list world;
+        srand(69);
+        build_scene(scene, world);
+        std::vector<point3> centers;
+        for (const auto &object : world.objects)
+        {
+            aabb box;
+            if (auto set = std::dynamic_pointer_cast<sphere_set>(object))
+                for (size_t i = 0; i < set->size(); i++)
+                    centers.push_back(set->center(i));
+            else if (object->bounding_box(box))
+                centers.push_back(box.centroid());
+        }
+
+        aabb spread = aabb::empty();
+        for (const point3 &c : centers)
+            spread.grow(c);
+        const int axis = centers.empty() ? 0 : spread.longest_axis();
+        std::vector<double> values;
+        for (const point3 &c : centers)
+            values.push_back(c[axis]);
+        std::sort(values.begin(), values.end());
+        for (int k = 1; k < parts; k++)
+            cuts.push_back(values.empty() ? 0.0 : values[values.size() * k / parts]);
+        for (scene_slab &slab : slabs)
+            slab.axis = axis;
+    }
+
+    for (int k = 0; k + 1 < parts; k++)
+        slabs[k].max = slabs[k + 1].min = cuts[k];
+    return slabs;
+}
+
+// Body of a partition process: builds its slab of the scene, reports what
+// it holds and answers trace messages on fd with threads threads until it
+// is told to finish or the coordinator goes away
+void run_partition(int fd, const std::string &scene, const scene_slab &slab, int threads)
+{
+    using std::chrono::duration;
+    using std::chrono::steady_clock;
+
+    partition_stats stats = {};
+    const double rss_start = resident_mb("VmRSS");
+    auto build_start = steady_clock::now();
+    hittable_list list;
+    srand(69);
+    if (!build_scene(scene, list, slab))
+    {
+        send_all(fd, &stats, sizeof(stats));
+        return;
+    }
+    bvh world(list);
+    stats.ok = 1;
+    stats.build_seconds = duration<double>(steady_clock::now() - build_start).count();
+    stats.scene_mb = resident_mb("VmRSS") - rss_start;
+
+    aabb bounds = aabb::empty();
+    for (const auto &object : list.objects)
+    {
+        aabb box;
+        auto set = std::dynamic_pointer_cast<sphere_set>(object);
+        stats.primitives += set ? set->size() : 1;
+        if (set && set->size() == 0)
+            continue;
+        if (object->bounding_box(box))
+            bounds = surrounding_box(bounds, box);
+        else
+            stats.unbounded = 1;
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        stats.box_min[axis] = bounds.min()[axis];
+        stats.box_max[axis] = bounds.max()[axis];
+    }
+    if (!send_all(fd, &stats, sizeof(stats)))
+        return;
+
+    std::vector<forwarded_ray> rays;
+    std::vector<std::vector<forwarded_hit>> thread_hits(threads);
+    std::vector<forwarded_hit> hits;
+    message_header header;
+    while (receive_all(fd, &header, sizeof(header)))
+    {
+        if (header.kind != partition_trace)
+        {
+            stats.peak_mb = resident_mb("VmHWM");
+            send_all(fd, &stats, sizeof(stats));
+            return;
+        }
+        rays.resize(header.count);
+        if (!receive_all(fd, rays.data(), rays.size() * sizeof(forwarded_ray)))
+            return;
+
+        auto start = steady_clock::now();
+        const size_t chunk = 256;
+        std::atomic<size_t> next(0);
+        auto worker = [&](std::vector<forwarded_hit> &found)
+        {
+            found.clear();
+            for (size_t begin = next.fetch_add(chunk); begin < rays.size(); begin = next.fetch_add(chunk))
+                for (size_t k = begin; k < std::min(begin + chunk, rays.size()); k++)
+                {
+                    const forwarded_ray &in = rays[k];
+                    ray r(point3(in.origin[0], in.origin[1], in.origin[2]),
+                          vec3(in.direction[0], in.direction[1], in.direction[2]));
+                    hit_record rec;
+                    if (!world.hit(r, 0.001, infinity, rec))
+                        continue;
+
+                    // As shade_hit without caches
+                    rng generator(0);
+                    memcpy(static_cast<void *>(&generator), in.generator, sizeof(generator));
+                    thread_rng = &generator;
+                    rec.footprint = in.cone_width + rec.t * r.direction().length() * in.cone_spread;
+                    ray scattered;
+                    color attenuation;
+                    forwarded_hit out = {};
+                    out.t = rec.t;
+                    out.path = in.path;
+                    out.scatters = rec.mat_ptr->scatter(r, rec, attenuation, scattered);
+                    if (out.scatters)
+                    {
+                        for (int axis = 0; axis < 3; axis++)
+                        {
+                            out.origin[axis] = scattered.origin()[axis];
+                            out.direction[axis] = scattered.direction()[axis];
+                            out.attenuation[axis] = attenuation[axis];
+                        }
+                        out.cone_width = rec.footprint;
+                        out.cone_spread = in.cone_spread + rec.mat_ptr->cone_spread(rec);
+                    }
+                    memcpy(out.generator, static_cast<const void *>(&generator), sizeof(generator));
+                    thread_rng = nullptr;
+                    found.push_back(out);
+                }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads; t++)
+            workers.emplace_back(worker, std::ref(thread_hits[t]));
+        worker(thread_hits[0]);
+        for (auto &w : workers)
+            w.join();
+
+        hits.clear();
+        for (const auto &found : thread_hits)
+            hits.insert(hits.end(), found.begin(), found.end());
+        stats.rays += rays.size();
+        stats.hits += hits.size();
+        stats.busy_seconds += duration<double>(steady_clock::now() - start).count();
+
+        message_header reply = {partition_trace, static_cast<uint32_t>(hits.size())};
+        if (!send_all(fd, &reply, sizeof(reply)) || !send_all(fd, hits.data(), hits.size() * sizeof(forwarded_hit)))
+            return;
+    }
+}
+
+// The coordinator's side: starts the partition processes, renders frames
+// through them and collects their stats when stopped
+class distributed_scene
+{
+public:
+    struct partition
+    {
+        pid_t pid = -1;
+        int fd = -1;
+        scene_slab slab;
+        partition_stats stats = {};
+        aabb bounds;
+    };
+
+    std::vector<partition> partitions;
+    size_t wave_pixels = 1 << 16; // paths traced together, bounds the coordinator's memory
+
+    // Totals over the frames rendered, for the forwarding throughput
+    uint64_t rays_forwarded = 0, hits_returned = 0;
+    uint64_t bytes_sent = 0, bytes_received = 0;
+    uint64_t bounces = 0;         // round trips
+    double exchange_seconds = 0;  // waiting on the partitions, sending and receiving included
+    double render_seconds = 0;
+
+    distributed_scene() {}
+    distributed_scene(const distributed_scene &) = delete;
+    distributed_scene &operator=(const distributed_scene &) = delete;
+    ~distributed_scene() { shut_down(); }
+
+    // Forks a partition process for every slab of plan_slabs(scene, parts),
+    // each tracing with threads threads, and waits for them to build their
+    // slabs. Fork before allocating anything large, the partitions inherit
+    // the coordinator's memory.
+    bool start(const std::string &scene, int parts, int threads, std::string &error)
+    {
+        std::vector<scene_slab> slabs = plan_slabs(scene, parts);
+        for (const scene_slab &slab : slabs)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            {
+                error = std::string("socketpair: ") + strerror(errno);
+                return false;
+            }
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                error = std::string("fork: ") + strerror(errno);
+                close(fds[0]);
+                close(fds[1]);
+                return false;
+            }
+            if (pid == 0)
+            {
+                // The other partitions' sockets stay with the coordinator
+                for (const partition &p : partitions)
+                    close(p.fd);
+                close(fds[0]);
+                run_partition(fds[1], scene, slab, threads);
+                _exit(0);
+            }
+            close(fds[1]);
+            partition p;
+            p.pid = pid;
+            p.fd = fds[0];
+            p.slab = slab;
+            partitions.push_back(p);
+        }
+
+        for (partition &p : partitions)
+        {
+            if (!receive_all(p.fd, &p.stats, sizeof(p.stats)) || !p.stats.ok)
+            {
+                error = "a partition could not build its slab of " + scene;
+                shut_down();
+                return false;
+            }
+            p.bounds = aabb(point3(p.stats.box_min[0], p.stats.box_min[1], p.stats.box_min[2]),
+                            point3(p.stats.box_max[0], p.stats.box_max[1], p.stats.box_max[2]));
+        }
+        return true;
+    }
+
+    // Renders the sums of samples_per_pixel samples of every pixel (rows top
+    // to bottom) seeded like accumulate_tile, seed >= 0
+    bool render(const camera &cam, int width, int height, int samples_per_pixel, int max_depth, int64_t seed,
+                std::vector<color> &sums, std::string &error)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const size_t pixels = static_cast<size_t>(width) * height;
+        const double spread = cam.pixel_spread(height);
+        sums.assign(pixels, color(0, 0, 0));
+
+        for (size_t first = 0; first < pixels; first += wave_pixels)
+        {
+            const size_t count = std::min(wave_pixels, pixels - first);
+            std::vector<rng> pixel_rngs;
+            pixel_rngs.reserve(count);
+            for (size_t p = first; p < first + count; p++)
+                pixel_rngs.emplace_back(static_cast<uint64_t>(seed), p);
+            std::vector<color> blocks(count, color(0, 0, 0));
+
+            for (int s = 0; s < samples_per_pixel; s++)
+            {
+                // Camera rays, as render_samples draws them
+                std::vector<path_state> paths;
+                paths.reserve(count);
+                for (size_t k = 0; k < count; k++)
+                {
+                    rng sample_rng = pixel_rngs[k].split();
+                    thread_rng = &sample_rng;
+                    int i = static_cast<int>((first + k) % width);
+                    int j = height - 1 - static_cast<int>((first + k) / width);
+                    auto u = (i + random_double()) / (width - 1);
+                    auto v = (j + random_double()) / (height - 1);
+                    ray r = cam.get_ray(u, v);
+                    thread_rng = nullptr;
+                    paths.push_back({r, sample_rng, {0, spread}, color(0, 0, 0), 0});
+                }
+                if (!trace_paths(paths, max_depth, error))
+                    return false;
+
+                for (size_t k = 0; k < count; k++)
+                {
+                    // Innermost attenuation first, like the recursion of ray_color
+                    color c = paths[k].light;
+                    for (int b = paths[k].bounces - 1; b >= 0; b--)
+                        c = attenuations[k * max_depth + b] * c;
+                    blocks[k] += c;
+                    if ((s + 1) % sample_block == 0 || s + 1 == samples_per_pixel)
+                    {
+                        sums[first + k] += blocks[k];
+                        blocks[k] = color(0, 0, 0);
+                    }
+                }
+            }
+        }
+        render_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // Tells the partitions to finish, collects their stats and waits for
+    // them to exit
+    bool stop()
+    {
+        bool ok = true;
+        for (partition &p : partitions)
+        {
+            message_header finish = {partition_finish, 0};
+            partition_stats final_stats;
+            if (send_all(p.fd, &finish, sizeof(finish)) && receive_all(p.fd, &final_stats, sizeof(final_stats)))
+                p.stats = final_stats;
+            else
+                ok = false;
+        }
+        shut_down();
+        return ok;
+    }
+
+private:
+    // A path of the wave: its next ray, where it ended and the attenuation
+    // of every bounce so far (in attenuations)
+    struct path_state
+    {
+        ray next;
+        rng generator;
+        ray_cone cone;
+        color light; // sky the path reached, black if it was absorbed or ran out of depth
+        int bounces;
+    };
+
+    std::vector<color> attenuations; // max_depth per path of the wave
+    std::vector<std::vector<forwarded_ray>> batches;
+    std::vector<forwarded_hit> closest, received;
+
+    void shut_down()
+    {
+        for (partition &p : partitions)
+        {
+            if (p.fd >= 0)
+                close(p.fd);
+            if (p.pid > 0)
+                waitpid(p.pid, nullptr, 0);
+            p.fd = -1;
+            p.pid = -1;
+        }
+    }
+
+    // Traces every path of the wave to its end, one bounce of all of them
+    // per round trip to the partitions
+    bool trace_paths(std::vector<path_state> &paths, int max_depth, std::string &error)
+    {
+        attenuations.resize(paths.size() * max_depth);
+        batches.resize(partitions.size());
+        closest.resize(paths.size());
+        std::vector<uint32_t> active(paths.size());
+        for (size_t k = 0; k < paths.size(); k++)
+            active[k] = static_cast<uint32_t>(k);
+
+        for (int depth = max_depth; depth > 0 && !active.empty(); depth--)
+        {
+            for (auto &batch : batches)
+                batch.clear();
+            for (uint32_t k : active)
+            {
+                const path_state &path = paths[k];
+                forwarded_ray out;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    out.origin[axis] = path.next.origin()[axis];
+                    out.direction[axis] = path.next.direction()[axis];
+                }
+                out.cone_width = path.cone.width;
+                out.cone_spread = path.cone.spread;
+                memcpy(out.generator, static_cast<const void *>(&path.generator), sizeof(out.generator));
+                out.path = k;
+                out.padding = 0;
+
+                // The slab test of bvh_tree::traverse, so a ray is only left
+                // out where the partition's own tree would leave it out
+                const vec3 dir = path.next.direction();
+                const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+                double t_near;
+                for (size_t p = 0; p < partitions.size(); p++)
+                    if (partitions[p].stats.unbounded ||
+                        partitions[p].bounds.hit(path.next.origin(), inv_dir, 0.001, infinity, t_near))
+                        batches[p].push_back(out);
+                closest[k].t = infinity;
+            }
+            if (!exchange(error))
+                return false;
+
+            // The path continues from the closest hit, or ends in the sky
+            std::vector<uint32_t> still_active;
+            for (uint32_t k : active)
+            {
+                path_state &path = paths[k];
+                const forwarded_hit &hit = closest[k];
+                if (hit.t == infinity)
+                {
+                    path.light = scene_sky.value(path.next.direction());
+                    continue;
+                }
+                if (!hit.scatters)
+                    continue;
+                attenuations[k * max_depth + path.bounces++] =
+                    color(hit.attenuation[0], hit.attenuation[1], hit.attenuation[2]);
+                path.next = ray(point3(hit.origin[0], hit.origin[1], hit.origin[2]),
+                                vec3(hit.direction[0], hit.direction[1], hit.direction[2]));
+                memcpy(static_cast<void *>(&path.generator), hit.generator, sizeof(hit.generator));
+                path.cone = {hit.cone_width, hit.cone_spread};
+                still_active.push_back(k);
+            }
+            active.swap(still_active);
+        }
+        return true;
+    }
+
+    // Sends every partition its batch, then keeps the closest of the hits
+    // they send back. All batches go out before any answer is read, so the
+    // partitions trace at the same time.
+    bool exchange(std::string &error)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < partitions.size(); p++)
+        {
+            message_header header = {partition_trace, static_cast<uint32_t>(batches[p].size())};
+            size_t bytes = batches[p].size() * sizeof(forwarded_ray);
+            if (!send_all(partitions[p].fd, &header, sizeof(header)) ||
+                !send_all(partitions[p].fd, batches[p].data(), bytes))
+            {
+                error = "partition " + std::to_string(p) + " went away";
+                return false;
+            }
+            rays_forwarded += batches[p].size();
+            bytes_sent += sizeof(header) + bytes;
+        }
+        for (size_t p = 0; p < partitions.size(); p++)
+        {
+            message_header header;
+            if (!receive_all(partitions[p].fd, &header, sizeof(header)) || header.kind != partition_trace)
+            {
+                error = "partition " + std::to_string(p) + " went away";
+                return false;
+            }
+            received.resize(header.count);
+            if (!receive_all(partitions[p].fd, received.data(), received.size() * sizeof(forwarded_hit)))
+            {
+                error = "partition " + std::to_string(p) + " went away";
+                return false;
+            }
+            for (const forwarded_hit &hit : received)
+                if (hit.t < closest[hit.path].t)
+                    closest[hit.path] = hit;
+            hits_returned += received.size();
+            bytes_received += sizeof(header) + received.size() * sizeof(forwarded_hit);
+        }
+        bounces++;
+        exchange_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+};
+
+#endif
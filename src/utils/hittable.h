@@ -3,16 +3,28 @@
 
 #include "ray.h"
 #include "rtweekend.h"
+#include "aabb.h"
 
+#include <cstdint>
+
+class hittable;
 class material;
 
 struct hit_record {
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat_ptr;
+    const material* mat_ptr; // owned by the object that was hit
     double t;
     bool front_face;
 
+    // What was hit, for texture coordinates (see hittable::surface_uv)
+    const hittable* object = nullptr;
+    uint32_t primitive = 0;
+
+    // World space width of the ray cone at p, set by the renderer for
+    // texture filtering (0 if unknown)
+    double footprint = 0;
+
     inline void set_face_normal(const ray& r, const vec3& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal :-outward_normal;
@@ -22,6 +34,19 @@ struct hit_record {
 class hittable {
     public:
         virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+
+        // Returns false for unbounded objects
+        virtual bool bounding_box(aabb& output_box) const = 0;
+
+        // Floors and walls return true to stay out of a bvh, where their wide
+        // flat boxes would overlap everything else, and get tested on every ray
+        virtual bool always_test() const { return false; }
+
+        // Texture coordinates of a hit on this object and the world space
+        // length that one unit of u covers there, false if it has none
+        virtual bool surface_uv(const hit_record& rec, double& u, double& v, double& uv_size) const {
+            return false;
+        }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,444 @@
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+// Batch conversion of renders to PNG or JPEG
+// Inputs are decoded straight from a mapping of the file: P3 (the ascii
+// ppm write_color produces) with a hand rolled integer scanner instead of
+// iostreams, P6 with 8 or 16 bit samples, and PF/Pf float images. Float
+// images are tonemapped: scaled by the exposure, compressed by Reinhard's
+// L / (1 + L) on their luminance and gamma corrected like the renderer's
+// frames (color.h). The calling thread lists the inputs into a bounded queue
+// that every worker takes the next image from, so the conversion of a
+// directory starts with its first file and holds at most the queue's
+// capacity of names, and each worker reuses its pixel and file buffers
+// from one image to the next.
+
+#include "jpeg_encoder.h"
+#include "mapped_file.h"
+#include "png_encoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+struct convert_options
+{
+    bool jpeg = false;   // png otherwise
+    int quality = 90;    // jpeg, 1-100
+    int png_level = 3;   // 0 stores, 1-9 search longer matches
+    double exposure = 1; // float images
+};
+
+// Sample scanner over a mapped image
+struct image_scanner
+{
+    const char *p, *end;
+
+    // Skips whitespace and # comments
+    void skip()
+    {
+        while (p < end)
+        {
+            if (*p == '#')
+                while (p < end && *p != '\n')
+                    p++;
+            else if (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+                p++;
+            else
+                break;
+        }
+    }
+
+    // Returns false if there is no number or it has more than 7 digits
+    bool next_int(int &value)
+    {
+        skip();
+        if (p == end || *p < '0' || *p > '9')
+            return false;
+        value = 0;
+        for (int digits = 0; p < end && *p >= '0' && *p <= '9'; digits++)
+        {
+            if (digits == 7)
+                return false;
+            value = 10 * value + (*p++ - '0');
+        }
+        return true;
+    }
+
+    bool next_token(std::string &token)
+    {
+        skip();
+        const char *start = p;
+        while (p < end && !isspace(static_cast<unsigned char>(*p)))
+            p++;
+        token.assign(start, p);
+        return p > start;
+    }
+};
+
+// Maps a sample of 0..max_value to 0..255
+inline unsigned char scale_sample(int value, int max_value)
+{
+    return static_cast<unsigned char>(max_value == 255 ? value : (std::min(value, max_value) * 255 + max_value / 2) / max_value);
+}
+
+// Gamma 2 and [0, 255] of a tonemapped float, as write_color quantizes
+inline unsigned char quantize_linear(float v)
+{
+    return static_cast<unsigned char>(static_cast<int>(256 * std::clamp(std::sqrt(std::max(v, 0.0f)), 0.0f, 0.999f)));
+}
+
+// Decodes a P3, P6 or PF/Pf image into rgb (3 bytes per pixel, rows top to bottom)
+// Returns false with a message in error if the file can't be read or isn't one.
+bool decode_image(const mapped_file &file, const convert_options &options, int &width, int &height,
+                  std::vector<unsigned char> &rgb, std::string &error)
+{
+    if (!file.is_open())
+    {
+        error = "cannot read";
+        return false;
+    }
+    image_scanner in{file.data, file.data + file.size};
+    std::string magic, scale_text;
+    int max_value = 255;
+    in.next_token(magic);
+    bool pfm = magic == "PF" || magic == "Pf";
+    if ((magic != "P3" && magic != "P6" && !pfm) || !in.next_int(width) || !in.next_int(height) ||
+        (pfm ? !in.next_token(scale_text) : !in.next_int(max_value)) || width <= 0 || height <= 0 ||
+        max_value <= 0 || max_value > 65535)
+    {
+        error = "not a P3, P6 or PFM image";
+        return false;
+    }
+    // Checked against the file before anything is allocated: every P3
+    // sample but the last takes at least a digit and a separator, binary
+    // samples follow one separator byte
+    const size_t pixels = static_cast<size_t>(width) * height;
+    const size_t remaining = static_cast<size_t>(in.end - in.p);
+    const size_t samples = (magic == "Pf" ? 1 : 3) * pixels;
+    const size_t needed = magic == "P3" ? 2 * samples - 1
+                                        : 1 + samples * (pfm ? sizeof(float) : (max_value > 255 ? 2 : 1));
+    if (remaining < needed)
+    {
+        error = "truncated " + magic + " pixels";
+        return false;
+    }
+    rgb.resize(3 * pixels);
+
+    if (magic == "P3")
+    {
+        for (size_t i = 0; i < 3 * pixels; i++)
+        {
+            int value;
+            if (!in.next_int(value))
+            {
+                error = "truncated P3 pixels";
+                return false;
+            }
+            rgb[i] = scale_sample(value, max_value);
+        }
+        return true;
+    }
+
+    // One whitespace byte separates the header from binary samples
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(in.p + 1);
+    const size_t available = in.p < in.end ? static_cast<size_t>(in.end - in.p - 1) : 0;
+    if (magic == "P6")
+    {
+        const int bytes = max_value > 255 ? 2 : 1;
+        if (available < 3 * pixels * bytes)
+        {
+            error = "truncated P6 pixels";
+            return false;
+        }
+        if (max_value == 255)
+            memcpy(rgb.data(), data, 3 * pixels);
+        else
+            for (size_t i = 0; i < 3 * pixels; i++)
+                rgb[i] = scale_sample(bytes == 2 ? data[2 * i] << 8 | data[2 * i + 1] : data[i], max_value);
+        return true;
+    }
+
+    // pfm stores rows bottom to top, a negative scale marks little endian floats
+    const int channels = magic == "PF" ? 3 : 1;
+    const double scale = atof(scale_text.c_str());
+    if (scale == 0 || available < channels * pixels * sizeof(float))
+    {
+        error = "truncated PFM pixels";
+        return false;
+    }
+    const bool swap = (scale < 0) != (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+    const float exposure = static_cast<float>(options.exposure);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = data + static_cast<size_t>(height - 1 - y) * width * channels * sizeof(float);
+        unsigned char *out = rgb.data() + 3 * static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; x++)
+        {
+            float c[3];
+            for (int k = 0; k < channels; k++)
+            {
+                uint32_t bits;
+                memcpy(&bits, row + (x * channels + k) * sizeof(float), sizeof(bits));
+                if (swap)
+                    bits = __builtin_bswap32(bits);
+                memcpy(&c[k], &bits, sizeof(bits));
+                c[k] = std::isfinite(c[k]) ? exposure * c[k] : 0.0f;
+            }
+            if (channels == 1)
+                c[1] = c[2] = c[0];
+            float luminance = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+            float compress = luminance > 0 ? 1 / (1 + luminance) : 1;
+            for (int k = 0; k < 3; k++)
+                out[3 * x + k] = quantize_linear(compress * c[k]);
+        }
+    }
+    return true;
+}
+
+// Buffers a worker keeps from one image to the next
+struct convert_buffers
+{
+    std::vector<unsigned char> rgb;
+    std::vector<uint8_t> encoded;
+};
+
+// Converts the image at input to a PNG or JPEG file at output
+// Returns false with a message in error if it fails.
+bool convert_image(const std::string &input, const std::string &output, const convert_options &options,
+                   convert_buffers &buffers, size_t &bytes_in, size_t &bytes_out, std::string &error)
+{
+    int width, height;
+    {
+        mapped_file file(input);
+        if (!decode_image(file, options, width, height, buffers.rgb, error))
+            return false;
+        bytes_in = file.size;
+    }
+    if (options.jpeg)
+        encode_jpeg(width, height, buffers.rgb, options.quality, buffers.encoded);
+    else
+        encode_png(width, height, buffers.rgb, options.png_level, buffers.encoded);
+
+    std::ofstream out(output, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(buffers.encoded.data()), buffers.encoded.size());
+    if (!out)
+    {
+        error = "cannot write " + output;
+        return false;
+    }
+    bytes_out = buffers.encoded.size();
+    return true;
+}
+
+// A queue that blocks producers while it holds capacity items and consumers
+// while it is empty, until it is closed
+template <typename T>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]
+                      { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    // Wakes the consumers once the queue runs empty
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]
+                       { return !items.empty() || closed; });
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_full, not_empty;
+};
+
+struct convert_job
+{
+    std::string input, output;
+};
+
+struct convert_report
+{
+    size_t images = 0, bytes_in = 0, bytes_out = 0;
+    std::vector<std::string> failures; // "input: error"
+    double seconds = 0;
+};
+
+// Converts the jobs next hands out (until it returns false) on threads
+// workers through a queue of capacity jobs
+convert_report convert_all(const std::function<bool(convert_job &)> &next, int threads, size_t capacity,
+                           const convert_options &options)
+{
+    auto start = std::chrono::steady_clock::now();
+    bounded_queue<convert_job> queue(capacity);
+    convert_report report;
+    std::mutex report_mutex;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < std::max(1, threads); t++)
+        workers.emplace_back([&]()
+                             {
+                                 convert_buffers buffers;
+                                 convert_job job;
+                                 while (queue.pop(job))
+                                 {
+                                     size_t bytes_in = 0, bytes_out = 0;
+                                     std::string error;
+                                     bool ok = false;
+                                     // One bad frame fails alone instead of ending the batch
+                                     try
+                                     {
+                                         ok = convert_image(job.input, job.output, options, buffers, bytes_in,
+                                                            bytes_out, error);
+                                     }
+                                     catch (const std::exception &e)
+                                     {
+                                         error = e.what();
+                                     }
+                                     std::lock_guard<std::mutex> lock(report_mutex);
+                                     if (!ok)
+                                         report.failures.push_back(job.input + ": " + error);
+                                     else
+                                     {
+                                         report.images++;
+                                         report.bytes_in += bytes_in;
+                                         report.bytes_out += bytes_out;
+                                     }
+                                 } });
+
+    convert_job job;
+    while (next(job))
+        queue.push(job);
+    queue.close();
+    for (auto &w : workers)
+        w.join();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+// Whether path names a .ppm or .pfm file
+inline bool convertible_name(const std::string &path)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".ppm" || extension == ".pfm";
+}
+
+// Hands out one job per input file and per .ppm/.pfm file in an input
+// directory, reading directories an entry at a time. Outputs go to
+// output_dir, or to a converted directory next to a directory's files.
+class convert_inputs
+{
+public:
+    convert_inputs(const std::vector<std::string> &inputs, const std::string &output_dir, bool jpeg)
+        : inputs(inputs), output_dir(output_dir), extension(jpeg ? ".jpg" : ".png") {}
+
+    ~convert_inputs()
+    {
+        if (dir)
+            closedir(dir);
+    }
+
+    bool operator()(convert_job &job)
+    {
+        while (true)
+        {
+            if (dir)
+            {
+                if (dirent *entry = readdir(dir))
+                {
+                    std::string name = entry->d_name;
+                    if (convertible_name(name))
+                    {
+                        job.input = dir_path + "/" + name;
+                        job.output = output_for(name, dir_path);
+                        return true;
+                    }
+                    continue;
+                }
+                closedir(dir);
+                dir = nullptr;
+            }
+            if (next_input == inputs.size())
+                return false;
+
+            const std::string &path = inputs[next_input++];
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            {
+                dir_path = path;
+                while (dir_path.size() > 1 && dir_path.back() == '/')
+                    dir_path.pop_back();
+                dir = opendir(dir_path.c_str());
+                continue;
+            }
+            size_t slash = path.rfind('/');
+            job.input = path;
+            job.output = output_for(slash == std::string::npos ? path : path.substr(slash + 1),
+                                    slash == std::string::npos ? "." : path.substr(0, slash));
+            return true;
+        }
+    }
+
+private:
+    std::string output_for(const std::string &name, const std::string &source_dir)
+    {
+        std::string directory = output_dir.empty() ? source_dir + "/converted" : output_dir;
+        if (directory != made_dir)
+        {
+            mkdir(directory.c_str(), 0755);
+            made_dir = directory;
+        }
+        return directory + "/" + name.substr(0, name.rfind('.')) + extension;
+    }
+
+    std::vector<std::string> inputs;
+    std::string output_dir, extension;
+    size_t next_input = 0;
+    DIR *dir = nullptr;
+    std::string dir_path, made_dir;
+};
+
+#endif
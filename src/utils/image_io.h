@@ -0,0 +1,85 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+// Reading and writing of 8 bit ppm images
+// Reads both the ascii (P3) format write_color produces and binary (P6),
+// writes binary since it is a quarter of the size. Float images are
+// written as pfm.
+
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Next header integer, skipping whitespace and # comments
+inline bool read_ppm_int(std::istream &in, int &value)
+{
+    int c;
+    while ((c = in.peek()) != EOF)
+    {
+        if (isspace(c))
+            in.get();
+        else if (c == '#')
+            while ((c = in.get()) != EOF && c != '\n')
+                ;
+        else
+            break;
+    }
+    return static_cast<bool>(in >> value);
+}
+
+// Reads a P3 or P6 image into rgb (3 bytes per pixel, rows top to bottom)
+bool read_ppm(const std::string &path, int &width, int &height, std::vector<unsigned char> &rgb)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    if (!(in >> magic) || (magic != "P3" && magic != "P6"))
+        return false;
+
+    int max_value;
+    if (!read_ppm_int(in, width) || !read_ppm_int(in, height) || !read_ppm_int(in, max_value) ||
+        width <= 0 || height <= 0 || max_value <= 0 || max_value > 255)
+        return false;
+
+    rgb.resize(3 * static_cast<size_t>(width) * height);
+    if (magic == "P6")
+    {
+        // Exactly one whitespace byte separates the header from the pixels
+        in.get();
+        in.read(reinterpret_cast<char *>(rgb.data()), rgb.size());
+        return static_cast<size_t>(in.gcount()) == rgb.size();
+    }
+
+    for (auto &v : rgb)
+    {
+        int value;
+        if (!read_ppm_int(in, value))
+            return false;
+        v = static_cast<unsigned char>(value);
+    }
+    return true;
+}
+
+bool write_ppm(const std::string &path, int width, int height, const std::vector<unsigned char> &rgb)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n"
+        << width << ' ' << height << "\n255\n";
+    out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+    return static_cast<bool>(out);
+}
+
+// Writes a 1 (Pf) or 3 (PF) channel float image, data holds rows top to bottom
+// pfm stores rows bottom to top, a negative scale marks little endian floats
+bool write_pfm(const std::string &path, int width, int height, int channels, const std::vector<float> &data)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << (channels == 1 ? "Pf\n" : "PF\n")
+        << width << ' ' << height << "\n-1.0\n";
+    const size_t row = static_cast<size_t>(width) * channels;
+    for (int y = height - 1; y >= 0; --y)
+        out.write(reinterpret_cast<const char *>(data.data() + y * row), row * sizeof(float));
+    return static_cast<bool>(out);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef JOB_ARGS_H
+#define JOB_ARGS_H
+
+// key=value job arguments, as the render daemon receives them and batch
+// job files list them
+
+#include "rtweekend.h"
+
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Job arguments after the command word, parsed as key=value pairs
+using job_args = std::map<std::string, std::string>;
+
+job_args parse_args(std::istringstream &line)
+{
+    job_args args;
+    std::string token;
+    while (line >> token)
+    {
+        auto eq = token.find('=');
+        if (eq == std::string::npos)
+            args[token] = "";
+        else
+            args[token.substr(0, eq)] = token.substr(eq + 1);
+    }
+    return args;
+}
+
+// The numeric arguments throw std::invalid_argument unless the whole value
+// is a number (std::stod and std::stoi alone stop at the first bad character)
+void bad_arg(const std::string &key, const std::string &value)
+{
+    throw std::invalid_argument("bad " + key + "=" + value);
+}
+
+double arg_double(const job_args &args, const std::string &key, double fallback)
+{
+    auto it = args.find(key);
+    if (it == args.end())
+        return fallback;
+    size_t used = 0;
+    double value = std::stod(it->second, &used);
+    if (used != it->second.size())
+        bad_arg(key, it->second);
+    return value;
+}
+
+int arg_int(const job_args &args, const std::string &key, int fallback)
+{
+    auto it = args.find(key);
+    if (it == args.end())
+        return fallback;
+    size_t used = 0;
+    int value = std::stoi(it->second, &used);
+    if (used != it->second.size())
+        bad_arg(key, it->second);
+    return value;
+}
+
+// Parses "x,y,z"
+vec3 arg_vec3(const job_args &args, const std::string &key, vec3 fallback)
+{
+    auto it = args.find(key);
+    if (it == args.end())
+        return fallback;
+    vec3 v;
+    char comma1, comma2;
+    std::istringstream in(it->second);
+    if (!(in >> v[0] >> comma1 >> v[1] >> comma2 >> v[2]) || comma1 != ',' || comma2 != ',' || in.peek() != EOF)
+        bad_arg(key, it->second);
+    return v;
+}
+
+#endif
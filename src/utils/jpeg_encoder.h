@@ -0,0 +1,344 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+// Baseline JPEG encoding of 8 bit rgb images
+// JFIF YCbCr with the chroma subsampled 2x2 (4:2:0), the quantization
+// tables of the JPEG standard scaled for quality 1-100 as libjpeg scales
+// them, the float AAN forward DCT (libjpeg's jfdctflt) with its scale
+// factors folded into the quantization, and the standard Huffman tables.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Natural (row major) index of the k-th coefficient in zigzag order
+const int jpeg_zigzag[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                             12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                             35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                             58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+const uint8_t jpeg_luma_quant[64] = {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+                                     14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+                                     18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+                                     49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+const uint8_t jpeg_chroma_quant[64] = {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+                                       24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+                                       99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                                       99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Standard Huffman tables: codes per length 1-16, then the symbols
+const uint8_t jpeg_dc_luma_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t jpeg_dc_chroma_bits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t jpeg_dc_values[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const uint8_t jpeg_ac_luma_bits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t jpeg_ac_luma_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+    0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+const uint8_t jpeg_ac_chroma_bits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t jpeg_ac_chroma_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+    0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// Code and length of every symbol of a table (JPEG Annex C)
+struct jpeg_huffman
+{
+    uint16_t codes[256] = {};
+    uint8_t lengths[256] = {};
+
+    jpeg_huffman(const uint8_t *bits, const uint8_t *values)
+    {
+        uint16_t code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; length++)
+        {
+            for (int i = 0; i < bits[length - 1]; i++, k++)
+            {
+                codes[values[k]] = code++;
+                lengths[values[k]] = static_cast<uint8_t>(length);
+            }
+            code <<= 1;
+        }
+    }
+};
+
+// Entropy coded bits, most significant first, with a 0 stuffed after
+// every 0xff byte
+class jpeg_bits
+{
+public:
+    std::vector<uint8_t> &out;
+
+    explicit jpeg_bits(std::vector<uint8_t> &stream) : out(stream) {}
+
+    void put(uint32_t bits, int count)
+    {
+        buffer = (buffer << count) | (bits & ((1u << count) - 1));
+        filled += count;
+        while (filled >= 8)
+        {
+            uint8_t byte = static_cast<uint8_t>(buffer >> (filled - 8));
+            out.push_back(byte);
+            if (byte == 0xff)
+                out.push_back(0);
+            filled -= 8;
+        }
+    }
+
+    // Pads the last byte with ones
+    void flush() { put(0x7f, 7); }
+
+private:
+    uint64_t buffer = 0;
+    int filled = 0;
+};
+
+// Float AAN forward DCT of a block in place (rows, then columns), the
+// outputs scaled by 8 and jpeg_aan_scale of their row and column
+inline void jpeg_fdct(float *block)
+{
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const int step = pass == 0 ? 1 : 8, next = pass == 0 ? 8 : 1;
+        for (int line = 0; line < 8; line++)
+        {
+            float *d = block + line * next;
+            float tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+            float tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+            float tmp2 = d[2 * step] + d[5 * step], tmp5 = d[2 * step] - d[5 * step];
+            float tmp3 = d[3 * step] + d[4 * step], tmp4 = d[3 * step] - d[4 * step];
+
+            // Even part
+            float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+            float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+            d[0] = tmp10 + tmp11;
+            d[4 * step] = tmp10 - tmp11;
+            float z1 = (tmp12 + tmp13) * 0.707106781f;
+            d[2 * step] = tmp13 + z1;
+            d[6 * step] = tmp13 - z1;
+
+            // Odd part
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+            float z5 = (tmp10 - tmp12) * 0.382683433f;
+            float z2 = 0.541196100f * tmp10 + z5;
+            float z4 = 1.306562965f * tmp12 + z5;
+            float z3 = tmp11 * 0.707106781f;
+            float z11 = tmp7 + z3, z13 = tmp7 - z3;
+            d[5 * step] = z13 + z2;
+            d[3 * step] = z13 - z2;
+            d[step] = z11 + z4;
+            d[7 * step] = z11 - z4;
+        }
+    }
+}
+
+const float jpeg_aan_scale[8] = {1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+                                 1.0f, 0.785694958f, 0.541196100f, 0.275899379f};
+
+// One component's quantization: the table in zigzag order for the file and
+// the reciprocal divisors of the scaled DCT outputs in natural order
+struct jpeg_quantizer
+{
+    uint8_t table[64];
+    float divisors[64];
+
+    jpeg_quantizer(const uint8_t *base, int quality)
+    {
+        quality = std::clamp(quality, 1, 100);
+        int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+        for (int k = 0; k < 64; k++)
+        {
+            int natural = jpeg_zigzag[k];
+            int q = std::clamp((base[natural] * scale + 50) / 100, 1, 255);
+            table[k] = static_cast<uint8_t>(q);
+            divisors[natural] = 1.0f / (q * jpeg_aan_scale[natural / 8] * jpeg_aan_scale[natural % 8] * 8.0f);
+        }
+    }
+};
+
+// Quantizes a block and writes its Huffman codes, dc is the previous
+// block's DC of the component
+inline void jpeg_encode_block(jpeg_bits &bits, float *block, const jpeg_quantizer &quantizer,
+                              const jpeg_huffman &dc_code, const jpeg_huffman &ac_code, int &dc)
+{
+    jpeg_fdct(block);
+    int coefficients[64];
+    for (int k = 0; k < 64; k++)
+    {
+        int natural = jpeg_zigzag[k];
+        coefficients[k] = static_cast<int>(lrintf(block[natural] * quantizer.divisors[natural]));
+    }
+
+    // A value of category c (its bit length) as its c low bits, negative
+    // ones minus one
+    auto put_value = [&](int value, int &category)
+    {
+        int magnitude = value < 0 ? -value : value;
+        category = 0;
+        while (magnitude >> category)
+            category++;
+        return static_cast<uint32_t>(value < 0 ? value - 1 : value);
+    };
+
+    int category;
+    uint32_t bits_value = put_value(coefficients[0] - dc, category);
+    dc = coefficients[0];
+    bits.put(dc_code.codes[category], dc_code.lengths[category]);
+    if (category)
+        bits.put(bits_value, category);
+
+    int last = 63;
+    while (last > 0 && coefficients[last] == 0)
+        last--;
+    int run = 0;
+    for (int k = 1; k <= last; k++)
+    {
+        if (coefficients[k] == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run >= 16)
+        {
+            bits.put(ac_code.codes[0xf0], ac_code.lengths[0xf0]);
+            run -= 16;
+        }
+        bits_value = put_value(coefficients[k], category);
+        int symbol = (run << 4) | category;
+        bits.put(ac_code.codes[symbol], ac_code.lengths[symbol]);
+        bits.put(bits_value, category);
+        run = 0;
+    }
+    if (last < 63)
+        bits.put(ac_code.codes[0], ac_code.lengths[0]);
+}
+
+// Encodes rgb (3 bytes per pixel, rows top to bottom) as a baseline JPEG
+// file of the given quality (1-100)
+void encode_jpeg(int width, int height, const std::vector<unsigned char> &rgb, int quality, std::vector<uint8_t> &out)
+{
+    static const jpeg_huffman dc_luma(jpeg_dc_luma_bits, jpeg_dc_values);
+    static const jpeg_huffman dc_chroma(jpeg_dc_chroma_bits, jpeg_dc_values);
+    static const jpeg_huffman ac_luma(jpeg_ac_luma_bits, jpeg_ac_luma_values);
+    static const jpeg_huffman ac_chroma(jpeg_ac_chroma_bits, jpeg_ac_chroma_values);
+    const jpeg_quantizer luma(jpeg_luma_quant, quality), chroma(jpeg_chroma_quant, quality);
+
+    out.clear();
+    auto put16 = [&](int v)
+    {
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    };
+    auto marker = [&](uint8_t m, int length)
+    {
+        out.push_back(0xff);
+        out.push_back(m);
+        put16(length);
+    };
+
+    out.push_back(0xff);
+    out.push_back(0xd8); // start of image
+    marker(0xe0, 16);    // JFIF 1.01, no density, no thumbnail
+    const uint8_t jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    marker(0xdb, 2 + 2 * 65);
+    out.push_back(0);
+    out.insert(out.end(), luma.table, luma.table + 64);
+    out.push_back(1);
+    out.insert(out.end(), chroma.table, chroma.table + 64);
+
+    marker(0xc0, 17); // baseline frame, 8 bit, 3 components
+    out.push_back(8);
+    put16(height);
+    put16(width);
+    out.push_back(3);
+    const uint8_t components[9] = {1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1};
+    out.insert(out.end(), components, components + 9);
+
+    struct table_source
+    {
+        uint8_t id;
+        const uint8_t *bits, *values;
+        int count;
+    };
+    const table_source tables[4] = {{0x00, jpeg_dc_luma_bits, jpeg_dc_values, 12},
+                                    {0x10, jpeg_ac_luma_bits, jpeg_ac_luma_values, 162},
+                                    {0x01, jpeg_dc_chroma_bits, jpeg_dc_values, 12},
+                                    {0x11, jpeg_ac_chroma_bits, jpeg_ac_chroma_values, 162}};
+    marker(0xc4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    for (const table_source &t : tables)
+    {
+        out.push_back(t.id);
+        out.insert(out.end(), t.bits, t.bits + 16);
+        out.insert(out.end(), t.values, t.values + t.count);
+    }
+
+    marker(0xda, 12); // scan of all three components
+    const uint8_t scan[10] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    out.insert(out.end(), scan, scan + 10);
+
+    // 16x16 pixel MCUs: four Y blocks, then Cb and Cr averaged over 2x2
+    // pixels. Pixels past the edges repeat the last row and column.
+    jpeg_bits bits(out);
+    int dc_y = 0, dc_cb = 0, dc_cr = 0;
+    float y_plane[256], cb_plane[256], cr_plane[256], block[64];
+    for (int my = 0; my < height; my += 16)
+        for (int mx = 0; mx < width; mx += 16)
+        {
+            for (int py = 0; py < 16; py++)
+            {
+                const unsigned char *row = rgb.data() + 3 * static_cast<size_t>(std::min(my + py, height - 1)) * width;
+                for (int px = 0; px < 16; px++)
+                {
+                    const unsigned char *p = row + 3 * std::min(mx + px, width - 1);
+                    float r = p[0], g = p[1], b = p[2];
+                    y_plane[py * 16 + px] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+                    cb_plane[py * 16 + px] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+                    cr_plane[py * 16 + px] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+                }
+            }
+            for (int by = 0; by < 16; by += 8)
+                for (int bx = 0; bx < 16; bx += 8)
+                {
+                    for (int k = 0; k < 64; k++)
+                        block[k] = y_plane[(by + k / 8) * 16 + bx + k % 8];
+                    jpeg_encode_block(bits, block, luma, dc_luma, ac_luma, dc_y);
+                }
+            for (int c = 0; c < 2; c++)
+            {
+                const float *plane = c == 0 ? cb_plane : cr_plane;
+                for (int k = 0; k < 64; k++)
+                {
+                    int i = (k / 8) * 32 + (k % 8) * 2;
+                    block[k] = 0.25f * (plane[i] + plane[i + 1] + plane[i + 16] + plane[i + 17]);
+                }
+                jpeg_encode_block(bits, block, chroma, dc_chroma, ac_chroma, c == 0 ? dc_cb : dc_cr);
+            }
+        }
+    bits.flush();
+
+    out.push_back(0xff);
+    out.push_back(0xd9); // end of image
+}
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef LIVE_FRAMEBUFFER_H
+#define LIVE_FRAMEBUFFER_H
+
+// Live view of a render in progress
+// The renderer publishes its accumulated samples into a shared memory
+// mapped file (put it in /dev/shm to keep it in memory, which is what POSIX
+// shm_open does) that any number of viewers can map and read while the
+// render runs, see live_view.cpp.
+//
+// Layout (native endianness, checked through the byte order field):
+//   live_header
+//   uint32_t row_sequence[height]    seqlock of every row
+//   live_pixel pixels[width * height] rows top to bottom
+//
+// Every finished tile is added row by row: a row's sequence number is odd
+// while it is written. A reader copies a row between two reads of its
+// sequence number and copies it again if the number changed or was odd, so
+// the sum and sample count of every pixel it gets belong together, and the
+// writer never waits for readers. The generation counter goes up after
+// every tile; a reader that needs the whole frame from one moment retries
+// until the generation is the same before and after its copy.
+// Tiles are published by one thread at a time (accumulate_tiles calls its
+// on_tile under a lock).
+
+#include "rtweekend.h"
+
+#include "tile_scheduler.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t live_framebuffer_version = 1;
+
+enum live_state : uint32_t
+{
+    live_rendering = 1,
+    live_finished = 2,
+    live_abandoned = 3 // the writer went away before finishing
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "live framebuffer counters must be lock free to work across processes");
+
+struct live_header
+{
+    char magic[8];       // "GHDLIVE" and a zero byte
+    uint32_t byte_order; // 0x01020304 as written
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t target_spp; // samples per pixel the render aims for, 0 if open ended
+    std::atomic<uint32_t> state;
+    uint64_t pid;                     // of the renderer
+    std::atomic<uint64_t> generation; // tiles added so far
+    uint64_t pixels_offset;
+};
+
+// Sum of a pixel's samples and how many there are
+struct live_pixel
+{
+    float sum[3]; // floats, so a finished frame can be 1/255 off the double precision output
+    uint32_t samples;
+};
+
+inline size_t live_file_size(int width, int height, uint64_t &pixels_offset)
+{
+    size_t rows = sizeof(live_header) + sizeof(uint32_t) * height;
+    pixels_offset = (rows + 63) / 64 * 64;
+    return pixels_offset + sizeof(live_pixel) * static_cast<size_t>(width) * height;
+}
+
+// Writer side, owned by the renderer
+class live_framebuffer
+{
+public:
+    live_framebuffer() = default;
+    ~live_framebuffer() { close(); }
+
+    live_framebuffer(const live_framebuffer &) = delete;
+    live_framebuffer &operator=(const live_framebuffer &) = delete;
+
+    // Creates (or replaces) the file with an empty frame, returns false if
+    // it can't be created or mapped
+    bool create(const std::string &file_path, int width, int height, int target_spp)
+    {
+        close();
+        uint64_t pixels_offset;
+        size_t bytes = live_file_size(width, height, pixels_offset);
+
+        // A fresh file, so a viewer still mapping an older one keeps reading that
+        std::string temporary = file_path + ".tmp";
+        int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            std::cerr << "cannot create live framebuffer " << file_path << "\n";
+            return false;
+        }
+        void *p = MAP_FAILED;
+        if (ftruncate(fd, bytes) == 0)
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED || rename(temporary.c_str(), file_path.c_str()) != 0)
+        {
+            std::cerr << "cannot map live framebuffer " << file_path << "\n";
+            if (p != MAP_FAILED)
+                munmap(p, bytes);
+            unlink(temporary.c_str());
+            return false;
+        }
+
+        // The file starts out zeroed: no samples, every row at sequence 0
+        data = static_cast<char *>(p);
+        size = bytes;
+        header = new (data) live_header;
+        memcpy(header->magic, "GHDLIVE", 8);
+        header->byte_order = 0x01020304;
+        header->version = live_framebuffer_version;
+        header->width = width;
+        header->height = height;
+        header->target_spp = target_spp;
+        header->pid = static_cast<uint64_t>(getpid());
+        header->pixels_offset = pixels_offset;
+        header->generation.store(0, std::memory_order_relaxed);
+        rows = reinterpret_cast<std::atomic<uint32_t> *>(data + sizeof(live_header));
+        for (int y = 0; y < height; y++)
+            new (&rows[y]) std::atomic<uint32_t>(0);
+        pixels = reinterpret_cast<live_pixel *>(data + pixels_offset);
+        header->state.store(live_rendering, std::memory_order_release);
+        path = file_path;
+        return true;
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // Adds samples_per_pixel samples over a tile, sums as accumulate_tile
+    // returns them
+    void add(const tile &t, const std::vector<color> &sums, int samples_per_pixel)
+    {
+        if (!header)
+            return;
+        const int width = static_cast<int>(header->width);
+        size_t k = 0;
+        for (int y = t.y0; y < t.y1; y++)
+        {
+            uint32_t sequence = rows[y].load(std::memory_order_relaxed);
+            rows[y].store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            live_pixel *row = pixels + static_cast<size_t>(y) * width;
+            for (int x = t.x0; x < t.x1; x++, k++)
+            {
+                live_pixel &p = row[x];
+                for (int c = 0; c < 3; c++)
+                    p.sum[c] += static_cast<float>(sums[k][c]);
+                p.samples += samples_per_pixel;
+            }
+            rows[y].store(sequence + 2, std::memory_order_release);
+        }
+        header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+    // Marks the render as done (or abandoned) and unmaps the file, which
+    // stays for viewers until it is deleted or replaced
+    void close(live_state final_state = live_finished)
+    {
+        if (!header)
+            return;
+        header->state.store(final_state, std::memory_order_release);
+        munmap(data, size);
+        data = nullptr;
+        header = nullptr;
+    }
+
+public:
+    std::string path;
+
+private:
+    char *data = nullptr;
+    size_t size = 0;
+    live_header *header = nullptr;
+    std::atomic<uint32_t> *rows = nullptr;
+    live_pixel *pixels = nullptr;
+};
+
+// A copy of a live framebuffer
+struct live_snapshot
+{
+    int width = 0, height = 0;
+    int target_spp = 0;
+    live_state state = live_rendering;
+    uint64_t pid = 0;
+    uint64_t generation = 0;  // when the copy started
+    bool whole_frame = false; // no tile was added during the copy
+    bool whole_rows = true;   // false if the writer died while adding to a row
+    std::vector<live_pixel> pixels;
+
+    // Mean of every pixel tonemapped like write_color (3 bytes per pixel),
+    // pixels without samples black
+    void resolve(std::vector<unsigned char> &rgb) const
+    {
+        rgb.assign(3 * pixels.size(), 0);
+        for (size_t p = 0; p < pixels.size(); p++)
+        {
+            if (!pixels[p].samples)
+                continue;
+            for (int c = 0; c < 3; c++)
+                rgb[3 * p + c] = static_cast<unsigned char>(
+                    256 * clamp(sqrt(pixels[p].sum[c] / pixels[p].samples), 0.0, 0.999));
+        }
+    }
+};
+
+// True once the renderer that wrote a live framebuffer has exited
+bool live_writer_gone(uint64_t pid)
+{
+    return kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
+
+// Busy reads of a row held by the writer before checking the writer is alive
+const int live_row_spins = 1 << 16;
+
+// Reads a live framebuffer file into snapshot, retrying up to attempts
+// times for a copy no tile was added during if whole_frame is set (the last
+// attempt is kept either way, with snapshot.whole_frame telling which).
+// A row the writer died adding to is copied half written, with
+// snapshot.whole_rows cleared.
+// Returns false if the file is missing or not a live framebuffer.
+bool read_live_snapshot(const std::string &path, live_snapshot &snapshot, bool whole_frame = false,
+                        int attempts = 10)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(live_header))
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    const char *data = static_cast<const char *>(p);
+    const live_header *header = reinterpret_cast<const live_header *>(data);
+
+    uint64_t pixels_offset;
+    bool valid = memcmp(header->magic, "GHDLIVE", 8) == 0 && header->byte_order == 0x01020304 &&
+                 header->version == live_framebuffer_version && header->width > 0 && header->height > 0 &&
+                 live_file_size(header->width, header->height, pixels_offset) <= static_cast<size_t>(st.st_size) &&
+                 header->pixels_offset == pixels_offset;
+    if (valid)
+    {
+        const int width = header->width, height = header->height;
+        const std::atomic<uint32_t> *rows = reinterpret_cast<const std::atomic<uint32_t> *>(data + sizeof(live_header));
+        const live_pixel *pixels = reinterpret_cast<const live_pixel *>(data + pixels_offset);
+        snapshot.width = width;
+        snapshot.height = height;
+        snapshot.target_spp = header->target_spp;
+        snapshot.pid = header->pid;
+        snapshot.pixels.resize(static_cast<size_t>(width) * height);
+
+        for (int attempt = 0; attempt < attempts; attempt++)
+        {
+            snapshot.state = static_cast<live_state>(header->state.load(std::memory_order_acquire));
+            snapshot.generation = header->generation.load(std::memory_order_acquire);
+            snapshot.whole_rows = true;
+            for (int y = 0; y < height; y++)
+            {
+                // The writer only holds a row for one tile's width of pixels.
+                // After spinning that long the row is checked on: a writer
+                // that died holding it never lets go, so the row is taken as
+                // it is, and a live one that lost its core is waited on
+                // without spinning.
+                int spins = 0;
+                while (true)
+                {
+                    uint32_t before = rows[y].load(std::memory_order_acquire);
+                    const bool held = before & 1;
+                    if (held && ++spins < live_row_spins)
+                        continue;
+                    if (held && !live_writer_gone(snapshot.pid))
+                    {
+                        spins = 0;
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    memcpy(&snapshot.pixels[static_cast<size_t>(y) * width], pixels + static_cast<size_t>(y) * width,
+                           sizeof(live_pixel) * width);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (held)
+                    {
+                        snapshot.whole_rows = false;
+                        break;
+                    }
+                    if (rows[y].load(std::memory_order_relaxed) == before)
+                        break;
+                }
+            }
+            snapshot.whole_frame = header->generation.load(std::memory_order_acquire) == snapshot.generation;
+            if (!whole_frame || snapshot.whole_frame)
+                break;
+        }
+    }
+    munmap(p, st.st_size);
+    return valid;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file
+class mapped_file {
+    public:
+        mapped_file(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    // Mesh parsers and cache loads stream through the file front to back
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    data = static_cast<const char*>(p);
+                    size = st.st_size;
+                }
+            }
+            close(fd);
+        }
+
+        ~mapped_file() {
+            if (data) munmap(const_cast<char*>(data), size);
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        bool is_open() const { return data != nullptr; }
+
+    public:
+        const char* data = nullptr;
+        size_t size = 0;
+};
+
+#endif
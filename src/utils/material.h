@@ -3,19 +3,39 @@
 
 #include "rtweekend.h"
 
-struct hit_record;
+#include "hittable.h"
+#include "texture.h"
+
+// How much wider, in radians, a diffuse bounce makes the ray cone used for
+// texture filtering. The bounce gathers light from the whole hemisphere, so
+// what it hits next only needs coarse mip levels.
+const double diffuse_cone_spread = 0.5;
 
 class material {
     public:
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const = 0;
+
+        // True for ideal diffuse surfaces, whose outgoing light is albedo times
+        // the cosine-weighted mean of the incoming light
+        virtual bool diffuse(const hit_record& rec, color& albedo) const {
+            return false;
+        }
+
+        // Angle in radians the ray cone of a scattered ray opens by
+        virtual double cone_spread(const hit_record& rec) const {
+            return 0;
+        }
 };
 
 class lambertian : public material {
     public:
         lambertian(const color& a) : albedo(a) {}
 
+        // Albedo from a texture, times tint
+        lambertian(shared_ptr<texture> map, const color& tint = color(1, 1, 1)) : albedo(tint), albedo_map(map) {}
+
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
@@ -26,30 +46,58 @@ class lambertian : public material {
                 scatter_direction = rec.normal;
 
             scattered = ray(rec.p, scatter_direction);
-            attenuation = albedo;
+            attenuation = albedo_at(rec);
+            return true;
+        }
+
+        virtual bool diffuse(const hit_record& rec, color& a) const override {
+            a = albedo_at(rec);
             return true;
         }
 
+        virtual double cone_spread(const hit_record&) const override {
+            return diffuse_cone_spread;
+        }
+
+        color albedo_at(const hit_record& rec) const {
+            return albedo_map ? albedo * texture_value(*albedo_map, rec) : albedo;
+        }
+
     public:
         color albedo;
+        shared_ptr<texture> albedo_map; // optional
 };
 
 class metal : public material {
     public:
         metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
+        // Albedo and fuzz scaled by textures, either may be null
+        metal(const color& a, double f, shared_ptr<texture> albedo_texture, shared_ptr<texture> roughness_texture)
+            : albedo(a), fuzz(f < 1 ? f : 1), albedo_map(albedo_texture), roughness_map(roughness_texture) {}
+
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
             vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-            scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere());
-            attenuation = albedo;
+            scattered = ray(rec.p, reflected + fuzz_at(rec)*random_in_unit_sphere());
+            attenuation = albedo_map ? albedo * texture_value(*albedo_map, rec) : albedo;
             return (dot(scattered.direction(), rec.normal) > 0);
         }
 
+        virtual double cone_spread(const hit_record& rec) const override {
+            return fuzz_at(rec);
+        }
+
+        double fuzz_at(const hit_record& rec) const {
+            return roughness_map ? fuzz * texture_value(*roughness_map, rec).x() : fuzz;
+        }
+
     public:
         color albedo;
         double fuzz;
+        shared_ptr<texture> albedo_map;    // optional
+        shared_ptr<texture> roughness_map; // optional, scales fuzz
 };
 
 class dielectric : public material {
@@ -0,0 +1,550 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+// OBJ and PLY triangle mesh loading
+// Files are memory-mapped and split into line-aligned chunks that are parsed
+// on all cores. Only positions and faces are read, polygons are fan-triangulated.
+// The loaders print the reason to std::cerr and return false on failure.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace mesh_io {
+
+// Runs fn(chunk, begin, end) on line-aligned chunks of [begin, end) in parallel
+// and returns the number of chunks used
+template <typename chunk_fn>
+int parallel_lines(const char* begin, const char* end, chunk_fn&& fn) {
+    const size_t min_chunk = 1 << 20;
+    size_t size = end - begin;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int chunks = static_cast<int>(std::min<size_t>(threads, size / min_chunk + 1));
+
+    std::vector<const char*> bounds(chunks + 1);
+    bounds[0] = begin;
+    bounds[chunks] = end;
+    for (int c = 1; c < chunks; c++) {
+        const char* p = begin + size * c / chunks;
+        p = std::max(p, bounds[c - 1]);
+        auto nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        bounds[c] = nl ? nl + 1 : end;
+    }
+
+    if (chunks == 1) {
+        fn(0, begin, end);
+        return 1;
+    }
+
+    std::vector<std::thread> workers;
+    for (int c = 0; c < chunks; c++)
+        workers.emplace_back([&, c] { fn(c, bounds[c], bounds[c + 1]); });
+    for (auto& w : workers) w.join();
+    return chunks;
+}
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+inline const char* next_line(const char* p, const char* end) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    return nl ? nl + 1 : end;
+}
+
+// Bounded float parser, the mapped file is not null terminated so strtod cannot be used
+inline bool parse_float(const char*& p, const char* end, float& out) {
+    p = skip_spaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    double value = 0;
+    bool digits = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value += (*p++ - '0') * scale;
+            scale *= 0.1;
+            digits = true;
+        }
+    }
+    if (!digits) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+        int exponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') exponent = exponent * 10 + (*p++ - '0');
+        value *= pow(10.0, negative_exponent ? -exponent : exponent);
+    }
+
+    out = static_cast<float>(negative ? -value : value);
+    return true;
+}
+
+inline bool parse_int(const char*& p, const char* end, long long& out) {
+    p = skip_spaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9') return false;
+    long long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+    out = negative ? -value : value;
+    return true;
+}
+
+// Appends the per-chunk face lists in chunk order
+inline void concat_chunks(std::vector<std::vector<uint32_t>>& parts, std::vector<uint32_t>& out) {
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    out.reserve(out.size() + total);
+    for (auto& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+        std::vector<uint32_t>().swap(part);
+    }
+}
+
+// Fan-triangulates one polygon into out. Returns false, adding nothing, if
+// an index is negative or too large for 32 bits, which would wrap to a
+// valid vertex; the rest are range checked by check_indices.
+inline bool add_polygon(const std::vector<long long>& polygon, std::vector<uint32_t>& out) {
+    for (auto i : polygon)
+        if (i < 0 || i > static_cast<long long>(UINT32_MAX)) return false;
+    for (size_t k = 2; k < polygon.size(); k++) {
+        out.push_back(static_cast<uint32_t>(polygon[0]));
+        out.push_back(static_cast<uint32_t>(polygon[k - 1]));
+        out.push_back(static_cast<uint32_t>(polygon[k]));
+    }
+    return true;
+}
+
+inline bool check_indices(const std::vector<uint32_t>& indices, size_t vertex_count, const std::string& path) {
+    for (auto i : indices) {
+        if (i >= vertex_count) {
+            std::cerr << path << ": face index " << i << " out of range\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Scalar types of PLY properties
+enum ply_type { ply_int8, ply_uint8, ply_int16, ply_uint16, ply_int32, ply_uint32, ply_float32, ply_float64, ply_unknown };
+
+inline ply_type parse_ply_type(const std::string& t) {
+    if (t == "char" || t == "int8") return ply_int8;
+    if (t == "uchar" || t == "uint8") return ply_uint8;
+    if (t == "short" || t == "int16") return ply_int16;
+    if (t == "ushort" || t == "uint16") return ply_uint16;
+    if (t == "int" || t == "int32") return ply_int32;
+    if (t == "uint" || t == "uint32") return ply_uint32;
+    if (t == "float" || t == "float32") return ply_float32;
+    if (t == "double" || t == "float64") return ply_float64;
+    return ply_unknown;
+}
+
+inline int ply_type_size(ply_type t) {
+    static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+    return sizes[t];
+}
+
+// Reads one binary value, swapping bytes for big endian files
+inline double read_ply_value(const char* q, ply_type t, bool swap_bytes) {
+    unsigned char b[8];
+    int n = ply_type_size(t);
+    for (int i = 0; i < n; i++) b[i] = q[swap_bytes ? n - 1 - i : i];
+
+    int8_t c; int16_t s; uint16_t us; int32_t i; uint32_t ui; float f; double d;
+    switch (t) {
+        case ply_int8: memcpy(&c, b, 1); return c;
+        case ply_uint8: return b[0];
+        case ply_int16: memcpy(&s, b, 2); return s;
+        case ply_uint16: memcpy(&us, b, 2); return us;
+        case ply_int32: memcpy(&i, b, 4); return i;
+        case ply_uint32: memcpy(&ui, b, 4); return ui;
+        case ply_float32: memcpy(&f, b, 4); return f;
+        default: memcpy(&d, b, 8); return d;
+    }
+}
+
+} // namespace mesh_io
+
+// Loads the v and f records of a Wavefront OBJ file
+bool load_obj(const std::string& path, std::vector<float>& positions, std::vector<uint32_t>& indices) {
+    using namespace mesh_io;
+
+    mapped_file file(path);
+    if (!file.is_open()) {
+        std::cerr << path << ": cannot open\n";
+        return false;
+    }
+    const char* begin = file.data;
+    const char* end = file.data + file.size;
+
+    auto is_vertex = [](const char* p, const char* e) { return e - p > 1 && p[0] == 'v' && is_space(p[1]); };
+    auto is_face = [](const char* p, const char* e) { return e - p > 1 && p[0] == 'f' && is_space(p[1]); };
+
+    // First pass counts the vertices of every chunk, so each chunk knows the
+    // global number of its first vertex for relative (negative) indices
+    std::vector<size_t> chunk_vertices(std::max(1u, std::thread::hardware_concurrency()) + 1, 0);
+    int chunks = parallel_lines(begin, end, [&](int c, const char* p, const char* e) {
+        size_t count = 0;
+        for (; p < e; p = next_line(p, e)) {
+            p = skip_spaces(p, e);
+            if (is_vertex(p, e)) count++;
+        }
+        chunk_vertices[c] = count;
+    });
+
+    std::vector<size_t> first_vertex(chunks + 1, 0);
+    for (int c = 0; c < chunks; c++) first_vertex[c + 1] = first_vertex[c] + chunk_vertices[c];
+    size_t vertex_count = first_vertex[chunks];
+
+    positions.assign(3 * vertex_count, 0.0f);
+    std::vector<std::vector<uint32_t>> chunk_faces(chunks);
+    std::vector<int> chunk_ok(chunks, 1);
+
+    parallel_lines(begin, end, [&](int c, const char* p, const char* e) {
+        size_t v = first_vertex[c];
+        std::vector<long long> polygon;
+        for (; p < e; p = next_line(p, e)) {
+            p = skip_spaces(p, e);
+            if (is_vertex(p, e)) {
+                p++;
+                float* out = &positions[3 * v++];
+                if (!parse_float(p, e, out[0]) || !parse_float(p, e, out[1]) || !parse_float(p, e, out[2]))
+                    chunk_ok[c] = 0;
+            }
+            else if (is_face(p, e)) {
+                p++;
+                polygon.clear();
+                long long index;
+                while (parse_int(p, e, index)) {
+                    // OBJ indices are 1-based, negative ones count back from the last vertex
+                    // and 0 is no vertex at all
+                    if (index == 0) chunk_ok[c] = 0;
+                    polygon.push_back(index > 0 ? index - 1 : static_cast<long long>(v) + index);
+                    // Skip the /texture/normal parts of v/vt/vn
+                    while (p < e && !is_space(*p) && *p != '\n') p++;
+                }
+                if (!add_polygon(polygon, chunk_faces[c])) chunk_ok[c] = 0;
+            }
+        }
+    });
+
+    if (std::find(chunk_ok.begin(), chunk_ok.end(), 0) != chunk_ok.end()) {
+        std::cerr << path << ": malformed vertex or face record\n";
+        return false;
+    }
+
+    indices.clear();
+    concat_chunks(chunk_faces, indices);
+    return check_indices(indices, vertex_count, path);
+}
+
+// Loads the vertex positions and faces of an ascii or binary PLY file
+bool load_ply(const std::string& path, std::vector<float>& positions, std::vector<uint32_t>& indices) {
+    using namespace mesh_io;
+
+    mapped_file file(path);
+    if (!file.is_open()) {
+        std::cerr << path << ": cannot open\n";
+        return false;
+    }
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+
+    // Header
+    struct property {
+        std::string name;
+        ply_type type;
+        ply_type count_type;
+        bool is_list;
+    };
+    struct element {
+        std::string name;
+        size_t count;
+        std::vector<property> properties;
+    };
+
+    std::vector<element> elements;
+    std::string format;
+    bool header_done = false;
+    for (int line = 0; p < end && !header_done; line++) {
+        const char* e = next_line(p, end);
+        std::string text(p, e);
+        p = e;
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+
+        std::vector<std::string> words;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t stop = text.find(' ', start);
+            if (stop == std::string::npos) stop = text.size();
+            if (stop > start) words.push_back(text.substr(start, stop - start));
+            start = stop + 1;
+        }
+
+        if (line == 0 && (words.empty() || words[0] != "ply")) {
+            std::cerr << path << ": not a ply file\n";
+            return false;
+        }
+        if (words.empty()) continue;
+        if (words[0] == "format" && words.size() > 1) format = words[1];
+        else if (words[0] == "element") {
+            // The count must be all digits and fit, stoull would throw
+            char* stop = nullptr;
+            errno = 0;
+            unsigned long long count = 0;
+            if (words.size() > 2 && words[2][0] >= '0' && words[2][0] <= '9')
+                count = std::strtoull(words[2].c_str(), &stop, 10);
+            if (!stop || *stop != '\0' || errno == ERANGE) {
+                std::cerr << path << ": bad element count\n";
+                return false;
+            }
+            elements.push_back({words[1], static_cast<size_t>(count), {}});
+        }
+        else if (words[0] == "property" && !elements.empty()) {
+            if (words.size() > 4 && words[1] == "list")
+                elements.back().properties.push_back({words[4], parse_ply_type(words[3]), parse_ply_type(words[2]), true});
+            else if (words.size() > 2)
+                elements.back().properties.push_back({words[2], parse_ply_type(words[1]), ply_unknown, false});
+        }
+        else if (words[0] == "end_header") header_done = true;
+    }
+
+    if (!header_done || (format != "ascii" && format != "binary_little_endian" && format != "binary_big_endian")) {
+        std::cerr << path << ": unsupported ply header\n";
+        return false;
+    }
+
+    const bool swap_bytes = format == "binary_big_endian";
+
+    positions.clear();
+    indices.clear();
+    size_t vertex_count = 0;
+
+    for (const auto& el : elements) {
+        bool is_vertex = el.name == "vertex";
+        bool is_face = el.name == "face";
+
+        // Column of x, y, z and of the face index list
+        int column[3] = {-1, -1, -1};
+        int list_column = -1;
+        for (size_t k = 0; k < el.properties.size(); k++) {
+            const auto& prop = el.properties[k];
+            if (prop.name == "x") column[0] = static_cast<int>(k);
+            if (prop.name == "y") column[1] = static_cast<int>(k);
+            if (prop.name == "z") column[2] = static_cast<int>(k);
+            if (prop.is_list && (prop.name == "vertex_indices" || prop.name == "vertex_index"))
+                list_column = static_cast<int>(k);
+        }
+        if (is_vertex && (column[0] < 0 || column[1] < 0 || column[2] < 0)) {
+            std::cerr << path << ": vertex element without x, y and z\n";
+            return false;
+        }
+
+        // The count comes from the header, so bound it by the bytes left
+        // before allocating for it: an ascii record takes at least a
+        // character and a separator per property (the last line may lack its
+        // newline), a binary one its scalars and list counts
+        size_t min_record = 0;
+        for (const auto& prop : el.properties)
+            min_record += format == "ascii" ? 2 : ply_type_size(prop.is_list ? prop.count_type : prop.type);
+        size_t left = static_cast<size_t>(end - p) + (format == "ascii" ? 1 : 0);
+        if (min_record > 0 && el.count > left / min_record) {
+            std::cerr << path << ": truncated " << el.name << " block\n";
+            return false;
+        }
+        if (is_vertex) {
+            vertex_count = el.count;
+            positions.assign(3 * vertex_count, 0.0f);
+        }
+
+        if (format == "ascii") {
+            // One element per line, find where this element's lines end
+            const char* block = p;
+            size_t lines = 0;
+            for (; lines < el.count && p < end; lines++) p = next_line(p, end);
+            if (lines < el.count) {
+                std::cerr << path << ": truncated " << el.name << " block\n";
+                return false;
+            }
+            if (!is_vertex && !is_face) continue;
+
+            std::vector<size_t> chunk_lines(std::max(1u, std::thread::hardware_concurrency()) + 1, 0);
+            int chunks = parallel_lines(block, p, [&](int c, const char* q, const char* e) {
+                size_t count = 0;
+                for (; q < e; q = next_line(q, e)) count++;
+                chunk_lines[c] = count;
+            });
+            std::vector<size_t> first_line(chunks + 1, 0);
+            for (int c = 0; c < chunks; c++) first_line[c + 1] = first_line[c] + chunk_lines[c];
+
+            std::vector<std::vector<uint32_t>> chunk_faces(chunks);
+            std::vector<int> chunk_ok(chunks, 1);
+            parallel_lines(block, p, [&](int c, const char* q, const char* e) {
+                size_t row = first_line[c];
+                std::vector<long long> polygon;
+                for (; q < e; q = next_line(q, e), row++) {
+                    const char* s = q;
+                    for (size_t k = 0; k < el.properties.size(); k++) {
+                        const auto& prop = el.properties[k];
+                        long long count = 1;
+                        if (prop.is_list && !parse_int(s, e, count)) {
+                            chunk_ok[c] = 0;
+                            break;
+                        }
+                        if (is_face && static_cast<int>(k) == list_column) polygon.clear();
+                        for (long long n = 0; n < count; n++) {
+                            float value;
+                            if (!parse_float(s, e, value)) {
+                                chunk_ok[c] = 0;
+                                break;
+                            }
+                            if (is_vertex)
+                                for (int axis = 0; axis < 3; axis++)
+                                    if (column[axis] == static_cast<int>(k)) positions[3 * row + axis] = value;
+                            if (is_face && static_cast<int>(k) == list_column)
+                                polygon.push_back(static_cast<long long>(value));
+                        }
+                    }
+                    if (is_face && !add_polygon(polygon, chunk_faces[c])) chunk_ok[c] = 0;
+                }
+            });
+            if (std::find(chunk_ok.begin(), chunk_ok.end(), 0) != chunk_ok.end()) {
+                std::cerr << path << ": malformed " << el.name << " record\n";
+                return false;
+            }
+            concat_chunks(chunk_faces, indices);
+            continue;
+        }
+
+        // Binary elements, fixed-size records when there are no list properties
+        bool fixed = true;
+        size_t stride = 0;
+        for (const auto& prop : el.properties) {
+            if (prop.type == ply_unknown || (prop.is_list && prop.count_type == ply_unknown)) {
+                std::cerr << path << ": unknown type of property " << prop.name << "\n";
+                return false;
+            }
+            if (prop.is_list) fixed = false;
+            else stride += ply_type_size(prop.type);
+        }
+
+        if (fixed) {
+            if (static_cast<size_t>(end - p) < stride * el.count) {
+                std::cerr << path << ": truncated " << el.name << " block\n";
+                return false;
+            }
+            if (is_vertex) {
+                int offset[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    offset[axis] = 0;
+                    for (int k = 0; k < column[axis]; k++) offset[axis] += ply_type_size(el.properties[k].type);
+                }
+
+                // Records are independent, so decode them in parallel slices
+                const char* block = p;
+                int threads = std::max(1u, std::thread::hardware_concurrency());
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; t++) {
+                    workers.emplace_back([&, t] {
+                        size_t first = el.count * t / threads, last = el.count * (t + 1) / threads;
+                        for (size_t n = first; n < last; n++)
+                            for (int axis = 0; axis < 3; axis++)
+                                positions[3 * n + axis] = static_cast<float>(
+                                    read_ply_value(block + n * stride + offset[axis], el.properties[column[axis]].type, swap_bytes));
+                    });
+                }
+                for (auto& w : workers) w.join();
+            }
+            p += stride * el.count;
+            continue;
+        }
+
+        // Variable-size records (faces, or vertices with a list property)
+        // are walked front to back
+        std::vector<long long> polygon;
+        for (size_t n = 0; n < el.count; n++) {
+            for (size_t k = 0; k < el.properties.size(); k++) {
+                const auto& prop = el.properties[k];
+                size_t count = 1;
+                if (prop.is_list) {
+                    if (end - p < ply_type_size(prop.count_type)) {
+                        std::cerr << path << ": truncated " << el.name << " block\n";
+                        return false;
+                    }
+                    double value = read_ply_value(p, prop.count_type, swap_bytes);
+                    // Signed and float count types can hold values no size_t can
+                    if (!(value >= 0)) {
+                        std::cerr << path << ": negative list count in " << el.name << " block\n";
+                        return false;
+                    }
+                    if (value > static_cast<double>(end - p)) {
+                        std::cerr << path << ": truncated " << el.name << " block\n";
+                        return false;
+                    }
+                    count = static_cast<size_t>(value);
+                    p += ply_type_size(prop.count_type);
+                }
+                size_t size = ply_type_size(prop.type);
+                if (static_cast<size_t>(end - p) < count * size) {
+                    std::cerr << path << ": truncated " << el.name << " block\n";
+                    return false;
+                }
+                if (is_vertex && !prop.is_list)
+                    for (int axis = 0; axis < 3; axis++)
+                        if (column[axis] == static_cast<int>(k))
+                            positions[3 * n + axis] = static_cast<float>(read_ply_value(p, prop.type, swap_bytes));
+                if (is_face && static_cast<int>(k) == list_column) {
+                    polygon.clear();
+                    for (size_t i = 0; i < count; i++)
+                        polygon.push_back(static_cast<long long>(read_ply_value(p + i * size, prop.type, swap_bytes)));
+                    if (!add_polygon(polygon, indices)) {
+                        std::cerr << path << ": face index out of range\n";
+                        return false;
+                    }
+                }
+                p += count * size;
+            }
+        }
+    }
+
+    if (vertex_count == 0) {
+        std::cerr << path << ": no vertices\n";
+        return false;
+    }
+    return check_indices(indices, vertex_count, path);
+}
+
+// Picks the loader from the file extension
+bool load_mesh(const std::string& path, std::vector<float>& positions, std::vector<uint32_t>& indices) {
+    auto dot = path.find_last_of('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "obj") return load_obj(path, positions, indices);
+    if (ext == "ply") return load_ply(path, positions, indices);
+    std::cerr << path << ": unknown mesh format\n";
+    return false;
+}
+
+#endif
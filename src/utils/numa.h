@@ -0,0 +1,322 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+// NUMA-aware rendering
+// On a multi-socket machine memory is attached to one socket (node) and
+// reading it from another crosses the interconnect. Here every worker is
+// pinned to one core, the frame is cut into one band of rows per node
+// (of equal estimated cost for the node's share of the cores) and each
+// node's workers render the tiles of their own band, only taking tiles from
+// other bands once theirs run out. The sums of each band are written into a
+// framebuffer whose pages were first touched by a thread on that node, which
+// Linux's default policy places on that node's memory. The scene can also be
+// built once per node by a thread pinned there (replicate_per_node), so
+// rays read a local copy of the BVH and primitives.
+//
+// Huge pages: the framebuffer is advised to use transparent huge pages. For
+// scene memory run with GLIBC_TUNABLES=glibc.malloc.hugetlb=1 (glibc 2.35 or
+// later advises them for malloc'd memory) unless THP is already "always".
+//
+// The topology comes from /sys/devices/system/node, limited to the CPUs the
+// process may run on (taskset or a cgroup cpuset). GHD_NUMA overrides it with
+// one CPU list per node to simulate one, e.g. GHD_NUMA="0-3;4-7".
+
+#include "rtweekend.h"
+
+#include "render.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct numa_node
+{
+    int id;
+    std::vector<int> cpus;
+};
+
+// Parses a kernel CPU list such as "0-3,8,10-11"
+std::vector<int> parse_cpu_list(const std::string &text)
+{
+    std::vector<int> cpus;
+    std::istringstream in(text);
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        if (range.find_first_of("0123456789") == std::string::npos)
+            continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Nodes with at least one CPU this process may use, never empty
+std::vector<numa_node> numa_topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &allowed);
+
+    std::vector<numa_node> nodes;
+    const char *simulated = getenv("GHD_NUMA");
+    if (simulated && *simulated)
+    {
+        std::istringstream in(simulated);
+        std::string list;
+        for (int id = 0; std::getline(in, list, ';'); id++)
+            nodes.push_back({id, parse_cpu_list(list)});
+    }
+    else if (DIR *dir = opendir("/sys/devices/system/node"))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            int id;
+            if (sscanf(entry->d_name, "node%d", &id) != 1)
+                continue;
+            std::ifstream in(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+            std::string list;
+            std::getline(in, list);
+            nodes.push_back({id, parse_cpu_list(list)});
+        }
+        closedir(dir);
+        std::sort(nodes.begin(), nodes.end(), [](const numa_node &a, const numa_node &b)
+                  { return a.id < b.id; });
+    }
+
+    std::vector<numa_node> usable;
+    for (numa_node &node : nodes)
+    {
+        std::vector<int> cpus;
+        for (int cpu : node.cpus)
+            if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            usable.push_back({node.id, cpus});
+    }
+    if (usable.empty())
+    {
+        // No NUMA information, one node of every allowed CPU
+        numa_node all{0, {}};
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                all.cpus.push_back(cpu);
+        usable.push_back(all);
+    }
+    return usable;
+}
+
+std::string describe_topology(const std::vector<numa_node> &nodes)
+{
+    std::ostringstream out;
+    for (size_t n = 0; n < nodes.size(); n++)
+        out << (n ? ", " : "") << "node " << nodes[n].id << ": " << nodes[n].cpus.size() << " cpus";
+    return out.str();
+}
+
+// Pins the calling thread to one CPU, returns false if it can't be
+bool pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Transparent huge page mode, "always", "madvise" or "never" ("" if unknown)
+std::string transparent_huge_pages()
+{
+    std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string text;
+    std::getline(in, text);
+    size_t open = text.find('['), close = text.find(']');
+    return open == std::string::npos || close == std::string::npos ? "" : text.substr(open + 1, close - open - 1);
+}
+
+// Runs build() on a thread pinned to each node in turn and returns what it
+// built, so everything the build allocates is first touched on its node.
+// The builds run one after the other (scene builders draw from rand()).
+template <typename build_fn>
+auto replicate_per_node(const std::vector<numa_node> &nodes, build_fn &&build) -> std::vector<decltype(build())>
+{
+    std::vector<decltype(build())> replicas;
+    for (const numa_node &node : nodes)
+    {
+        std::thread builder([&]()
+                            {
+                                pin_thread(node.cpus.front());
+                                replicas.push_back(build());
+                            });
+        builder.join();
+    }
+    return replicas;
+}
+
+// One band of rows per node, of equal estimated cost per core
+std::vector<tile> numa_bands(const cost_map &estimate, const std::vector<numa_node> &nodes)
+{
+    const int width = estimate.image_width, height = estimate.image_height;
+    size_t total_cpus = 0;
+    for (const numa_node &node : nodes)
+        total_cpus += node.cpus.size();
+
+    double total = estimate.cost({0, 0, width, height});
+    std::vector<tile> bands;
+    int y = 0;
+    double share = 0;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        share += total * nodes[n].cpus.size() / total_cpus;
+        int y1 = y;
+        if (n + 1 == nodes.size())
+            y1 = height;
+        else
+            while (y1 < height && estimate.cost({0, 0, width, y1 + 1}) <= share)
+                y1++;
+        bands.push_back({0, y, width, std::max(y1, y)});
+        y = bands.back().y1;
+    }
+    return bands;
+}
+
+// Per-pixel sums of a render, rows top to bottom, each node's band of rows
+// first touched on that node
+class numa_frame
+{
+public:
+    numa_frame(int image_width, int image_height, const std::vector<numa_node> &frame_nodes,
+               const std::vector<tile> &node_bands, bool pin = true)
+        : width(image_width), height(image_height), nodes(frame_nodes), bands(node_bands)
+    {
+        bytes = sizeof(color) * static_cast<size_t>(width) * height;
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        pixels = static_cast<color *>(p);
+#ifdef MADV_HUGEPAGE
+        huge_pages = madvise(p, bytes, MADV_HUGEPAGE) == 0;
+#endif
+
+        // Nothing is backed by memory yet, every band is zeroed from its node
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            std::thread toucher([&]()
+                                {
+                                    if (pin)
+                                        pin_thread(nodes[n].cpus.front());
+                                    const tile &b = bands[n];
+                                    memset(static_cast<void *>(row(b.y0)), 0,
+                                           sizeof(color) * static_cast<size_t>(width) * (b.y1 - b.y0));
+                                });
+            toucher.join();
+        }
+    }
+    ~numa_frame() { munmap(pixels, bytes); }
+
+    numa_frame(const numa_frame &) = delete;
+    numa_frame &operator=(const numa_frame &) = delete;
+
+    color *row(int y) { return pixels + static_cast<size_t>(y) * width; }
+    const color *row(int y) const { return pixels + static_cast<size_t>(y) * width; }
+
+public:
+    int width, height;
+    std::vector<numa_node> nodes;
+    std::vector<tile> bands; // rows of each node
+    bool huge_pages = false;
+
+private:
+    color *pixels;
+    size_t bytes;
+};
+
+// The tiles of every node's band, planned for the node's cores
+std::vector<std::vector<tile>> numa_tiles(const cost_map &estimate, const numa_frame &frame)
+{
+    std::vector<std::vector<tile>> queues;
+    for (size_t n = 0; n < frame.nodes.size(); n++)
+    {
+        const tile &band = frame.bands[n];
+        int count = 16 * static_cast<int>(frame.nodes[n].cpus.size());
+        queues.push_back(band.height() > 0 ? plan_tiles(estimate, band, count) : std::vector<tile>());
+    }
+    return queues;
+}
+
+// Renders frame's bands with one worker per CPU of each node, pinned to it
+// if pin is set, and writes the sums into frame. worlds holds the scene once
+// per node (see replicate_per_node) or once for all. on_tile(tile, sums,
+// seconds) runs under a lock like in accumulate_tiles and returns false to
+// stop handing out tiles. Pixels are seeded as in accumulate_tile, so the
+// sums are the same as its for any topology.
+template <typename tile_fn>
+void accumulate_tiles_numa(const camera &cam, const std::vector<const hittable *> &worlds, numa_frame &frame,
+                           const cost_map &estimate, int samples_per_pixel, int max_depth, int64_t seed,
+                           tile_fn &&on_tile, bool pin = true, const render_caches *caches = nullptr)
+{
+    const std::vector<numa_node> &nodes = frame.nodes;
+    std::vector<std::vector<tile>> queues = numa_tiles(estimate, frame);
+    std::vector<std::atomic<size_t>> next(nodes.size());
+    for (auto &k : next)
+        k = 0;
+    std::atomic<bool> stop(false);
+    std::mutex done_lock;
+
+    auto worker = [&](size_t node, int cpu)
+    {
+        if (pin)
+            pin_thread(cpu);
+        const hittable &world = *worlds[worlds.size() == nodes.size() ? node : 0];
+        std::vector<color> sums;
+        // The node's own tiles, then whatever the other nodes have left
+        for (size_t step = 0; step < nodes.size() && !stop; step++)
+        {
+            size_t n = (node + step) % nodes.size();
+            for (size_t k = next[n]++; k < queues[n].size() && !stop; k = next[n]++)
+            {
+                const tile &t = queues[n][k];
+                auto start = std::chrono::steady_clock::now();
+                accumulate_tile(cam, world, t, frame.width, frame.height, samples_per_pixel, max_depth, sums,
+                                nullptr, seed, caches);
+                for (int y = t.y0; y < t.y1; y++)
+                    std::copy(sums.begin() + (y - t.y0) * t.width(), sums.begin() + (y - t.y0 + 1) * t.width(),
+                              frame.row(y) + t.x0);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> guard(done_lock);
+                if (!on_tile(t, sums, seconds))
+                    stop = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t n = 0; n < nodes.size(); n++)
+        for (int cpu : nodes[n].cpus)
+            workers.emplace_back(worker, n, cpu);
+    for (auto &w : workers)
+        w.join();
+}
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef PATH_GUIDE_H
+#define PATH_GUIDE_H
+
+// Online path guiding (after Mueller et al., Practical Path Guiding, 2017)
+// A spatial binary tree over the scene holds, in every leaf, quadtrees
+// over the sphere of directions that learn where incoming light comes
+// from, one per rough surface orientation. They learn the light times the
+// cosine to the surface normal, the product a diffuse bounce would ideally
+// be sampled from, since the light alone is a worse fit than the plain
+// cosine lobe under a sky that is bright everywhere. Diffuse bounces then
+// sample a direction from the quadtree or from the cosine lobe, one of the
+// two picked at random, and weight it with the combined pdf of both
+// (one-sample MIS, balance heuristic), so a bad guide costs variance but
+// never bias.
+//
+// Training works in passes: paths record what they find into each leaf's
+// building quadtree while sampling from the one the previous pass built.
+// end_pass() refines the recorded quadtrees (busy directions get finer
+// cells), makes them the sampling ones and splits leaves that saw many
+// samples. Directions are mapped to the unit square by the equal-area
+// cylindrical map, so quadtree densities convert to solid angle by 1 / 4 pi.
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Quadtree over [0,1]^2, every node stores the energy of its four quadrants
+class direction_tree {
+    public:
+        direction_tree() { nodes.push_back(node()); }
+
+        void record(double u, double v, float value) {
+            uint32_t n = 0;
+            while (true) {
+                int k = quadrant(u, v);
+                nodes[n].sum[k] += value;
+                if (!nodes[n].child[k]) return;
+                n = nodes[n].child[k];
+            }
+        }
+
+        float total() const { return nodes[0].sum[0] + nodes[0].sum[1] + nodes[0].sum[2] + nodes[0].sum[3]; }
+
+        // Samples a point by descending into quadrants in proportion to
+        // their energy, returns its density over the unit square
+        double sample(double& u, double& v) const {
+            double pdf = 1, x0 = 0, y0 = 0, size = 1;
+            uint32_t n = 0;
+            while (true) {
+                const node& nd = nodes[n];
+                float sum = nd.sum[0] + nd.sum[1] + nd.sum[2] + nd.sum[3];
+                if (sum <= 0) break;
+                double pick = random_double() * sum;
+                int k = 0;
+                while (k < 3 && pick >= nd.sum[k]) pick -= nd.sum[k++];
+                pdf *= 4 * nd.sum[k] / sum;
+                size *= 0.5;
+                x0 += (k & 1) * size;
+                y0 += (k >> 1) * size;
+                if (!nd.child[k]) break;
+                n = nd.child[k];
+            }
+            u = x0 + random_double() * size;
+            v = y0 + random_double() * size;
+            return pdf;
+        }
+
+        double pdf(double u, double v) const {
+            double p = 1;
+            uint32_t n = 0;
+            while (true) {
+                const node& nd = nodes[n];
+                float sum = nd.sum[0] + nd.sum[1] + nd.sum[2] + nd.sum[3];
+                int k = quadrant(u, v);
+                if (sum <= 0) return 0;
+                p *= 4 * nd.sum[k] / sum;
+                if (!nd.child[k]) return p;
+                n = nd.child[k];
+            }
+        }
+
+        // New tree with a quadrant subdivided while it holds more than
+        // threshold of the energy, down to max_depth levels. Energy of a
+        // quadrant that had no cells yet is spread evenly over its new ones.
+        direction_tree refined(double threshold, int max_depth) const {
+            direction_tree out;
+            out.nodes.clear();
+            float all = total();
+            out.refine_node(*this, 0, 0, all > 0 ? threshold * all : 0, max_depth, nullptr);
+            return out;
+        }
+
+        // Same cells, all energy zeroed
+        direction_tree cleared() const {
+            direction_tree out = *this;
+            for (auto& n : out.nodes) n.sum[0] = n.sum[1] = n.sum[2] = n.sum[3] = 0;
+            return out;
+        }
+
+        size_t memory_bytes() const { return nodes.capacity() * sizeof(node); }
+
+    private:
+        struct node {
+            float sum[4] = {0, 0, 0, 0};
+            uint32_t child[4] = {0, 0, 0, 0}; // 0 for a leaf quadrant
+        };
+
+        // Quadrant of (u, v) in the current node, rescaling u, v into it
+        static int quadrant(double& u, double& v) {
+            int k = 0;
+            u *= 2;
+            v *= 2;
+            if (u >= 1) { k |= 1; u -= 1; }
+            if (v >= 1) { k |= 2; v -= 1; }
+            return k;
+        }
+
+        // Copies node n of src (or, with n == 0 and sums given, a fresh
+        // node holding those sums) and refines its quadrants
+        uint32_t refine_node(const direction_tree& src, uint32_t n, int depth,
+                             double threshold, int max_depth, const float* sums) {
+            uint32_t index = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(node());
+            for (int k = 0; k < 4; k++) {
+                float sum = sums ? sums[k] : src.nodes[n].sum[k];
+                nodes[index].sum[k] = sum;
+                if (threshold <= 0 || sum <= threshold || depth + 1 >= max_depth) continue;
+
+                uint32_t child;
+                if (!sums && src.nodes[n].child[k]) {
+                    child = refine_node(src, src.nodes[n].child[k], depth + 1, threshold, max_depth, nullptr);
+                }
+                else {
+                    float quarter[4] = {sum / 4, sum / 4, sum / 4, sum / 4};
+                    child = refine_node(src, 0, depth + 1, threshold, max_depth, quarter);
+                }
+                nodes[index].child[k] = child;
+            }
+            return index;
+        }
+
+        std::vector<node> nodes;
+};
+
+class path_guide {
+    public:
+        // bounds should contain everything paths can hit
+        path_guide(const aabb& bounds) : root_box(bounds) {
+            spatial.push_back({{0, 0}, 0, 0});
+            leaves.emplace_back(new leaf());
+        }
+
+        // Bounds of the world, or a large box if it has unbounded objects
+        path_guide(const hittable& world)
+            : path_guide(world_bounds(world)) {}
+
+        // Learned distribution of incoming light for surfaces at p facing
+        // normal, null where nothing has been learned yet
+        const direction_tree* distribution(const point3& p, const vec3& normal) const {
+            const direction_tree& d = leaves[leaf_at(p)]->sampling[normal_bin(normal)];
+            return d.total() > 0 ? &d : nullptr;
+        }
+
+        // Unit direction drawn from a distribution and its solid angle density
+        static vec3 sample(const direction_tree& d, double& pdf) {
+            double u, v;
+            pdf = d.sample(u, v) / (4 * pi);
+            return square_to_direction(u, v);
+        }
+
+        // Solid angle density of drawing a unit direction from a distribution
+        static double pdf(const direction_tree& d, const vec3& direction) {
+            double u, v;
+            direction_to_square(direction, u, v);
+            return d.pdf(u, v) / (4 * pi);
+        }
+
+        // Adds the incoming radiance found along a unit direction sampled with
+        // density pdf at a surface facing normal, thread safe
+        void record(const point3& p, const vec3& normal, const vec3& direction, const color& incoming, double pdf) {
+            // Diffuse bounces want light times the cosine, so learn that product
+            double cosine = fmax(0.0, dot(normal, direction));
+            float value = static_cast<float>((incoming.x() + incoming.y() + incoming.z()) / 3 * cosine / pdf);
+            double u, v;
+            direction_to_square(direction, u, v);
+            leaf& l = *leaves[leaf_at(p)];
+            std::lock_guard<std::mutex> guard(l.lock);
+            l.points.push_back(p);
+            if (value > 0 && std::isfinite(value))
+                l.building[normal_bin(normal)].record(u, v, value);
+        }
+
+        // Call between passes, see the top of the file
+        void end_pass() {
+            split_leaves(0, root_box.min(), root_box.max(), 0);
+
+            for (auto& l : leaves) {
+                for (int n = 0; n < normal_bins; n++) {
+                    if (l->building[n].total() > 0)
+                        l->sampling[n] = l->building[n].refined(subdivide_fraction, max_direction_depth);
+                    l->building[n] = l->sampling[n].cleared();
+                }
+                l->points.clear();
+                l->points.shrink_to_fit();
+            }
+        }
+
+        size_t leaf_count() const { return leaves.size(); }
+
+        size_t memory_bytes() const {
+            size_t bytes = spatial.capacity() * sizeof(spatial_node);
+            for (const auto& l : leaves) {
+                bytes += sizeof(leaf);
+                for (int n = 0; n < normal_bins; n++)
+                    bytes += l->sampling[n].memory_bytes() + l->building[n].memory_bytes();
+            }
+            return bytes;
+        }
+
+    public:
+        // Training passes record, the render after them only samples
+        bool recording = false;
+
+        // Share of diffuse bounces sampled from the guide once it is trained
+        double guide_fraction = 0.3;
+
+    private:
+        static const size_t split_samples = 4000;
+        static const int max_spatial_depth = 60;
+        static constexpr double subdivide_fraction = 0.01;
+        static const int max_direction_depth = 12;
+
+        // Surfaces facing different ways see different halves of the sphere,
+        // so every region learns one distribution per dominant normal axis
+        // and sign
+        static const int normal_bins = 6;
+
+        static int normal_bin(const vec3& n) {
+            int axis = fabs(n.x()) > fabs(n.y()) ? (fabs(n.x()) > fabs(n.z()) ? 0 : 2)
+                                                 : (fabs(n.y()) > fabs(n.z()) ? 1 : 2);
+            return 2 * axis + (n[axis] < 0);
+        }
+
+        struct spatial_node {
+            uint32_t child[2]; // 0 for a leaf
+            int axis;          // split axis, halves are at the middle
+            uint32_t leaf;     // index into leaves for a leaf
+        };
+
+        struct leaf {
+            direction_tree sampling[normal_bins];
+            direction_tree building[normal_bins];
+            std::vector<point3> points; // where this pass recorded
+            std::mutex lock;
+        };
+
+        uint32_t leaf_at(const point3& p) const {
+            uint32_t n = 0;
+            point3 lo = root_box.min(), hi = root_box.max();
+            while (spatial[n].child[0]) {
+                int a = spatial[n].axis;
+                double mid = 0.5 * (lo[a] + hi[a]);
+                if (p[a] < mid) {
+                    hi[a] = mid;
+                    n = spatial[n].child[0];
+                }
+                else {
+                    lo[a] = mid;
+                    n = spatial[n].child[1];
+                }
+            }
+            return spatial[n].leaf;
+        }
+
+        // Halves leaves that recorded more than split_samples, cycling through
+        // the axes, until no leaf has. Both halves start from what the
+        // leaf learned.
+        void split_leaves(uint32_t n, point3 lo, point3 hi, int depth) {
+            int a = spatial[n].axis;
+            double mid = 0.5 * (lo[a] + hi[a]);
+            point3 left_hi = hi, right_lo = lo;
+            left_hi[a] = mid;
+            right_lo[a] = mid;
+
+            if (!spatial[n].child[0]) {
+                leaf& l = *leaves[spatial[n].leaf];
+                if (l.points.size() <= split_samples || depth >= max_spatial_depth) return;
+
+                uint32_t left = static_cast<uint32_t>(spatial.size());
+                uint32_t right_leaf = static_cast<uint32_t>(leaves.size());
+                spatial.push_back({{0, 0}, (a + 1) % 3, spatial[n].leaf});
+                spatial.push_back({{0, 0}, (a + 1) % 3, right_leaf});
+                spatial[n].child[0] = left;
+                spatial[n].child[1] = left + 1;
+
+                leaves.emplace_back(new leaf());
+                leaf& right = *leaves.back();
+                for (int b = 0; b < normal_bins; b++) {
+                    right.sampling[b] = l.sampling[b];
+                    right.building[b] = l.building[b];
+                }
+                auto split = std::partition(l.points.begin(), l.points.end(),
+                                            [&](const point3& p) { return p[a] < mid; });
+                right.points.assign(split, l.points.end());
+                l.points.erase(split, l.points.end());
+            }
+
+            split_leaves(spatial[n].child[0], lo, left_hi, depth + 1);
+            split_leaves(spatial[n].child[1], right_lo, hi, depth + 1);
+        }
+
+        static vec3 square_to_direction(double u, double v) {
+            double z = 2 * u - 1;
+            double r = sqrt(fmax(0.0, 1 - z * z));
+            double phi = 2 * pi * v;
+            return vec3(r * cos(phi), r * sin(phi), z);
+        }
+
+        static void direction_to_square(const vec3& d, double& u, double& v) {
+            u = fmin(fmax(0.5 * (d.z() + 1), 0.0), 0.999999);
+            double phi = atan2(d.y(), d.x());
+            if (phi < 0) phi += 2 * pi;
+            v = fmin(phi / (2 * pi), 0.999999);
+        }
+
+        static aabb world_bounds(const hittable& world) {
+            aabb box;
+            if (world.bounding_box(box)) return box;
+            return aabb(point3(-1e4, -1e4, -1e4), point3(1e4, 1e4, 1e4));
+        }
+
+        aabb root_box;
+        std::vector<spatial_node> spatial;
+        std::vector<std::unique_ptr<leaf>> leaves;
+};
+
+#endif
@@ -0,0 +1,578 @@
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+// PNG encoding of 8 bit rgb images, without zlib
+// Every row gets the filter (none, sub, up, average or Paeth) whose output
+// has the smallest sum of absolute values, as libpng picks them, and the
+// filtered rows are compressed with our own deflate: LZ77 over a 32 KB
+// window with hash chains of up to max_chain candidates, and a dynamic
+// Huffman block of length limited codes for every 64K symbols. Level 0
+// stores the rows uncompressed. Noisy renders mostly compress through the
+// Huffman codes of the filtered rows, whose values cluster around 0.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// CRC-32 of the PNG chunks (polynomial 0xEDB88320), continued from crc
+// Four bytes a step through four tables (slicing by 4).
+uint32_t png_crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    static const std::vector<uint32_t> table = []()
+    {
+        std::vector<uint32_t> t(4 * 256);
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        for (uint32_t n = 0; n < 256; n++)
+            for (int s = 1; s < 4; s++)
+                t[s * 256 + n] = t[(s - 1) * 256 + n] >> 8 ^ t[t[(s - 1) * 256 + n] & 0xff];
+        return t;
+    }();
+    crc = ~crc;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) | data[i + 1] << 8 | data[i + 2] << 16 |
+               static_cast<uint32_t>(data[i + 3]) << 24;
+        crc = table[3 * 256 + (crc & 0xff)] ^ table[2 * 256 + (crc >> 8 & 0xff)] ^ table[256 + (crc >> 16 & 0xff)] ^
+              table[crc >> 24];
+    }
+    for (; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Adler-32 of the zlib stream
+uint32_t adler32(const uint8_t *data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while (size > 0)
+    {
+        // The largest run whose sums can't overflow before the modulo
+        size_t run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+// Bits of a deflate stream, least significant first
+class deflate_bits
+{
+public:
+    std::vector<uint8_t> &out;
+
+    explicit deflate_bits(std::vector<uint8_t> &stream) : out(stream) {}
+
+    void put(uint32_t bits, int count)
+    {
+        buffer |= static_cast<uint64_t>(bits) << filled;
+        filled += count;
+        if (filled >= 32)
+        {
+            for (int k = 0; k < 4; k++)
+                out.push_back(static_cast<uint8_t>(buffer >> (8 * k)));
+            buffer >>= 32;
+            filled -= 32;
+        }
+    }
+
+    // Pads to a byte boundary
+    void align()
+    {
+        while (filled > 0)
+        {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            filled = std::max(0, filled - 8);
+        }
+        buffer = 0;
+    }
+
+private:
+    uint64_t buffer = 0;
+    int filled = 0;
+};
+
+// A canonical Huffman code, codes bit reversed for deflate_bits
+struct huffman_code
+{
+    std::vector<uint8_t> lengths;
+    std::vector<uint16_t> codes;
+
+    // Code lengths of at most max_length bits for the symbols' frequencies,
+    // 0 for unused symbols
+    void build(const std::vector<uint32_t> &freqs, int max_length)
+    {
+        lengths.assign(freqs.size(), 0);
+        codes.assign(freqs.size(), 0);
+        std::vector<int> used;
+        for (size_t s = 0; s < freqs.size(); s++)
+            if (freqs[s])
+                used.push_back(static_cast<int>(s));
+        if (used.size() == 1)
+            lengths[used[0]] = 1;
+        if (used.size() > 1)
+            limited_lengths(freqs, used, max_length);
+
+        // Canonical codes, shorter ones first and in symbol order within a length
+        std::vector<int> count(max_length + 2, 0);
+        for (uint8_t l : lengths)
+            count[l]++;
+        count[0] = 0;
+        std::vector<uint32_t> next(max_length + 2, 0);
+        for (int l = 1; l <= max_length; l++)
+            next[l] = (next[l - 1] + count[l - 1]) << 1;
+        for (size_t s = 0; s < lengths.size(); s++)
+        {
+            int l = lengths[s];
+            if (!l)
+                continue;
+            uint32_t code = next[l]++, reversed = 0;
+            for (int k = 0; k < l; k++)
+                reversed |= ((code >> k) & 1) << (l - 1 - k);
+            codes[s] = static_cast<uint16_t>(reversed);
+        }
+    }
+
+    void put(deflate_bits &bits, int symbol) const { bits.put(codes[symbol], lengths[symbol]); }
+
+private:
+    // Huffman lengths of the used symbols, then the longest codes cut to
+    // max_length by moving leaves up while keeping the code complete
+    void limited_lengths(const std::vector<uint32_t> &freqs, std::vector<int> &used, int max_length)
+    {
+        std::sort(used.begin(), used.end(), [&](int a, int b) { return freqs[a] < freqs[b] || (freqs[a] == freqs[b] && a < b); });
+
+        // Two queue Huffman: leaves in frequency order, inner nodes in the
+        // order they are made (which is also frequency order)
+        const size_t n = used.size();
+        std::vector<uint64_t> weight(2 * n - 1);
+        std::vector<size_t> parent(2 * n - 1, 0);
+        for (size_t k = 0; k < n; k++)
+            weight[k] = freqs[used[k]];
+        size_t leaf = 0, inner = n;
+        for (size_t node = n; node < 2 * n - 1; node++)
+        {
+            size_t pair[2];
+            for (size_t &pick : pair)
+                pick = leaf < n && (inner >= node || weight[leaf] <= weight[inner]) ? leaf++ : inner++;
+            weight[node] = weight[pair[0]] + weight[pair[1]];
+            parent[pair[0]] = parent[pair[1]] = node;
+        }
+        std::vector<int> depth(2 * n - 1, 0);
+        for (size_t k = 2 * n - 1; k-- > 0;)
+            if (k != 2 * n - 2)
+                depth[k] = depth[parent[k]] + 1;
+
+        std::vector<int> count(max_length + 1, 0);
+        for (size_t k = 0; k < n; k++)
+            count[std::min(depth[k], max_length)]++;
+        uint64_t kraft = 0;
+        for (int l = 1; l <= max_length; l++)
+            kraft += static_cast<uint64_t>(count[l]) << (max_length - l);
+        while (kraft > (uint64_t(1) << max_length))
+        {
+            count[max_length]--;
+            for (int l = max_length - 1; l > 0; l--)
+                if (count[l])
+                {
+                    count[l]--;
+                    count[l + 1] += 2;
+                    break;
+                }
+            kraft--;
+        }
+
+        // The rarest symbols get the longest codes
+        size_t k = 0;
+        for (int l = max_length; l > 0; l--)
+            for (int c = 0; c < count[l]; c++)
+                lengths[used[k++]] = static_cast<uint8_t>(l);
+    }
+};
+
+// Length and distance symbols of deflate (RFC 1951 3.2.5)
+struct deflate_tables
+{
+    uint16_t length_symbol[259]; // 257..285 for lengths 3..258
+    uint8_t distance_symbol[512];
+    static constexpr uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static constexpr uint16_t distance_base[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                                   33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                                   1025, 1537, 2049, 3073, 4097, 6145,  8193, 12289, 16385, 24577};
+    static constexpr uint8_t distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                   6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    deflate_tables()
+    {
+        for (int s = 0; s < 29; s++)
+            for (int l = length_base[s]; l < (s == 28 ? 259 : length_base[s + 1]); l++)
+                length_symbol[l] = static_cast<uint16_t>(257 + s);
+        // Distances up to 256 directly, longer ones by (distance - 1) / 128
+        for (int s = 0; s < 30; s++)
+            for (int d = distance_base[s]; d < (s == 29 ? 32769 : distance_base[s + 1]); d++)
+                distance_symbol[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7)] = static_cast<uint8_t>(s);
+    }
+
+    int distance_code(int distance) const
+    {
+        return distance_symbol[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+    }
+};
+
+const deflate_tables &deflate_lookup()
+{
+    static const deflate_tables tables;
+    return tables;
+}
+
+// A literal (distance 0) or a match of length 3..258 at distance 1..32768
+struct deflate_token
+{
+    uint16_t value;
+    uint16_t distance;
+};
+
+// One dynamic Huffman block of tokens
+void write_dynamic_block(deflate_bits &bits, const std::vector<deflate_token> &tokens, bool last)
+{
+    const deflate_tables &t = deflate_lookup();
+    std::vector<uint32_t> literal_freqs(286, 0), distance_freqs(30, 0);
+    for (const deflate_token &token : tokens)
+    {
+        if (!token.distance)
+        {
+            literal_freqs[token.value]++;
+            continue;
+        }
+        literal_freqs[t.length_symbol[token.value]]++;
+        distance_freqs[t.distance_code(token.distance)]++;
+    }
+    literal_freqs[256] = 1;
+    // Inflaters want at least two distance codes, even unused ones
+    for (int d = 0; d < 2; d++)
+        distance_freqs[d] = std::max(distance_freqs[d], 1u);
+
+    huffman_code literals, distances;
+    literals.build(literal_freqs, 15);
+    distances.build(distance_freqs, 15);
+    int literal_count = 286, distance_count = 30;
+    while (literal_count > 257 && !literals.lengths[literal_count - 1])
+        literal_count--;
+    while (distance_count > 1 && !distances.lengths[distance_count - 1])
+        distance_count--;
+
+    // Both code lengths run length coded with symbols 16 (repeat the last
+    // 3-6 times), 17 (3-10 zeros) and 18 (11-138 zeros)
+    std::vector<uint8_t> all(literals.lengths.begin(), literals.lengths.begin() + literal_count);
+    all.insert(all.end(), distances.lengths.begin(), distances.lengths.begin() + distance_count);
+    std::vector<std::pair<uint8_t, uint8_t>> runs; // symbol and its extra bits
+    std::vector<uint32_t> length_freqs(19, 0);
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == all[i])
+            run++;
+        if (all[i] == 0 && run >= 3)
+        {
+            run = std::min<size_t>(run, 138);
+            runs.push_back(run >= 11 ? std::make_pair(uint8_t(18), uint8_t(run - 11)) : std::make_pair(uint8_t(17), uint8_t(run - 3)));
+        }
+        else if (all[i] != 0 && run >= 4)
+        {
+            run = std::min<size_t>(run, 7);
+            runs.push_back({all[i], 0});
+            runs.push_back({16, static_cast<uint8_t>(run - 4)});
+        }
+        else
+        {
+            run = 1;
+            runs.push_back({all[i], 0});
+        }
+        i += run;
+    }
+    for (const auto &r : runs)
+        length_freqs[r.first]++;
+    huffman_code length_code;
+    length_code.build(length_freqs, 7);
+    static const int order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int order_count = 19;
+    while (order_count > 4 && !length_code.lengths[order[order_count - 1]])
+        order_count--;
+
+    bits.put(last ? 1 : 0, 1);
+    bits.put(2, 2);
+    bits.put(literal_count - 257, 5);
+    bits.put(distance_count - 1, 5);
+    bits.put(order_count - 4, 4);
+    for (int k = 0; k < order_count; k++)
+        bits.put(length_code.lengths[order[k]], 3);
+    for (const auto &r : runs)
+    {
+        length_code.put(bits, r.first);
+        if (r.first == 16)
+            bits.put(r.second, 2);
+        else if (r.first == 17)
+            bits.put(r.second, 3);
+        else if (r.first == 18)
+            bits.put(r.second, 7);
+    }
+
+    for (const deflate_token &token : tokens)
+    {
+        if (!token.distance)
+        {
+            literals.put(bits, token.value);
+            continue;
+        }
+        int s = t.length_symbol[token.value];
+        literals.put(bits, s);
+        bits.put(token.value - t.length_base[s - 257], t.length_extra[s - 257]);
+        int d = t.distance_code(token.distance);
+        distances.put(bits, d);
+        bits.put(token.distance - t.distance_base[d], t.distance_extra[d]);
+    }
+    literals.put(bits, 256);
+}
+
+// zlib stream of data: stored blocks at level 0, otherwise LZ77 with hash
+// chains of up to max_chain candidates and dynamic Huffman blocks
+void zlib_compress(const uint8_t *data, size_t size, int max_chain, std::vector<uint8_t> &out)
+{
+    out.reserve(out.size() + size + size / 64 + 64);
+    out.push_back(0x78); // deflate, 32 KB window
+    out.push_back(0x01); // no dictionary, check bits
+    deflate_bits bits(out);
+
+    if (max_chain <= 0)
+    {
+        size_t pos = 0;
+        do
+        {
+            size_t run = std::min<size_t>(size - pos, 65535);
+            bits.put(pos + run == size ? 1 : 0, 1);
+            bits.put(0, 2);
+            bits.align();
+            uint8_t header[4] = {static_cast<uint8_t>(run), static_cast<uint8_t>(run >> 8),
+                                 static_cast<uint8_t>(~run), static_cast<uint8_t>(~run >> 8)};
+            out.insert(out.end(), header, header + 4);
+            out.insert(out.end(), data + pos, data + pos + run);
+            pos += run;
+        } while (pos < size);
+    }
+    else
+    {
+        const size_t window = 32768, block_tokens = 1 << 16;
+        const int hash_bits = 15;
+        std::vector<int32_t> head(size_t(1) << hash_bits, -1), previous(window, -1);
+        auto hash = [&](size_t p)
+        {
+            uint32_t v = data[p] | (data[p + 1] << 8) | (data[p + 2] << 16);
+            return (v * 2654435761u) >> (32 - hash_bits);
+        };
+        auto insert = [&](size_t p)
+        {
+            uint32_t h = hash(p);
+            previous[p & (window - 1)] = head[h];
+            head[h] = static_cast<int32_t>(p);
+        };
+
+        std::vector<deflate_token> tokens;
+        tokens.reserve(block_tokens);
+        size_t pos = 0;
+        while (pos < size)
+        {
+            size_t best_length = 0, best_distance = 0;
+            if (pos + 3 <= size)
+            {
+                const size_t limit = std::min<size_t>(258, size - pos);
+                const uint8_t *a = data + pos;
+                int32_t candidate = head[hash(pos)];
+                for (int chain = 0; chain < max_chain && candidate >= 0 && pos - candidate <= window; chain++)
+                {
+                    // Most candidates of noisy rows are hash collisions, so
+                    // the first three bytes are checked at once
+                    const uint8_t *b = data + candidate;
+                    if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2] ||
+                        (best_length >= 3 && (best_length >= limit || a[best_length] != b[best_length])))
+                    {
+                        candidate = previous[candidate & (window - 1)];
+                        continue;
+                    }
+                    size_t length = 3;
+                    while (length + 8 <= limit)
+                    {
+                        uint64_t x, y;
+                        memcpy(&x, a + length, 8);
+                        memcpy(&y, b + length, 8);
+                        if (x != y)
+                        {
+                            length += __builtin_ctzll(x ^ y) / 8;
+                            break;
+                        }
+                        length += 8;
+                    }
+                    if (length + 8 > limit)
+                        while (length < limit && a[length] == b[length])
+                            length++;
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = pos - candidate;
+                        if (length == limit)
+                            break;
+                    }
+                    candidate = previous[candidate & (window - 1)];
+                }
+                insert(pos);
+            }
+
+            if (best_length >= 3)
+            {
+                tokens.push_back({static_cast<uint16_t>(best_length), static_cast<uint16_t>(best_distance)});
+                for (size_t p = pos + 1; p < pos + best_length && p + 3 <= size; p++)
+                    insert(p);
+                pos += best_length;
+            }
+            else
+            {
+                tokens.push_back({data[pos], 0});
+                pos++;
+            }
+            if (tokens.size() == block_tokens || pos == size)
+            {
+                write_dynamic_block(bits, tokens, pos == size);
+                tokens.clear();
+            }
+        }
+        if (size == 0)
+            write_dynamic_block(bits, tokens, true);
+        bits.align();
+    }
+
+    uint32_t check = adler32(data, size);
+    for (int k = 3; k >= 0; k--)
+        out.push_back(static_cast<uint8_t>(check >> (8 * k)));
+}
+
+// Candidates the LZ77 search tries per position at levels 1 to 9
+inline int png_max_chain(int level)
+{
+    return level <= 0 ? 0 : 1 << (std::min(level, 9) - 1);
+}
+
+// Filters a row with one of the five PNG filters into out and returns the
+// sum of the absolute values of the output. The first pixel has no left
+// neighbours; the rest go in blocks of 16 bytes, which -O2 vectorizes.
+template <int filter>
+uint32_t png_filter_row(const uint8_t *row, const uint8_t *above, size_t stride, uint8_t *out)
+{
+    auto filtered = [&](size_t i, int a, int c)
+    {
+        int b = above[i], predicted = 0;
+        if (filter == 1)
+            predicted = a;
+        else if (filter == 2)
+            predicted = b;
+        else if (filter == 3)
+            predicted = (a + b) >> 1;
+        else if (filter == 4)
+        {
+            // Paeth, as selects rather than branches
+            int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+            predicted = pb <= pc ? b : c;
+            predicted = pa <= std::min(pb, pc) ? a : predicted;
+        }
+        return static_cast<uint8_t>(row[i] - predicted);
+    };
+    auto magnitude = [](uint8_t v)
+    { return static_cast<uint32_t>(abs(static_cast<int8_t>(v))); };
+
+    uint32_t cost = 0;
+    size_t i = 0;
+    for (; i < std::min<size_t>(3, stride); i++)
+        cost += magnitude(out[i] = filtered(i, 0, 0));
+    for (; i + 16 <= stride; i += 16)
+    {
+        // Through a local block, which can't alias the rows
+        uint8_t block[16];
+        for (size_t k = 0; k < 16; k++)
+            cost += magnitude(block[k] = filtered(i + k, row[i + k - 3], above[i + k - 3]));
+        memcpy(out + i, block, 16);
+    }
+    for (; i < stride; i++)
+        cost += magnitude(out[i] = filtered(i, row[i - 3], above[i - 3]));
+    return cost;
+}
+
+// Encodes rgb (3 bytes per pixel, rows top to bottom) as a PNG file at
+// level 0 (stored) to 9
+void encode_png(int width, int height, const std::vector<unsigned char> &rgb, int level, std::vector<uint8_t> &out)
+{
+    // Filtered rows, each behind its filter byte
+    const size_t stride = 3 * static_cast<size_t>(width);
+    std::vector<uint8_t> filtered((stride + 1) * height);
+    std::vector<uint8_t> zero_row(stride, 0), candidates(5 * stride);
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = rgb.data() + y * stride;
+        const uint8_t *above = y > 0 ? row - stride : zero_row.data();
+        const uint32_t costs[5] = {png_filter_row<0>(row, above, stride, candidates.data()),
+                                   png_filter_row<1>(row, above, stride, candidates.data() + stride),
+                                   png_filter_row<2>(row, above, stride, candidates.data() + 2 * stride),
+                                   png_filter_row<3>(row, above, stride, candidates.data() + 3 * stride),
+                                   png_filter_row<4>(row, above, stride, candidates.data() + 4 * stride)};
+        int best = static_cast<int>(std::min_element(costs, costs + 5) - costs);
+        uint8_t *dst = filtered.data() + y * (stride + 1);
+        dst[0] = static_cast<uint8_t>(best);
+        memcpy(dst + 1, candidates.data() + best * stride, stride);
+    }
+
+    std::vector<uint8_t> compressed;
+    zlib_compress(filtered.data(), filtered.size(), png_max_chain(level), compressed);
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(signature, signature + 8);
+    auto chunk = [&](const char *type, const uint8_t *data, size_t size)
+    {
+        for (int k = 3; k >= 0; k--)
+            out.push_back(static_cast<uint8_t>(size >> (8 * k)));
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        uint32_t crc = png_crc32(out.data() + start, size + 4);
+        for (int k = 3; k >= 0; k--)
+            out.push_back(static_cast<uint8_t>(crc >> (8 * k)));
+    };
+    uint8_t header[13] = {static_cast<uint8_t>(width >> 24),  static_cast<uint8_t>(width >> 16),
+                          static_cast<uint8_t>(width >> 8),   static_cast<uint8_t>(width),
+                          static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16),
+                          static_cast<uint8_t>(height >> 8),  static_cast<uint8_t>(height),
+                          8,  // bits per channel
+                          2,  // rgb
+                          0, 0, 0};
+    chunk("IHDR", header, sizeof(header));
+    chunk("IDAT", compressed.data(), compressed.size());
+    chunk("IEND", nullptr, 0);
+}
+
+#endif
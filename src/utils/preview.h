@@ -0,0 +1,139 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+// Coarse-to-fine preview
+// The frame is rendered in levels of 1/16, 1/8, 1/4 and full resolution.
+// Level 1/s renders the pixels whose x and y are multiples of s and that no
+// coarser level rendered (every pixel of an 1/16 grid is also on the 1/8
+// grid), and a preview of the level shows every pixel with the mean of the
+// nearest one rendered. Nothing is thrown away: the samples a pixel got on a
+// coarse level are its first samples, and the full level only renders the
+// rest of them. Coarse pixels get their first block of sample_block samples
+// (all of them at lower sample counts), and blocks are added in order with
+// every block starting the pixel's generator at its first sample (see
+// render_pixel), so the final frame is the same bits as accumulate_tiles
+// gives with the same seed, for the same total work. The 1/16 level is
+// 1/256 of the pixels, so its preview comes after about that share of the
+// render time (more at high sample counts, where it has a full block).
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "render.h"
+#include "simd_dispatch.h"
+#include "../primitives/camera.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+const int preview_scales[] = {16, 8, 4, 1};
+
+class preview_frame
+{
+public:
+    int width, height;
+    int samples_per_pixel, max_depth;
+    std::vector<color> sums; // rows top to bottom
+    std::vector<int> spp;
+
+    preview_frame(int image_width, int image_height, int samples, int depth)
+        : width(image_width), height(image_height), samples_per_pixel(samples), max_depth(depth),
+          sums(static_cast<size_t>(image_width) * image_height, color(0, 0, 0)), spp(sums.size(), 0) {}
+
+    // Renders the levels in turn, calling on_level(scale, seconds) after
+    // each with the seconds since the render started. on_level returns
+    // false to stop before the next level.
+    template <typename level_fn>
+    void render(const camera &cam, const hittable &world, int threads, int64_t seed, level_fn &&on_level,
+                const render_caches *caches = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int scale : preview_scales)
+        {
+            // The pixels of this grid that still need samples, in squares of
+            // run pixels so neighbouring rays go through the same part of the
+            // scene one after the other (as they do in a tile)
+            std::vector<size_t> pixels;
+            const int side = block_side * scale;
+            for (int by = 0; by < height; by += side)
+                for (int bx = 0; bx < width; bx += side)
+                    for (int y = by; y < std::min(by + side, height); y += scale)
+                        for (int x = bx; x < std::min(bx + side, width); x += scale)
+                        {
+                            size_t p = static_cast<size_t>(y) * width + x;
+                            if (spp[p] < samples_per_pixel && (scale == 1 || spp[p] == 0))
+                                pixels.push_back(p);
+                        }
+            int count = scale == 1 ? samples_per_pixel : std::min(samples_per_pixel, sample_block);
+            render_pixels(cam, world, pixels, count, threads, seed, caches);
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!on_level(scale, seconds))
+                return;
+        }
+    }
+
+    // Tonemaps the preview of a level into rgb (3 bytes per pixel): every
+    // pixel shows the mean of the nearest pixel on the level's grid
+    void resolve(int scale, std::vector<unsigned char> &rgb) const
+    {
+        std::vector<color> means(sums.size());
+        const int last_x = (width - 1) / scale * scale, last_y = (height - 1) / scale * scale;
+        for (int y = 0; y < height; y++)
+        {
+            int ry = std::min((y + scale / 2) / scale * scale, last_y);
+            for (int x = 0; x < width; x++)
+            {
+                int rx = std::min((x + scale / 2) / scale * scale, last_x);
+                size_t r = static_cast<size_t>(ry) * width + rx;
+                means[static_cast<size_t>(y) * width + x] = spp[r] ? sums[r] / spp[r] : color(0, 0, 0);
+            }
+        }
+        rgb.resize(3 * means.size());
+        simd().tonemap(means.data(), means.size(), 1.0, rgb.data());
+    }
+
+private:
+    static const int block_side = 8;
+
+    // Brings every pixel in the list up to `total` samples, threads taking
+    // runs of pixels in list order
+    void render_pixels(const camera &cam, const hittable &world, const std::vector<size_t> &pixels, int total,
+                       int threads, int64_t seed, const render_caches *caches)
+    {
+        const size_t run = block_side * block_side;
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            rng *previous_rng = thread_rng;
+            for (size_t begin = next.fetch_add(run); begin < pixels.size(); begin = next.fetch_add(run))
+            {
+                for (size_t k = begin; k < std::min(begin + run, pixels.size()); k++)
+                {
+                    size_t p = pixels[k];
+                    int x = static_cast<int>(p % width), y = static_cast<int>(p / width);
+                    rng pixel_rng(static_cast<uint64_t>(seed), p);
+                    pixel_rng.advance(2 * static_cast<uint64_t>(spp[p]));
+                    if (seed >= 0)
+                        thread_rng = &pixel_rng;
+                    for (int first = spp[p]; first < total; first += sample_block)
+                        sums[p] += render_samples(cam, world, x, height - 1 - y, width, height,
+                                                  std::min(sample_block, total - first), max_depth, nullptr, caches);
+                    spp[p] = total;
+                }
+            }
+            thread_rng = previous_rng;
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads; t++)
+            workers.emplace_back(worker);
+        worker();
+        for (auto &w : workers)
+            w.join();
+    }
+};
+
+#endif
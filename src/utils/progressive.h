@@ -0,0 +1,260 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+// Time-budgeted progressive rendering
+// The frame is rendered in passes over cost-planned tiles until a wall clock
+// deadline, every pass adding samples to running per-pixel sums, so the
+// frame after any pass is a complete image. The throughput measured so far
+// (seconds per sample and unit of estimated tile cost) predicts how long
+// the next pass takes: passes double in size while there is time and the
+// last one is sized to what is left, and a pass that doesn't fit is not
+// started. A pass that runs late anyway stops handing out tiles once the
+// largest one would no longer finish in time and, to keep sample counts
+// uniform, its finished tiles are dropped (adaptive mode keeps them).
+//
+// Noise comes from the spread between passes. A pixel with P passes holding
+// N samples in total with sum S has E[sum(pass_sum^2 / pass_spp) - S^2 / N]
+// = (P - 1) * variance per sample, and the error of its mean is
+// sqrt(variance / N). The reported noise carries that error through the
+// gamma 2 tonemap, in display units (1 = full 8-bit range), so it compares
+// with an RMSE against a converged reference.
+//
+// Adaptive mode spends every pass after the second on the half of the tiles
+// with the most estimated noise instead of the whole frame.
+//
+// A frame with a live framebuffer publishes every pass it keeps there.
+
+#include "rtweekend.h"
+
+#include "live_framebuffer.h"
+#include "render.h"
+#include "simd_dispatch.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// What a time-budgeted render achieved
+struct progressive_report
+{
+    int passes = 0;
+    double seconds = 0; // wall clock from the start handed to render_progressive
+    int min_spp = 0, max_spp = 0;
+    double mean_spp = 0;
+    double noise = -1;     // estimated RMS error in display units, -1 before two passes
+    size_t dropped_tiles = 0; // tiles of an overrunning pass that were thrown away
+};
+
+// Running per-pixel sums of a progressive render, rows top to bottom
+struct progressive_frame
+{
+    int width, height;
+    std::vector<color> sums;
+    std::vector<color> squares; // sum of pass_sum^2 / pass_spp per channel
+    std::vector<int> spp;
+    std::vector<int> passes;
+    live_framebuffer *live = nullptr; // also gets every tile added, if set
+
+    progressive_frame(int image_width, int image_height)
+        : width(image_width), height(image_height),
+          sums(static_cast<size_t>(image_width) * image_height, color(0, 0, 0)),
+          squares(sums.size(), color(0, 0, 0)), spp(sums.size(), 0), passes(sums.size(), 0) {}
+
+    // Adds one pass of samples_per_pixel samples over a tile
+    void add(const tile &t, const std::vector<color> &pass_sums, int samples_per_pixel)
+    {
+        size_t k = 0;
+        for (int y = t.y0; y < t.y1; y++)
+        {
+            for (int x = t.x0; x < t.x1; x++, k++)
+            {
+                size_t p = static_cast<size_t>(y) * width + x;
+                const color &s = pass_sums[k];
+                sums[p] += s;
+                squares[p] += s * s / samples_per_pixel;
+                spp[p] += samples_per_pixel;
+                passes[p]++;
+            }
+        }
+        if (live)
+            live->add(t, pass_sums, samples_per_pixel);
+    }
+
+    // Estimated squared error of the pixel's tonemapped value summed over
+    // its channels, -1 with fewer than two passes
+    double squared_error(size_t p) const
+    {
+        if (passes[p] < 2)
+            return -1;
+        double error = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            double mean = sums[p][c] / spp[p];
+            double variance = std::max(0.0, (squares[p][c] - sums[p][c] * mean) / (passes[p] - 1));
+            double standard_error = sqrt(variance / spp[p]);
+            // d sqrt(x) = dx / (2 sqrt(x)), and never more than sqrt(dx) near black
+            double display = std::min(standard_error / (2 * sqrt(std::max(mean, 1e-12))), sqrt(standard_error));
+            error += display * display;
+        }
+        return error;
+    }
+
+    // RMS estimated error over the pixels of a region, -1 if any has fewer than two passes
+    double noise(const tile &t) const
+    {
+        double sum = 0;
+        for (int y = t.y0; y < t.y1; y++)
+        {
+            for (int x = t.x0; x < t.x1; x++)
+            {
+                double e = squared_error(static_cast<size_t>(y) * width + x);
+                if (e < 0)
+                    return -1;
+                sum += e;
+            }
+        }
+        return sqrt(sum / (3.0 * t.width() * t.height()));
+    }
+
+    // Fewest samples of any pixel in a region
+    int min_spp(const tile &t) const
+    {
+        int fewest = std::numeric_limits<int>::max();
+        for (int y = t.y0; y < t.y1; y++)
+            for (int x = t.x0; x < t.x1; x++)
+                fewest = std::min(fewest, spp[static_cast<size_t>(y) * width + x]);
+        return fewest;
+    }
+
+    // Tonemaps the mean of every pixel into rgb (3 bytes per pixel)
+    void resolve(std::vector<unsigned char> &rgb) const
+    {
+        std::vector<color> means(sums.size());
+        for (size_t p = 0; p < sums.size(); p++)
+            means[p] = spp[p] ? sums[p] / spp[p] : color(0, 0, 0);
+        rgb.resize(3 * means.size());
+        simd().tonemap(means.data(), means.size(), 1.0, rgb.data());
+    }
+};
+
+// Renders passes into frame until budget_seconds after start (at least one
+// pass is always rendered) and returns what was achieved. on_pass(report)
+// runs after every pass. Pass k is seeded from seed + 1000 + k, so the
+// result only depends on the sample counts the clock allowed.
+template <typename pass_fn>
+progressive_report render_progressive(const camera &cam, const hittable &world, progressive_frame &frame,
+                                      int max_depth, int threads, int64_t seed, double budget_seconds,
+                                      bool adaptive, pass_fn &&on_pass,
+                                      const render_caches *caches = nullptr,
+                                      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now())
+{
+    using clock = std::chrono::steady_clock;
+    auto elapsed = [&]()
+    { return std::chrono::duration<double>(clock::now() - start).count(); };
+
+    const int width = frame.width, height = frame.height;
+    cost_map estimate = estimate_cost(cam, world, width, height, max_depth);
+    std::vector<tile> tiles = plan_tiles(estimate, {0, 0, width, height}, 16 * threads);
+    std::vector<double> costs;
+    for (const auto &t : tiles)
+        costs.push_back(std::max(estimate.cost(t), 1.0));
+
+    // Wall clock seconds per sample and unit of cost per thread, first
+    // guessed from the pre-pass (one sample over 1 / downscale^2 of the pixels)
+    double rate = 1e-9 * estimate.downscale * estimate.downscale;
+    double measured_seconds = 0, measured_work = 0;
+    double overhead = 0; // bookkeeping after a pass, the longest seen
+
+    progressive_report report;
+    std::vector<size_t> selected(tiles.size());
+    for (size_t k = 0; k < tiles.size(); k++)
+        selected[k] = k;
+
+    while (true)
+    {
+        if (adaptive && report.passes >= 2)
+        {
+            // Noisiest half of the tiles, kept in cost order
+            std::vector<std::pair<double, size_t>> noisy;
+            for (size_t k = 0; k < tiles.size(); k++)
+                noisy.push_back({frame.noise(tiles[k]), k});
+            std::nth_element(noisy.begin(), noisy.begin() + noisy.size() / 2, noisy.end(),
+                             [](const std::pair<double, size_t> &a, const std::pair<double, size_t> &b)
+                             { return a.first > b.first; });
+            selected.clear();
+            for (size_t k = 0; k < std::max<size_t>(1, noisy.size() / 2); k++)
+                selected.push_back(noisy[k].second);
+            std::sort(selected.begin(), selected.end());
+        }
+
+        // Wall clock units of one sample over the selected tiles: the work
+        // spread over the threads, or the slowest tile if that is longer
+        double work = 0, largest = 0;
+        int base_spp = std::numeric_limits<int>::max();
+        for (size_t k : selected)
+        {
+            work += costs[k];
+            largest = std::max(largest, costs[k]);
+            base_spp = std::min(base_spp, frame.min_spp(tiles[k]));
+        }
+        double units = std::max(work / threads, largest);
+
+        // Double the tiles' samples, or less to fit the time left with a margin
+        double left = 0.9 * (budget_seconds - elapsed() - overhead);
+        int samples = std::max(1, std::min(std::max(1, base_spp), static_cast<int>(left / (rate * units))));
+        if (report.passes > 0 && samples * rate * units > left)
+            break;
+
+        std::vector<tile> pass_tiles;
+        for (size_t k : selected)
+            pass_tiles.push_back(tiles[k]);
+        std::vector<std::pair<tile, std::vector<color>>> done;
+        auto pass_start = clock::now();
+        accumulate_tiles(cam, world, pass_tiles, width, height, samples, max_depth, threads, seed + 1000 + report.passes,
+                         [&](const tile &t, const std::vector<color> &sums, double)
+                         {
+                             done.push_back({t, sums});
+                             // Only hand out another tile that should still finish in time
+                             return report.passes == 0 ||
+                                    elapsed() + overhead + samples * rate * largest < budget_seconds;
+                         },
+                         nullptr, caches);
+        auto pass_end = clock::now();
+
+        measured_seconds += std::chrono::duration<double>(pass_end - pass_start).count();
+        measured_work += samples * units;
+        rate = measured_seconds / measured_work;
+
+        if (done.size() < selected.size() && !adaptive && report.passes > 0)
+        {
+            report.dropped_tiles = done.size();
+            break;
+        }
+        for (const auto &d : done)
+            frame.add(d.first, d.second, samples);
+        report.passes++;
+
+        report.seconds = elapsed();
+        report.min_spp = *std::min_element(frame.spp.begin(), frame.spp.end());
+        report.max_spp = *std::max_element(frame.spp.begin(), frame.spp.end());
+        double sum = 0;
+        for (int s : frame.spp)
+            sum += s;
+        report.mean_spp = sum / frame.spp.size();
+        report.noise = frame.noise({0, 0, width, height});
+        on_pass(report);
+        overhead = std::max(overhead, std::chrono::duration<double>(clock::now() - pass_end).count());
+
+        if (done.size() < selected.size())
+            break;
+    }
+
+    report.seconds = elapsed();
+    return report;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+// Radiance cache for diffuse bounces
+// A hash grid over world space stores the mean incoming radiance (cosine
+// weighted, so irradiance / pi) of diffuse surfaces, one entry per grid
+// cell and normal direction. Training passes trace full paths and record
+// what they find at every diffuse vertex. Later passes and the final render
+// end a path at its second diffuse vertex with albedo times the cell's
+// mean instead of tracing on. The cell size trades bias (light is averaged
+// over a cell) against the samples every cell gets.
+//
+// Records of a pass go to a pending table under striped locks and become
+// visible to lookups at end_pass(), so lookups need no locking and a pass
+// sees the same cache whatever order its tiles run in.
+
+#include "rtweekend.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class radiance_cache {
+    public:
+        // cell_size is the edge of a grid cell in world units, the table has
+        // 2^log2_slots entries. Cells are used once they have min_samples.
+        radiance_cache(double cell_size, int log2_slots = 18, int min_samples = 4)
+            : cell(cell_size), min_count(min_samples),
+              resolved(static_cast<size_t>(1) << log2_slots), pending(resolved.size()),
+              locks(new std::mutex[lock_count]) {}
+
+        // Mean incoming radiance of the cell around p facing normal
+        bool lookup(const point3& p, const vec3& normal, color& incoming) const {
+            uint64_t key = cell_key(p, normal);
+            const entry* bucket = &resolved[bucket_of(key)];
+            for (int k = 0; k < bucket_size; k++) {
+                if (bucket[k].key == key) {
+                    if (bucket[k].count < static_cast<uint32_t>(min_count)) return false;
+                    float scale = 1.0f / bucket[k].count;
+                    incoming = color(bucket[k].sum[0] * scale, bucket[k].sum[1] * scale, bucket[k].sum[2] * scale);
+                    return true;
+                }
+                if (bucket[k].key == 0) return false;
+            }
+            return false;
+        }
+
+        // Adds one incoming radiance sample, thread safe
+        void record(const point3& p, const vec3& normal, const color& incoming) {
+            uint64_t key = cell_key(p, normal);
+            size_t b = bucket_of(key);
+            std::lock_guard<std::mutex> guard(locks[(b / bucket_size) % lock_count]);
+            entry* e = find_slot(&pending[b], key);
+            if (!e) return;
+            for (int c = 0; c < 3; c++) e->sum[c] += static_cast<float>(incoming[c]);
+            e->count++;
+        }
+
+        // Makes this pass's records visible to lookups, call between passes
+        void end_pass() {
+            for (size_t b = 0; b < pending.size(); b += bucket_size) {
+                for (int k = 0; k < bucket_size; k++) {
+                    entry& p = pending[b + k];
+                    if (!p.key) break;
+                    entry* e = find_slot(&resolved[b], p.key);
+                    if (!e) {
+                        // Full bucket, the cell with the fewest samples makes room
+                        e = &resolved[b];
+                        for (int j = 1; j < bucket_size; j++)
+                            if (resolved[b + j].count < e->count) e = &resolved[b + j];
+                        *e = entry();
+                        e->key = p.key;
+                    }
+                    for (int c = 0; c < 3; c++) e->sum[c] += p.sum[c];
+                    e->count += p.count;
+                    p = entry();
+                }
+            }
+        }
+
+        // Cells with at least one sample
+        size_t cells() const {
+            size_t n = 0;
+            for (const auto& e : resolved) n += e.key != 0;
+            return n;
+        }
+
+        size_t memory_bytes() const {
+            return (resolved.size() + pending.size()) * sizeof(entry) + lock_count * sizeof(std::mutex);
+        }
+
+    public:
+        // Training passes record, and only continue a path past a cached
+        // cell with train_probability so cells keep improving
+        bool recording = false;
+        double train_probability = 0.25;
+
+    private:
+        struct entry {
+            uint64_t key = 0; // 0 marks an empty slot
+            float sum[3] = {0, 0, 0};
+            uint32_t count = 0;
+        };
+
+        static const int bucket_size = 8;
+        static const int lock_count = 256;
+
+        // 20 bits per cell coordinate, 3 bits for the dominant normal axis
+        // and sign and the top bit set so no key is 0
+        uint64_t cell_key(const point3& p, const vec3& n) const {
+            uint64_t key = 1ULL << 63;
+            for (int a = 0; a < 3; a++) {
+                int64_t i = static_cast<int64_t>(std::floor(p[a] / cell));
+                key |= (static_cast<uint64_t>(i) & 0xfffff) << (20 * a);
+            }
+            int axis = fabs(n.x()) > fabs(n.y()) ? (fabs(n.x()) > fabs(n.z()) ? 0 : 2)
+                                                 : (fabs(n.y()) > fabs(n.z()) ? 1 : 2);
+            key |= static_cast<uint64_t>(2 * axis + (n[axis] < 0)) << 60;
+            return key;
+        }
+
+        // First slot of the key's bucket
+        size_t bucket_of(uint64_t key) const {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            return (key & (resolved.size() - 1)) & ~static_cast<size_t>(bucket_size - 1);
+        }
+
+        // The key's slot in the bucket, claiming an empty one, null if full
+        static entry* find_slot(entry* bucket, uint64_t key) {
+            for (int k = 0; k < bucket_size; k++) {
+                if (bucket[k].key == key) return &bucket[k];
+                if (bucket[k].key == 0) {
+                    bucket[k].key = key;
+                    return &bucket[k];
+                }
+            }
+            return nullptr;
+        }
+
+        double cell;
+        int min_count;
+        std::vector<entry> resolved;
+        std::vector<entry> pending;
+        std::unique_ptr<std::mutex[]> locks;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+// Rendering helpers shared by the renderer and the render daemon
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "cost_aov.h"
+#include "hittable.h"
+#include "material.h"
+#include "path_guide.h"
+#include "radiance_cache.h"
+#include "simd_dispatch.h"
+#include "../primitives/camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Learned state that changes how paths are traced, both optional
+struct render_caches
+{
+    radiance_cache *radiance = nullptr;
+    path_guide *guide = nullptr;
+};
+
+// Samples a diffuse bounce from the path guide or the cosine lobe and
+// returns its weight cos / (pi * pdf), 0 if it points below the surface.
+// Where the guide has not learned anything this is plain cosine sampling.
+double guided_bounce(const path_guide &guide, const hit_record &rec, vec3 &direction, double &pdf)
+{
+    const direction_tree *learned = guide.distribution(rec.p, rec.normal);
+    const double a = learned ? guide.guide_fraction : 0.0;
+    double guide_pdf = 0;
+    if (a > 0 && random_double() < a)
+    {
+        direction = path_guide::sample(*learned, guide_pdf);
+    }
+    else
+    {
+        direction = rec.normal + random_unit_vector();
+        if (direction.near_zero())
+            direction = rec.normal;
+        direction = unit_vector(direction);
+        if (a > 0)
+            guide_pdf = path_guide::pdf(*learned, direction);
+    }
+
+    double cosine = dot(direction, rec.normal);
+    if (cosine <= 0)
+        return 0;
+    pdf = a * guide_pdf + (1 - a) * cosine / pi;
+    return cosine / pi / pdf;
+}
+
+// Width of a ray's footprint where it leaves its origin and the angle in
+// radians it widens by per unit of distance, for texture filtering
+struct ray_cone
+{
+    double width = 0;
+    double spread = 0;
+};
+
+// Background of every ray that leaves the scene, a vertical gradient
+struct sky_gradient
+{
+    color bottom = color(1.0, 1.0, 1.0);
+    color top = color(0.5, 0.7, 1.0);
+
+    color value(const vec3 &direction) const
+    {
+        vec3 unit_direction = unit_vector(direction);
+        auto t = 0.5 * (unit_direction.y() + 1.0);
+        return (1.0 - t) * bottom + t * top;
+    }
+};
+
+// The sky of every render, changed between renders (see incremental.h)
+inline sky_gradient scene_sky;
+
+// Which materials a pixel's paths met, one bit per material picked by its
+// address (so unrelated materials can share a bit), bit 0 for the sky
+const uint64_t sky_bit = 1;
+
+inline uint64_t material_bit(const material *m)
+{
+    uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(m)) * 0x9E3779B97F4A7C15ULL;
+    return uint64_t(1) << (1 + (h >> 32) % 63);
+}
+
+color shade_hit(const ray &r, hit_record &rec, const hittable &world, int depth, int *ray_count,
+                const render_caches *caches, int bounce, ray_cone cone, uint64_t *touched);
+
+// Returns a color for a given ray r
+// ray_count, if given, is incremented for every ray traced against the world.
+// With a radiance cache, paths end at their second diffuse vertex (bounce > 0)
+// with a cached value if there is one. With a path guide, diffuse bounces
+// are sampled from it. Training passes of either record the incoming light
+// of every diffuse vertex they trace past. The ray's cone sets the footprint
+// textures are filtered over; materials widen it for the next ray. touched,
+// if given, gets the bits of every material hit and of the sky if reached.
+color ray_color(const ray &r, const hittable &world, int depth, int *ray_count = nullptr,
+                const render_caches *caches = nullptr, int bounce = 0, ray_cone cone = ray_cone(),
+                uint64_t *touched = nullptr)
+{
+    hit_record rec;
+
+    // If we've exceeded the ray bounce limit, no more light is gathered.
+    if (depth <= 0)
+        return color(0, 0, 0);
+
+    if (ray_count)
+        ++*ray_count;
+    if (world.hit(r, 0.001, infinity, rec))
+        return shade_hit(r, rec, world, depth, ray_count, caches, bounce, cone, touched);
+    if (touched)
+        *touched |= sky_bit;
+    return scene_sky.value(r.direction());
+}
+
+// The light ray r brings back from the hit rec, see ray_color
+color shade_hit(const ray &r, hit_record &rec, const hittable &world, int depth, int *ray_count,
+                const render_caches *caches, int bounce, ray_cone cone, uint64_t *touched)
+{
+    rec.footprint = cone.width + rec.t * r.direction().length() * cone.spread;
+    if (touched)
+        *touched |= material_bit(rec.mat_ptr);
+    color albedo;
+    bool diffuse = caches && rec.mat_ptr->diffuse(rec, albedo);
+    radiance_cache *cache = diffuse ? caches->radiance : nullptr;
+    path_guide *guide = diffuse ? caches->guide : nullptr;
+    if (cache && bounce > 0 && !(cache->recording && random_double() < cache->train_probability))
+    {
+        color incoming;
+        if (cache->lookup(rec.p, rec.normal, incoming))
+            return albedo * incoming;
+    }
+
+    ray scattered;
+    color attenuation;
+    double pdf = 0;
+    bool scatters;
+    if (guide)
+    {
+        vec3 direction;
+        double weight = guided_bounce(*guide, rec, direction, pdf);
+        scatters = weight > 0;
+        scattered = ray(rec.p, direction);
+        attenuation = albedo * weight;
+    }
+    else
+    {
+        scatters = rec.mat_ptr->scatter(r, rec, attenuation, scattered);
+    }
+
+    if (scatters)
+    {
+        ray_cone next = {rec.footprint, cone.spread + rec.mat_ptr->cone_spread(rec)};
+        color incoming = ray_color(scattered, world, depth - 1, ray_count, caches, bounce + 1, next, touched);
+        if (cache && cache->recording)
+            cache->record(rec.p, rec.normal, incoming);
+        if (guide && guide->recording)
+            guide->record(rec.p, rec.normal, scattered.direction(), incoming, pdf);
+        return attenuation * incoming;
+    }
+    return color(0, 0, 0);
+}
+
+// Samples of a pixel are summed in blocks of sample_block and the blocks
+// added in order, so the blocks can be rendered on different threads (see
+// accumulate_tiles) and still give the same sum
+const int sample_block = 64;
+
+// Sum of count samples of pixel (i, j), thread_rng being the pixel's
+// generator positioned at the first of them
+color render_samples(const camera &cam, const hittable &world,
+                     int i, int j, int image_width, int image_height,
+                     int count, int max_depth, int *ray_count = nullptr,
+                     const render_caches *caches = nullptr)
+{
+    color sum(0, 0, 0);
+    ray_cone cone = {0, cam.pixel_spread(image_height)};
+    rng *pixel_rng = thread_rng;
+    for (int s = 0; s < count; ++s)
+    {
+        // Every sample draws from its own generator split off the pixel's
+        // (see incremental.h)
+        rng sample_rng = pixel_rng ? pixel_rng->split() : rng(0);
+        if (pixel_rng)
+            thread_rng = &sample_rng;
+
+        // Screen UV coordinates
+        auto u = (i + random_double()) / (image_width - 1);
+        auto v = (j + random_double()) / (image_height - 1);
+        ray r = cam.get_ray(u, v);
+
+        // Add the color of every sample to current pixels color
+        sum += ray_color(r, world, max_depth, ray_count, caches, 0, cone);
+    }
+    thread_rng = pixel_rng;
+    return sum;
+}
+
+// Sum of samples_per_pixel samples for pixel (i, j)
+// j counts rows from the bottom of the image like the camera's v coordinate
+color render_pixel(const camera &cam, const hittable &world,
+                   int i, int j, int image_width, int image_height,
+                   int samples_per_pixel, int max_depth, int *ray_count = nullptr,
+                   const render_caches *caches = nullptr)
+{
+    color pixel_color(0, 0, 0);
+    for (int first = 0; first < samples_per_pixel; first += sample_block)
+        pixel_color += render_samples(cam, world, i, j, image_width, image_height,
+                                      std::min(sample_block, samples_per_pixel - first), max_depth,
+                                      ray_count, caches);
+    return pixel_color;
+}
+
+// A rectangle of pixels [x0,x1) x [y0,y1) in image space, y = 0 is the top row
+struct tile
+{
+    int x0, y0, x1, y1;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+};
+
+// Splits a region into tile_size x tile_size tiles in scanline order
+std::vector<tile> split_tiles(const tile &region, int tile_size)
+{
+    std::vector<tile> tiles;
+    for (int y = region.y0; y < region.y1; y += tile_size)
+        for (int x = region.x0; x < region.x1; x += tile_size)
+            tiles.push_back({x, y,
+                             std::min(x + tile_size, region.x1),
+                             std::min(y + tile_size, region.y1)});
+    return tiles;
+}
+
+// Renders one tile into sums (samples_per_pixel samples summed per pixel,
+// rows top to bottom) and, if given, records what every pixel cost into aov.
+// A seed >= 0 gives every pixel its own generator seeded from seed and the
+// pixel's position, so the image doesn't depend on how the frame was split
+// into tiles or which thread rendered them. -1 keeps drawing from rand().
+void accumulate_tile(const camera &cam, const hittable &world, const tile &t,
+                     int image_width, int image_height,
+                     int samples_per_pixel, int max_depth,
+                     std::vector<color> &sums, cost_aov *aov = nullptr, int64_t seed = -1,
+                     const render_caches *caches = nullptr)
+{
+    sums.clear();
+    sums.reserve(t.width() * t.height());
+    rng *previous_rng = thread_rng;
+    for (int y = t.y0; y < t.y1; ++y)
+    {
+        int j = image_height - 1 - y;
+        for (int i = t.x0; i < t.x1; ++i)
+        {
+            rng pixel_rng(static_cast<uint64_t>(seed), static_cast<uint64_t>(y) * image_width + i);
+            if (seed >= 0)
+                thread_rng = &pixel_rng;
+
+            if (!aov)
+            {
+                sums.push_back(render_pixel(cam, world, i, j, image_width, image_height,
+                                            samples_per_pixel, max_depth, nullptr, caches));
+                continue;
+            }
+            int rays = 0;
+            auto start = std::chrono::steady_clock::now();
+            sums.push_back(render_pixel(cam, world, i, j, image_width, image_height,
+                                        samples_per_pixel, max_depth, &rays, caches));
+            aov->record(i, y, std::chrono::steady_clock::now() - start, rays, samples_per_pixel);
+        }
+    }
+    thread_rng = previous_rng;
+}
+
+// Renders one tile into rgb (3 bytes per pixel, rows top to bottom),
+// see accumulate_tile for the other arguments
+void render_tile(const camera &cam, const hittable &world, const tile &t,
+                 int image_width, int image_height,
+                 int samples_per_pixel, int max_depth,
+                 std::vector<unsigned char> &rgb, cost_aov *aov = nullptr, int64_t seed = -1,
+                 const render_caches *caches = nullptr)
+{
+    std::vector<color> sums;
+    accumulate_tile(cam, world, t, image_width, image_height, samples_per_pixel, max_depth,
+                    sums, aov, seed, caches);
+
+    // Same bytes as write_color_rgb8, the whole tile at once
+    rgb.resize(3 * sums.size());
+    simd().tonemap(sums.data(), sums.size(), 1.0 / samples_per_pixel, rgb.data());
+}
+
+#endif
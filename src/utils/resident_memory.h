@@ -0,0 +1,17 @@
+#ifndef RESIDENT_MEMORY_H
+#define RESIDENT_MEMORY_H
+
+#include <fstream>
+#include <string>
+
+// Resident set size in MB (VmRSS) or its peak (VmHWM) from /proc/self/status
+inline double resident_mb(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, field.size() + 1, field + ":") == 0)
+            return std::stod(line.substr(field.size() + 1)) / 1024.0;
+    return 0;
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <limits>
 #include <memory>
 #include <cstdlib>
+#include <cstdint>
 
 
 
@@ -31,8 +32,64 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Small random number generator (PCG32) for render threads
+// rand() has one state shared by every thread, so a render thread installs
+// one of these, seeded from the pixel it works on, as its thread_rng. The
+// image then comes out the same whatever thread renders which tile.
+class rng {
+    public:
+        rng(uint64_t seed, uint64_t stream = 0) : state(0), inc((stream << 1) | 1) {
+            next();
+            state += seed;
+            next();
+        }
+
+        uint32_t next() {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+            uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+            uint32_t rot = static_cast<uint32_t>(old >> 59);
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+
+        // A generator seeded from two draws of this one, for a sample of a
+        // pixel: the sample then starts from the same numbers however many
+        // the samples before it drew
+        rng split() {
+            uint64_t high = next();
+            uint64_t low = next();
+            return rng((high << 32) | low, inc >> 1);
+        }
+
+        // Skips delta draws ahead in O(log delta) steps, so a generator can
+        // start at any sample of a pixel (a split takes two draws)
+        void advance(uint64_t delta) {
+            uint64_t mult = 6364136223846793005ULL, plus = inc;
+            uint64_t total_mult = 1, total_plus = 0;
+            while (delta > 0) {
+                if (delta & 1) {
+                    total_mult *= mult;
+                    total_plus = total_plus * mult + plus;
+                }
+                plus = (mult + 1) * plus;
+                mult *= mult;
+                delta >>= 1;
+            }
+            state = total_mult * state + total_plus;
+        }
+
+    private:
+        uint64_t state;
+        uint64_t inc;
+};
+
+// Generator of the current thread, null means use rand()
+inline thread_local rng* thread_rng = nullptr;
+
 inline double random_double() {
     // Returns a random real in [0,1).
+    if (thread_rng)
+        return thread_rng->next() / 4294967296.0;
     return rand() / (RAND_MAX + 1.0);
 }
 
@@ -0,0 +1,114 @@
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+// Arena for scene objects
+// Objects are placed back to back in large blocks instead of getting a heap
+// allocation and a reference count each, and are all released together when
+// the arena goes away. Materials are also registered in a table so
+// primitives can refer to them by a 32 bit index that never changes.
+
+#include "rtweekend.h"
+
+#include "material.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Blocks are aligned to a cache line, enough for SIMD vec3 members
+const size_t arena_block_align = 64;
+
+class scene_arena {
+    public:
+        scene_arena(size_t block_bytes = 1 << 20) : block_size(block_bytes) {}
+        ~scene_arena() { clear(); }
+
+        scene_arena(const scene_arena&) = delete;
+        scene_arena& operator=(const scene_arena&) = delete;
+
+        // Constructs a T inside the arena, it lives until clear()
+        template <typename T, typename... Args>
+        T* make(Args&&... args);
+
+        // Constructs a material and returns its index in materials
+        template <typename T, typename... Args>
+        uint32_t add_material(Args&&... args) {
+            materials.push_back(make<T>(std::forward<Args>(args)...));
+            return static_cast<uint32_t>(materials.size() - 1);
+        }
+
+        const material* get_material(uint32_t index) const { return materials[index]; }
+
+        // Destroys every object and frees all blocks at once
+        void clear();
+
+        size_t memory_bytes() const {
+            return reserved + materials.capacity() * sizeof(const material*) +
+                   destructors.capacity() * sizeof(destructor_entry);
+        }
+
+    public:
+        std::vector<const material*> materials;
+
+    private:
+        struct destructor_entry {
+            void (*destroy)(void*);
+            void* object;
+        };
+
+        void* allocate(size_t size, size_t align);
+
+        size_t block_size;
+        size_t used = 0;
+        size_t reserved = 0;
+        std::vector<char*> blocks;
+        std::vector<char*> large_blocks; // objects bigger than a block
+        std::vector<destructor_entry> destructors; // only for types that need one
+};
+
+template <typename T, typename... Args>
+T* scene_arena::make(Args&&... args) {
+    static_assert(alignof(T) <= arena_block_align, "over-aligned types are not supported");
+    T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+        destructors.push_back({[](void* p) { static_cast<T*>(p)->~T(); }, object});
+    return object;
+}
+
+void* scene_arena::allocate(size_t size, size_t align) {
+    if (size > block_size) {
+        large_blocks.push_back(static_cast<char*>(::operator new(size, std::align_val_t(arena_block_align))));
+        reserved += size;
+        return large_blocks.back();
+    }
+
+    used = (used + align - 1) & ~(align - 1);
+    if (blocks.empty() || used + size > block_size) {
+        blocks.push_back(static_cast<char*>(::operator new(block_size, std::align_val_t(arena_block_align))));
+        reserved += block_size;
+        used = 0;
+    }
+    void* p = blocks.back() + used;
+    used += size;
+    return p;
+}
+
+void scene_arena::clear() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+        it->destroy(it->object);
+    for (char* block : blocks)
+        ::operator delete(block, std::align_val_t(arena_block_align));
+    for (char* block : large_blocks)
+        ::operator delete(block, std::align_val_t(arena_block_align));
+    destructors.clear();
+    blocks.clear();
+    large_blocks.clear();
+    materials.clear();
+    used = 0;
+    reserved = 0;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+// Runtime selected SIMD kernels
+// The hot loops in simd_kernels.h are compiled once per instruction set
+// (scalar, SSE4.2, AVX2, AVX-512) into the same binary. The best variant the
+// CPU supports is picked through cpuid the first time simd() is called.
+// The choice can be overridden with the GHD_ISA environment variable or
+// select_isa() before that, an unsupported request falls back to the best
+// supported variant below it.
+
+#include "rtweekend.h"
+
+#include "wide_bvh_node.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define GHD_SIMD_X86 1
+#else
+#define GHD_SIMD_X86 0
+#endif
+
+enum simd_isa { isa_scalar, isa_sse42, isa_avx2, isa_avx512, isa_count };
+
+inline const char* isa_name(simd_isa isa) {
+    static const char* names[isa_count] = {"scalar", "sse4.2", "avx2", "avx512"};
+    return names[isa];
+}
+
+// Returns false for unknown names
+inline bool parse_isa(const std::string& name, simd_isa& isa) {
+    for (int i = 0; i < isa_count; i++) {
+        if (name == isa_name(static_cast<simd_isa>(i))) {
+            isa = static_cast<simd_isa>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool isa_supported(simd_isa isa) {
+#if GHD_SIMD_X86
+    switch (isa) {
+        case isa_scalar: return true;
+        case isa_sse42: return __builtin_cpu_supports("sse4.2");
+        case isa_avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case isa_avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") &&
+                                __builtin_cpu_supports("fma");
+        default: return false;
+    }
+#else
+    return isa == isa_scalar;
+#endif
+}
+
+inline simd_isa best_isa() {
+    int isa = isa_count - 1;
+    while (isa > isa_scalar && !isa_supported(static_cast<simd_isa>(isa))) isa--;
+    return static_cast<simd_isa>(isa);
+}
+
+// Spheres as separate coordinate arrays
+struct sphere_soa {
+    const double* cx;
+    const double* cy;
+    const double* cz;
+    const double* radius;
+    size_t count;
+};
+
+// One instruction set's set of kernels
+struct simd_kernels {
+    simd_isa isa;
+
+    // Closest sphere hit in [t_min, t_max], returns its index or -1
+    int (*hit_spheres)(const sphere_soa& spheres, const ray& r, double t_min, double t_max, double& t_hit);
+
+    // Children of a wide BVH node hit in [t_min, t_max] as a bit mask, with their entry distances
+    int (*wide_node_test)(const wide_bvh_node& node, const wide_ray& r, float t_min, float t_max, float t_near[4]);
+
+    // Averages, gamma-corrects and quantizes n summed pixels like write_color
+    void (*tonemap)(const color* pixels, size_t n, double scale, unsigned char* rgb);
+
+    // y += a * x over n vectors
+    void (*vec3_axpy)(double a, const vec3* x, vec3* y, size_t n);
+};
+
+// The kernels work on vec3 arrays as flat arrays of doubles, vec3_lanes
+// per vector (the fourth lane of a SIMD vec3 is zero padding)
+static_assert(sizeof(vec3) == vec3_lanes * sizeof(double), "vec3 must be vec3_lanes packed doubles");
+
+// fp-contract is off in every variant so the AVX2 and AVX-512 code does not
+// fuse multiplies and adds the scalar code rounds separately
+
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#define GHD_SIMD_NS simd_scalar
+#define GHD_SIMD_ISA 0
+#include "simd_kernels.h"
+#undef GHD_SIMD_NS
+#undef GHD_SIMD_ISA
+#pragma GCC pop_options
+
+#if GHD_SIMD_X86
+
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("sse4.2")
+#define GHD_SIMD_NS simd_sse42
+#define GHD_SIMD_ISA 1
+#include "simd_kernels.h"
+#undef GHD_SIMD_NS
+#undef GHD_SIMD_ISA
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx2,fma")
+#define GHD_SIMD_NS simd_avx2
+#define GHD_SIMD_ISA 2
+#include "simd_kernels.h"
+#undef GHD_SIMD_NS
+#undef GHD_SIMD_ISA
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx512f,avx2,fma")
+#define GHD_SIMD_NS simd_avx512
+#define GHD_SIMD_ISA 3
+#include "simd_kernels.h"
+#undef GHD_SIMD_NS
+#undef GHD_SIMD_ISA
+#pragma GCC pop_options
+
+#endif
+
+#define GHD_SIMD_KERNELS(ns, isa) {isa, ns::hit_spheres, ns::wide_node_test, ns::tonemap, ns::vec3_axpy}
+
+// Kernels of one instruction set, the caller checks isa_supported
+inline const simd_kernels& kernels_for(simd_isa isa) {
+#if GHD_SIMD_X86
+    static const simd_kernels table[isa_count] = {
+        GHD_SIMD_KERNELS(simd_scalar, isa_scalar),
+        GHD_SIMD_KERNELS(simd_sse42, isa_sse42),
+        GHD_SIMD_KERNELS(simd_avx2, isa_avx2),
+        GHD_SIMD_KERNELS(simd_avx512, isa_avx512),
+    };
+    return table[isa];
+#else
+    static const simd_kernels scalar = GHD_SIMD_KERNELS(simd_scalar, isa_scalar);
+    (void)isa;
+    return scalar;
+#endif
+}
+
+#undef GHD_SIMD_KERNELS
+
+inline simd_isa& requested_isa() {
+    static simd_isa isa = isa_count;
+    return isa;
+}
+
+// Requests an instruction set, only has an effect before the first simd() call
+inline void select_isa(simd_isa isa) {
+    requested_isa() = isa;
+}
+
+// The kernels used by the renderer
+inline const simd_kernels& simd() {
+    static const simd_kernels& selected = [] () -> const simd_kernels& {
+        simd_isa isa = requested_isa();
+        const char* env = getenv("GHD_ISA");
+        if (isa == isa_count && env && !parse_isa(env, isa)) {
+            std::cerr << "GHD_ISA: unknown instruction set " << env << ", using the best supported\n";
+        }
+        if (isa == isa_count) isa = best_isa();
+        while (!isa_supported(isa)) isa = static_cast<simd_isa>(isa - 1);
+        return kernels_for(isa);
+    }();
+    return selected;
+}
+
+#endif
@@ -0,0 +1,305 @@
+// SIMD kernel bodies, compiled once per instruction set
+// simd_dispatch.h includes this file several times, each time inside a
+// "#pragma GCC target" region with GHD_SIMD_NS naming the namespace of that
+// variant and GHD_SIMD_ISA selecting the vector wrappers below. The kernels
+// are written once against the wrappers, so every variant computes exactly
+// the same results as the scalar one, only more lanes at a time.
+//
+// No include guard on purpose.
+
+namespace GHD_SIMD_NS {
+
+// Vector wrappers
+// vd holds W doubles, vm is the matching lane mask
+
+#if GHD_SIMD_ISA == 0
+
+typedef double vd;
+typedef bool vm;
+const int W = 1;
+inline vd vd_load(const double* p) { return *p; }
+inline void vd_store(double* p, vd v) { *p = v; }
+inline vd vd_set1(double x) { return x; }
+inline vd vd_add(vd a, vd b) { return a + b; }
+inline vd vd_sub(vd a, vd b) { return a - b; }
+inline vd vd_mul(vd a, vd b) { return a * b; }
+inline vd vd_div(vd a, vd b) { return a / b; }
+inline vd vd_sqrt(vd a) { return sqrt(a); }
+inline vd vd_min(vd a, vd b) { return b < a ? b : a; }
+inline vd vd_max(vd a, vd b) { return b > a ? b : a; }
+inline vm vd_lt(vd a, vd b) { return a < b; }
+inline vm vd_le(vd a, vd b) { return a <= b; }
+inline vm vm_and(vm a, vm b) { return a && b; }
+inline vm vm_andnot(vm a, vm b) { return !a && b; }
+inline vd vd_select(vm m, vd a, vd b) { return m ? a : b; }
+inline void vd_store_int(int32_t* p, vd v) { *p = static_cast<int32_t>(v); }
+
+#elif GHD_SIMD_ISA == 1 || GHD_SIMD_ISA == 2
+
+#if GHD_SIMD_ISA == 1
+typedef __m128d vd;
+typedef __m128d vm;
+const int W = 2;
+inline vd vd_load(const double* p) { return _mm_loadu_pd(p); }
+inline void vd_store(double* p, vd v) { _mm_storeu_pd(p, v); }
+inline vd vd_set1(double x) { return _mm_set1_pd(x); }
+inline vd vd_add(vd a, vd b) { return _mm_add_pd(a, b); }
+inline vd vd_sub(vd a, vd b) { return _mm_sub_pd(a, b); }
+inline vd vd_mul(vd a, vd b) { return _mm_mul_pd(a, b); }
+inline vd vd_div(vd a, vd b) { return _mm_div_pd(a, b); }
+inline vd vd_sqrt(vd a) { return _mm_sqrt_pd(a); }
+inline vd vd_min(vd a, vd b) { return _mm_min_pd(b, a); }
+inline vd vd_max(vd a, vd b) { return _mm_max_pd(b, a); }
+inline vm vd_lt(vd a, vd b) { return _mm_cmplt_pd(a, b); }
+inline vm vd_le(vd a, vd b) { return _mm_cmple_pd(a, b); }
+inline vm vm_and(vm a, vm b) { return _mm_and_pd(a, b); }
+inline vm vm_andnot(vm a, vm b) { return _mm_andnot_pd(a, b); }
+inline vd vd_select(vm m, vd a, vd b) { return _mm_blendv_pd(b, a, m); }
+inline void vd_store_int(int32_t* p, vd v) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_cvttpd_epi32(v)); }
+#else
+typedef __m256d vd;
+typedef __m256d vm;
+const int W = 4;
+inline vd vd_load(const double* p) { return _mm256_loadu_pd(p); }
+inline void vd_store(double* p, vd v) { _mm256_storeu_pd(p, v); }
+inline vd vd_set1(double x) { return _mm256_set1_pd(x); }
+inline vd vd_add(vd a, vd b) { return _mm256_add_pd(a, b); }
+inline vd vd_sub(vd a, vd b) { return _mm256_sub_pd(a, b); }
+inline vd vd_mul(vd a, vd b) { return _mm256_mul_pd(a, b); }
+inline vd vd_div(vd a, vd b) { return _mm256_div_pd(a, b); }
+inline vd vd_sqrt(vd a) { return _mm256_sqrt_pd(a); }
+inline vd vd_min(vd a, vd b) { return _mm256_min_pd(b, a); }
+inline vd vd_max(vd a, vd b) { return _mm256_max_pd(b, a); }
+inline vm vd_lt(vd a, vd b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+inline vm vd_le(vd a, vd b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+inline vm vm_and(vm a, vm b) { return _mm256_and_pd(a, b); }
+inline vm vm_andnot(vm a, vm b) { return _mm256_andnot_pd(a, b); }
+inline vd vd_select(vm m, vd a, vd b) { return _mm256_blendv_pd(b, a, m); }
+inline void vd_store_int(int32_t* p, vd v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvttpd_epi32(v)); }
+#endif
+
+#elif GHD_SIMD_ISA == 3
+
+typedef __m512d vd;
+typedef __mmask8 vm;
+const int W = 8;
+inline vd vd_load(const double* p) { return _mm512_loadu_pd(p); }
+inline void vd_store(double* p, vd v) { _mm512_storeu_pd(p, v); }
+inline vd vd_set1(double x) { return _mm512_set1_pd(x); }
+inline vd vd_add(vd a, vd b) { return _mm512_add_pd(a, b); }
+inline vd vd_sub(vd a, vd b) { return _mm512_sub_pd(a, b); }
+inline vd vd_mul(vd a, vd b) { return _mm512_mul_pd(a, b); }
+inline vd vd_div(vd a, vd b) { return _mm512_div_pd(a, b); }
+// The unmasked sqrt, min, max and cvtt intrinsics of GCC's headers pass an
+// undefined vector through, which -Wall reports as maybe uninitialized.
+// Their zero-masking forms under a full mask compute the same lanes.
+const __mmask8 all_lanes = 0xff;
+inline vd vd_sqrt(vd a) { return _mm512_maskz_sqrt_pd(all_lanes, a); }
+inline vd vd_min(vd a, vd b) { return _mm512_maskz_min_pd(all_lanes, b, a); }
+inline vd vd_max(vd a, vd b) { return _mm512_maskz_max_pd(all_lanes, b, a); }
+inline vm vd_lt(vd a, vd b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+inline vm vd_le(vd a, vd b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+inline vm vm_and(vm a, vm b) { return a & b; }
+inline vm vm_andnot(vm a, vm b) { return ~a & b; }
+inline vd vd_select(vm m, vd a, vd b) { return _mm512_mask_blend_pd(m, b, a); }
+inline void vd_store_int(int32_t* p, vd v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvttpd_epi32(all_lanes, v));
+}
+
+#endif
+
+// Closest hit of a ray against a set of spheres stored as separate arrays
+// Same root selection as sphere::hit, returns the sphere index or -1
+int hit_spheres(const sphere_soa& s, const ray& r, double t_min, double t_max, double& t_hit) {
+    const point3 o = r.origin();
+    const vec3 d = r.direction();
+    const double a = d.length_squared();
+
+    const vd ox = vd_set1(o.x()), oy = vd_set1(o.y()), oz = vd_set1(o.z());
+    const vd dx = vd_set1(d.x()), dy = vd_set1(d.y()), dz = vd_set1(d.z());
+    const vd va = vd_set1(a), zero = vd_set1(0.0), inf = vd_set1(infinity);
+    const vd lo = vd_set1(t_min), hi = vd_set1(t_max);
+
+    vd best_t = inf;
+    vd best_i = vd_set1(-1.0);
+    double lane_index[W];
+    for (int k = 0; k < W; k++) lane_index[k] = k;
+    const vd index = vd_load(lane_index);
+
+    size_t i = 0;
+    for (; i + W <= s.count; i += W) {
+        vd ocx = vd_sub(ox, vd_load(s.cx + i));
+        vd ocy = vd_sub(oy, vd_load(s.cy + i));
+        vd ocz = vd_sub(oz, vd_load(s.cz + i));
+        vd rad = vd_load(s.radius + i);
+
+        vd half_b = vd_add(vd_add(vd_mul(ocx, dx), vd_mul(ocy, dy)), vd_mul(ocz, dz));
+        vd c = vd_sub(vd_add(vd_add(vd_mul(ocx, ocx), vd_mul(ocy, ocy)), vd_mul(ocz, ocz)), vd_mul(rad, rad));
+        vd discriminant = vd_sub(vd_mul(half_b, half_b), vd_mul(va, c));
+        vm valid = vd_le(zero, discriminant);
+        vd sqrtd = vd_sqrt(vd_max(discriminant, zero));
+
+        vd neg_half_b = vd_sub(zero, half_b);
+        vd root1 = vd_div(vd_sub(neg_half_b, sqrtd), va);
+        vd root2 = vd_div(vd_add(neg_half_b, sqrtd), va);
+        vm ok1 = vm_and(valid, vm_and(vd_le(lo, root1), vd_le(root1, hi)));
+        vm ok2 = vm_andnot(ok1, vm_and(valid, vm_and(vd_le(lo, root2), vd_le(root2, hi))));
+        vd t = vd_select(ok1, root1, vd_select(ok2, root2, inf));
+
+        vm better = vd_lt(t, best_t);
+        best_t = vd_select(better, t, best_t);
+        best_i = vd_select(better, vd_add(index, vd_set1(static_cast<double>(i))), best_i);
+    }
+
+    double lanes_t[W], lanes_i[W];
+    vd_store(lanes_t, best_t);
+    vd_store(lanes_i, best_i);
+    int hit = -1;
+    double closest = infinity;
+    for (int k = 0; k < W; k++) {
+        if (lanes_i[k] >= 0 && (lanes_t[k] < closest || (lanes_t[k] == closest && lanes_i[k] < hit))) {
+            closest = lanes_t[k];
+            hit = static_cast<int>(lanes_i[k]);
+        }
+    }
+
+    // Remainder one sphere at a time
+    for (; i < s.count; i++) {
+        vec3 oc = o - point3(s.cx[i], s.cy[i], s.cz[i]);
+        auto half_b = dot(oc, d);
+        auto c = oc.length_squared() - s.radius[i] * s.radius[i];
+        auto discriminant = half_b * half_b - a * c;
+        if (discriminant < 0) continue;
+        auto sqrtd = sqrt(discriminant);
+        auto root = (-half_b - sqrtd) / a;
+        if (root < t_min || t_max < root) {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || t_max < root)
+                continue;
+        }
+        if (root < closest) {
+            closest = root;
+            hit = static_cast<int>(i);
+        }
+    }
+
+    t_hit = closest;
+    return hit;
+}
+
+// y += a * x over n vectors
+void vec3_axpy(double a, const vec3* x, vec3* y, size_t n) {
+    const double* xs = reinterpret_cast<const double*>(x);
+    double* ys = reinterpret_cast<double*>(y);
+    size_t count = vec3_lanes * n; // padding lanes stay 0 + a * 0
+    const vd va = vd_set1(a);
+    size_t i = 0;
+    for (; i + W <= count; i += W)
+        vd_store(ys + i, vd_add(vd_load(ys + i), vd_mul(va, vd_load(xs + i))));
+    for (; i < count; i++)
+        ys[i] += a * xs[i];
+}
+
+// write_color for a row of pixels: average, gamma 2 and quantize to bytes
+// The padding lane of a four lane vec3 is computed along and not written.
+void tonemap(const color* pixels, size_t n, double scale, unsigned char* rgb) {
+    const double* xs = reinterpret_cast<const double*>(pixels);
+    size_t count = vec3_lanes * n;
+    const vd vscale = vd_set1(scale), zero = vd_set1(0.0), top = vd_set1(0.999), v256 = vd_set1(256.0);
+    int32_t quantized[W];
+    size_t i = 0;
+    for (; i + W <= count; i += W) {
+        vd v = vd_sqrt(vd_mul(vscale, vd_load(xs + i)));
+        v = vd_min(vd_max(v, zero), top);
+        vd_store_int(quantized, vd_mul(v256, v));
+        for (int k = 0; k < W; k++) {
+            size_t lane = (i + k) % vec3_lanes;
+            if (lane < 3) rgb[(i + k) / vec3_lanes * 3 + lane] = static_cast<unsigned char>(quantized[k]);
+        }
+    }
+    for (; i < count; i++) {
+        size_t lane = i % vec3_lanes;
+        if (lane < 3)
+            rgb[i / vec3_lanes * 3 + lane] =
+                static_cast<unsigned char>(static_cast<int>(256 * clamp(sqrt(scale * xs[i]), 0.0, 0.999)));
+    }
+}
+
+#if GHD_SIMD_ISA == 0
+// minps and maxps: the second operand when either is NaN, as an axis
+// parallel ray starting on a slab plane gets (0 * inf), so every variant
+// culls the same children
+inline float lane_min(float a, float b) { return a < b ? a : b; }
+inline float lane_max(float a, float b) { return a > b ? a : b; }
+#endif
+
+// Slab test of a ray against the four children of a wide BVH node
+// Returns the mask of children hit within [t_min, t_max] and their entry distances
+int wide_node_test(const wide_bvh_node& node, const wide_ray& r, float t_min, float t_max, float t_near[4]) {
+#if GHD_SIMD_ISA == 0
+    int mask = 0;
+    for (int c = 0; c < node.child_count; c++) {
+        float t0 = t_min, t1 = t_max;
+        for (int a = 0; a < 3; a++) {
+            float scale = ldexpf(1.0f, node.exponent[a]);
+            float lo = node.origin[a] + node.bounds[a][c] * scale;
+            float hi = node.origin[a] + node.bounds[a][4 + c] * scale;
+            float ta = (lo - r.origin[a]) * r.inv_dir[a];
+            float tb = (hi - r.origin[a]) * r.inv_dir[a];
+            t0 = lane_max(t0, lane_min(ta, tb));
+            t1 = lane_min(t1, lane_max(ta, tb));
+        }
+        if (t0 <= t1 * wide_far_scale) {
+            mask |= 1 << c;
+            t_near[c] = t0;
+        }
+    }
+    return mask;
+#elif GHD_SIMD_ISA == 1
+    // Minima and maxima of the four children as two float vectors per axis
+    __m128 t0 = _mm_set1_ps(t_min);
+    __m128 t1 = _mm_set1_ps(t_max);
+    for (int a = 0; a < 3; a++) {
+        int32_t packed[2];
+        memcpy(packed, node.bounds[a], 8);
+        __m128 scale = _mm_set1_ps(ldexpf(1.0f, node.exponent[a]));
+        __m128 origin = _mm_set1_ps(node.origin[a]);
+        __m128 ray_origin = _mm_set1_ps(r.origin[a]);
+        __m128 inv = _mm_set1_ps(r.inv_dir[a]);
+        __m128 qlo = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed[0])));
+        __m128 qhi = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed[1])));
+        __m128 lo = _mm_add_ps(origin, _mm_mul_ps(qlo, scale));
+        __m128 hi = _mm_add_ps(origin, _mm_mul_ps(qhi, scale));
+        __m128 ta = _mm_mul_ps(_mm_sub_ps(lo, ray_origin), inv);
+        __m128 tb = _mm_mul_ps(_mm_sub_ps(hi, ray_origin), inv);
+        t0 = _mm_max_ps(t0, _mm_min_ps(ta, tb));
+        t1 = _mm_min_ps(t1, _mm_max_ps(ta, tb));
+    }
+    t1 = _mm_mul_ps(t1, _mm_set1_ps(wide_far_scale));
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1)) & ((1 << node.child_count) - 1);
+#else
+    // Minima and maxima of an axis in one 8 lane vector. q * 2^e is exact,
+    // so the fma rounds exactly like the separate multiply and add
+    __m128 t0 = _mm_set1_ps(t_min);
+    __m128 t1 = _mm_set1_ps(t_max);
+    for (int a = 0; a < 3; a++) {
+        long long packed;
+        memcpy(&packed, node.bounds[a], 8);
+        __m256 q = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(packed)));
+        __m256 planes = _mm256_fmadd_ps(q, _mm256_set1_ps(ldexpf(1.0f, node.exponent[a])),
+                                        _mm256_set1_ps(node.origin[a]));
+        __m256 t = _mm256_mul_ps(_mm256_sub_ps(planes, _mm256_set1_ps(r.origin[a])),
+                                 _mm256_set1_ps(r.inv_dir[a]));
+        __m128 ta = _mm256_castps256_ps128(t);
+        __m128 tb = _mm256_extractf128_ps(t, 1);
+        t0 = _mm_max_ps(t0, _mm_min_ps(ta, tb));
+        t1 = _mm_min_ps(t1, _mm_max_ps(ta, tb));
+    }
+    t1 = _mm_mul_ps(t1, _mm_set1_ps(wide_far_scale));
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1)) & ((1 << node.child_count) - 1);
+#endif
+}
+
+} // namespace GHD_SIMD_NS
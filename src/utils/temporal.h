@@ -0,0 +1,193 @@
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+// Temporal sample reuse for camera animations over a static scene
+// Every frame of a flythrough is rendered with a few new samples per pixel,
+// and the pixel's history from the frame before is found by projecting the
+// point its first sample hit into the previous camera (bilinear over the
+// four nearest pixels). A tap of the previous frame is only used if it saw
+// the same material, with a normal within normal_tolerance and at a point
+// within depth_tolerance (relative to the distance to the camera), so
+// surfaces that came out from behind others (disocclusion) and the borders
+// of objects start over. The history is weighed by the samples behind it,
+// capped at max_history frames' worth, so the image converges over a still
+// camera and follows a moving one.
+//
+// Only rough first hits reuse history, whose scattered rays spread by at
+// least min_spread (see material::cone_spread): diffuse and fuzzy metal
+// surfaces look about the same from nearby viewpoints, mirrors and glass
+// reflect a different part of the scene from each. Sky pixels cost one ray
+// anyway. Reused pixels are biased towards where the camera was, which the
+// cap keeps to a few frames.
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "material.h"
+#include "render.h"
+#include "simd_dispatch.h"
+#include "tile_scheduler.h"
+#include "../primitives/camera.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// What the first sample of a pixel hit
+struct temporal_hit
+{
+    point3 p;
+    vec3 normal;
+    const material *mat = nullptr;
+    double distance = 0; // from the camera
+    bool reusable = false;
+};
+
+class temporal_frame
+{
+public:
+    int width, height;
+    int samples_per_pixel, max_depth;
+    int max_history = 8;           // frames' worth of samples a pixel keeps
+    double normal_tolerance = 0.9; // smallest cosine between the normals
+    double depth_tolerance = 0.02; // largest distance between the points over distance
+    double min_spread = 0.3;       // least cone spread of a surface that reuses history
+    std::vector<color> radiance;   // mean per pixel, rows top to bottom
+    std::vector<double> weight;    // samples behind radiance
+    std::vector<temporal_hit> hits;
+    int frames = 0; // rendered since the history was reset
+
+    temporal_frame(int image_width, int image_height, int spp, int depth)
+        : width(image_width), height(image_height), samples_per_pixel(spp), max_depth(depth),
+          radiance(static_cast<size_t>(image_width) * image_height), weight(radiance.size()), hits(radiance.size())
+    {
+    }
+
+    // Forgets the history, the next frame starts from its own samples
+    void reset()
+    {
+        previous_camera.reset();
+        frames = 0;
+    }
+
+    // Renders the frame seen by cam with samples_per_pixel new samples per
+    // pixel (seeded like accumulate_tile, so give every frame its own seed)
+    // blended with what the previous frame saw. Returns how many pixels
+    // reused history.
+    size_t render(const camera &cam, const hittable &world, int64_t seed, int threads)
+    {
+        last_radiance.swap(radiance);
+        last_weight.swap(weight);
+        last_hits.swap(hits);
+        radiance.resize(last_radiance.size());
+        weight.resize(last_radiance.size());
+        hits.resize(last_radiance.size());
+
+        const double spread = cam.pixel_spread(height);
+        std::atomic<size_t> reused(0);
+        for_rows(height, threads,
+                 [&](int y)
+                 {
+                     int j = height - 1 - y;
+                     size_t row_reused = 0;
+                     for (int i = 0; i < width; ++i)
+                     {
+                         size_t p = static_cast<size_t>(y) * width + i;
+                         rng pixel_rng(static_cast<uint64_t>(seed), p);
+                         color sum(0, 0, 0);
+                         hits[p] = temporal_hit();
+                         for (int s = 0; s < samples_per_pixel; ++s)
+                         {
+                             rng sample_rng = pixel_rng.split();
+                             thread_rng = &sample_rng;
+                             auto u = (i + random_double()) / (width - 1);
+                             auto v = (j + random_double()) / (height - 1);
+                             sum += trace(cam.get_ray(u, v), world, spread, s == 0 ? &hits[p] : nullptr);
+                         }
+
+                         color history;
+                         double history_weight = 0;
+                         if (previous_camera && hits[p].reusable)
+                             history_weight = reproject(hits[p], history);
+                         if (history_weight > 0)
+                             row_reused++;
+                         history_weight = std::min(history_weight, static_cast<double>(max_history) * samples_per_pixel);
+                         weight[p] = history_weight + samples_per_pixel;
+                         radiance[p] = (history_weight * history + sum) / weight[p];
+                     }
+                     reused += row_reused;
+                 });
+        previous_camera.reset(new camera(cam));
+        frames++;
+        return reused;
+    }
+
+    // Tonemaps the frame into rgb (3 bytes per pixel)
+    void resolve(std::vector<unsigned char> &rgb) const
+    {
+        rgb.resize(3 * radiance.size());
+        simd().tonemap(radiance.data(), radiance.size(), 1.0, rgb.data());
+    }
+
+    size_t memory_bytes() const
+    {
+        // The previous frame is held while rendering the next
+        return 2 * radiance.size() * (sizeof(color) + sizeof(double) + sizeof(temporal_hit));
+    }
+
+private:
+    std::unique_ptr<camera> previous_camera;
+    std::vector<color> last_radiance;
+    std::vector<double> last_weight;
+    std::vector<temporal_hit> last_hits;
+
+    // ray_color of a camera ray, recording its first hit into first if given
+    color trace(const ray &r, const hittable &world, double spread, temporal_hit *first) const
+    {
+        hit_record rec;
+        if (!world.hit(r, 0.001, infinity, rec))
+            return scene_sky.value(r.direction());
+        if (first && rec.mat_ptr->cone_spread(rec) >= min_spread)
+            *first = {rec.p, rec.normal, rec.mat_ptr, rec.t * r.direction().length(), true};
+        return shade_hit(r, rec, world, max_depth, nullptr, nullptr, 0, {0, spread}, nullptr);
+    }
+
+    // The history of a hit from the previous frame's pixels around where it
+    // was seen, returns the samples behind it (0 if there is none)
+    double reproject(const temporal_hit &hit, color &history) const
+    {
+        double s, t;
+        if (!previous_camera->project(hit.p, s, t))
+            return 0;
+        double x = s * (width - 1) - 0.5, row = (1 - t) * (height - 1) + 0.5;
+        int x0 = static_cast<int>(floor(x)), y0 = static_cast<int>(floor(row));
+        double fx = x - x0, fy = row - y0;
+
+        const double tolerance = depth_tolerance * hit.distance;
+        color sum(0, 0, 0);
+        double taps = 0, samples = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            int tx = x0 + (k & 1), ty = y0 + (k >> 1);
+            if (tx < 0 || tx >= width || ty < 0 || ty >= height)
+                continue;
+            size_t q = static_cast<size_t>(ty) * width + tx;
+            const temporal_hit &last = last_hits[q];
+            if (!last.reusable || last.mat != hit.mat || dot(last.normal, hit.normal) < normal_tolerance ||
+                (last.p - hit.p).length_squared() > tolerance * tolerance)
+                continue;
+            double w = ((k & 1) ? fx : 1 - fx) * ((k >> 1) ? fy : 1 - fy);
+            sum += w * last_radiance[q];
+            samples += w * last_weight[q];
+            taps += w;
+        }
+        if (taps < 0.05)
+            return 0;
+        history = sum / taps;
+        return samples / taps;
+    }
+};
+
+#endif
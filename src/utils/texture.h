@@ -0,0 +1,114 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+// Textures for material parameters
+// A texture maps surface coordinates (u, v) to a color. Image textures read
+// their texels through a texture_cache and filter them over the ray's
+// footprint: the width of the ray cone where it hit (hit_record::footprint)
+// over the world size of one unit of u (hittable::surface_uv) is how many
+// texels of level 0 the lookup covers, and its log2 picks the mip levels
+// that are blended (trilinear filtering). Wide footprints, like those of
+// rays after a diffuse bounce, read small coarse levels and keep the
+// cache's working set small.
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "texture_cache.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+class texture {
+    public:
+        virtual ~texture() = default;
+
+        // Color at (u, v), averaged over a footprint width wide in uv units
+        virtual color value(double u, double v, double width) const = 0;
+};
+
+class solid_color : public texture {
+    public:
+        solid_color(const color& c) : value_color(c) {}
+
+        virtual color value(double, double, double) const override { return value_color; }
+
+    public:
+        color value_color;
+};
+
+// Image texture repeating over uv, v = 0 at the bottom row of the image
+class image_texture : public texture {
+    public:
+        image_texture(shared_ptr<texture_cache> tile_cache, int texture_id)
+            : cache(tile_cache), id(texture_id), levels(tile_cache->header(texture_id).levels),
+              width(tile_cache->header(texture_id).width) {}
+
+        virtual color value(double u, double v, double footprint) const override {
+            // Level 0 texels the footprint covers
+            double level = log2(fmax(footprint * width, 1e-12));
+            if (level <= 0) return bilinear(0, u, v);
+            if (level >= levels - 1) return bilinear(levels - 1, u, v);
+            int l = static_cast<int>(level);
+            double blend = level - l;
+            return (1 - blend) * bilinear(l, u, v) + blend * bilinear(l + 1, u, v);
+        }
+
+    public:
+        shared_ptr<texture_cache> cache;
+        int id;
+
+    private:
+        color bilinear(int l, double u, double v) const {
+            const texture_level& lv = cache->level(id, l);
+            double x = u * lv.width - 0.5, y = (1 - v) * lv.height - 0.5;
+            double fx = floor(x), fy = floor(y);
+            double ax = x - fx, ay = y - fy;
+            int ix = static_cast<int>(fx - lv.width * floor(fx / lv.width));
+            int iy = static_cast<int>(fy - lv.height * floor(fy / lv.height));
+            // Rounding can land exactly on the width
+            ix = ix >= static_cast<int>(lv.width) ? 0 : ix;
+            iy = iy >= static_cast<int>(lv.height) ? 0 : iy;
+
+            color texels[4];
+            cache->quad(id, l, ix, iy, texels);
+            return (1 - ay) * ((1 - ax) * texels[0] + ax * texels[1]) + ay * ((1 - ax) * texels[2] + ax * texels[3]);
+        }
+
+        int levels;
+        double width;
+};
+
+// The texture's value at a hit, filtered over the hit's footprint. Objects
+// without surface coordinates get the texture's average.
+inline color texture_value(const texture& t, const hit_record& rec) {
+    double u, v, uv_size;
+    if (!rec.object || !rec.object->surface_uv(rec, u, v, uv_size))
+        return t.value(0, 0, infinity);
+    return t.value(u, v, rec.footprint / uv_size);
+}
+
+// Cache the built-in scenes load their textures into, sized by
+// $GHD_TEXTURE_CACHE_MB (default 256)
+shared_ptr<texture_cache> default_texture_cache() {
+    static shared_ptr<texture_cache> cache = []() {
+        const char* mb = getenv("GHD_TEXTURE_CACHE_MB");
+        size_t bytes = (mb ? strtoull(mb, nullptr, 10) : 256) << 20;
+        return make_shared<texture_cache>(bytes);
+    }();
+    return cache;
+}
+
+// Opens a texture file (see make_texture) in a cache, null if it can't be read
+shared_ptr<image_texture> load_texture(const std::string& path,
+                                       shared_ptr<texture_cache> cache = default_texture_cache()) {
+    int id = cache->open(path);
+    if (id < 0) {
+        std::cerr << "cannot read texture " << path << "\n";
+        return nullptr;
+    }
+    return make_shared<image_texture>(cache, id);
+}
+
+#endif
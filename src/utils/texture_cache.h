@@ -0,0 +1,399 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+// Tiled, mipmapped texture files and a bounded cache of their tiles
+// A texture file holds every mip level of an image down to 1x1, each cut
+// into tile_size x tile_size tiles stored one after the other. Every tile
+// carries one extra column and row copied from its right and lower
+// neighbours (wrapping around the image), so a bilinear lookup reads a
+// single tile. Texels are 8 bit with 1 or 3 channels; color textures are
+// stored with gamma 2 like the renderer's output, data textures (roughness)
+// as they are.
+//
+// texture_cache keeps a fixed number of tiles in memory and reads missing
+// ones from the files with pread, the least recently used tile making room,
+// so texture sets far larger than memory can be rendered. Tiles are spread
+// over shards by hash, each shard with its own lock, LRU list and share of
+// the memory, so threads rarely wait for each other. A miss reads from disk
+// holding only its shard's lock. Open every texture before rendering.
+//
+// File layout (native endianness, checked through the byte order field):
+//   texture_file_header
+//   texture_level      one per level, largest first
+//   tiles              (tile_size + 1)^2 * channels bytes each, level by
+//                      level, rows of tiles top to bottom
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t texture_file_version = 1;
+
+struct texture_file_header {
+    char magic[8];        // "GHDTEX" and two zero bytes
+    uint32_t byte_order;  // 0x01020304 as written
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t channels;    // 1 or 3
+    uint32_t gamma;       // 1 if texels are stored with gamma 2
+    uint32_t tile_size;
+    uint32_t levels;
+};
+
+struct texture_level {
+    uint32_t width, height;
+    uint32_t tiles_x, tiles_y;
+    uint64_t offset; // of the level's first tile in the file
+};
+
+// Source texels and their weights covering each of the size texels of a
+// level made from source_size texels, exact box filtering for odd sizes
+inline std::vector<std::vector<std::pair<int, float>>> box_weights(int source_size, int size) {
+    std::vector<std::vector<std::pair<int, float>>> weights(size);
+    double scale = static_cast<double>(source_size) / size;
+    for (int i = 0; i < size; i++) {
+        double begin = i * scale, end = (i + 1) * scale;
+        for (int s = static_cast<int>(begin); s < end && s < source_size; s++) {
+            double overlap = std::min<double>(end, s + 1) - std::max<double>(begin, s);
+            if (overlap > 1e-9) weights[i].push_back({s, static_cast<float>(overlap / scale)});
+        }
+    }
+    return weights;
+}
+
+// Writes a texture file from 8 bit texels (channels per texel, rows top to
+// bottom). Levels are box filtered in linear space. Returns false if the
+// file can't be written.
+bool write_texture(const std::string& path, int width, int height, int channels,
+                   const std::vector<unsigned char>& texels, bool gamma, int tile_size = 64) {
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3) ||
+        texels.size() != static_cast<size_t>(width) * height * channels)
+        return false;
+
+    // Level 0 in linear floats, then halve until 1x1
+    std::vector<std::vector<float>> images(1);
+    std::vector<texture_level> levels(1);
+    images[0].resize(texels.size());
+    for (size_t i = 0; i < texels.size(); i++) {
+        float value = texels[i] / 255.0f;
+        images[0][i] = gamma ? value * value : value;
+    }
+    levels[0] = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 0, 0, 0};
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const texture_level& above = levels.back();
+        const std::vector<float>& src = images.back();
+        int w = static_cast<int>(above.width), h = static_cast<int>(above.height);
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        std::vector<float> dst(static_cast<size_t>(nw) * nh * channels, 0.0f);
+        std::vector<std::vector<std::pair<int, float>>> wx = box_weights(w, nw), wy = box_weights(h, nh);
+        for (int y = 0; y < nh; y++) {
+            for (int x = 0; x < nw; x++) {
+                float* d = &dst[(static_cast<size_t>(y) * nw + x) * channels];
+                for (const auto& sy : wy[y])
+                    for (const auto& sx : wx[x])
+                        for (int c = 0; c < channels; c++)
+                            d[c] += sy.second * sx.second * src[(static_cast<size_t>(sy.first) * w + sx.first) * channels + c];
+            }
+        }
+        images.push_back(std::move(dst));
+        levels.push_back({static_cast<uint32_t>(nw), static_cast<uint32_t>(nh), 0, 0, 0});
+    }
+
+    const size_t tile_bytes = static_cast<size_t>(tile_size + 1) * (tile_size + 1) * channels;
+    uint64_t offset = sizeof(texture_file_header) + levels.size() * sizeof(texture_level);
+    for (auto& level : levels) {
+        level.tiles_x = (level.width + tile_size - 1) / tile_size;
+        level.tiles_y = (level.height + tile_size - 1) / tile_size;
+        level.offset = offset;
+        offset += static_cast<uint64_t>(level.tiles_x) * level.tiles_y * tile_bytes;
+    }
+
+    texture_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GHDTEX", 6);
+    header.byte_order = 0x01020304;
+    header.version = texture_file_version;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.gamma = gamma;
+    header.tile_size = tile_size;
+    header.levels = static_cast<uint32_t>(levels.size());
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(texture_level));
+
+    std::vector<unsigned char> tile(tile_bytes);
+    for (size_t l = 0; l < levels.size(); l++) {
+        const texture_level& level = levels[l];
+        const std::vector<float>& image = images[l];
+        for (uint32_t ty = 0; ty < level.tiles_y; ty++) {
+            for (uint32_t tx = 0; tx < level.tiles_x; tx++) {
+                unsigned char* t = tile.data();
+                for (int j = 0; j <= tile_size; j++) {
+                    size_t y = (ty * tile_size + j) % level.height;
+                    for (int i = 0; i <= tile_size; i++) {
+                        size_t x = (tx * tile_size + i) % level.width;
+                        for (int c = 0; c < channels; c++) {
+                            float value = image[(y * level.width + x) * channels + c];
+                            *t++ = static_cast<unsigned char>(255 * (gamma ? sqrt(value) : value) + 0.5f);
+                        }
+                    }
+                }
+                out.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+            }
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+// Hit rate and memory of a texture_cache
+struct texture_cache_stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;    // tiles read from disk
+    uint64_t evictions = 0;
+    uint64_t bytes_read = 0;
+    size_t resident_tiles = 0;
+    size_t capacity_tiles = 0;
+    size_t memory_bytes = 0; // tile memory plus bookkeeping
+
+    double hit_rate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+class texture_cache {
+    public:
+        // Holds about capacity_bytes of tiles of the given tile size
+        texture_cache(size_t capacity_bytes, int tile_size = 64, int shard_count = 16)
+            : tile(tile_size), slot_bytes(static_cast<size_t>(tile_size + 1) * (tile_size + 1) * 3),
+              shards(shard_count) {
+            size_t per_shard = std::max<size_t>(1, capacity_bytes / slot_bytes / shard_count);
+            for (auto& s : shards) s.capacity = per_shard;
+        }
+
+        ~texture_cache() {
+            for (const auto& f : files) close(f.fd);
+        }
+
+        texture_cache(const texture_cache&) = delete;
+        texture_cache& operator=(const texture_cache&) = delete;
+
+        // Opens a texture file, returns its id or -1 if it can't be read, was
+        // written with another tile size or its levels don't fit the file
+        int open(const std::string& path) {
+            texture_file f;
+            f.fd = ::open(path.c_str(), O_RDONLY);
+            if (f.fd < 0) return -1;
+            bool valid = pread(f.fd, &f.header, sizeof(f.header), 0) == sizeof(f.header) &&
+                         memcmp(f.header.magic, "GHDTEX", 6) == 0 && f.header.byte_order == 0x01020304 &&
+                         f.header.version == texture_file_version && f.header.tile_size == static_cast<uint32_t>(tile) &&
+                         (f.header.channels == 1 || f.header.channels == 3) && f.header.levels > 0 &&
+                         f.header.levels <= 32;
+            if (valid) {
+                f.levels.resize(f.header.levels);
+                size_t bytes = f.levels.size() * sizeof(texture_level);
+                valid = pread(f.fd, f.levels.data(), bytes, sizeof(f.header)) == static_cast<ssize_t>(bytes);
+            }
+            // Levels are trusted by the lookups, so each must cover its size
+            // with whole tiles that lie inside the file
+            struct stat st;
+            valid = valid && fstat(f.fd, &st) == 0;
+            uint64_t tile_bytes = static_cast<uint64_t>(tile + 1) * (tile + 1) * f.header.channels;
+            for (size_t l = 0; valid && l < f.levels.size(); l++) {
+                const texture_level& lv = f.levels[l];
+                uint64_t tiles = static_cast<uint64_t>(lv.tiles_x) * lv.tiles_y;
+                valid = lv.width >= 1 && lv.height >= 1 && lv.width <= INT32_MAX && lv.height <= INT32_MAX &&
+                        lv.tiles_x == (lv.width + tile - 1) / tile && lv.tiles_y == (lv.height + tile - 1) / tile &&
+                        tiles < (uint64_t(1) << 35) && lv.offset <= static_cast<uint64_t>(st.st_size) &&
+                        tiles * tile_bytes <= static_cast<uint64_t>(st.st_size) - lv.offset;
+            }
+            if (!valid) {
+                close(f.fd);
+                return -1;
+            }
+            std::lock_guard<std::mutex> guard(open_lock);
+            files.push_back(std::move(f));
+            return static_cast<int>(files.size() - 1);
+        }
+
+        const texture_file_header& header(int id) const { return files[id].header; }
+        const texture_level& level(int id, int l) const { return files[id].levels[l]; }
+
+        // The texels at (x, y), (x + 1, y), (x, y + 1) and (x + 1, y + 1) of a
+        // level as linear values, x and y inside the level, the +1 neighbours
+        // wrapping around its edges. One color per texel, data textures
+        // repeat their value in all three channels.
+        void quad(int id, int l, int x, int y, color out[4]) {
+            const texture_file& f = files[id];
+            const texture_level& lv = f.levels[l];
+            uint32_t tx = x / tile, ty = y / tile;
+            uint64_t index = static_cast<uint64_t>(ty) * lv.tiles_x + tx;
+            uint64_t key = (static_cast<uint64_t>(id + 1) << 40) | (static_cast<uint64_t>(l) << 35) | index;
+            int channels = static_cast<int>(f.header.channels);
+            const float* decode = f.header.gamma ? gamma_table().data() : linear_table().data();
+
+            shard& s = shards[hash(key) % shards.size()];
+            std::lock_guard<std::mutex> guard(s.lock);
+            int slot = find(s, key, f, lv, index);
+            const unsigned char* texels = &s.data[slot * slot_bytes];
+            int i = x - tx * tile, j = y - ty * tile;
+            for (int k = 0; k < 4; k++) {
+                const unsigned char* t = texels + ((j + k / 2) * (tile + 1) + i + k % 2) * channels;
+                out[k] = channels == 3 ? color(decode[t[0]], decode[t[1]], decode[t[2]])
+                                       : color(decode[t[0]], decode[t[0]], decode[t[0]]);
+            }
+        }
+
+        texture_cache_stats stats() const {
+            texture_cache_stats result;
+            for (const auto& s : shards) {
+                std::lock_guard<std::mutex> guard(s.lock);
+                result.hits += s.hits;
+                result.misses += s.misses;
+                result.evictions += s.evictions;
+                result.bytes_read += s.bytes_read;
+                result.resident_tiles += s.slots.size();
+                result.capacity_tiles += s.capacity;
+                result.memory_bytes += s.data.capacity() + s.keys.capacity() * (sizeof(uint64_t) + 2 * sizeof(int)) +
+                                       s.slots.size() * (sizeof(uint64_t) + sizeof(int) + 2 * sizeof(void*));
+            }
+            return result;
+        }
+
+        // Zeroes the hit, miss and read counters, the tiles stay
+        void reset_counters() {
+            for (auto& s : shards) {
+                std::lock_guard<std::mutex> guard(s.lock);
+                s.hits = s.misses = s.evictions = s.bytes_read = 0;
+            }
+        }
+
+    private:
+        struct texture_file {
+            int fd = -1;
+            texture_file_header header;
+            std::vector<texture_level> levels;
+        };
+
+        // A share of the tiles with an LRU list through prev / next, most
+        // recent at head, and its own counters so lookups share no cache
+        // line. Slots are allocated as they fill, an unused cache costs
+        // nothing.
+        struct shard {
+            mutable std::mutex lock;
+            size_t capacity = 0; // slots
+            std::unordered_map<uint64_t, int> slots;
+            std::vector<unsigned char> data;
+            std::vector<uint64_t> keys;
+            std::vector<int> prev, next;
+            int head = -1, tail = -1;
+            uint64_t hits = 0, misses = 0, evictions = 0, bytes_read = 0;
+        };
+
+        static uint64_t hash(uint64_t key) {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            return key;
+        }
+
+        static void unlink(shard& s, int slot) {
+            if (s.prev[slot] >= 0) s.next[s.prev[slot]] = s.next[slot];
+            else s.head = s.next[slot];
+            if (s.next[slot] >= 0) s.prev[s.next[slot]] = s.prev[slot];
+            else s.tail = s.prev[slot];
+        }
+
+        static void push_front(shard& s, int slot) {
+            s.prev[slot] = -1;
+            s.next[slot] = s.head;
+            if (s.head >= 0) s.prev[s.head] = slot;
+            s.head = slot;
+            if (s.tail < 0) s.tail = slot;
+        }
+
+        // Slot holding the tile, read from the file into a free or the least
+        // recently used slot on a miss
+        int find(shard& s, uint64_t key, const texture_file& f, const texture_level& lv, uint64_t index) {
+            auto it = s.slots.find(key);
+            if (it != s.slots.end()) {
+                s.hits++;
+                if (s.head != it->second) {
+                    unlink(s, it->second);
+                    push_front(s, it->second);
+                }
+                return it->second;
+            }
+
+            s.misses++;
+            int slot;
+            if (s.slots.size() < s.capacity) {
+                slot = static_cast<int>(s.slots.size());
+                // Grow geometrically but never past the shard's share
+                size_t needed = (slot + 1) * slot_bytes;
+                if (needed > s.data.capacity())
+                    s.data.reserve(std::min(s.capacity * slot_bytes, std::max(needed, 2 * s.data.capacity())));
+                s.data.resize(needed);
+                s.keys.push_back(0);
+                s.prev.push_back(-1);
+                s.next.push_back(-1);
+            }
+            else {
+                slot = s.tail;
+                unlink(s, slot);
+                s.slots.erase(s.keys[slot]);
+                s.evictions++;
+            }
+            size_t bytes = static_cast<size_t>(tile + 1) * (tile + 1) * f.header.channels;
+            unsigned char* data = &s.data[slot * slot_bytes];
+            if (pread(f.fd, data, bytes, lv.offset + index * bytes) != static_cast<ssize_t>(bytes))
+                memset(data, 0, bytes);
+            s.bytes_read += bytes;
+
+            s.keys[slot] = key;
+            s.slots[key] = slot;
+            push_front(s, slot);
+            return slot;
+        }
+
+        static const std::vector<float>& gamma_table() {
+            static const std::vector<float> table = []() {
+                std::vector<float> t(256);
+                for (int i = 0; i < 256; i++) t[i] = (i / 255.0f) * (i / 255.0f);
+                return t;
+            }();
+            return table;
+        }
+
+        static const std::vector<float>& linear_table() {
+            static const std::vector<float> table = []() {
+                std::vector<float> t(256);
+                for (int i = 0; i < 256; i++) t[i] = i / 255.0f;
+                return t;
+            }();
+            return table;
+        }
+
+        int tile;
+        size_t slot_bytes;
+        std::vector<shard> shards;
+        std::vector<texture_file> files;
+        std::mutex open_lock;
+};
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+// Cost-predictive tile scheduling
+// A cheap pre-pass renders the frame at a fraction of the resolution with a
+// single sample and times every pixel. The resulting cost map sizes the
+// tiles, small where the image is expensive and large where it is cheap, and
+// orders them most expensive first (longest processing time first) so the
+// slow tiles start early and the cheap ones fill in at the end instead of a
+// few threads or nodes holding the tail of the render. The same estimates
+// split a frame into equally expensive shards for several render nodes.
+
+#include "rtweekend.h"
+
+#include "cost_aov.h"
+#include "hittable.h"
+#include "path_guide.h"
+#include "radiance_cache.h"
+#include "render.h"
+#include "../primitives/camera.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Estimated render cost of the frame, one pre-pass pixel per downscale x downscale pixels
+struct cost_map
+{
+    int image_width, image_height;
+    int downscale;
+    int width, height; // pre-pass resolution
+    std::vector<float> ns;
+
+    // Estimated cost of a region of the full resolution image, in pre-pass nanoseconds
+    double cost(const tile &t) const
+    {
+        double sum = 0;
+        for (int cy = t.y0 / downscale; cy <= (t.y1 - 1) / downscale && cy < height; cy++)
+        {
+            int h = std::min(t.y1, (cy + 1) * downscale) - std::max(t.y0, cy * downscale);
+            for (int cx = t.x0 / downscale; cx <= (t.x1 - 1) / downscale && cx < width; cx++)
+            {
+                int w = std::min(t.x1, (cx + 1) * downscale) - std::max(t.x0, cx * downscale);
+                sum += ns[cy * width + cx] * w * h;
+            }
+        }
+        return sum / (downscale * downscale);
+    }
+};
+
+// Renders the pre-pass and times it, about 1 / (downscale^2 * spp) of the real render
+cost_map estimate_cost(const camera &cam, const hittable &world, int image_width, int image_height,
+                       int max_depth, int downscale = 8, int samples_per_pixel = 1, int64_t seed = 1)
+{
+    cost_map map;
+    map.image_width = image_width;
+    map.image_height = image_height;
+    map.downscale = downscale;
+    map.width = std::max(2, (image_width + downscale - 1) / downscale);
+    map.height = std::max(2, (image_height + downscale - 1) / downscale);
+
+    cost_aov aov(map.width, map.height);
+    std::vector<unsigned char> rgb;
+    render_tile(cam, world, {0, 0, map.width, map.height}, map.width, map.height,
+                samples_per_pixel, max_depth, rgb, &aov, seed);
+    map.ns = aov.ns;
+    return map;
+}
+
+// Splits the region into about tile_count tiles by repeatedly halving the most
+// expensive one along its longer side, down to min_size pixels, and returns
+// them most expensive first
+std::vector<tile> plan_tiles(const cost_map &map, const tile &region, int tile_count, int min_size = 8)
+{
+    struct costed_tile
+    {
+        double cost;
+        tile t;
+        bool operator<(const costed_tile &other) const { return cost < other.cost; }
+    };
+
+    std::priority_queue<costed_tile> open;
+    std::vector<costed_tile> done;
+    open.push({map.cost(region), region});
+    while (!open.empty() && static_cast<int>(open.size() + done.size()) < tile_count)
+    {
+        costed_tile top = open.top();
+        open.pop();
+        const tile &t = top.t;
+        if (std::max(t.width(), t.height()) < 2 * min_size)
+        {
+            done.push_back(top);
+            continue;
+        }
+
+        tile a = t, b = t;
+        if (t.width() >= t.height())
+            a.x1 = b.x0 = t.x0 + t.width() / 2;
+        else
+            a.y1 = b.y0 = t.y0 + t.height() / 2;
+        open.push({map.cost(a), a});
+        open.push({map.cost(b), b});
+    }
+    while (!open.empty())
+    {
+        done.push_back(open.top());
+        open.pop();
+    }
+
+    std::stable_sort(done.begin(), done.end(), [](const costed_tile &x, const costed_tile &y)
+                     { return x.cost > y.cost; });
+    std::vector<tile> tiles;
+    for (const auto &c : done)
+        tiles.push_back(c.t);
+    return tiles;
+}
+
+// Orders any list of tiles most expensive first
+void order_by_cost(const cost_map &map, std::vector<tile> &tiles)
+{
+    std::vector<double> costs;
+    for (const auto &t : tiles)
+        costs.push_back(map.cost(t));
+    std::vector<size_t> order(tiles.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                     { return costs[a] > costs[b]; });
+    std::vector<tile> sorted;
+    for (size_t i : order)
+        sorted.push_back(tiles[i]);
+    tiles.swap(sorted);
+}
+
+// Deals tiles out to shards (render nodes), each tile going to the shard
+// with the least estimated work so far, most expensive tiles first
+std::vector<std::vector<tile>> assign_shards(const cost_map &map, std::vector<tile> tiles, int shards)
+{
+    order_by_cost(map, tiles);
+    std::vector<std::vector<tile>> assignment(shards);
+    std::vector<double> load(shards, 0.0);
+    for (const auto &t : tiles)
+    {
+        int s = static_cast<int>(std::min_element(load.begin(), load.end()) - load.begin());
+        assignment[s].push_back(t);
+        load[s] += map.cost(t);
+    }
+    return assignment;
+}
+
+// How accumulate_tiles spreads a render over its threads: a tile per
+// thread, or every tile with all threads on blocks of samples of its pixels
+enum class parallel_mode
+{
+    automatic,
+    pixels,
+    samples
+};
+
+// Parses "auto", "pixels" or "samples"
+bool parse_parallel_mode(const std::string &name, parallel_mode &mode)
+{
+    if (name == "auto")
+        mode = parallel_mode::automatic;
+    else if (name == "pixels")
+        mode = parallel_mode::pixels;
+    else if (name == "samples")
+        mode = parallel_mode::samples;
+    else
+        return false;
+    return true;
+}
+
+// Samples when there are too few tiles to keep every thread busy and the
+// pixels have more than one block of samples to share out
+bool use_sample_parallel(parallel_mode mode, size_t tiles, int samples_per_pixel, int threads)
+{
+    if (mode != parallel_mode::automatic)
+        return mode == parallel_mode::samples;
+    return threads > 1 && tiles < 2 * static_cast<size_t>(threads) && samples_per_pixel > sample_block;
+}
+
+// Renders one tile into sums like accumulate_tile with all threads taking
+// (pixel, block of sample_block samples) pairs. Every block starts its
+// pixel's generator at its first sample and the blocks are added in order,
+// so the sums are the same bits as accumulate_tile's.
+void accumulate_tile_samples(const camera &cam, const hittable &world, const tile &t,
+                             int image_width, int image_height, int samples_per_pixel, int max_depth,
+                             int threads, std::vector<color> &sums, cost_aov *aov = nullptr, int64_t seed = -1,
+                             const render_caches *caches = nullptr)
+{
+    const size_t pixels = static_cast<size_t>(t.width()) * t.height();
+    const int blocks = (samples_per_pixel + sample_block - 1) / sample_block;
+    std::vector<color> partial(pixels * blocks);
+    std::vector<std::chrono::nanoseconds> cost(aov ? partial.size() : 0);
+    std::vector<int> rays(cost.size(), 0);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]()
+    {
+        rng *previous_rng = thread_rng;
+        for (size_t k = next++; k < partial.size(); k = next++)
+        {
+            size_t p = k / blocks;
+            int b = static_cast<int>(k % blocks);
+            int x = t.x0 + static_cast<int>(p % t.width()), y = t.y0 + static_cast<int>(p / t.width());
+            rng pixel_rng(static_cast<uint64_t>(seed), static_cast<uint64_t>(y) * image_width + x);
+            pixel_rng.advance(2 * static_cast<uint64_t>(b) * sample_block);
+            if (seed >= 0)
+                thread_rng = &pixel_rng;
+
+            int count = std::min(sample_block, samples_per_pixel - b * sample_block);
+            auto start = std::chrono::steady_clock::now();
+            partial[k] = render_samples(cam, world, x, image_height - 1 - y, image_width, image_height, count,
+                                        max_depth, aov ? &rays[k] : nullptr, caches);
+            if (aov)
+                cost[k] = std::chrono::steady_clock::now() - start;
+        }
+        thread_rng = previous_rng;
+    };
+    std::vector<std::thread> workers;
+    for (int w = 1; w < threads; w++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+
+    // The blocks of every pixel in sample order, as render_pixel adds them
+    sums.assign(pixels, color(0, 0, 0));
+    for (size_t p = 0; p < pixels; p++)
+    {
+        std::chrono::nanoseconds pixel_cost(0);
+        int pixel_rays = 0;
+        for (int b = 0; b < blocks; b++)
+        {
+            sums[p] += partial[p * blocks + b];
+            if (aov)
+            {
+                pixel_cost += cost[p * blocks + b];
+                pixel_rays += rays[p * blocks + b];
+            }
+        }
+        if (aov)
+            aov->record(t.x0 + static_cast<int>(p % t.width()), t.y0 + static_cast<int>(p / t.width()), pixel_cost,
+                        pixel_rays, samples_per_pixel);
+    }
+}
+
+// Renders tiles on worker threads that take the next tile in list order as
+// they become free. on_tile(tile, sums, seconds) runs under a lock for each
+// finished tile with its per-pixel sums (see accumulate_tile) and returns
+// false to stop handing out tiles. Pixels are seeded from seed (see
+// accumulate_tile), so the image is the same for any thread count, tiling
+// or order. With fewer tiles than threads (small crops at high sample
+// counts) the tiles are rendered one after the other, each by all threads
+// sharing out its samples (see use_sample_parallel), for the same sums.
+template <typename tile_fn>
+void accumulate_tiles(const camera &cam, const hittable &world, const std::vector<tile> &tiles,
+                      int image_width, int image_height, int samples_per_pixel, int max_depth,
+                      int threads, int64_t seed, tile_fn &&on_tile, cost_aov *aov = nullptr,
+                      const render_caches *caches = nullptr, parallel_mode mode = parallel_mode::automatic)
+{
+    if (use_sample_parallel(mode, tiles.size(), samples_per_pixel, threads))
+    {
+        std::vector<color> sums;
+        for (const tile &t : tiles)
+        {
+            auto start = std::chrono::steady_clock::now();
+            accumulate_tile_samples(cam, world, t, image_width, image_height, samples_per_pixel, max_depth,
+                                    threads, sums, aov, seed, caches);
+            if (!on_tile(t, sums, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()))
+                return;
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::mutex done_lock;
+
+    auto worker = [&]()
+    {
+        std::vector<color> sums;
+        for (size_t k = next++; k < tiles.size(); k = next++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            accumulate_tile(cam, world, tiles[k], image_width, image_height,
+                            samples_per_pixel, max_depth, sums, aov, seed, caches);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> guard(done_lock);
+            if (!on_tile(tiles[k], sums, seconds))
+                next = tiles.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+}
+
+// Same as accumulate_tiles with on_tile(tile, rgb, seconds) getting the
+// tonemapped tile (3 bytes per pixel, rows top to bottom, see render_tile)
+template <typename tile_fn>
+void render_tiles(const camera &cam, const hittable &world, const std::vector<tile> &tiles,
+                  int image_width, int image_height, int samples_per_pixel, int max_depth,
+                  int threads, int64_t seed, tile_fn &&on_tile, cost_aov *aov = nullptr,
+                  const render_caches *caches = nullptr, parallel_mode mode = parallel_mode::automatic)
+{
+    std::vector<unsigned char> rgb;
+    accumulate_tiles(cam, world, tiles, image_width, image_height, samples_per_pixel, max_depth, threads, seed,
+                     [&](const tile &t, const std::vector<color> &sums, double seconds)
+                     {
+                         rgb.resize(3 * sums.size());
+                         simd().tonemap(sums.data(), sums.size(), 1.0 / samples_per_pixel, rgb.data());
+                         return on_tile(t, rgb, seconds);
+                     },
+                     aov, caches, mode);
+}
+
+// Runs row(y) for every y below height, rows handed out to threads as they
+// free up, for the full frame passes of incremental.h and temporal.h
+template <typename row_fn>
+void for_rows(int height, int threads, row_fn &&row)
+{
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        rng *previous_rng = thread_rng;
+        for (int y = next++; y < height; y = next++)
+            row(y);
+        thread_rng = previous_rng;
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+}
+
+// Fills a radiance cache with passes of one sample per pixel at
+// 1 / downscale of the resolution, each pass reading what the ones before it
+// recorded. The cache is left read only for the render that follows.
+void train_radiance_cache(radiance_cache &cache, const camera &cam, const hittable &world,
+                          int image_width, int image_height, int max_depth, int threads, int64_t seed,
+                          int passes = 4, int downscale = 2)
+{
+    int width = std::max(2, image_width / downscale);
+    int height = std::max(2, image_height / downscale);
+    std::vector<tile> tiles = split_tiles({0, 0, width, height}, 32);
+    render_caches caches;
+    caches.radiance = &cache;
+
+    cache.recording = true;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        render_tiles(cam, world, tiles, width, height, 1, max_depth, threads, seed + 1 + pass,
+                     [](const tile &, const std::vector<unsigned char> &, double)
+                     { return true; },
+                     nullptr, &caches);
+        cache.end_pass();
+    }
+    cache.recording = false;
+}
+
+// Trains a path guide with passes of 1, 2, 4, ... samples per pixel at
+// 1 / downscale of the resolution, each pass sampling from what the ones
+// before it learned. The guide is left read only for the render that follows.
+void train_path_guide(path_guide &guide, const camera &cam, const hittable &world,
+                      int image_width, int image_height, int max_depth, int threads, int64_t seed,
+                      int passes = 4, int downscale = 2)
+{
+    int width = std::max(2, image_width / downscale);
+    int height = std::max(2, image_height / downscale);
+    std::vector<tile> tiles = split_tiles({0, 0, width, height}, 32);
+    render_caches caches;
+    caches.guide = &guide;
+
+    guide.recording = true;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        render_tiles(cam, world, tiles, width, height, 1 << pass, max_depth, threads, seed + 101 + pass,
+                     [](const tile &, const std::vector<unsigned char> &, double)
+                     { return true; },
+                     nullptr, &caches);
+        guide.end_pass();
+    }
+    guide.recording = false;
+}
+
+#endif
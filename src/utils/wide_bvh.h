@@ -0,0 +1,195 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+// Compressed 4-wide BVH
+// Built by collapsing a binary bvh_tree. Every node stores its four child
+// boxes quantized to 8 bits per plane relative to the node's own box, so a
+// node with all four children fits one 64 byte cache line, where the binary
+// layout needs a 64 byte node per child. All four children are tested at
+// once by the node test kernel of the selected SIMD variant.
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "simd_dispatch.h"
+#include "wide_bvh_node.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class wide_bvh {
+    public:
+        wide_bvh() {}
+        wide_bvh(const bvh_tree& tree) { build_from(tree); }
+
+        // Collapses a binary tree, its primitive order is reused as is
+        void build_from(const bvh_tree& tree);
+
+        aabb bounds() const { return box; }
+
+        size_t memory_bytes() const {
+            return nodes.size() * sizeof(wide_bvh_node) + prim_indices.size() * sizeof(int);
+        }
+
+        // Same contract as bvh_tree::traverse
+        template <typename hit_fn>
+        bool traverse(const ray& r, double t_min, double t_max, hit_fn&& hit_primitive) const;
+
+    public:
+        std::vector<wide_bvh_node> nodes;
+        std::vector<int> prim_indices;
+        aabb box;
+
+    private:
+        uint32_t emit_node(const bvh_tree& tree, int binary_index);
+};
+
+void wide_bvh::build_from(const bvh_tree& tree) {
+    nodes.clear();
+    prim_indices = tree.prim_indices;
+    box = tree.bounds();
+    if (tree.nodes.empty()) return;
+
+    nodes.reserve(tree.nodes.size() / 3 + 1);
+    emit_node(tree, 0);
+    nodes.shrink_to_fit();
+}
+
+uint32_t wide_bvh::emit_node(const bvh_tree& tree, int binary_index) {
+    const bvh_node& parent = tree.nodes[binary_index];
+
+    // Pull grandchildren up until there are four children, opening the largest first
+    std::vector<int> children;
+    if (parent.count > 0) {
+        children.push_back(binary_index);
+    }
+    else {
+        children.push_back(binary_index + 1);
+        children.push_back(parent.offset);
+    }
+    while (children.size() < 4) {
+        int best = -1;
+        double best_area = -1;
+        for (size_t k = 0; k < children.size(); k++) {
+            const bvh_node& n = tree.nodes[children[k]];
+            if (n.count == 0 && n.box.surface_area() > best_area) {
+                best_area = n.box.surface_area();
+                best = static_cast<int>(k);
+            }
+        }
+        if (best < 0) break;
+        int opened = children[best];
+        children[best] = opened + 1;
+        children.push_back(tree.nodes[opened].offset);
+    }
+
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(wide_bvh_node());
+    wide_bvh_node node;
+    memset(&node, 0, sizeof(node));
+    node.child_count = static_cast<uint8_t>(children.size());
+
+    for (int a = 0; a < 3; a++) {
+        // Round the origin down and pick the smallest power of two step
+        // that still spans the whole box in 255 steps
+        double lo = parent.box.min()[a];
+        float origin = static_cast<float>(lo);
+        if (origin > lo) origin = nextafterf(origin, -std::numeric_limits<float>::infinity());
+        double extent = parent.box.max()[a] - origin;
+        int e = extent > 0 ? static_cast<int>(ceil(log2(extent / 255.0))) : -100;
+        e = std::max(-100, std::min(100, e));
+        while (ldexp(255.0, e) < extent) e++;
+
+        node.origin[a] = origin;
+        node.exponent[a] = static_cast<int8_t>(e);
+
+        double scale = ldexp(1.0, e);
+        for (size_t c = 0; c < children.size(); c++) {
+            const aabb& b = tree.nodes[children[c]].box;
+            double qlo = floor((b.min()[a] - origin) / scale);
+            double qhi = ceil((b.max()[a] - origin) / scale);
+            node.bounds[a][c] = static_cast<uint8_t>(std::max(0.0, std::min(255.0, qlo)));
+            node.bounds[a][4 + c] = static_cast<uint8_t>(std::max(0.0, std::min(255.0, qhi)));
+        }
+    }
+
+    for (size_t c = 0; c < children.size(); c++) {
+        const bvh_node& n = tree.nodes[children[c]];
+        if (n.count > 0) {
+            node.child[c] = static_cast<uint32_t>(n.offset);
+            node.leaf_count[c] = static_cast<uint8_t>(n.count);
+        }
+        else {
+            node.child[c] = emit_node(tree, children[c]);
+        }
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+template <typename hit_fn>
+bool wide_bvh::traverse(const ray& r, double t_min, double t_max, hit_fn&& hit_primitive) const {
+    if (nodes.empty()) return false;
+
+    const wide_ray wr(r);
+    const auto node_test = simd().wide_node_test;
+
+    struct entry {
+        uint32_t node;
+        float t_near;
+    };
+    // Every level pushes at most three siblings besides the one it descends into
+    entry stack[512];
+    int top = 0;
+    stack[top++] = {0, static_cast<float>(t_min)};
+
+    bool hit_anything = false;
+    double closest = t_max;
+    const float t_lo = static_cast<float>(t_min);
+
+    while (top > 0) {
+        entry e = stack[--top];
+        if (e.t_near > closest) continue;
+
+        const wide_bvh_node& node = nodes[e.node];
+        float t_near[4];
+        int mask = node_test(node, wr, t_lo, static_cast<float>(closest), t_near);
+        if (!mask) continue;
+
+        // Hit children sorted near to far
+        int order[4];
+        int hits = 0;
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) continue;
+            int k = hits++;
+            while (k > 0 && t_near[order[k - 1]] > t_near[c]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = c;
+        }
+
+        // Leaves are intersected right away, inner children pushed far first
+        for (int k = 0; k < hits; k++) {
+            int c = order[k];
+            if (node.leaf_count[c] == 0) continue;
+            if (t_near[c] > closest) break;
+            for (uint32_t i = node.child[c]; i < node.child[c] + node.leaf_count[c]; i++)
+                if (hit_primitive(prim_indices[i], t_min, closest))
+                    hit_anything = true;
+        }
+        for (int k = hits - 1; k >= 0; k--) {
+            int c = order[k];
+            if (node.leaf_count[c] == 0)
+                stack[top++] = {node.child[c], t_near[c]};
+        }
+    }
+
+    return hit_anything;
+}
+
+#endif
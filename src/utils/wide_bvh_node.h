@@ -0,0 +1,39 @@
+#ifndef WIDE_BVH_NODE_H
+#define WIDE_BVH_NODE_H
+
+// Node and ray layout of the compressed 4-wide BVH (see wide_bvh.h)
+
+#include "rtweekend.h"
+
+#include <cstdint>
+#include <limits>
+
+struct alignas(64) wide_bvh_node {
+    float origin[3];         // lower corner of the node box, rounded down
+    int8_t exponent[3];      // child planes are origin + q * 2^exponent per axis
+    uint8_t child_count;
+    uint8_t bounds[3][8];    // quantized planes per axis: minima of children 0-3, then their maxima
+    uint32_t child[4];       // inner child: node index, leaf child: first entry in prim_indices
+    uint8_t leaf_count[4];   // primitives in a leaf child, 0 for inner children
+};
+
+static_assert(sizeof(wide_bvh_node) == 64, "wide_bvh_node should fill exactly one cache line");
+
+// Ray data in the precision the node test works in
+struct wide_ray {
+    float origin[3];
+    float inv_dir[3];
+
+    wide_ray(const ray& r) {
+        for (int a = 0; a < 3; a++) {
+            origin[a] = static_cast<float>(r.origin()[a]);
+            inv_dir[a] = static_cast<float>(1.0 / r.direction()[a]);
+        }
+    }
+};
+
+// The dequantized planes and the float slab test are each off by an ulp or
+// two, grow the far distance a little so grazing rays never miss a child
+const float wide_far_scale = 1.0f + 8.0f * std::numeric_limits<float>::epsilon();
+
+#endif
@@ -1,7 +1,5 @@
 #!/bin/bash
 
-for img in ../renders/*.ppm; do
-    filename=${img%.*}
-    echo ${filename/renders/renders\/converted}".png"
-    convert "$filename.ppm" ${filename/renders/renders\/converted}".png"
-done
\ No newline at end of file
+# Converts every render to renders/converted/*.png on all cores
+# (compile src/convert_images.cpp to exec/convert_images first)
+../exec/convert_images --format png --out ../renders/converted ../renders
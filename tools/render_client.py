@@ -0,0 +1,71 @@
+# Sends one render (or reshade) job to render_daemon and saves the streamed
+# tiles as a ppm
+#
+# usage: python3 render_client.py <output.ppm> [reshade] [key=value ...]
+#   e.g. python3 render_client.py ../renders/ghd.ppm scene=GHD_scene spp=32
+# set GHD_RENDER_SOCKET to talk to a daemon on a non-default socket
+
+import os
+import socket
+import sys
+import time
+
+socket_path = os.environ.get("GHD_RENDER_SOCKET", "/tmp/ghd_render.sock")
+
+
+def read_line(f):
+    line = f.readline()
+    if not line:
+        raise RuntimeError("daemon closed the connection")
+    return line.decode().rstrip("\n")
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: render_client.py <output.ppm> [reshade] [key=value ...]")
+        sys.exit(1)
+
+    output = sys.argv[1]
+    args = sys.argv[2:]
+    command = args.pop(0) if args and args[0] == "reshade" else "render"
+    job = command + " " + " ".join(args) + "\n"
+
+    start = time.time()
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(socket_path)
+        s.sendall(job.encode())
+        f = s.makefile("rb")
+
+        header = read_line(f).split()
+        if header[0] != "ok":
+            print(" ".join(header), file=sys.stderr)
+            sys.exit(1)
+        width, height, tiles = int(header[1]), int(header[2]), int(header[3])
+        print("scene cache " + header[4] + ", built in " + header[5] + " ms", file=sys.stderr)
+
+        # Pixels outside the requested region stay black
+        image = bytearray(width * height * 3)
+        first_tile = None
+        for n in range(tiles):
+            _, x0, y0, x1, y1 = read_line(f).split()
+            x0, y0, x1, y1 = int(x0), int(y0), int(x1), int(y1)
+            data = f.read((x1 - x0) * (y1 - y0) * 3)
+            if first_tile is None:
+                first_tile = time.time() - start
+            row = (x1 - x0) * 3
+            for y in range(y0, y1):
+                offset = (y * width + x0) * 3
+                image[offset:offset + row] = data[(y - y0) * row:(y - y0 + 1) * row]
+            print("\rtiles " + str(n + 1) + "/" + str(tiles), end="", file=sys.stderr)
+
+        done = read_line(f).split()
+        print("\nfirst tile after %.3f s, rendered in %s ms" % (first_tile, done[1]), file=sys.stderr)
+
+    with open(output, "w") as out:
+        out.write("P3\n" + str(width) + " " + str(height) + "\n255\n")
+        for p in range(width * height):
+            out.write("%d %d %d\n" % (image[3 * p], image[3 * p + 1], image[3 * p + 2]))
+
+
+if __name__ == "__main__":
+    main()